@@ -29,9 +29,11 @@
 #include "../LibISDBWindows.hpp"
 #endif
 #include "ARIBString.hpp"
+#include "ARIBStringCache.hpp"
 #include "JISKanjiMap.hpp"
 #include "../Utilities/Utilities.hpp"
 #include "../Utilities/StringUtilities.hpp"
+#include <memory>
 #include "DebugDef.hpp"
 
 
@@ -66,17 +68,145 @@ namespace LibISDB
 #define TOFU_STR ARIB_STR("□")
 
 
+namespace
+{
+
+
+// 英数字集合
+const ARIBStrTableType AlphanumericTable[] =
+	ARIB_STR_TABLE_BEGIN
+	ARIB_STR_TABLE("　", "！", "”", "＃", "＄", "％", "＆", "’", "（", "）", "＊", "＋", "，", "－", "．", "／")
+	ARIB_STR_TABLE("０", "１", "２", "３", "４", "５", "６", "７", "８", "９", "：", "；", "＜", "＝", "＞", "？")
+	ARIB_STR_TABLE("＠", "Ａ", "Ｂ", "Ｃ", "Ｄ", "Ｅ", "Ｆ", "Ｇ", "Ｈ", "Ｉ", "Ｊ", "Ｋ", "Ｌ", "Ｍ", "Ｎ", "Ｏ")
+	ARIB_STR_TABLE("Ｐ", "Ｑ", "Ｒ", "Ｓ", "Ｔ", "Ｕ", "Ｖ", "Ｗ", "Ｘ", "Ｙ", "Ｚ", "［", "￥", "］", "＾", "＿")
+	ARIB_STR_TABLE("｀", "ａ", "ｂ", "ｃ", "ｄ", "ｅ", "ｆ", "ｇ", "ｈ", "ｉ", "ｊ", "ｋ", "ｌ", "ｍ", "ｎ", "ｏ")
+	ARIB_STR_TABLE("ｐ", "ｑ", "ｒ", "ｓ", "ｔ", "ｕ", "ｖ", "ｗ", "ｘ", "ｙ", "ｚ", "｛", "｜", "｝", "￣", "　")
+	ARIB_STR_TABLE_END;
+
+// ひらがな集合
+const ARIBStrTableType HiraganaTable[] =
+	ARIB_STR_TABLE_BEGIN
+	ARIB_STR_TABLE("　", "ぁ", "あ", "ぃ", "い", "ぅ", "う", "ぇ", "え", "ぉ", "お", "か", "が", "き", "ぎ", "く")
+	ARIB_STR_TABLE("ぐ", "け", "げ", "こ", "ご", "さ", "ざ", "し", "じ", "す", "ず", "せ", "ぜ", "そ", "ぞ", "た")
+	ARIB_STR_TABLE("だ", "ち", "ぢ", "っ", "つ", "づ", "て", "で", "と", "ど", "な", "に", "ぬ", "ね", "の", "は")
+	ARIB_STR_TABLE("ば", "ぱ", "ひ", "び", "ぴ", "ふ", "ぶ", "ぷ", "へ", "べ", "ぺ", "ほ", "ぼ", "ぽ", "ま", "み")
+	ARIB_STR_TABLE("む", "め", "も", "ゃ", "や", "ゅ", "ゆ", "ょ", "よ", "ら", "り", "る", "れ", "ろ", "ゎ", "わ")
+	ARIB_STR_TABLE("ゐ", "ゑ", "を", "ん", "　", "　", "　", "ゝ", "ゞ", "ー", "。", "「", "」", "、", "・", "　")
+	ARIB_STR_TABLE_END;
+
+// カタカナ集合
+const ARIBStrTableType KatakanaTable[] =
+	ARIB_STR_TABLE_BEGIN
+	ARIB_STR_TABLE("　", "ァ", "ア", "ィ", "イ", "ゥ", "ウ", "ェ", "エ", "ォ", "オ", "カ", "ガ", "キ", "ギ", "ク")
+	ARIB_STR_TABLE("グ", "ケ", "ゲ", "コ", "ゴ", "サ", "ザ", "シ", "ジ", "ス", "ズ", "セ", "ゼ", "ソ", "ゾ", "タ")
+	ARIB_STR_TABLE("ダ", "チ", "ヂ", "ッ", "ツ", "ヅ", "テ", "デ", "ト", "ド", "ナ", "ニ", "ヌ", "ネ", "ノ", "ハ")
+	ARIB_STR_TABLE("バ", "パ", "ヒ", "ビ", "ピ", "フ", "ブ", "プ", "ヘ", "ベ", "ペ", "ホ", "ボ", "ポ", "マ", "ミ")
+	ARIB_STR_TABLE("ム", "メ", "モ", "ャ", "ヤ", "ュ", "ユ", "ョ", "ヨ", "ラ", "リ", "ル", "レ", "ロ", "ヮ", "ワ")
+	ARIB_STR_TABLE("ヰ", "ヱ", "ヲ", "ン", "ヴ", "ヵ", "ヶ", "ヽ", "ヾ", "ー", "。", "「", "」", "、", "・", "　")
+	ARIB_STR_TABLE_END;
+
+
+#ifdef LIBISDB_ARIB_STR_IS_UTF8
+constexpr size_t CHAR_MAX_LENGTH = 4;
+#else
+constexpr size_t CHAR_MAX_LENGTH = 2;
+#endif
+
+// 変換後の文字
+struct CharInfo {
+	ARIBStringDecoder::InternalChar Char[CHAR_MAX_LENGTH];
+	uint8_t Length; // 0 の場合は変換できないか、追加記号
+};
+
+// 既定の符号集合の変換テーブル
+struct GraphicCharTable {
+	CharInfo Kanji[94 * 94]; // 漢字集合1面
+	CharInfo Alphanumeric[94];
+	CharInfo Hiragana[94];
+	CharInfo Katakana[94];
+	CharInfo Space;
+	CharInfo HalfWidthSpace;
+};
+
+void SetCharInfo(CharInfo *pInfo, ARIBStrTableType Str)
+{
+#ifdef LIBISDB_ARIB_STR_IS_UTF8
+	const size_t Length = std::strlen(Str);
+	LIBISDB_ASSERT(Length <= CHAR_MAX_LENGTH);
+	std::memcpy(pInfo->Char, Str, Length);
+	pInfo->Length = static_cast<uint8_t>(Length);
+#else
+	pInfo->Char[0] = Str;
+	pInfo->Length = 1;
+#endif
+}
+
+// 変換テーブルを取得する
+// 漢字の変換結果は JISX0213KanjiToUTF8 / JISX0213KanjiToWChar と同じで、最初に使われる時に作成する
+const GraphicCharTable & GetGraphicCharTable()
+{
+	static const std::unique_ptr<GraphicCharTable> Table = []() {
+		std::unique_ptr<GraphicCharTable> NewTable(new GraphicCharTable());
+
+		for (uint16_t Row = 0; Row < 94; Row++) {
+			for (uint16_t Cell = 0; Cell < 94; Cell++) {
+				const uint16_t Code = ((Row + 0x21) << 8) | (Cell + 0x21);
+				CharInfo &Info = NewTable->Kanji[Row * 94 + Cell];
+
+				if (Code >= 0x7521)
+					continue;
+#ifdef LIBISDB_ARIB_STR_IS_UTF8
+				Info.Length = static_cast<uint8_t>(JISX0213KanjiToUTF8(1, Code, Info.Char, CHAR_MAX_LENGTH));
+#else
+				Info.Length = static_cast<uint8_t>(JISX0213KanjiToWChar(1, Code, Info.Char, CHAR_MAX_LENGTH));
+#endif
+			}
+		}
+
+		for (int i = 0; i < 94; i++) {
+			SetCharInfo(&NewTable->Alphanumeric[i], AlphanumericTable[i + 1]);
+			SetCharInfo(&NewTable->Hiragana[i], HiraganaTable[i + 1]);
+			SetCharInfo(&NewTable->Katakana[i], KatakanaTable[i + 1]);
+		}
+
+		SetCharInfo(&NewTable->Space, HiraganaTable[0]);
+		NewTable->HalfWidthSpace.Char[0] = ARIB_STR(' ');
+		NewTable->HalfWidthSpace.Length = 1;
+
+		return NewTable;
+	}();
+
+	return *Table;
+}
+
+const CharInfo * GetKanjiCharInfo(uint16_t Code)
+{
+	const uint8_t Row = Code >> 8, Cell = Code & 0xFF;
+	if ((Row < 0x21) || (Row > 0x7E) || (Cell < 0x21) || (Cell > 0x7E))
+		return nullptr;
+
+	const CharInfo *pInfo = &GetGraphicCharTable().Kanji[(Row - 0x21) * 94 + (Cell - 0x21)];
+	if (pInfo->Length == 0)
+		return nullptr;
+
+	return pInfo;
+}
+
+
+}	// namespace
+
+
 bool ARIBStringDecoder::Decode(
 	const uint8_t *pSrcData, size_t SrcLength, ReturnArg<String> DstString, DecodeFlag Flags)
 {
-	return DecodeInternal(pSrcData, SrcLength, DstString, Flags);
+	return DecodeCached(pSrcData, SrcLength, DstString, Flags);
 }
 
 
 bool ARIBStringDecoder::Decode(
 	const ARIBString &SrcString, ReturnArg<String> DstString, DecodeFlag Flags)
 {
-	return DecodeInternal(SrcString.data(), SrcString.length(), DstString, Flags);
+	return DecodeCached(SrcString.data(), SrcString.length(), DstString, Flags);
 }
 
 
@@ -96,6 +226,69 @@ bool ARIBStringDecoder::DecodeCaption(
 }
 
 
+// 内部のバッファにデコードし、その内容を参照する
+// 結果は次にデコードを行うまで有効で、バッファは再利用されるためメモリの確保は繰り返されない
+bool ARIBStringDecoder::Decode(
+	const uint8_t *pSrcData, size_t SrcLength, ReturnArg<CStringView> DstString, DecodeFlag Flags)
+{
+	if (!DstString)
+		return false;
+
+	const bool Result = DecodeCached(pSrcData, SrcLength, &m_Buffer, Flags);
+	DstString = CStringView(m_Buffer);
+	return Result;
+}
+
+
+bool ARIBStringDecoder::Decode(
+	const ARIBString &SrcString, ReturnArg<CStringView> DstString, DecodeFlag Flags)
+{
+	return Decode(SrcString.data(), SrcString.length(), DstString, Flags);
+}
+
+
+bool ARIBStringDecoder::DecodeCaption(
+	const uint8_t *pSrcData, size_t SrcLength, ReturnArg<CStringView> DstString,
+	DecodeFlag Flags, OptionalReturnArg<FormatList> FormatList, DRCSMap *pDRCSMap)
+{
+	if (!DstString)
+		return false;
+
+	const bool Result = DecodeInternal(pSrcData, SrcLength, &m_Buffer, Flags | DecodeFlag::Caption, FormatList, pDRCSMap);
+	DstString = CStringView(m_Buffer);
+	return Result;
+}
+
+
+void ARIBStringDecoder::FreeBuffer()
+{
+	String().swap(m_Buffer);
+}
+
+
+// キャッシュが設定されていれば、キャッシュされた結果を利用する
+// デコードに失敗した場合はキャッシュしない
+bool ARIBStringDecoder::DecodeCached(
+	const uint8_t *pSrcData, size_t SrcLength, ReturnArg<String> DstString, DecodeFlag Flags)
+{
+	if (!DstString)
+		return false;
+
+	if ((m_pCache == nullptr) || (pSrcData == nullptr) || (SrcLength == 0))
+		return DecodeInternal(pSrcData, SrcLength, DstString, Flags);
+
+	if (m_pCache->Find(pSrcData, SrcLength, Flags, DstString))
+		return true;
+
+	if (!DecodeInternal(pSrcData, SrcLength, DstString, Flags))
+		return false;
+
+	m_pCache->Add(pSrcData, SrcLength, Flags, *DstString);
+
+	return true;
+}
+
+
 bool ARIBStringDecoder::DecodeInternal(
 	const uint8_t *pSrcData, size_t SrcLength, ReturnArg<String> DstString,
 	DecodeFlag Flags, OptionalReturnArg<FormatList> FormatList, DRCSMap *pDRCSMap)
@@ -172,8 +365,23 @@ bool ARIBStringDecoder::DecodeInternal(
 
 bool ARIBStringDecoder::DecodeString(const uint8_t *pSrcData, size_t SrcLength, InternalString *pDstString)
 {
+#ifdef LIBISDB_ARIB_STR_IS_UTF8
+	pDstString->reserve(pDstString->length() + SrcLength + SrcLength / 2);
+#else
+	pDstString->reserve(pDstString->length() + SrcLength);
+#endif
+
 	for (size_t SrcPos = 0; SrcPos < SrcLength; SrcPos++) {
 		if (m_ESCSeqCount == 0) {
+			// 既定の符号集合の文字が続く部分はまとめて処理する
+			if ((m_SingleGL < 0) && (m_RPC == 1) && !(m_UseCharSize && (m_CharSize == CharSize::Medium))) {
+				const size_t Length = DecodeRun(pSrcData + SrcPos, SrcLength - SrcPos, pDstString);
+				if (Length > 0) {
+					SrcPos += Length - 1;
+					continue;
+				}
+			}
+
 			// GL/GR領域
 			if ((pSrcData[SrcPos] >= 0x21) && (pSrcData[SrcPos] <= 0x7E)) {
 				// GL領域
@@ -364,6 +572,90 @@ bool ARIBStringDecoder::DecodeString(const uint8_t *pSrcData, size_t SrcLength,
 }
 
 
+size_t ARIBStringDecoder::DecodeRun(const uint8_t *pSrcData, size_t SrcLength, InternalString *pDstString)
+{
+	const GraphicCharTable &Table = GetGraphicCharTable();
+
+	auto GetCodeSetTable = [&Table](CodeSet Set) -> const CharInfo * {
+		switch (Set) {
+		case CodeSet::Kanji:
+		case CodeSet::JIS_KanjiPlane1:
+			return Table.Kanji;
+		case CodeSet::Alphanumeric:
+		case CodeSet::ProportionalAlphanumeric:
+			return Table.Alphanumeric;
+		case CodeSet::Hiragana:
+		case CodeSet::ProportionalHiragana:
+			return Table.Hiragana;
+		case CodeSet::Katakana:
+		case CodeSet::ProportionalKatakana:
+			return Table.Katakana;
+		default:
+			return nullptr;
+		}
+	};
+
+	const CharInfo *pGLTable = GetCodeSetTable(m_CodeG[m_LockingGL]);
+	const CharInfo *pGRTable = GetCodeSetTable(m_CodeG[m_LockingGR]);
+	if ((pGLTable == nullptr) && (pGRTable == nullptr))
+		return 0;
+
+	const CharInfo &Space = IsSmallCharMode() ? Table.HalfWidthSpace : Table.Space;
+
+	// 変換結果はバッファにまとめてから追加する
+	InternalChar Buffer[256];
+	size_t BufferLength = 0;
+	size_t Pos = 0;
+
+	while (Pos < SrcLength) {
+		const uint8_t Byte = pSrcData[Pos];
+		const CharInfo *pInfo;
+
+		if (((Byte >= 0x21) && (Byte <= 0x7E)) || ((Byte >= 0xA1) && (Byte <= 0xFE))) {
+			const CharInfo *pTable = (Byte < 0x80) ? pGLTable : pGRTable;
+
+			if (pTable == nullptr)
+				break;
+
+			if (pTable == Table.Kanji) {
+				if (SrcLength - Pos < 2)
+					break;
+				// GR の場合は2バイト目も 0x7F でマスクする
+				const uint8_t Cell = (Byte < 0x80) ? pSrcData[Pos + 1] : (pSrcData[Pos + 1] & 0x7F);
+				if ((Cell < 0x21) || (Cell > 0x7E))
+					break;
+				pInfo = &pTable[((Byte & 0x7F) - 0x21) * 94 + (Cell - 0x21)];
+				if (pInfo->Length == 0)
+					break;
+				Pos += 2;
+			} else {
+				pInfo = &pTable[(Byte & 0x7F) - 0x21];
+				Pos++;
+			}
+		} else if (Byte == 0x20) {
+			pInfo = &Space;
+			Pos++;
+		} else if (Byte == 0xA0) {
+			pInfo = &Table.HalfWidthSpace;
+			Pos++;
+		} else {
+			break;
+		}
+
+		if (BufferLength > std::size(Buffer) - CHAR_MAX_LENGTH) {
+			pDstString->append(Buffer, BufferLength);
+			BufferLength = 0;
+		}
+		std::memcpy(&Buffer[BufferLength], pInfo->Char, sizeof(pInfo->Char));
+		BufferLength += pInfo->Length;
+	}
+
+	pDstString->append(Buffer, BufferLength);
+
+	return Pos;
+}
+
+
 void ARIBStringDecoder::DecodeChar(uint16_t Code, CodeSet Set, InternalString *pDstString)
 {
 	const size_t OldLength = pDstString->length();
@@ -524,23 +816,12 @@ void ARIBStringDecoder::PutKanjiChar(uint16_t Code, InternalString *pDstString)
 
 #else
 
-#ifdef LIBISDB_ARIB_STR_IS_UTF8
-	// JIS -> UTF-8 漢字コード変換
-	char Buffer[4];
-	size_t Length = JISX0213KanjiToUTF8(1, Code, Buffer, std::size(Buffer));
-	if (Length > 0)
-		pDstString->append(Buffer, Length);
-	else
-		pDstString->append(TOFU_STR);
-#else
-	// JIS -> wchar_t 漢字コード変換
-	wchar_t Buffer[2];
-	size_t Length = JISX0213KanjiToWChar(1, Code, Buffer, std::size(Buffer));
-	if (Length > 0)
-		pDstString->append(Buffer, Length);
+	// JIS -> UTF-8 / wchar_t 漢字コード変換
+	const CharInfo *pInfo = GetKanjiCharInfo(Code);
+	if (pInfo != nullptr)
+		pDstString->append(pInfo->Char, pInfo->Length);
 	else
 		pDstString->append(TOFU_STR);
-#endif
 
 #endif
 }
@@ -571,15 +852,6 @@ void ARIBStringDecoder::PutKanjiPlane2Char(uint16_t Code, InternalString *pDstSt
 void ARIBStringDecoder::PutAlphanumericChar(uint16_t Code, InternalString *pDstString)
 {
 	// 英数字文字コード変換
-	static const ARIBStrTableType AlphanumericTable[] =
-		ARIB_STR_TABLE_BEGIN
-		ARIB_STR_TABLE("　", "！", "”", "＃", "＄", "％", "＆", "’", "（", "）", "＊", "＋", "，", "－", "．", "／")
-		ARIB_STR_TABLE("０", "１", "２", "３", "４", "５", "６", "７", "８", "９", "：", "；", "＜", "＝", "＞", "？")
-		ARIB_STR_TABLE("＠", "Ａ", "Ｂ", "Ｃ", "Ｄ", "Ｅ", "Ｆ", "Ｇ", "Ｈ", "Ｉ", "Ｊ", "Ｋ", "Ｌ", "Ｍ", "Ｎ", "Ｏ")
-		ARIB_STR_TABLE("Ｐ", "Ｑ", "Ｒ", "Ｓ", "Ｔ", "Ｕ", "Ｖ", "Ｗ", "Ｘ", "Ｙ", "Ｚ", "［", "￥", "］", "＾", "＿")
-		ARIB_STR_TABLE("｀", "ａ", "ｂ", "ｃ", "ｄ", "ｅ", "ｆ", "ｇ", "ｈ", "ｉ", "ｊ", "ｋ", "ｌ", "ｍ", "ｎ", "ｏ")
-		ARIB_STR_TABLE("ｐ", "ｑ", "ｒ", "ｓ", "ｔ", "ｕ", "ｖ", "ｗ", "ｘ", "ｙ", "ｚ", "｛", "｜", "｝", "￣", "　")
-		ARIB_STR_TABLE_END;
 	static const ARIBStrTableType AlphanumericHalfWidthTable[] =
 		ARIB_STR_TABLE_BEGIN
 		ARIB_STR_TABLE(" ", "!", "\"", "#", "$", "%", "&", "'", "(", ")", "*", "+", ",", "-", ".", "/")
@@ -600,16 +872,6 @@ void ARIBStringDecoder::PutAlphanumericChar(uint16_t Code, InternalString *pDstS
 void ARIBStringDecoder::PutHiraganaChar(uint16_t Code, InternalString *pDstString)
 {
 	// ひらがな文字コード変換
-	static const ARIBStrTableType HiraganaTable[] =
-		ARIB_STR_TABLE_BEGIN
-		ARIB_STR_TABLE("　", "ぁ", "あ", "ぃ", "い", "ぅ", "う", "ぇ", "え", "ぉ", "お", "か", "が", "き", "ぎ", "く")
-		ARIB_STR_TABLE("ぐ", "け", "げ", "こ", "ご", "さ", "ざ", "し", "じ", "す", "ず", "せ", "ぜ", "そ", "ぞ", "た")
-		ARIB_STR_TABLE("だ", "ち", "ぢ", "っ", "つ", "づ", "て", "で", "と", "ど", "な", "に", "ぬ", "ね", "の", "は")
-		ARIB_STR_TABLE("ば", "ぱ", "ひ", "び", "ぴ", "ふ", "ぶ", "ぷ", "へ", "べ", "ぺ", "ほ", "ぼ", "ぽ", "ま", "み")
-		ARIB_STR_TABLE("む", "め", "も", "ゃ", "や", "ゅ", "ゆ", "ょ", "よ", "ら", "り", "る", "れ", "ろ", "ゎ", "わ")
-		ARIB_STR_TABLE("ゐ", "ゑ", "を", "ん", "　", "　", "　", "ゝ", "ゞ", "ー", "。", "「", "」", "、", "・", "　")
-		ARIB_STR_TABLE_END;
-
 	*pDstString += HiraganaTable[Code < 0x20 ? 0 : Code - 0x20];
 }
 
@@ -617,16 +879,6 @@ void ARIBStringDecoder::PutHiraganaChar(uint16_t Code, InternalString *pDstStrin
 void ARIBStringDecoder::PutKatakanaChar(uint16_t Code, InternalString *pDstString)
 {
 	// カタカナ文字コード変換
-	static const ARIBStrTableType KatakanaTable[] =
-		ARIB_STR_TABLE_BEGIN
-		ARIB_STR_TABLE("　", "ァ", "ア", "ィ", "イ", "ゥ", "ウ", "ェ", "エ", "ォ", "オ", "カ", "ガ", "キ", "ギ", "ク")
-		ARIB_STR_TABLE("グ", "ケ", "ゲ", "コ", "ゴ", "サ", "ザ", "シ", "ジ", "ス", "ズ", "セ", "ゼ", "ソ", "ゾ", "タ")
-		ARIB_STR_TABLE("ダ", "チ", "ヂ", "ッ", "ツ", "ヅ", "テ", "デ", "ト", "ド", "ナ", "ニ", "ヌ", "ネ", "ノ", "ハ")
-		ARIB_STR_TABLE("バ", "パ", "ヒ", "ビ", "ピ", "フ", "ブ", "プ", "ヘ", "ベ", "ペ", "ホ", "ボ", "ポ", "マ", "ミ")
-		ARIB_STR_TABLE("ム", "メ", "モ", "ャ", "ヤ", "ュ", "ユ", "ョ", "ヨ", "ラ", "リ", "ル", "レ", "ロ", "ヮ", "ワ")
-		ARIB_STR_TABLE("ヰ", "ヱ", "ヲ", "ン", "ヴ", "ヵ", "ヶ", "ヽ", "ヾ", "ー", "。", "「", "」", "、", "・", "　")
-		ARIB_STR_TABLE_END;
-
 	*pDstString += KatakanaTable[Code < 0x20 ? 0 : Code - 0x20];
 }
 
@@ -41,6 +41,8 @@
 namespace LibISDB
 {
 
+	class ARIBStringCache;
+
 	/** 8単位符号文字列 */
 	typedef std::basic_string<uint8_t> ARIBString;
 
@@ -130,6 +132,21 @@ namespace LibISDB
 			OptionalReturnArg<FormatList> FormatList = std::nullopt,
 			DRCSMap *pDRCSMap = nullptr);
 
+		bool Decode(
+			const uint8_t *pSrcData, size_t SrcLength, ReturnArg<CStringView> DstString,
+			DecodeFlag Flags = DecodeFlag::UseCharSize);
+		bool Decode(
+			const ARIBString &SrcString, ReturnArg<CStringView> DstString,
+			DecodeFlag Flags = DecodeFlag::UseCharSize);
+		bool DecodeCaption(
+			const uint8_t *pSrcData, size_t SrcLength, ReturnArg<CStringView> DstString,
+			DecodeFlag Flags = DecodeFlag::None,
+			OptionalReturnArg<FormatList> FormatList = std::nullopt,
+			DRCSMap *pDRCSMap = nullptr);
+		void FreeBuffer();
+		void SetCache(ARIBStringCache *pCache) noexcept { m_pCache = pCache; }
+		ARIBStringCache * GetCache() const noexcept { return m_pCache; }
+
 	private:
 		/** 符号集合 */
 		enum class CodeSet {
@@ -190,12 +207,19 @@ namespace LibISDB
 		bool m_UseCharSize;
 		bool m_UnicodeSymbol;
 
+		String m_Buffer;
+		ARIBStringCache *m_pCache = nullptr;
+
+		bool DecodeCached(
+			const uint8_t *pSrcData, size_t SrcLength, ReturnArg<String> DstString,
+			DecodeFlag Flags);
 		bool DecodeInternal(
 			const uint8_t *pSrcData, size_t SrcLength, ReturnArg<String> DstString,
 			DecodeFlag Flags,
 			OptionalReturnArg<FormatList> FormatList = std::nullopt,
 			DRCSMap *pDRCSMap = nullptr);
 		bool DecodeString(const uint8_t *pSrcData, size_t SrcLength, InternalString *pDstString);
+		size_t DecodeRun(const uint8_t *pSrcData, size_t SrcLength, InternalString *pDstString);
 		void DecodeChar(uint16_t Code, CodeSet Set, InternalString *pDstString);
 
 		void PutKanjiChar(uint16_t Code, InternalString *pDstString);
@@ -0,0 +1,225 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   ARIBStringCache.cpp
+ @brief  8単位符号文字列のデコード結果のキャッシュ
+ @author DBCTRADO
+*/
+
+
+#include "../LibISDBPrivate.hpp"
+#include "ARIBStringCache.hpp"
+#include <functional>
+#include <string_view>
+#include <iterator>
+#include <cstring>
+#include "DebugDef.hpp"
+
+
+namespace LibISDB
+{
+
+
+ARIBStringCache::ARIBStringCache(size_t MaxEntries)
+	: m_MaxEntries(MaxEntries)
+	, m_HitCount(0)
+	, m_MissCount(0)
+{
+}
+
+
+bool ARIBStringCache::Find(
+	const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+	ReturnArg<String> DstString)
+{
+	if (!DstString || (pSrcData == nullptr) || (SrcLength == 0))
+		return false;
+
+	auto it = m_EntryMap.find(GetKey(pSrcData, SrcLength, Flags));
+
+	// ハッシュが衝突している場合はミスとして扱う
+	if ((it == m_EntryMap.end())
+			|| (it->second->Flags != Flags)
+			|| (it->second->Source.length() != SrcLength)
+			|| (std::memcmp(it->second->Source.data(), pSrcData, SrcLength) != 0)) {
+		m_MissCount++;
+		return false;
+	}
+
+	m_EntryList.splice(m_EntryList.begin(), m_EntryList, it->second);
+	DstString = it->second->Decoded;
+	m_HitCount++;
+
+	return true;
+}
+
+
+void ARIBStringCache::Add(
+	const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+	const String &Str)
+{
+	if ((pSrcData == nullptr) || (SrcLength == 0) || (m_MaxEntries == 0))
+		return;
+
+	const size_t Key = GetKey(pSrcData, SrcLength, Flags);
+	auto it = m_EntryMap.find(Key);
+	EntryList::iterator itEntry;
+
+	if (it != m_EntryMap.end()) {
+		itEntry = it->second;
+	} else if (m_EntryMap.size() >= m_MaxEntries) {
+		// 最も古いエントリを再利用する
+		itEntry = std::prev(m_EntryList.end());
+		m_EntryMap.erase(itEntry->Key);
+		m_EntryMap.emplace(Key, itEntry);
+	} else {
+		itEntry = m_EntryList.emplace(m_EntryList.begin());
+		m_EntryMap.emplace(Key, itEntry);
+	}
+
+	m_EntryList.splice(m_EntryList.begin(), m_EntryList, itEntry);
+
+	itEntry->Key = Key;
+	itEntry->Flags = Flags;
+	itEntry->Source.assign(pSrcData, SrcLength);
+	itEntry->Decoded = Str;
+}
+
+
+void ARIBStringCache::Clear()
+{
+	m_EntryMap.clear();
+	m_EntryList.clear();
+}
+
+
+void ARIBStringCache::SetMaxEntries(size_t MaxEntries)
+{
+	m_MaxEntries = MaxEntries;
+	TrimEntries(MaxEntries);
+}
+
+
+size_t ARIBStringCache::GetMaxEntries() const
+{
+	return m_MaxEntries;
+}
+
+
+ARIBStringCache::Statistics ARIBStringCache::GetStatistics() const
+{
+	Statistics Stats;
+
+	Stats.HitCount = m_HitCount;
+	Stats.MissCount = m_MissCount;
+	Stats.EntryCount = m_EntryMap.size();
+
+	return Stats;
+}
+
+
+void ARIBStringCache::ResetStatistics()
+{
+	m_HitCount = 0;
+	m_MissCount = 0;
+}
+
+
+void ARIBStringCache::TrimEntries(size_t MaxEntries)
+{
+	while (m_EntryMap.size() > MaxEntries) {
+		m_EntryMap.erase(m_EntryList.back().Key);
+		m_EntryList.pop_back();
+	}
+}
+
+
+size_t ARIBStringCache::GetKey(const uint8_t *pData, size_t Length, ARIBStringDecoder::DecodeFlag Flags) noexcept
+{
+	const size_t Hash = std::hash<std::string_view>()(
+		std::string_view(reinterpret_cast<const char *>(pData), Length));
+
+	return Hash ^ (static_cast<size_t>(Flags) * 0x9E3779B9U);
+}
+
+
+
+
+bool ConcurrentARIBStringCache::Find(
+	const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+	ReturnArg<String> DstString)
+{
+	BlockLock Lock(m_Lock);
+
+	return ARIBStringCache::Find(pSrcData, SrcLength, Flags, DstString);
+}
+
+
+void ConcurrentARIBStringCache::Add(
+	const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+	const String &Str)
+{
+	BlockLock Lock(m_Lock);
+
+	ARIBStringCache::Add(pSrcData, SrcLength, Flags, Str);
+}
+
+
+void ConcurrentARIBStringCache::Clear()
+{
+	BlockLock Lock(m_Lock);
+
+	ARIBStringCache::Clear();
+}
+
+
+void ConcurrentARIBStringCache::SetMaxEntries(size_t MaxEntries)
+{
+	BlockLock Lock(m_Lock);
+
+	ARIBStringCache::SetMaxEntries(MaxEntries);
+}
+
+
+size_t ConcurrentARIBStringCache::GetMaxEntries() const
+{
+	BlockLock Lock(m_Lock);
+
+	return ARIBStringCache::GetMaxEntries();
+}
+
+
+ARIBStringCache::Statistics ConcurrentARIBStringCache::GetStatistics() const
+{
+	BlockLock Lock(m_Lock);
+
+	return ARIBStringCache::GetStatistics();
+}
+
+
+void ConcurrentARIBStringCache::ResetStatistics()
+{
+	BlockLock Lock(m_Lock);
+
+	ARIBStringCache::ResetStatistics();
+}
+
+
+}	// namespace LibISDB
@@ -0,0 +1,130 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   ARIBStringCache.hpp
+ @brief  8単位符号文字列のデコード結果のキャッシュ
+ @author DBCTRADO
+*/
+
+
+#ifndef LIBISDB_ARIB_STRING_CACHE_H
+#define LIBISDB_ARIB_STRING_CACHE_H
+
+
+#include "ARIBString.hpp"
+#include "../Utilities/Lock.hpp"
+#include <list>
+#include <unordered_map>
+
+
+namespace LibISDB
+{
+
+	/**
+		8単位符号文字列のデコード結果のキャッシュクラス
+
+		元の文字列のバイト列とデコードフラグをキーとして、デコード結果を保持する。
+		保持する数が上限に達すると、最も長い間参照されていないものから破棄される。
+		このクラスはスレッドセーフではないため、複数のスレッドから利用する場合は
+		ConcurrentARIBStringCache を使用する。
+	*/
+	class ARIBStringCache
+	{
+	public:
+		/** 統計情報 */
+		struct Statistics {
+			unsigned long long HitCount;  /**< ヒット回数 */
+			unsigned long long MissCount; /**< ミス回数 */
+			size_t EntryCount;            /**< エントリ数 */
+		};
+
+		static constexpr size_t DEFAULT_MAX_ENTRIES = 1024;
+
+		ARIBStringCache(size_t MaxEntries = DEFAULT_MAX_ENTRIES);
+		virtual ~ARIBStringCache() = default;
+
+		ARIBStringCache(const ARIBStringCache &) = delete;
+		ARIBStringCache & operator = (const ARIBStringCache &) = delete;
+
+		virtual bool Find(
+			const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+			ReturnArg<String> DstString);
+		virtual void Add(
+			const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+			const String &Str);
+		virtual void Clear();
+		virtual void SetMaxEntries(size_t MaxEntries);
+		virtual size_t GetMaxEntries() const;
+		virtual Statistics GetStatistics() const;
+		virtual void ResetStatistics();
+
+	protected:
+		struct CacheEntry {
+			size_t Key;
+			ARIBStringDecoder::DecodeFlag Flags;
+			ARIBString Source;
+			String Decoded;
+		};
+
+		typedef std::list<CacheEntry> EntryList;
+
+		EntryList m_EntryList;
+		std::unordered_map<size_t, EntryList::iterator> m_EntryMap;
+		size_t m_MaxEntries;
+		unsigned long long m_HitCount;
+		unsigned long long m_MissCount;
+
+		void TrimEntries(size_t MaxEntries);
+
+		static size_t GetKey(const uint8_t *pData, size_t Length, ARIBStringDecoder::DecodeFlag Flags) noexcept;
+	};
+
+	/**
+		スレッドセーフな8単位符号文字列のデコード結果のキャッシュクラス
+
+		複数の ARIBStringDecoder で共有できる。
+	*/
+	class ConcurrentARIBStringCache
+		: public ARIBStringCache
+	{
+	public:
+		using ARIBStringCache::ARIBStringCache;
+
+	// ARIBStringCache
+		bool Find(
+			const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+			ReturnArg<String> DstString) override;
+		void Add(
+			const uint8_t *pSrcData, size_t SrcLength, ARIBStringDecoder::DecodeFlag Flags,
+			const String &Str) override;
+		void Clear() override;
+		void SetMaxEntries(size_t MaxEntries) override;
+		size_t GetMaxEntries() const override;
+		Statistics GetStatistics() const override;
+		void ResetStatistics() override;
+
+	private:
+		mutable MutexLock m_Lock;
+	};
+
+}	// namespace LibISDB
+
+
+#endif	// ifndef LIBISDB_ARIB_STRING_CACHE_H
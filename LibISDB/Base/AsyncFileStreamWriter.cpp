@@ -0,0 +1,878 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   AsyncFileStreamWriter.cpp
+ @brief  非同期ファイル書き出し
+ @author DBCTRADO
+*/
+
+
+#include "../LibISDBPrivate.hpp"
+
+
+#ifndef LIBISDB_WINDOWS
+
+
+#include "AsyncFileStreamWriter.hpp"
+#include "../Utilities/AlignedAlloc.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define LIBISDB_IO_URING_SUPPORT
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "DebugDef.hpp"
+
+
+namespace LibISDB
+{
+
+
+/** io_uring の最小限のラッパー */
+class AsyncFileStreamWriter::IOURing
+{
+public:
+	~IOURing();
+
+	bool Initialize(unsigned int Entries);
+	void Finalize() noexcept;
+	bool SubmitWrite(int FD, const void *pData, size_t Size, SizeType Offset, unsigned int Slot);
+	bool WaitCompletion(uint64_t *pUserData, int *pResult);
+
+#ifdef LIBISDB_IO_URING_SUPPORT
+private:
+	static constexpr int MAX_SUBMIT_RETRY_COUNT = 100;
+
+	int m_FD = -1;
+	void *m_pSQRing = nullptr;
+	size_t m_SQRingSize = 0;
+	void *m_pCQRing = nullptr;
+	size_t m_CQRingSize = 0;
+	::io_uring_sqe *m_pSQEs = nullptr;
+	size_t m_SQEsSize = 0;
+	unsigned int m_SQEntries = 0;
+	unsigned int m_SQMask = 0;
+	unsigned int m_CQMask = 0;
+	unsigned int *m_pSQHead = nullptr;
+	unsigned int *m_pSQTail = nullptr;
+	unsigned int *m_pSQArray = nullptr;
+	unsigned int *m_pCQHead = nullptr;
+	unsigned int *m_pCQTail = nullptr;
+	::io_uring_cqe *m_pCQEs = nullptr;
+	std::vector<::iovec> m_IOVecList;
+#endif
+};
+
+
+AsyncFileStreamWriter::IOURing::~IOURing()
+{
+	Finalize();
+}
+
+
+#ifdef LIBISDB_IO_URING_SUPPORT
+
+
+bool AsyncFileStreamWriter::IOURing::Initialize(unsigned int Entries)
+{
+	Finalize();
+
+	::io_uring_params Params = {};
+
+	m_FD = static_cast<int>(::syscall(__NR_io_uring_setup, Entries, &Params));
+	if (m_FD < 0) {
+		LIBISDB_TRACE_WARNING(LIBISDB_STR("io_uring_setup() failed (%d)\n"), errno);
+		m_FD = -1;
+		return false;
+	}
+
+	m_SQRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned int);
+	m_CQRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(::io_uring_cqe);
+	const bool SingleMMap = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (SingleMMap)
+		m_SQRingSize = std::max(m_SQRingSize, m_CQRingSize);
+
+	m_pSQRing = ::mmap(nullptr, m_SQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_FD, IORING_OFF_SQ_RING);
+	if (m_pSQRing == MAP_FAILED) {
+		m_pSQRing = nullptr;
+		Finalize();
+		return false;
+	}
+
+	if (SingleMMap) {
+		m_pCQRing = m_pSQRing;
+		m_CQRingSize = 0;
+	} else {
+		m_pCQRing = ::mmap(nullptr, m_CQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_FD, IORING_OFF_CQ_RING);
+		if (m_pCQRing == MAP_FAILED) {
+			m_pCQRing = nullptr;
+			Finalize();
+			return false;
+		}
+	}
+
+	m_SQEsSize = Params.sq_entries * sizeof(::io_uring_sqe);
+	void *pSQEs = ::mmap(nullptr, m_SQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_FD, IORING_OFF_SQES);
+	if (pSQEs == MAP_FAILED) {
+		Finalize();
+		return false;
+	}
+	m_pSQEs = static_cast<::io_uring_sqe *>(pSQEs);
+
+	uint8_t *pSQ = static_cast<uint8_t *>(m_pSQRing);
+	uint8_t *pCQ = static_cast<uint8_t *>(m_pCQRing);
+	m_SQEntries = Params.sq_entries;
+	m_SQMask = *reinterpret_cast<unsigned int *>(pSQ + Params.sq_off.ring_mask);
+	m_pSQHead = reinterpret_cast<unsigned int *>(pSQ + Params.sq_off.head);
+	m_pSQTail = reinterpret_cast<unsigned int *>(pSQ + Params.sq_off.tail);
+	m_pSQArray = reinterpret_cast<unsigned int *>(pSQ + Params.sq_off.array);
+	m_CQMask = *reinterpret_cast<unsigned int *>(pCQ + Params.cq_off.ring_mask);
+	m_pCQHead = reinterpret_cast<unsigned int *>(pCQ + Params.cq_off.head);
+	m_pCQTail = reinterpret_cast<unsigned int *>(pCQ + Params.cq_off.tail);
+	m_pCQEs = reinterpret_cast<::io_uring_cqe *>(pCQ + Params.cq_off.cqes);
+
+	m_IOVecList.resize(Entries);
+
+	return true;
+}
+
+
+void AsyncFileStreamWriter::IOURing::Finalize() noexcept
+{
+	if (m_pSQEs != nullptr) {
+		::munmap(m_pSQEs, m_SQEsSize);
+		m_pSQEs = nullptr;
+	}
+	if ((m_pCQRing != nullptr) && (m_pCQRing != m_pSQRing))
+		::munmap(m_pCQRing, m_CQRingSize);
+	m_pCQRing = nullptr;
+	if (m_pSQRing != nullptr) {
+		::munmap(m_pSQRing, m_SQRingSize);
+		m_pSQRing = nullptr;
+	}
+	if (m_FD >= 0) {
+		::close(m_FD);
+		m_FD = -1;
+	}
+}
+
+
+bool AsyncFileStreamWriter::IOURing::SubmitWrite(int FD, const void *pData, size_t Size, SizeType Offset, unsigned int Slot)
+{
+	if ((m_FD < 0) || (Slot >= m_IOVecList.size()))
+		return false;
+
+	const unsigned int Tail = *m_pSQTail;
+	if (Tail - __atomic_load_n(m_pSQHead, __ATOMIC_ACQUIRE) >= m_SQEntries)
+		return false;
+
+	::iovec &IOVec = m_IOVecList[Slot];
+	IOVec.iov_base = const_cast<void *>(pData);
+	IOVec.iov_len = Size;
+
+	const unsigned int Index = Tail & m_SQMask;
+	::io_uring_sqe *pSQE = &m_pSQEs[Index];
+	std::memset(pSQE, 0, sizeof(::io_uring_sqe));
+	pSQE->opcode = IORING_OP_WRITEV;
+	pSQE->fd = FD;
+	pSQE->addr = reinterpret_cast<uintptr_t>(&IOVec);
+	pSQE->len = 1;
+	pSQE->off = Offset;
+	pSQE->user_data = Slot;
+	m_pSQArray[Index] = Index;
+
+	__atomic_store_n(m_pSQTail, Tail + 1, __ATOMIC_RELEASE);
+
+	for (int Retry = 0;; Retry++) {
+		const long Result = ::syscall(__NR_io_uring_enter, m_FD, 1, 0, 0, nullptr, 0);
+		if (Result >= 1)
+			return true;
+		if (Result == 0) {
+			// 提出されなかった
+			LIBISDB_TRACE_ERROR(LIBISDB_STR("io_uring_enter() submitted nothing\n"));
+			break;
+		}
+		if (((errno != EINTR) && (errno != EAGAIN)) || (Retry >= MAX_SUBMIT_RETRY_COUNT)) {
+			LIBISDB_TRACE_ERROR(LIBISDB_STR("io_uring_enter() failed (%d)\n"), errno);
+			break;
+		}
+	}
+
+	// カーネルが取り出していなければ取り消し、呼び出し元で同期的に書き出せるようにする
+	if (__atomic_load_n(m_pSQHead, __ATOMIC_ACQUIRE) == Tail)
+		__atomic_store_n(m_pSQTail, Tail, __ATOMIC_RELEASE);
+
+	return false;
+}
+
+
+bool AsyncFileStreamWriter::IOURing::WaitCompletion(uint64_t *pUserData, int *pResult)
+{
+	if (m_FD < 0)
+		return false;
+
+	for (;;) {
+		const unsigned int Head = *m_pCQHead;
+
+		if (Head != __atomic_load_n(m_pCQTail, __ATOMIC_ACQUIRE)) {
+			const ::io_uring_cqe &CQE = m_pCQEs[Head & m_CQMask];
+			*pUserData = CQE.user_data;
+			*pResult = CQE.res;
+			__atomic_store_n(m_pCQHead, Head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+		const long Result = ::syscall(__NR_io_uring_enter, m_FD, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if ((Result < 0) && (errno != EINTR)) {
+			LIBISDB_TRACE_ERROR(LIBISDB_STR("io_uring_enter() failed (%d)\n"), errno);
+			return false;
+		}
+	}
+}
+
+
+#else	// LIBISDB_IO_URING_SUPPORT
+
+
+bool AsyncFileStreamWriter::IOURing::Initialize(unsigned int Entries)
+{
+	return false;
+}
+
+
+void AsyncFileStreamWriter::IOURing::Finalize() noexcept
+{
+}
+
+
+bool AsyncFileStreamWriter::IOURing::SubmitWrite(int FD, const void *pData, size_t Size, SizeType Offset, unsigned int Slot)
+{
+	return false;
+}
+
+
+bool AsyncFileStreamWriter::IOURing::WaitCompletion(uint64_t *pUserData, int *pResult)
+{
+	return false;
+}
+
+
+#endif	// ndef LIBISDB_IO_URING_SUPPORT
+
+
+
+
+AsyncFileStreamWriter::AsyncFileStreamWriter() noexcept
+	: m_CurBuffer(0)
+	, m_BufferSize(DEFAULT_BUFFER_SIZE)
+	, m_QueueDepth(DEFAULT_QUEUE_DEPTH)
+	, m_DirectIO(false)
+	, m_UseIOURing(true)
+	, m_WriteError(false)
+	, m_WriteSize(0)
+	, m_PreallocationUnit(0)
+{
+}
+
+
+AsyncFileStreamWriter::~AsyncFileStreamWriter()
+{
+	Close();
+	FreeBuffers();
+}
+
+
+bool AsyncFileStreamWriter::Open(const CStringView &FileName, OpenFlag Flags)
+{
+	if (m_File.FD >= 0) {
+		SetError(std::errc::operation_in_progress);
+		return false;
+	}
+
+	if (!AllocateBuffers())
+		return false;
+
+	if (!OpenFile(FileName, Flags, &m_File))
+		return false;
+
+	m_WriteError = false;
+	m_WriteSize = 0;
+
+	ResetError();
+
+	return true;
+}
+
+
+bool AsyncFileStreamWriter::Reopen(const CStringView &FileName, OpenFlag Flags)
+{
+	if (!AllocateBuffers())
+		return false;
+
+	FileInfo File;
+
+	if (!OpenFile(FileName, Flags, &File))
+		return false;
+
+	Close();
+
+	m_File = std::move(File);
+	m_WriteError = false;
+
+	return true;
+}
+
+
+void AsyncFileStreamWriter::Close()
+{
+	if (m_File.FD < 0)
+		return;
+
+	// 残りのデータを書き出す
+	if (!m_BufferList.empty()) {
+		StagingBuffer &Buffer = m_BufferList[m_CurBuffer];
+		if (!Buffer.Pending && (Buffer.DataSize > 0)) {
+			if (m_WriteError)
+				DiscardBuffer(&Buffer, 0);
+			else if (SubmitBuffer(m_CurBuffer))
+				m_CurBuffer = (m_CurBuffer + 1) % m_BufferList.size();
+		}
+		WaitAllBuffers();
+	}
+
+	CloseFile(&m_File);
+}
+
+
+bool AsyncFileStreamWriter::IsOpen() const
+{
+	return m_File.FD >= 0;
+}
+
+
+size_t AsyncFileStreamWriter::Write(const void *pBuffer, size_t Size)
+{
+	if ((m_File.FD < 0) || m_WriteError || (pBuffer == nullptr) || (Size == 0))
+		return 0;
+
+	const uint8_t *pData = static_cast<const uint8_t *>(pBuffer);
+	size_t Remain = Size;
+
+	while (Remain > 0) {
+		StagingBuffer &Buffer = m_BufferList[m_CurBuffer];
+
+		if (Buffer.Pending && !WaitBuffer(m_CurBuffer))
+			break;
+
+		const size_t CopySize = std::min(Remain, m_BufferSize - Buffer.DataSize);
+		std::memcpy(Buffer.pData + Buffer.DataSize, pData, CopySize);
+		Buffer.DataSize += CopySize;
+		pData += CopySize;
+		Remain -= CopySize;
+		// 書き出しに失敗した場合は DiscardBuffer() で差し引かれる
+		m_WriteSize += CopySize;
+
+		if (Buffer.DataSize == m_BufferSize) {
+			if (!SubmitBuffer(m_CurBuffer))
+				break;
+			m_CurBuffer = (m_CurBuffer + 1) % m_BufferList.size();
+		}
+	}
+
+	// io_uring を使用しない場合は、埋まったバッファを残さずに書き出しておく
+	if (!m_IOURing)
+		FlushPendingBuffers();
+
+	// 書き出しに失敗したデータがあればエラーとする
+	// 以降は書き出されないので、溜めているデータも破棄する
+	if (m_WriteError) {
+		StagingBuffer &Buffer = m_BufferList[m_CurBuffer];
+		if (!Buffer.Pending)
+			DiscardBuffer(&Buffer, 0);
+		return 0;
+	}
+
+	return Size - Remain;
+}
+
+
+bool AsyncFileStreamWriter::GetFileName(String *pFileName) const
+{
+	if (pFileName == nullptr)
+		return false;
+
+	if (m_File.FD < 0) {
+		pFileName->clear();
+		return false;
+	}
+
+	*pFileName = m_File.FileName;
+
+	return !pFileName->empty();
+}
+
+
+StreamWriter::SizeType AsyncFileStreamWriter::GetWriteSize() const
+{
+	return m_WriteSize;
+}
+
+
+bool AsyncFileStreamWriter::IsWriteSizeAvailable() const
+{
+	return m_File.FD >= 0;
+}
+
+
+bool AsyncFileStreamWriter::SetPreallocationUnit(SizeType PreallocationUnit)
+{
+#ifdef __linux__
+	m_PreallocationUnit = PreallocationUnit;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool AsyncFileStreamWriter::SetBufferSize(size_t Size)
+{
+	if ((Size == 0) || (Size % DIRECT_IO_ALIGNMENT != 0) || (m_File.FD >= 0))
+		return false;
+
+	if (Size != m_BufferSize) {
+		FreeBuffers();
+		m_BufferSize = Size;
+	}
+
+	return true;
+}
+
+
+bool AsyncFileStreamWriter::SetQueueDepth(size_t Depth)
+{
+	if ((Depth == 0) || (Depth > 64) || (m_File.FD >= 0))
+		return false;
+
+	if (Depth != m_QueueDepth) {
+		FreeBuffers();
+		m_QueueDepth = Depth;
+	}
+
+	return true;
+}
+
+
+bool AsyncFileStreamWriter::IsIOURingActive() const noexcept
+{
+	return static_cast<bool>(m_IOURing);
+}
+
+
+bool AsyncFileStreamWriter::OpenFile(const CStringView &FileName, OpenFlag Flags, FileInfo *pFile)
+{
+	if (FileName.empty()) {
+		SetError(std::errc::invalid_argument);
+		return false;
+	}
+
+	int OFlags = O_WRONLY | O_CREAT | O_CLOEXEC;
+	if (!!(Flags & OpenFlag::Overwrite))
+		OFlags |= O_TRUNC;
+	else
+		OFlags |= O_EXCL;
+
+	int FD = -1;
+	bool DirectIO = false;
+
+#ifdef O_DIRECT
+	if (m_DirectIO) {
+		FD = ::open(FileName.c_str(), OFlags | O_DIRECT, 0666);
+		if (FD >= 0) {
+			DirectIO = true;
+		} else if (errno != EINVAL) {
+			SetError(static_cast<std::errc>(errno));
+			return false;
+		} else {
+			// ファイルシステムが O_DIRECT に対応していない
+			LIBISDB_TRACE_WARNING(LIBISDB_STR("O_DIRECT is not supported\n"));
+		}
+	}
+#endif
+
+	if (FD < 0) {
+		FD = ::open(FileName.c_str(), OFlags, 0666);
+		if (FD < 0) {
+			SetError(static_cast<std::errc>(errno));
+			return false;
+		}
+	}
+
+	LIBISDB_TRACE(
+		LIBISDB_STR("AsyncFileStreamWriter::OpenFile() : \"%") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR("\"%") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR("\n"),
+		FileName.c_str(), DirectIO ? LIBISDB_STR(" (O_DIRECT)") : LIBISDB_STR(""));
+
+	pFile->FD = FD;
+	pFile->DirectIO = DirectIO;
+	pFile->FileName = FileName;
+	pFile->Offset = 0;
+	pFile->PreallocatedSize = 0;
+	pFile->PreallocationFailed = false;
+
+	return true;
+}
+
+
+void AsyncFileStreamWriter::CloseFile(FileInfo *pFile)
+{
+	if (pFile->FD < 0)
+		return;
+
+	if (m_WriteError) {
+		// 書き出せなかった部分を含むサイズに切り詰めると欠落が分からなくなるため、そのままにする
+		LIBISDB_TRACE_ERROR(
+			LIBISDB_STR("AsyncFileStreamWriter::CloseFile() : Write error occurred \"%") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR("\"\n"),
+			pFile->FileName.c_str());
+		if (!GetLastErrorCode())
+			SetError(std::errc::io_error);
+	} else if (pFile->DirectIO || (pFile->PreallocatedSize > pFile->Offset)) {
+		// 最後のブロックの余白や先行して確保した領域を切り詰める
+		::ftruncate(pFile->FD, static_cast<::off_t>(pFile->Offset));
+	}
+
+	::close(pFile->FD);
+
+	*pFile = FileInfo();
+}
+
+
+bool AsyncFileStreamWriter::AllocateBuffers()
+{
+	if (m_BufferList.empty()) {
+		m_BufferList.resize(m_QueueDepth);
+
+		for (StagingBuffer &Buffer : m_BufferList) {
+			Buffer.pData = static_cast<uint8_t *>(AlignedAlloc(m_BufferSize, DIRECT_IO_ALIGNMENT));
+			if (Buffer.pData == nullptr) {
+				FreeBuffers();
+				SetError(std::errc::not_enough_memory);
+				return false;
+			}
+		}
+
+		m_CurBuffer = 0;
+	}
+
+	if (m_UseIOURing) {
+		if (!m_IOURing) {
+			m_IOURing = std::make_unique<IOURing>();
+			if (!m_IOURing->Initialize(static_cast<unsigned int>(m_QueueDepth)))
+				m_IOURing.reset();
+		}
+	} else {
+		m_IOURing.reset();
+	}
+
+	return true;
+}
+
+
+void AsyncFileStreamWriter::FreeBuffers() noexcept
+{
+	for (StagingBuffer &Buffer : m_BufferList)
+		AlignedFree(Buffer.pData);
+	m_BufferList.clear();
+	m_CurBuffer = 0;
+	m_IOURing.reset();
+}
+
+
+bool AsyncFileStreamWriter::SubmitBuffer(size_t Index)
+{
+	StagingBuffer &Buffer = m_BufferList[Index];
+
+	size_t WriteSize = Buffer.DataSize;
+	if (m_File.DirectIO && (WriteSize % DIRECT_IO_ALIGNMENT != 0)) {
+		// O_DIRECT ではサイズを揃える必要があるため、余白を埋めて書き出し後に切り詰める
+		const size_t AlignedSize = (WriteSize + (DIRECT_IO_ALIGNMENT - 1)) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+		std::memset(Buffer.pData + WriteSize, 0, AlignedSize - WriteSize);
+		WriteSize = AlignedSize;
+	}
+
+	Preallocate(m_File.Offset + WriteSize);
+
+	Buffer.WriteSize = WriteSize;
+	Buffer.Offset = m_File.Offset;
+	Buffer.Pending = true;
+	m_File.Offset += Buffer.DataSize;
+
+	if (m_IOURing) {
+		if (m_IOURing->SubmitWrite(m_File.FD, Buffer.pData, WriteSize, Buffer.Offset, static_cast<unsigned int>(Index)))
+			return true;
+
+		if (!WriteSync(Buffer.pData, WriteSize, Buffer.Offset)) {
+			DiscardBuffer(&Buffer, 0);
+			m_WriteError = true;
+			return false;
+		}
+
+		Buffer.Pending = false;
+		Buffer.DataSize = 0;
+	}
+
+	// io_uring を使用しない場合は、Write() から戻る前に FlushPendingBuffers() でまとめて書き出す
+
+	return true;
+}
+
+
+bool AsyncFileStreamWriter::WaitBuffer(size_t Index)
+{
+	StagingBuffer &Buffer = m_BufferList[Index];
+
+	if (!Buffer.Pending)
+		return true;
+
+	if (!m_IOURing)
+		return FlushPendingBuffers();
+
+	while (Buffer.Pending) {
+		if (!ProcessCompletion()) {
+			SetError(std::errc::io_error);
+			m_WriteError = true;
+			return false;
+		}
+	}
+
+	return !m_WriteError;
+}
+
+
+bool AsyncFileStreamWriter::WaitAllBuffers()
+{
+	if (!m_IOURing)
+		return FlushPendingBuffers();
+
+	bool Result = true;
+
+	for (size_t i = 0; i < m_BufferList.size(); i++) {
+		if (!WaitBuffer(i))
+			Result = false;
+	}
+
+	return Result;
+}
+
+
+bool AsyncFileStreamWriter::FlushPendingBuffers()
+{
+	StagingBuffer *PendingList[64];
+	size_t PendingCount = 0;
+
+	for (StagingBuffer &Buffer : m_BufferList) {
+		if (Buffer.Pending)
+			PendingList[PendingCount++] = &Buffer;
+	}
+
+	if (PendingCount == 0)
+		return true;
+
+	std::sort(
+		PendingList, PendingList + PendingCount,
+		[](const StagingBuffer *pBuffer1, const StagingBuffer *pBuffer2) -> bool {
+			return pBuffer1->Offset < pBuffer2->Offset;
+		});
+
+	// ファイル上で連続しているバッファを一度の pwritev で書き出す
+	::iovec IOVecList[64];
+	size_t First = 0;
+	bool Result = true;
+
+	while (First < PendingCount) {
+		const SizeType Offset = PendingList[First]->Offset;
+		SizeType End = Offset;
+		size_t Count = 0;
+
+		while ((First + Count < PendingCount) && (PendingList[First + Count]->Offset == End)) {
+			const StagingBuffer *pBuffer = PendingList[First + Count];
+			IOVecList[Count].iov_base = pBuffer->pData;
+			IOVecList[Count].iov_len = pBuffer->WriteSize;
+			End += pBuffer->WriteSize;
+			Count++;
+			if (pBuffer->WriteSize != pBuffer->DataSize)
+				break;
+		}
+
+		::iovec *pIOVec = IOVecList;
+		size_t IOVecCount = Count;
+		SizeType Pos = Offset;
+
+		while (IOVecCount > 0) {
+			const ::ssize_t Written = ::pwritev(m_File.FD, pIOVec, static_cast<int>(IOVecCount), static_cast<::off_t>(Pos));
+			if (Written < 0) {
+				if (errno == EINTR)
+					continue;
+				SetError(static_cast<std::errc>(errno));
+				Result = false;
+				break;
+			}
+			if (Written == 0) {
+				SetError(std::errc::io_error);
+				Result = false;
+				break;
+			}
+
+			Pos += Written;
+			size_t Remain = static_cast<size_t>(Written);
+			while ((IOVecCount > 0) && (Remain >= pIOVec->iov_len)) {
+				Remain -= pIOVec->iov_len;
+				pIOVec++;
+				IOVecCount--;
+			}
+			if (Remain > 0) {
+				pIOVec->iov_base = static_cast<uint8_t *>(pIOVec->iov_base) + Remain;
+				pIOVec->iov_len -= Remain;
+			}
+		}
+
+		if (!Result) {
+			// 書き出せた分を除いて書き込みサイズから差し引く
+			SizeType Written = Pos - Offset;
+			for (size_t i = First; i < PendingCount; i++) {
+				StagingBuffer *pBuffer = PendingList[i];
+				const size_t BufferWritten = static_cast<size_t>(std::min<SizeType>(Written, pBuffer->WriteSize));
+				DiscardBuffer(pBuffer, BufferWritten);
+				Written -= BufferWritten;
+			}
+			m_WriteError = true;
+			break;
+		}
+
+		for (size_t i = 0; i < Count; i++) {
+			PendingList[First + i]->Pending = false;
+			PendingList[First + i]->DataSize = 0;
+		}
+
+		First += Count;
+	}
+
+	return Result;
+}
+
+
+bool AsyncFileStreamWriter::ProcessCompletion()
+{
+	uint64_t UserData;
+	int Result;
+
+	if (!m_IOURing->WaitCompletion(&UserData, &Result))
+		return false;
+	if (UserData >= m_BufferList.size())
+		return false;
+
+	StagingBuffer &Buffer = m_BufferList[static_cast<size_t>(UserData)];
+
+	if (Result < 0) {
+		SetError(static_cast<std::errc>(-Result));
+		DiscardBuffer(&Buffer, 0);
+		m_WriteError = true;
+	} else if ((static_cast<size_t>(Result) < Buffer.WriteSize)
+			&& !WriteSync(Buffer.pData + Result, Buffer.WriteSize - Result, Buffer.Offset + Result)) {
+		DiscardBuffer(&Buffer, static_cast<size_t>(Result));
+		m_WriteError = true;
+	} else {
+		Buffer.Pending = false;
+		Buffer.DataSize = 0;
+	}
+
+	return true;
+}
+
+
+// 書き出せなかったバッファの内容を破棄し、書き込みサイズから差し引く
+void AsyncFileStreamWriter::DiscardBuffer(StagingBuffer *pBuffer, size_t WrittenSize) noexcept
+{
+	if (WrittenSize < pBuffer->DataSize)
+		m_WriteSize -= pBuffer->DataSize - WrittenSize;
+
+	pBuffer->Pending = false;
+	pBuffer->DataSize = 0;
+}
+
+
+bool AsyncFileStreamWriter::WriteSync(const uint8_t *pData, size_t Size, SizeType Offset)
+{
+	while (Size > 0) {
+		const ::ssize_t Written = ::pwrite(m_File.FD, pData, Size, static_cast<::off_t>(Offset));
+		if (Written < 0) {
+			if (errno == EINTR)
+				continue;
+			SetError(static_cast<std::errc>(errno));
+			return false;
+		}
+		if (Written == 0) {
+			SetError(std::errc::io_error);
+			return false;
+		}
+		pData += Written;
+		Size -= Written;
+		Offset += Written;
+	}
+
+	return true;
+}
+
+
+void AsyncFileStreamWriter::Preallocate(SizeType End)
+{
+#ifdef __linux__
+	if ((m_PreallocationUnit == 0) || m_File.PreallocationFailed)
+		return;
+
+	SizeType Begin = std::max(m_File.PreallocatedSize, m_File.Offset);
+	if (End <= Begin)
+		return;
+
+	// ファイルサイズは変えずに領域だけを確保し、閉じる際に余りを切り詰める
+	const SizeType Size = (End - Begin + (m_PreallocationUnit - 1)) / m_PreallocationUnit * m_PreallocationUnit;
+	if (::fallocate(m_File.FD, FALLOC_FL_KEEP_SIZE, static_cast<::off_t>(Begin), static_cast<::off_t>(Size)) != 0) {
+		LIBISDB_TRACE_WARNING(LIBISDB_STR("fallocate() failed (%d)\n"), errno);
+		m_File.PreallocationFailed = true;
+		return;
+	}
+
+	m_File.PreallocatedSize = Begin + Size;
+#endif
+}
+
+
+}	// namespace LibISDB
+
+
+#endif	// ndef LIBISDB_WINDOWS
@@ -0,0 +1,135 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   AsyncFileStreamWriter.hpp
+ @brief  非同期ファイル書き出し
+ @author DBCTRADO
+*/
+
+
+#ifndef LIBISDB_ASYNC_FILE_STREAM_WRITER_H
+#define LIBISDB_ASYNC_FILE_STREAM_WRITER_H
+
+
+#include "StreamWriter.hpp"
+#include <memory>
+#include <vector>
+
+
+#ifndef LIBISDB_WINDOWS
+
+
+namespace LibISDB
+{
+
+	/**
+		非同期ファイル書き出しクラス
+
+		書き出すデータをアラインメントされたバッファに溜め、io_uring で複数の書き込みを並行して行う。
+		io_uring が利用できない場合は、Write() で埋まったバッファを戻る前に pwritev でまとめて書き出す。
+		O_DIRECT を指定するとページキャッシュを経由せずに書き出す。
+	*/
+	class AsyncFileStreamWriter
+		: public StreamWriter
+	{
+	public:
+		static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+		static constexpr size_t DEFAULT_BUFFER_SIZE = 1024 * 1024;
+		static constexpr size_t DEFAULT_QUEUE_DEPTH = 4;
+
+		AsyncFileStreamWriter() noexcept;
+		~AsyncFileStreamWriter();
+
+	// StreamWriter
+		bool Open(const CStringView &FileName, OpenFlag Flags = OpenFlag::None) override;
+		bool Reopen(const CStringView &FileName, OpenFlag Flags = OpenFlag::None) override;
+		void Close() override;
+		bool IsOpen() const override;
+		size_t Write(const void *pBuffer, size_t Size) override;
+		bool GetFileName(String *pFileName) const override;
+		SizeType GetWriteSize() const override;
+		bool IsWriteSizeAvailable() const override;
+		bool SetPreallocationUnit(SizeType PreallocationUnit) override;
+
+	// AsyncFileStreamWriter
+		bool SetBufferSize(size_t Size);
+		size_t GetBufferSize() const noexcept { return m_BufferSize; }
+		bool SetQueueDepth(size_t Depth);
+		size_t GetQueueDepth() const noexcept { return m_QueueDepth; }
+		void SetDirectIO(bool DirectIO) noexcept { m_DirectIO = DirectIO; }
+		bool GetDirectIO() const noexcept { return m_DirectIO; }
+		void SetUseIOURing(bool Use) noexcept { m_UseIOURing = Use; }
+		bool GetUseIOURing() const noexcept { return m_UseIOURing; }
+		bool IsDirectIOActive() const noexcept { return m_File.DirectIO; }
+		bool IsIOURingActive() const noexcept;
+
+	private:
+		class IOURing;
+
+		struct StagingBuffer {
+			uint8_t *pData = nullptr;
+			size_t DataSize = 0;
+			size_t WriteSize = 0;
+			SizeType Offset = 0;
+			bool Pending = false;
+		};
+
+		struct FileInfo {
+			int FD = -1;
+			bool DirectIO = false;
+			String FileName;
+			SizeType Offset = 0;
+			SizeType PreallocatedSize = 0;
+			bool PreallocationFailed = false;
+		};
+
+		bool OpenFile(const CStringView &FileName, OpenFlag Flags, FileInfo *pFile);
+		void CloseFile(FileInfo *pFile);
+		bool AllocateBuffers();
+		void FreeBuffers() noexcept;
+		bool SubmitBuffer(size_t Index);
+		bool WaitBuffer(size_t Index);
+		bool WaitAllBuffers();
+		bool FlushPendingBuffers();
+		bool ProcessCompletion();
+		void DiscardBuffer(StagingBuffer *pBuffer, size_t WrittenSize) noexcept;
+		bool WriteSync(const uint8_t *pData, size_t Size, SizeType Offset);
+		void Preallocate(SizeType End);
+
+		FileInfo m_File;
+		std::vector<StagingBuffer> m_BufferList;
+		size_t m_CurBuffer;
+		std::unique_ptr<IOURing> m_IOURing;
+		size_t m_BufferSize;
+		size_t m_QueueDepth;
+		bool m_DirectIO;
+		bool m_UseIOURing;
+		bool m_WriteError;
+		SizeType m_WriteSize;
+		SizeType m_PreallocationUnit;
+	};
+
+}	// namespace LibISDB
+
+
+#endif	// ndef LIBISDB_WINDOWS
+
+
+#endif	// ifndef LIBISDB_ASYNC_FILE_STREAM_WRITER_H
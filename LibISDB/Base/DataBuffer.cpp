@@ -119,8 +119,10 @@ const uint8_t * DataBuffer::GetData() const noexcept
 
 void DataBuffer::SetAt(size_t Pos, uint8_t Data)
 {
-	if (LIBISDB_TRACE_ERROR_IF_NOT(Pos < m_DataSize))
-		m_pData[Pos] = Data;
+	if (LIBISDB_TRACE_ERROR_IF_NOT(Pos < m_DataSize)) {
+		if (MakeWritable())
+			m_pData[Pos] = Data;
+	}
 }
 
 
@@ -195,6 +197,8 @@ size_t DataBuffer::TrimHead(size_t TrimSize)
 	if (TrimSize >= m_DataSize) {
 		m_DataSize = 0;
 	} else if (m_DataSize > 0) {
+		if (!MakeWritable())
+			return m_DataSize;
 		std::memmove(m_pData, m_pData + TrimSize, m_DataSize - TrimSize);
 		m_DataSize -= TrimSize;
 	}
@@ -291,6 +295,29 @@ void DataBuffer::FreeBuffer() noexcept
 }
 
 
+// 参照している外部のデータを書き換えないよう、自身のバッファに複製する
+bool DataBuffer::MakeWritable() noexcept
+{
+	if (!IsDataReferenced())
+		return true;
+
+	const uint8_t *pData = m_pData;
+	const size_t DataSize = m_DataSize;
+
+	// 参照先は解放しない
+	m_DataSize = 0;
+	m_BufferSize = 0;
+	m_pData = static_cast<uint8_t *>(Allocate(DataSize));
+	if (m_pData != nullptr) {
+		std::memcpy(m_pData, pData, DataSize);
+		m_DataSize = DataSize;
+		m_BufferSize = DataSize;
+	}
+
+	return m_DataSize == DataSize;
+}
+
+
 void * DataBuffer::Allocate(size_t Size)
 {
 	return std::malloc(Size);
@@ -31,7 +31,12 @@
 namespace LibISDB
 {
 
-	/** メモリデータバッファクラス */
+	/**
+		メモリデータバッファクラス
+
+		派生クラスが外部のデータを参照させている場合、GetData() と GetBuffer() は参照先をそのまま返す。
+		データを書き換える場合は、先に MakeWritable() で自身のバッファに複製すること。
+	*/
 	class DataBuffer
 	{
 	public:
@@ -76,6 +81,9 @@ namespace LibISDB
 		void ClearSize() noexcept;
 		void FreeBuffer() noexcept;
 
+		bool MakeWritable() noexcept;
+		bool IsWritable() const noexcept { return !IsDataReferenced(); }
+
 		// dynamic_cast は遅いのでその代替
 		template<typename T> T * Cast()
 		{
@@ -89,6 +97,12 @@ namespace LibISDB
 		unsigned long GetTypeID() const noexcept { return m_TypeID; }
 
 	protected:
+		/*
+			派生クラスは外部のデータを参照させる場合、m_BufferSize を m_DataSize より小さくする
+			(MakeWritable() や、データを変更するメンバ関数で自身のバッファに複製される)
+		*/
+		bool IsDataReferenced() const noexcept { return m_BufferSize < m_DataSize; }
+
 		virtual void * Allocate(size_t Size);
 		virtual void Free(void *pBuffer) noexcept;
 		virtual void * ReAllocate(void *pBuffer, size_t Size);
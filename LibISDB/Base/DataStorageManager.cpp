@@ -26,6 +26,7 @@
 
 #include "../LibISDBPrivate.hpp"
 #include "DataStorageManager.hpp"
+#include "../Utilities/AlignedAlloc.hpp"
 #include "DebugDef.hpp"
 
 
@@ -39,4 +40,367 @@ DataStorage * MemoryDataStorageManager::CreateDataStorage()
 }
 
 
+
+
+MemoryBlockPool::MemoryBlockPool(size_t MaxBlockCount, bool LargePages) noexcept
+	: m_MaxBlockCount(MaxBlockCount)
+	, m_LargePages(LargePages)
+{
+}
+
+
+MemoryBlockPool::~MemoryBlockPool()
+{
+	for (const BlockInfo &Info : m_FreeList)
+		PageFree(Info.pBlock, Info.Size);
+}
+
+
+uint8_t * MemoryBlockPool::Allocate(size_t Size)
+{
+	if (Size == 0)
+		return nullptr;
+
+	{
+		BlockLock Lock(m_Lock);
+
+		for (auto it = m_FreeList.rbegin(); it != m_FreeList.rend(); ++it) {
+			if (it->Size == Size) {
+				uint8_t *pBlock = it->pBlock;
+				m_FreeList.erase(std::next(it).base());
+				m_Statistics.HitCount++;
+				m_Statistics.PooledBlockCount--;
+				m_Statistics.PooledBytes -= Size;
+				return pBlock;
+			}
+		}
+
+		m_Statistics.MissCount++;
+	}
+
+	return AllocateBlock(Size);
+}
+
+
+void MemoryBlockPool::Free(uint8_t *pBlock, size_t Size) noexcept
+{
+	if (pBlock == nullptr)
+		return;
+
+	{
+		BlockLock Lock(m_Lock);
+
+		if (m_FreeList.size() < m_MaxBlockCount) {
+			try {
+				m_FreeList.push_back(BlockInfo{pBlock, Size});
+				m_Statistics.ReturnCount++;
+				m_Statistics.PooledBlockCount++;
+				m_Statistics.PooledBytes += Size;
+				return;
+			} catch (...) {
+			}
+		}
+
+		m_Statistics.DiscardCount++;
+	}
+
+	PageFree(pBlock, Size);
+}
+
+
+bool MemoryBlockPool::Reserve(size_t Size, size_t Count)
+{
+	if (Size == 0)
+		return false;
+
+	size_t PooledCount = 0;
+	size_t AllocateCount = 0;
+
+	{
+		BlockLock Lock(m_Lock);
+
+		for (const BlockInfo &Info : m_FreeList) {
+			if (Info.Size == Size)
+				PooledCount++;
+		}
+		if (PooledCount < Count) {
+			AllocateCount = std::min(
+				Count - PooledCount,
+				m_MaxBlockCount - std::min(m_FreeList.size(), m_MaxBlockCount));
+		}
+	}
+
+	// 確保とページへの事前アクセスには時間が掛かるため、ロックの外で行う
+	std::vector<BlockInfo> BlockList;
+	BlockList.reserve(AllocateCount);
+	bool Result = true;
+	for (size_t i = 0; i < AllocateCount; i++) {
+		uint8_t *pBlock = AllocateBlock(Size);
+		if (pBlock == nullptr) {
+			Result = false;
+			break;
+		}
+		BlockList.push_back(BlockInfo{pBlock, Size});
+	}
+
+	{
+		BlockLock Lock(m_Lock);
+
+		while (!BlockList.empty() && (m_FreeList.size() < m_MaxBlockCount)) {
+			m_FreeList.push_back(BlockList.back());
+			BlockList.pop_back();
+			m_Statistics.PooledBlockCount++;
+			m_Statistics.PooledBytes += Size;
+			PooledCount++;
+		}
+	}
+
+	// 他のスレッドによって上限に達した場合は、入り切らなかったブロックを解放する
+	for (const BlockInfo &Info : BlockList)
+		PageFree(Info.pBlock, Info.Size);
+
+	return Result && (PooledCount >= Count);
+}
+
+
+void MemoryBlockPool::Trim(size_t MaxBlockCount)
+{
+	std::vector<BlockInfo> BlockList;
+
+	{
+		BlockLock Lock(m_Lock);
+
+		if (m_FreeList.size() <= MaxBlockCount)
+			return;
+
+		const size_t TrimCount = m_FreeList.size() - MaxBlockCount;
+		BlockList.assign(m_FreeList.begin(), m_FreeList.begin() + TrimCount);
+		m_FreeList.erase(m_FreeList.begin(), m_FreeList.begin() + TrimCount);
+		for (const BlockInfo &Info : BlockList) {
+			m_Statistics.PooledBlockCount--;
+			m_Statistics.PooledBytes -= Info.Size;
+		}
+	}
+
+	for (const BlockInfo &Info : BlockList)
+		PageFree(Info.pBlock, Info.Size);
+}
+
+
+void MemoryBlockPool::SetMaxBlockCount(size_t Count)
+{
+	{
+		BlockLock Lock(m_Lock);
+
+		m_MaxBlockCount = Count;
+	}
+
+	Trim(Count);
+}
+
+
+size_t MemoryBlockPool::GetMaxBlockCount() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_MaxBlockCount;
+}
+
+
+bool MemoryBlockPool::GetStatistics(PoolStatistics *pStats) const
+{
+	if (pStats == nullptr)
+		return false;
+
+	BlockLock Lock(m_Lock);
+
+	*pStats = m_Statistics;
+
+	return true;
+}
+
+
+void MemoryBlockPool::ResetStatistics()
+{
+	BlockLock Lock(m_Lock);
+
+	m_Statistics.HitCount = 0;
+	m_Statistics.MissCount = 0;
+	m_Statistics.ReturnCount = 0;
+	m_Statistics.DiscardCount = 0;
+}
+
+
+uint8_t * MemoryBlockPool::AllocateBlock(size_t Size)
+{
+	uint8_t *pBlock = static_cast<uint8_t *>(PageAlloc(Size, m_LargePages));
+	if (pBlock == nullptr)
+		return nullptr;
+
+	// 使用時にページフォルトが発生しないように、予め全てのページに触れておく
+	const size_t PageSize = GetPageSize();
+	for (size_t i = 0; i < Size; i += PageSize)
+		pBlock[i] = 0;
+
+	return pBlock;
+}
+
+
+
+
+PooledMemoryDataStorage::PooledMemoryDataStorage(const std::shared_ptr<MemoryBlockPool> &Pool) noexcept
+	: m_Pool(Pool)
+{
+}
+
+
+PooledMemoryDataStorage::~PooledMemoryDataStorage()
+{
+	Free();
+}
+
+
+bool PooledMemoryDataStorage::Allocate(SizeType Size)
+{
+	if (LIBISDB_TRACE_ERROR_IF((Size == 0) || (Size > RSIZE_MAX)))
+		return false;
+
+	if ((m_pBlock != nullptr) && (m_Capacity == Size)) {
+		m_DataSize = 0;
+		m_Pos = 0;
+		return true;
+	}
+
+	Free();
+
+	m_pBlock = m_Pool->Allocate(static_cast<size_t>(Size));
+	if (m_pBlock == nullptr)
+		return false;
+
+	m_Capacity = static_cast<size_t>(Size);
+
+	return true;
+}
+
+
+void PooledMemoryDataStorage::Free() noexcept
+{
+	if (m_pBlock != nullptr) {
+		m_Pool->Free(m_pBlock, m_Capacity);
+		m_pBlock = nullptr;
+	}
+
+	m_Capacity = 0;
+	m_DataSize = 0;
+	m_Pos = 0;
+}
+
+
+DataStorage::SizeType PooledMemoryDataStorage::GetCapacity() const
+{
+	return m_Capacity;
+}
+
+
+DataStorage::SizeType PooledMemoryDataStorage::GetDataSize() const
+{
+	return m_DataSize;
+}
+
+
+size_t PooledMemoryDataStorage::Read(void *pData, size_t Size)
+{
+	if (m_Pos >= m_DataSize)
+		return 0;
+
+	const size_t CopySize = std::min(Size, m_DataSize - m_Pos);
+	std::memcpy(pData, m_pBlock + m_Pos, CopySize);
+	m_Pos += CopySize;
+
+	return CopySize;
+}
+
+
+size_t PooledMemoryDataStorage::Write(const void *pData, size_t Size)
+{
+	if (m_Pos >= m_Capacity)
+		return 0;
+
+	const size_t CopySize = std::min(Size, m_Capacity - m_Pos);
+	std::memcpy(m_pBlock + m_Pos, pData, CopySize);
+	m_Pos += CopySize;
+	if (m_DataSize < m_Pos)
+		m_DataSize = m_Pos;
+
+	return CopySize;
+}
+
+
+bool PooledMemoryDataStorage::SetPos(SizeType Pos)
+{
+	if (Pos > m_Capacity)
+		return false;
+
+	m_Pos = static_cast<size_t>(Pos);
+
+	return true;
+}
+
+
+DataStorage::SizeType PooledMemoryDataStorage::GetPos() const
+{
+	return m_Pos;
+}
+
+
+
+
+PooledMemoryDataStorageManager::PooledMemoryDataStorageManager(size_t MaxPoolBlockCount, bool LargePages)
+	: m_Pool(std::make_shared<MemoryBlockPool>(MaxPoolBlockCount, LargePages))
+{
+}
+
+
+DataStorage * PooledMemoryDataStorageManager::CreateDataStorage()
+{
+	return new PooledMemoryDataStorage(m_Pool);
+}
+
+
+bool PooledMemoryDataStorageManager::Reserve(size_t BlockSize, size_t BlockCount)
+{
+	return m_Pool->Reserve(BlockSize, BlockCount);
+}
+
+
+void PooledMemoryDataStorageManager::Trim()
+{
+	m_Pool->Trim();
+}
+
+
+void PooledMemoryDataStorageManager::SetMaxPoolBlockCount(size_t Count)
+{
+	m_Pool->SetMaxBlockCount(Count);
+}
+
+
+size_t PooledMemoryDataStorageManager::GetMaxPoolBlockCount() const
+{
+	return m_Pool->GetMaxBlockCount();
+}
+
+
+bool PooledMemoryDataStorageManager::GetPoolStatistics(PoolStatistics *pStats) const
+{
+	return m_Pool->GetStatistics(pStats);
+}
+
+
+void PooledMemoryDataStorageManager::ResetPoolStatistics()
+{
+	m_Pool->ResetStatistics();
+}
+
+
 }	// namespace LibISDB
@@ -29,6 +29,9 @@
 
 
 #include "DataStorage.hpp"
+#include "../Utilities/Lock.hpp"
+#include <memory>
+#include <vector>
 
 
 namespace LibISDB
@@ -51,6 +54,105 @@ namespace LibISDB
 		DataStorage * CreateDataStorage() override;
 	};
 
+	/** メモリブロックプールクラス */
+	class MemoryBlockPool
+	{
+	public:
+		struct PoolStatistics {
+			unsigned long long HitCount = 0;     /**< プールから取得した回数 */
+			unsigned long long MissCount = 0;    /**< 新たに確保した回数 */
+			unsigned long long ReturnCount = 0;  /**< プールに戻した回数 */
+			unsigned long long DiscardCount = 0; /**< プールが一杯のため解放した回数 */
+			size_t PooledBlockCount = 0;         /**< プールにあるブロック数 */
+			unsigned long long PooledBytes = 0;  /**< プールにあるブロックの合計サイズ */
+		};
+
+		MemoryBlockPool(size_t MaxBlockCount, bool LargePages) noexcept;
+		~MemoryBlockPool();
+
+		MemoryBlockPool(const MemoryBlockPool &) = delete;
+		MemoryBlockPool & operator = (const MemoryBlockPool &) = delete;
+
+		uint8_t * Allocate(size_t Size);
+		void Free(uint8_t *pBlock, size_t Size) noexcept;
+		bool Reserve(size_t Size, size_t Count);
+		void Trim(size_t MaxBlockCount = 0);
+		void SetMaxBlockCount(size_t Count);
+		size_t GetMaxBlockCount() const;
+		bool GetLargePages() const noexcept { return m_LargePages; }
+		bool GetStatistics(PoolStatistics *pStats) const;
+		void ResetStatistics();
+
+	private:
+		struct BlockInfo {
+			uint8_t *pBlock;
+			size_t Size;
+		};
+
+		uint8_t * AllocateBlock(size_t Size);
+
+		std::vector<BlockInfo> m_FreeList;
+		size_t m_MaxBlockCount;
+		const bool m_LargePages;
+		PoolStatistics m_Statistics;
+		mutable MutexLock m_Lock;
+	};
+
+	/** プールを使用するメモリデータストレージクラス */
+	class PooledMemoryDataStorage
+		: public DataStorage
+	{
+	public:
+		PooledMemoryDataStorage(const std::shared_ptr<MemoryBlockPool> &Pool) noexcept;
+		~PooledMemoryDataStorage();
+
+	// DataStorage
+		bool Allocate(SizeType Size) override;
+		void Free() noexcept override;
+		SizeType GetCapacity() const override;
+		SizeType GetDataSize() const override;
+		size_t Read(void *pData, size_t Size) override;
+		size_t Write(const void *pData, size_t Size) override;
+		bool SetPos(SizeType Pos) override;
+		SizeType GetPos() const override;
+
+	protected:
+		std::shared_ptr<MemoryBlockPool> m_Pool;
+		uint8_t *m_pBlock = nullptr;
+		size_t m_Capacity = 0;
+		size_t m_DataSize = 0;
+		size_t m_Pos = 0;
+	};
+
+	/**
+		プールを使用するメモリデータストレージ管理クラス
+
+		解放されたブロックを一定数までプールして再利用する。
+		複数の StreamBuffer で共有する場合は std::shared_ptr で渡す。
+	*/
+	class PooledMemoryDataStorageManager
+		: public DataStorageManager
+	{
+	public:
+		typedef MemoryBlockPool::PoolStatistics PoolStatistics;
+
+		PooledMemoryDataStorageManager(size_t MaxPoolBlockCount = 64, bool LargePages = false);
+
+	// DataStorageManager
+		DataStorage * CreateDataStorage() override;
+
+	// PooledMemoryDataStorageManager
+		bool Reserve(size_t BlockSize, size_t BlockCount);
+		void Trim();
+		void SetMaxPoolBlockCount(size_t Count);
+		size_t GetMaxPoolBlockCount() const;
+		bool GetPoolStatistics(PoolStatistics *pStats) const;
+		void ResetPoolStatistics();
+
+	protected:
+		std::shared_ptr<MemoryBlockPool> m_Pool;
+	};
+
 }	// namespace LibISDB
 
 
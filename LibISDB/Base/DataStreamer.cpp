@@ -36,6 +36,8 @@ namespace LibISDB
 
 DataStreamer::DataStreamer()
 	: m_InputStartPos(StreamBuffer::POS_BEGIN)
+	, m_IsPoolTaskAdded(false)
+	, m_InputWaitStartTime(0)
 	, m_OutputErrorNotified(false)
 {
 }
@@ -80,7 +82,14 @@ bool DataStreamer::Start()
 			m_InputStartPos = StreamBuffer::POS_BEGIN;
 		}
 
-		if (!StartStreamingThread()) {
+		if (m_ThreadPool) {
+			m_IsPoolTaskAdded.store(true, std::memory_order_release);
+			if (!m_ThreadPool->AddTask(this)) {
+				m_IsPoolTaskAdded.store(false, std::memory_order_release);
+				m_StreamReader.Close();
+				return false;
+			}
+		} else if (!StartStreamingThread()) {
 			m_StreamReader.Close();
 			return false;
 		}
@@ -92,7 +101,10 @@ bool DataStreamer::Start()
 
 bool DataStreamer::Stop(const std::chrono::milliseconds &Timeout)
 {
-	if (IsStarted()) {
+	if (m_IsPoolTaskAdded.load(std::memory_order_acquire)) {
+		m_ThreadPool->RemoveTask(this);
+		m_IsPoolTaskAdded.store(false, std::memory_order_release);
+	} else if (Thread::IsStarted()) {
 		m_StreamingThreadTimeout = Timeout;
 		StopStreamingThread();
 	}
@@ -101,6 +113,12 @@ bool DataStreamer::Stop(const std::chrono::milliseconds &Timeout)
 }
 
 
+bool DataStreamer::IsStarted() const
+{
+	return Thread::IsStarted() || m_IsPoolTaskAdded.load(std::memory_order_acquire);
+}
+
+
 bool DataStreamer::Pause()
 {
 	if (!IsStarted())
@@ -136,7 +154,20 @@ bool DataStreamer::InputData(const uint8_t *pData, size_t DataSize)
 	bool Result;
 
 	if (m_InputBuffer) {
-		Result = m_InputBuffer->PushBack(pData, DataSize) == DataSize;
+		const size_t PushedSize = m_InputBuffer->PushBack(pData, DataSize);
+		Result = PushedSize == DataSize;
+		if (!Result)
+			m_Statistics.InputDroppedBytes += DataSize - PushedSize;
+		if ((PushedSize > 0) && (m_InputWaitStartTime == 0))
+			m_InputWaitStartTime = m_LatencyClock.Get();
+		if (m_IsPoolTaskAdded.load(std::memory_order_acquire)) {
+			if (!IsStreamingThreadEventDriven() || AddStreamingThreadPendingSize(PushedSize))
+				m_ThreadPool->NotifyTask(this);
+			else if (PushedSize > 0)
+				m_ThreadPool->NotifyTaskDelayed(this, m_StreamingThreadFlushDelay);
+		} else {
+			NotifyStreamingThread(PushedSize);
+		}
 	} else if (m_OutputCacheBuffer.GetBufferSize() > 0) {
 		Result = OutputDataWithCache(pData, DataSize);
 	} else if (IsOutputValid()) {
@@ -166,6 +197,7 @@ void DataStreamer::ClearBuffer()
 
 	if (m_InputBuffer)
 		m_InputBuffer->Clear();
+	m_InputWaitStartTime = 0;
 
 	ClearOutput();
 }
@@ -289,6 +321,49 @@ bool DataStreamer::AllocateOutputCacheBuffer(size_t Size)
 }
 
 
+bool DataStreamer::SetThreadPool(const std::shared_ptr<StreamingThreadPool> &ThreadPool)
+{
+	if (IsStarted())
+		return false;
+
+	BlockLock Lock(m_Lock);
+
+	m_ThreadPool = ThreadPool;
+
+	return true;
+}
+
+
+std::shared_ptr<StreamingThreadPool> DataStreamer::GetThreadPool() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_ThreadPool;
+}
+
+
+unsigned long long DataStreamer::GetPendingBytes() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_StreamReader.GetAvailableSize() + m_OutputCacheBuffer.GetSize();
+}
+
+
+bool DataStreamer::SetWakeupWatermark(size_t Size)
+{
+	SetStreamingThreadWakeupWatermark(Size);
+
+	return true;
+}
+
+
+size_t DataStreamer::GetWakeupWatermark() const noexcept
+{
+	return m_StreamingThreadWakeupWatermark.load(std::memory_order_acquire);
+}
+
+
 bool DataStreamer::GetStatistics(Statistics *pStats) const
 {
 	if (pStats == nullptr)
@@ -396,9 +471,30 @@ bool DataStreamer::ProcessStream()
 
 	m_Lock.Lock();
 
-	if (m_StreamReader.IsDataAvailable())
+	const size_t AvailableSize = m_StreamReader.GetAvailableSize();
+	const unsigned long long PendingBytes = AvailableSize + m_OutputCacheBuffer.GetSize();
+	if (m_Statistics.MaxPendingBytes < PendingBytes)
+		m_Statistics.MaxPendingBytes = PendingBytes;
+
+	if (AvailableSize > 0) {
+		if (m_InputWaitStartTime != 0) {
+			const HighPrecisionTickClock::ClockType Now = m_LatencyClock.Get();
+			const unsigned long long Latency =
+				(Now - m_InputWaitStartTime) / (HighPrecisionTickClock::ClocksPerSec / 1000000_u64);
+			m_Statistics.ProcessLatencyCount++;
+			m_Statistics.TotalProcessLatency += Latency;
+			if (m_Statistics.MaxProcessLatency < Latency)
+				m_Statistics.MaxProcessLatency = Latency;
+			m_InputWaitStartTime = 0;
+		}
+
 		IsFilled = FillOutputCache();
 
+		// 読み残しがある場合、その分の待ち時間はここから計測する
+		if (m_StreamReader.IsDataAvailable())
+			m_InputWaitStartTime = m_LatencyClock.Get();
+	}
+
 	m_Lock.Unlock();
 
 	if (IsFilled) {
@@ -416,4 +512,13 @@ bool DataStreamer::ProcessStream()
 }
 
 
+bool DataStreamer::ProcessTask()
+{
+	// ここで読み込まれるため、watermark までの量を数え直す
+	m_StreamingThreadPendingSize.store(0, std::memory_order_relaxed);
+
+	return ProcessStream();
+}
+
+
 }	// namespace LibISDB
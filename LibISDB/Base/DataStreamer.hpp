@@ -32,6 +32,8 @@
 #include "StreamBuffer.hpp"
 #include "EventListener.hpp"
 #include "StreamingThread.hpp"
+#include "StreamingThreadPool.hpp"
+#include "../Utilities/Clock.hpp"
 
 
 namespace LibISDB
@@ -41,6 +43,7 @@ namespace LibISDB
 	class DataStreamer
 		: public ObjectBase
 		, protected StreamingThread
+		, protected StreamingThreadPool::Task
 	{
 	public:
 		/** イベントリスナ */
@@ -57,6 +60,11 @@ namespace LibISDB
 			unsigned long long OutputBytes = 0;
 			unsigned long long OutputCount = 0;
 			unsigned long OutputErrorCount = 0;
+			unsigned long long InputDroppedBytes = 0;
+			unsigned long long MaxPendingBytes = 0;
+			unsigned long long ProcessLatencyCount = 0;
+			unsigned long long TotalProcessLatency = 0; // マイクロ秒単位
+			unsigned long long MaxProcessLatency = 0;   // マイクロ秒単位
 
 			void Reset() noexcept { *this = Statistics(); }
 		};
@@ -73,7 +81,7 @@ namespace LibISDB
 
 		bool Start();
 		bool Stop(const std::chrono::milliseconds &Timeout = std::chrono::milliseconds(0));
-		using Thread::IsStarted;
+		bool IsStarted() const;
 		bool Pause();
 		bool Resume();
 
@@ -92,6 +100,12 @@ namespace LibISDB
 
 		bool AllocateOutputCacheBuffer(size_t Size);
 
+		bool SetThreadPool(const std::shared_ptr<StreamingThreadPool> &ThreadPool);
+		std::shared_ptr<StreamingThreadPool> GetThreadPool() const;
+		unsigned long long GetPendingBytes() const;
+		bool SetWakeupWatermark(size_t Size);
+		size_t GetWakeupWatermark() const noexcept;
+
 		bool GetStatistics(Statistics *pStats) const;
 
 		bool AddEventListener(EventListener *pEventListener);
@@ -112,12 +126,21 @@ namespace LibISDB
 	// StreamingThread
 		bool ProcessStream() override;
 
+	// StreamingThreadPool::Task
+		bool ProcessTask() override;
+
 		std::shared_ptr<StreamBuffer> m_InputBuffer;
 		StreamBuffer::SequentialReader m_StreamReader;
 		StreamBuffer::PosType m_InputStartPos;
 		DataBuffer m_OutputCacheBuffer;
 		mutable MutexLock m_Lock;
 
+		std::shared_ptr<StreamingThreadPool> m_ThreadPool;
+		std::atomic<bool> m_IsPoolTaskAdded;
+
+		HighPrecisionTickClock m_LatencyClock;
+		HighPrecisionTickClock::ClockType m_InputWaitStartTime;
+
 		Statistics m_Statistics;
 		bool m_OutputErrorNotified;
 
@@ -366,7 +366,7 @@ bool FileStreamPOSIX::SetPos(OffsetType Pos, SetPosType Type)
 
 	m_EOF = false;
 
-	return lseek64(m_File, Pos, Origin) == 0;
+	return lseek64(m_File, Pos, Origin) >= 0;
 }
 
 
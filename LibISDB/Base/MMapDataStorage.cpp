@@ -0,0 +1,559 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   MMapDataStorage.cpp
+ @brief  メモリマップドファイルデータストレージ
+ @author DBCTRADO
+*/
+
+
+#include "../LibISDBPrivate.hpp"
+#include "MMapDataStorage.hpp"
+
+#ifdef LIBISDB_WINDOWS
+#include <winioctl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "DebugDef.hpp"
+
+
+namespace LibISDB
+{
+
+
+MMapBlockFile::MMapBlockFile() noexcept
+#ifdef LIBISDB_WINDOWS
+	: m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(nullptr)
+#else
+	: m_File(-1)
+#endif
+	, m_BlockSize(0)
+	, m_BlockCount(0)
+	, m_Sparse(false)
+{
+}
+
+
+MMapBlockFile::~MMapBlockFile()
+{
+	Close();
+}
+
+
+bool MMapBlockFile::Create(const CStringView &FileName, SizeType BlockSize, size_t BlockCount, bool Sparse)
+{
+	Close();
+
+	if (LIBISDB_TRACE_ERROR_IF(FileName.empty() || (BlockSize == 0) || (BlockCount == 0)))
+		return false;
+
+	// 各ブロックを個別にマップできるように、ブロックの間隔をマップ単位に揃える
+	const SizeType Granularity = GetAllocationGranularity();
+	const SizeType Stride = (BlockSize + (Granularity - 1)) / Granularity * Granularity;
+	if (LIBISDB_TRACE_ERROR_IF(Stride > std::numeric_limits<SizeType>::max() / BlockCount))
+		return false;
+	const SizeType FileSize = Stride * BlockCount;
+
+	LIBISDB_TRACE(
+		LIBISDB_STR("MMapBlockFile::Create() : \"%") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR("\" %llu x %zu blocks%") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR("\n"),
+		FileName.c_str(), static_cast<unsigned long long>(Stride), BlockCount,
+		Sparse ? LIBISDB_STR(" (sparse)") : LIBISDB_STR(""));
+
+#ifdef LIBISDB_WINDOWS
+
+	m_hFile = ::CreateFile(
+		FileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("CreateFile() failed (%x)\n"), ::GetLastError());
+		return false;
+	}
+
+	if (Sparse) {
+		DWORD Bytes;
+		if (!::DeviceIoControl(m_hFile, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &Bytes, nullptr))
+			Sparse = false;
+	}
+
+	m_hMapping = ::CreateFileMapping(
+		m_hFile, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(FileSize >> 32), static_cast<DWORD>(FileSize & 0xFFFFFFFFULL), nullptr);
+	if (m_hMapping == nullptr) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("CreateFileMapping() failed (%x)\n"), ::GetLastError());
+		::CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+#else	// LIBISDB_WINDOWS
+
+	// 閉じる時に削除するため、既存のファイルは開かない
+	m_File = ::open(FileName.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (m_File < 0) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("open() failed (%d)\n"), errno);
+		return false;
+	}
+
+	// スパースでない場合は、マップしたページへの書き込みでディスク容量不足の SIGBUS が起きないよう
+	// 先に全てのブロックの領域を確保しておく
+	int Error = 0;
+#ifndef LIBISDB_MACOS
+	if (!Sparse) {
+		// posix_fallocate() はファイルサイズも拡張し、errno を設定せずにエラーコードを返す
+		Error = ::posix_fallocate(m_File, 0, static_cast<::off_t>(FileSize));
+	} else {
+		if (::ftruncate(m_File, static_cast<::off_t>(FileSize)) != 0)
+			Error = errno;
+	}
+#else
+	if (!Sparse) {
+		// F_PREALLOCATE はファイルサイズを変更しないため、別途 ftruncate() する
+		::fstore_t Store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<::off_t>(FileSize), 0};
+		if (::fcntl(m_File, F_PREALLOCATE, &Store) == -1)
+			Error = errno;
+	}
+	if (Error == 0) {
+		if (::ftruncate(m_File, static_cast<::off_t>(FileSize)) != 0)
+			Error = errno;
+	}
+#endif
+	if (Error != 0) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("Failed to allocate file space (%d)\n"), Error);
+		::close(m_File);
+		m_File = -1;
+		std::remove(FileName.c_str());
+		return false;
+	}
+
+#endif	// ndef LIBISDB_WINDOWS
+
+	m_FileName = FileName;
+	m_BlockSize = Stride;
+	m_BlockCount = BlockCount;
+	m_Sparse = Sparse;
+
+	BlockLock Lock(m_Lock);
+
+	m_FreeBlockList.resize(BlockCount);
+	for (size_t i = 0; i < BlockCount; i++)
+		m_FreeBlockList[i] = BlockCount - 1 - i;
+
+	return true;
+}
+
+
+void MMapBlockFile::Close() noexcept
+{
+#ifdef LIBISDB_WINDOWS
+	if (m_hMapping != nullptr) {
+		::CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE) {
+		::CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_File >= 0) {
+		::close(m_File);
+		m_File = -1;
+		std::remove(m_FileName.c_str());
+	}
+#endif
+
+	m_FileName.clear();
+	m_BlockSize = 0;
+	m_BlockCount = 0;
+	m_Sparse = false;
+
+	BlockLock Lock(m_Lock);
+
+	m_FreeBlockList.clear();
+}
+
+
+bool MMapBlockFile::IsOpen() const noexcept
+{
+#ifdef LIBISDB_WINDOWS
+	return m_hMapping != nullptr;
+#else
+	return m_File >= 0;
+#endif
+}
+
+
+size_t MMapBlockFile::GetFreeBlockCount() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_FreeBlockList.size();
+}
+
+
+bool MMapBlockFile::AllocateBlock(ReturnArg<size_t> Index)
+{
+	BlockLock Lock(m_Lock);
+
+	if (m_FreeBlockList.empty())
+		return false;
+
+	Index = m_FreeBlockList.back();
+	m_FreeBlockList.pop_back();
+
+	return true;
+}
+
+
+void MMapBlockFile::FreeBlock(size_t Index) noexcept
+{
+	if (Index >= m_BlockCount)
+		return;
+
+	if (!DiscardBlock(Index)) {
+		// 領域を確保し直せなかったブロックは、書き込み時に SIGBUS となるため再利用しない
+		LIBISDB_TRACE_WARNING(LIBISDB_STR("MMapBlockFile::FreeBlock() : Block %zu is no longer usable\n"), Index);
+		return;
+	}
+
+	BlockLock Lock(m_Lock);
+
+	m_FreeBlockList.push_back(Index);
+}
+
+
+uint8_t * MMapBlockFile::MapBlock(size_t Index, size_t Size)
+{
+	if (!IsOpen() || (Index >= m_BlockCount) || (Size == 0) || (Size > m_BlockSize))
+		return nullptr;
+
+	const SizeType Offset = m_BlockSize * Index;
+
+#ifdef LIBISDB_WINDOWS
+
+	void *pAddress = ::MapViewOfFile(
+		m_hMapping, FILE_MAP_READ | FILE_MAP_WRITE,
+		static_cast<DWORD>(Offset >> 32), static_cast<DWORD>(Offset & 0xFFFFFFFFULL), Size);
+	if (pAddress == nullptr) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("MapViewOfFile() failed (%x)\n"), ::GetLastError());
+		return nullptr;
+	}
+
+#else
+
+	void *pAddress = ::mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, static_cast<::off_t>(Offset));
+	if (pAddress == MAP_FAILED) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("mmap() failed (%d)\n"), errno);
+		return nullptr;
+	}
+
+	// 書き込み・読み込みともに先頭から順に行われる
+	::madvise(pAddress, Size, MADV_SEQUENTIAL);
+
+#endif
+
+	return static_cast<uint8_t *>(pAddress);
+}
+
+
+void MMapBlockFile::UnmapBlock(uint8_t *pAddress, size_t Size) noexcept
+{
+	if (pAddress == nullptr)
+		return;
+
+#ifdef LIBISDB_WINDOWS
+	::UnmapViewOfFile(pAddress);
+#else
+	::munmap(pAddress, Size);
+#endif
+}
+
+
+size_t MMapBlockFile::GetAllocationGranularity() noexcept
+{
+#ifdef LIBISDB_WINDOWS
+	::SYSTEM_INFO Info;
+	::GetSystemInfo(&Info);
+	return Info.dwAllocationGranularity;
+#else
+	const long PageSize = ::sysconf(_SC_PAGESIZE);
+	return PageSize > 0 ? static_cast<size_t>(PageSize) : 4096;
+#endif
+}
+
+
+bool MMapBlockFile::DiscardBlock(size_t Index) noexcept
+{
+	// 解放されたブロックの内容は不要なので、書き戻さずに破棄する
+	const SizeType Offset = m_BlockSize * Index;
+
+#ifdef LIBISDB_WINDOWS
+
+	if (m_Sparse) {
+		::FILE_ZERO_DATA_INFORMATION ZeroData;
+		ZeroData.FileOffset.QuadPart = static_cast<LONGLONG>(Offset);
+		ZeroData.BeyondFinalZero.QuadPart = static_cast<LONGLONG>(Offset + m_BlockSize);
+		DWORD Bytes;
+		::DeviceIoControl(m_hFile, FSCTL_SET_ZERO_DATA, &ZeroData, sizeof(ZeroData), nullptr, 0, &Bytes, nullptr);
+	}
+
+#else
+
+	// posix_fadvise(POSIX_FADV_DONTNEED) はダーティページの書き戻しを伴うので使わない。
+	// 穴を開けるとページキャッシュ上の内容も書き戻されずに破棄される。
+#ifdef FALLOC_FL_PUNCH_HOLE
+	if (::fallocate(m_File, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			static_cast<::off_t>(Offset), static_cast<::off_t>(m_BlockSize)) == 0) {
+		// スパースでない場合は領域を確保し直す
+		if (!m_Sparse) {
+			if (::fallocate(m_File, FALLOC_FL_KEEP_SIZE,
+					static_cast<::off_t>(Offset), static_cast<::off_t>(m_BlockSize)) != 0) {
+				LIBISDB_TRACE_ERROR(LIBISDB_STR("fallocate() failed (%d)\n"), errno);
+				return false;
+			}
+		}
+	}
+#endif
+
+#endif
+
+	return true;
+}
+
+
+
+
+MMapDataStorage::MMapDataStorage() noexcept
+	: m_SharedBlockFile(false)
+	, m_BlockIndex(0)
+	, m_pData(nullptr)
+	, m_Capacity(0)
+	, m_DataSize(0)
+	, m_Pos(0)
+	, m_Sparse(false)
+{
+}
+
+
+MMapDataStorage::MMapDataStorage(const std::shared_ptr<MMapBlockFile> &BlockFile) noexcept
+	: MMapDataStorage()
+{
+	m_BlockFile = BlockFile;
+	m_SharedBlockFile = true;
+}
+
+
+MMapDataStorage::~MMapDataStorage()
+{
+	Free();
+}
+
+
+bool MMapDataStorage::Allocate(SizeType Size)
+{
+	Free();
+
+	if (LIBISDB_TRACE_ERROR_IF((Size == 0) || (Size > RSIZE_MAX)))
+		return false;
+
+	if (!m_SharedBlockFile) {
+		if (LIBISDB_TRACE_ERROR_IF(m_FileName.empty()))
+			return false;
+		m_BlockFile = std::make_shared<MMapBlockFile>();
+		if (!m_BlockFile->Create(m_FileName.c_str(), Size, 1, m_Sparse)) {
+			m_BlockFile.reset();
+			return false;
+		}
+	} else if (!m_BlockFile) {
+		return false;
+	}
+
+	size_t Index;
+
+	if (LIBISDB_TRACE_ERROR_IF(Size > m_BlockFile->GetBlockSize())
+			|| !m_BlockFile->AllocateBlock(&Index)) {
+		if (!m_SharedBlockFile)
+			m_BlockFile.reset();
+		return false;
+	}
+
+	m_pData = m_BlockFile->MapBlock(Index, static_cast<size_t>(Size));
+	if (m_pData == nullptr) {
+		m_BlockFile->FreeBlock(Index);
+		if (!m_SharedBlockFile)
+			m_BlockFile.reset();
+		return false;
+	}
+
+	m_BlockIndex = Index;
+	m_Capacity = static_cast<size_t>(Size);
+	m_DataSize = 0;
+	m_Pos = 0;
+
+	return true;
+}
+
+
+void MMapDataStorage::Free() noexcept
+{
+	if (m_pData != nullptr) {
+		m_BlockFile->UnmapBlock(m_pData, m_Capacity);
+		m_BlockFile->FreeBlock(m_BlockIndex);
+		m_pData = nullptr;
+	}
+
+	if (!m_SharedBlockFile)
+		m_BlockFile.reset();
+
+	m_BlockIndex = 0;
+	m_Capacity = 0;
+	m_DataSize = 0;
+	m_Pos = 0;
+}
+
+
+DataStorage::SizeType MMapDataStorage::GetCapacity() const
+{
+	return m_Capacity;
+}
+
+
+DataStorage::SizeType MMapDataStorage::GetDataSize() const
+{
+	return m_DataSize;
+}
+
+
+size_t MMapDataStorage::Read(void *pData, size_t Size)
+{
+	if (m_Pos >= m_DataSize)
+		return 0;
+
+	const size_t CopySize = std::min(Size, m_DataSize - m_Pos);
+	std::memcpy(pData, m_pData + m_Pos, CopySize);
+	m_Pos += CopySize;
+
+	return CopySize;
+}
+
+
+size_t MMapDataStorage::Write(const void *pData, size_t Size)
+{
+	if (m_Pos >= m_Capacity)
+		return 0;
+
+	const size_t CopySize = std::min(Size, m_Capacity - m_Pos);
+	std::memcpy(m_pData + m_Pos, pData, CopySize);
+	m_Pos += CopySize;
+	if (m_DataSize < m_Pos)
+		m_DataSize = m_Pos;
+
+	return CopySize;
+}
+
+
+bool MMapDataStorage::SetPos(SizeType Pos)
+{
+	if (Pos > m_Capacity)
+		return false;
+
+	m_Pos = static_cast<size_t>(Pos);
+
+	return true;
+}
+
+
+DataStorage::SizeType MMapDataStorage::GetPos() const
+{
+	return m_Pos;
+}
+
+
+bool MMapDataStorage::SetFileName(const StringView &FileName)
+{
+	if (m_SharedBlockFile || (m_pData != nullptr))
+		return false;
+
+	if (FileName.empty()) {
+		m_FileName.clear();
+		return false;
+	}
+
+	m_FileName = FileName;
+
+	return true;
+}
+
+
+
+
+DataStorage * MMapDataStorageManager::CreateDataStorage()
+{
+	if (!m_BlockFile)
+		return nullptr;
+
+	return new MMapDataStorage(m_BlockFile);
+}
+
+
+bool MMapDataStorageManager::Create(const CStringView &FileName, size_t BlockSize, size_t BlockCount, bool Sparse)
+{
+	Close();
+
+	std::shared_ptr<MMapBlockFile> BlockFile = std::make_shared<MMapBlockFile>();
+
+	if (!BlockFile->Create(FileName, BlockSize, BlockCount, Sparse))
+		return false;
+
+	m_BlockFile = std::move(BlockFile);
+
+	return true;
+}
+
+
+void MMapDataStorageManager::Close()
+{
+	// 使用中のブロックがあれば、全て解放された時点でファイルが閉じられる
+	m_BlockFile.reset();
+}
+
+
+bool MMapDataStorageManager::IsCreated() const noexcept
+{
+	return static_cast<bool>(m_BlockFile);
+}
+
+
+size_t MMapDataStorageManager::GetFreeBlockCount() const
+{
+	if (!m_BlockFile)
+		return 0;
+
+	return m_BlockFile->GetFreeBlockCount();
+}
+
+
+}	// namespace LibISDB
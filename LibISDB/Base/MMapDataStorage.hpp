@@ -0,0 +1,155 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   MMapDataStorage.hpp
+ @brief  メモリマップドファイルデータストレージ
+ @author DBCTRADO
+*/
+
+
+#ifndef LIBISDB_MMAP_DATA_STORAGE_H
+#define LIBISDB_MMAP_DATA_STORAGE_H
+
+
+#include "DataStorage.hpp"
+#include "DataStorageManager.hpp"
+#include "../Utilities/Lock.hpp"
+#include <memory>
+#include <vector>
+#ifdef LIBISDB_WINDOWS
+#include "../LibISDBWindows.hpp"
+#endif
+
+
+namespace LibISDB
+{
+
+	/** メモリマップドファイルのブロック管理クラス */
+	class MMapBlockFile
+	{
+	public:
+		typedef DataStorage::SizeType SizeType;
+
+		MMapBlockFile() noexcept;
+		~MMapBlockFile();
+
+		MMapBlockFile(const MMapBlockFile &) = delete;
+		MMapBlockFile & operator = (const MMapBlockFile &) = delete;
+
+		/*
+			既に存在するファイルは上書きせずにエラーとする
+			Sparse が false の場合は全てのブロックの領域を確保し、確保できなければエラーとする。
+			Sparse を true にすると領域は書き込み時に確保されるが、ディスクの空きが無くなった場合
+			マップしたページへの書き込みで SIGBUS (Windows では EXCEPTION_IN_PAGE_ERROR) が発生し、
+			書き込みエラーとして扱うことはできない。
+		*/
+		bool Create(const CStringView &FileName, SizeType BlockSize, size_t BlockCount, bool Sparse);
+		void Close() noexcept;
+		bool IsOpen() const noexcept;
+		const String & GetFileName() const noexcept { return m_FileName; }
+		SizeType GetBlockSize() const noexcept { return m_BlockSize; }
+		size_t GetBlockCount() const noexcept { return m_BlockCount; }
+		size_t GetFreeBlockCount() const;
+		bool IsSparse() const noexcept { return m_Sparse; }
+
+		bool AllocateBlock(ReturnArg<size_t> Index);
+		void FreeBlock(size_t Index) noexcept;
+		uint8_t * MapBlock(size_t Index, size_t Size);
+		void UnmapBlock(uint8_t *pAddress, size_t Size) noexcept;
+
+		static size_t GetAllocationGranularity() noexcept;
+
+	private:
+		bool DiscardBlock(size_t Index) noexcept;
+
+#ifdef LIBISDB_WINDOWS
+		HANDLE m_hFile;
+		HANDLE m_hMapping;
+#else
+		int m_File;
+#endif
+		String m_FileName;
+		SizeType m_BlockSize;
+		size_t m_BlockCount;
+		bool m_Sparse;
+		std::vector<size_t> m_FreeBlockList;
+		mutable MutexLock m_Lock;
+	};
+
+	/** メモリマップドファイルデータストレージクラス */
+	class MMapDataStorage
+		: public DataStorage
+	{
+	public:
+		MMapDataStorage() noexcept;
+		MMapDataStorage(const std::shared_ptr<MMapBlockFile> &BlockFile) noexcept;
+		~MMapDataStorage();
+
+	// DataStorage
+		bool Allocate(SizeType Size) override;
+		void Free() noexcept override;
+		SizeType GetCapacity() const override;
+		SizeType GetDataSize() const override;
+		size_t Read(void *pData, size_t Size) override;
+		size_t Write(const void *pData, size_t Size) override;
+		bool SetPos(SizeType Pos) override;
+		SizeType GetPos() const override;
+
+	// MMapDataStorage
+		bool SetFileName(const StringView &FileName);
+		const String & GetFileName() const noexcept { return m_FileName; }
+		// スパースファイルの危険性については MMapBlockFile::Create() を参照
+		void SetSparse(bool Sparse) noexcept { m_Sparse = Sparse; }
+		bool GetSparse() const noexcept { return m_Sparse; }
+
+	protected:
+		std::shared_ptr<MMapBlockFile> m_BlockFile;
+		bool m_SharedBlockFile;
+		size_t m_BlockIndex;
+		uint8_t *m_pData;
+		size_t m_Capacity;
+		size_t m_DataSize;
+		size_t m_Pos;
+		String m_FileName;
+		bool m_Sparse;
+	};
+
+	/** メモリマップドファイルデータストレージ管理クラス */
+	class MMapDataStorageManager
+		: public DataStorageManager
+	{
+	public:
+	// DataStorageManager
+		DataStorage * CreateDataStorage() override;
+
+	// MMapDataStorageManager
+		bool Create(const CStringView &FileName, size_t BlockSize, size_t BlockCount, bool Sparse = false);
+		void Close();
+		bool IsCreated() const noexcept;
+		size_t GetFreeBlockCount() const;
+
+	protected:
+		std::shared_ptr<MMapBlockFile> m_BlockFile;
+	};
+
+}	// namespace LibISDB
+
+
+#endif	// ifndef LIBISDB_MMAP_DATA_STORAGE_H
@@ -0,0 +1,167 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   MappedFile.cpp
+ @brief  読み込み専用のメモリマップドファイル
+ @author DBCTRADO
+*/
+
+
+#include "../LibISDBPrivate.hpp"
+#include "MappedFile.hpp"
+
+#ifndef LIBISDB_WINDOWS
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "DebugDef.hpp"
+
+
+namespace LibISDB
+{
+
+
+MappedFile::MappedFile() noexcept
+#ifdef LIBISDB_WINDOWS
+	: m_hFile(INVALID_HANDLE_VALUE)
+	, m_hMapping(nullptr)
+#else
+	: m_File(-1)
+#endif
+	, m_pData(nullptr)
+	, m_Size(0)
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+
+bool MappedFile::Open(const CStringView &FileName)
+{
+	Close();
+
+	if (LIBISDB_TRACE_ERROR_IF(FileName.empty()))
+		return false;
+
+#ifdef LIBISDB_WINDOWS
+
+	// 他からの一時ファイルによる置き換えや追記を妨げないようにする
+	m_hFile = ::CreateFile(
+		FileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("CreateFile() failed (%x)\n"), ::GetLastError());
+		return false;
+	}
+
+	LARGE_INTEGER FileSize;
+	if (!::GetFileSizeEx(m_hFile, &FileSize)
+			|| (FileSize.QuadPart <= 0)
+			|| (static_cast<unsigned long long>(FileSize.QuadPart) > std::numeric_limits<size_t>::max())) {
+		Close();
+		return false;
+	}
+
+	m_hMapping = ::CreateFileMapping(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_hMapping == nullptr) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("CreateFileMapping() failed (%x)\n"), ::GetLastError());
+		Close();
+		return false;
+	}
+
+	void *pAddress = ::MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (pAddress == nullptr) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("MapViewOfFile() failed (%x)\n"), ::GetLastError());
+		Close();
+		return false;
+	}
+
+	m_pData = static_cast<const uint8_t *>(pAddress);
+	m_Size = static_cast<size_t>(FileSize.QuadPart);
+
+#else	// LIBISDB_WINDOWS
+
+	m_File = ::open(FileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (m_File < 0) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("open() failed (%d)\n"), errno);
+		return false;
+	}
+
+	struct ::stat Stat;
+	if ((::fstat(m_File, &Stat) != 0)
+			|| (Stat.st_size <= 0)
+			|| (static_cast<unsigned long long>(Stat.st_size) > std::numeric_limits<size_t>::max())) {
+		Close();
+		return false;
+	}
+
+	const size_t Size = static_cast<size_t>(Stat.st_size);
+	void *pAddress = ::mmap(nullptr, Size, PROT_READ, MAP_SHARED, m_File, 0);
+	if (pAddress == MAP_FAILED) {
+		LIBISDB_TRACE_ERROR(LIBISDB_STR("mmap() failed (%d)\n"), errno);
+		Close();
+		return false;
+	}
+
+	m_pData = static_cast<const uint8_t *>(pAddress);
+	m_Size = Size;
+
+#endif	// !LIBISDB_WINDOWS
+
+	return true;
+}
+
+
+void MappedFile::Close() noexcept
+{
+#ifdef LIBISDB_WINDOWS
+	if (m_pData != nullptr)
+		::UnmapViewOfFile(m_pData);
+	if (m_hMapping != nullptr) {
+		::CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE) {
+		::CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_pData != nullptr)
+		::munmap(const_cast<uint8_t *>(m_pData), m_Size);
+	if (m_File >= 0) {
+		::close(m_File);
+		m_File = -1;
+	}
+#endif
+
+	m_pData = nullptr;
+	m_Size = 0;
+}
+
+
+}	// namespace LibISDB
@@ -0,0 +1,73 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   MappedFile.hpp
+ @brief  読み込み専用のメモリマップドファイル
+ @author DBCTRADO
+*/
+
+
+#ifndef LIBISDB_MAPPED_FILE_H
+#define LIBISDB_MAPPED_FILE_H
+
+
+#ifdef LIBISDB_WINDOWS
+#include "../LibISDBWindows.hpp"
+#endif
+
+
+namespace LibISDB
+{
+
+	/**
+		読み込み専用のメモリマップドファイルクラス
+
+		ファイル全体をマップし、アクセスされた部分のみが読み込まれる。
+	*/
+	class MappedFile
+	{
+	public:
+		MappedFile() noexcept;
+		~MappedFile();
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator = (const MappedFile &) = delete;
+
+		bool Open(const CStringView &FileName);
+		void Close() noexcept;
+		bool IsOpen() const noexcept { return m_pData != nullptr; }
+		const uint8_t * GetData() const noexcept { return m_pData; }
+		size_t GetSize() const noexcept { return m_Size; }
+
+	private:
+#ifdef LIBISDB_WINDOWS
+		HANDLE m_hFile;
+		HANDLE m_hMapping;
+#else
+		int m_File;
+#endif
+		const uint8_t *m_pData;
+		size_t m_Size;
+	};
+
+}	// namespace LibISDB
+
+
+#endif	// ifndef LIBISDB_MAPPED_FILE_H
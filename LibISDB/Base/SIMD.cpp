@@ -55,6 +55,7 @@ enum {
 	INSTRUCTION_SSSE3  = 0x00000010U,
 	INSTRUCTION_SSE4_1 = 0x00000020U,
 	INSTRUCTION_SSE4_2 = 0x00000040U,
+	INSTRUCTION_PCLMULQDQ = 0x00000080U,
 };
 
 
@@ -86,6 +87,8 @@ static unsigned int GetSupportedInstructions()
 		Supported |= INSTRUCTION_SSE4_1;
 	if (CPUInfo[2] & 0x00100000)
 		Supported |= INSTRUCTION_SSE4_2;
+	if (CPUInfo[2] & 0x00000002)
+		Supported |= INSTRUCTION_PCLMULQDQ;
 
 	return Supported;
 }
@@ -107,14 +110,16 @@ public:
 			LIBISDB_STR("SSE3 %") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR(" ")
 			LIBISDB_STR("SSSE3 %") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR(" ")
 			LIBISDB_STR("SSE4.1 %") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR(" ")
-			LIBISDB_STR("SSE4.2 %") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR("\n"),
+			LIBISDB_STR("SSE4.2 %") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR(" ")
+			LIBISDB_STR("PCLMULQDQ %") LIBISDB_STR(LIBISDB_PRIS) LIBISDB_STR("\n"),
 			(m_Available & INSTRUCTION_MMX)    ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"),
 			(m_Available & INSTRUCTION_SSE)    ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"),
 			(m_Available & INSTRUCTION_SSE2)   ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"),
 			(m_Available & INSTRUCTION_SSE3)   ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"),
 			(m_Available & INSTRUCTION_SSSE3)  ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"),
 			(m_Available & INSTRUCTION_SSE4_1) ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"),
-			(m_Available & INSTRUCTION_SSE4_2) ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"));
+			(m_Available & INSTRUCTION_SSE4_2) ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"),
+			(m_Available & INSTRUCTION_PCLMULQDQ) ? LIBISDB_STR("avail") : LIBISDB_STR("n/a"));
 	}
 
 	bool IsAvailable(unsigned int Instruction) const
@@ -174,6 +179,26 @@ void SetSSE2Enabled(bool Enabled)
 }
 
 
+// CRC の計算には PCLMULQDQ の他に SSSE3 の命令も使用する
+
+bool IsPCLMULQDQAvailable()
+{
+	return g_CPUIdentify.IsAvailable(INSTRUCTION_PCLMULQDQ | INSTRUCTION_SSSE3);
+}
+
+
+bool IsPCLMULQDQEnabled()
+{
+	return g_CPUIdentify.IsEnabled(INSTRUCTION_PCLMULQDQ | INSTRUCTION_SSSE3);
+}
+
+
+void SetPCLMULQDQEnabled(bool Enabled)
+{
+	g_CPUIdentify.SetEnabled(INSTRUCTION_PCLMULQDQ, Enabled);
+}
+
+
 #endif	// defined(LIBISDB_X86) || defined(LIBISDB_X64)
 
 
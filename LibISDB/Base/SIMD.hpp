@@ -84,6 +84,10 @@ namespace LibISDB
 	bool IsSSE2Enabled();
 #endif
 	void SetSSE2Enabled(bool Enabled);
+
+	bool IsPCLMULQDQAvailable();
+	bool IsPCLMULQDQEnabled();
+	void SetPCLMULQDQEnabled(bool Enabled);
 #endif
 
 }	// namespace LibISDB
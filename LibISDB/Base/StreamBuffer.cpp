@@ -38,6 +38,12 @@ StreamBuffer::StreamBuffer() noexcept
 	, m_MinBlockCount(0)
 	, m_MaxBlockCount(0)
 	, m_SerialPos(0)
+	, m_BufferType(BufferType::Queue)
+	, m_RingSize(0)
+	, m_RingBeginPos(0)
+	, m_RingEndPos(0)
+	, m_pRingReader(nullptr)
+	, m_RingReaderPos(POS_INVALID)
 {
 }
 
@@ -50,7 +56,7 @@ StreamBuffer::~StreamBuffer()
 
 bool StreamBuffer::Create(
 	size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount,
-	DataStorageManager *pDataStorageManager)
+	DataStorageManager *pDataStorageManager, BufferType Type)
 {
 	LIBISDB_TRACE(
 		LIBISDB_STR("StreamBuffer::Create() : %zu bytes (%zu - %zu blocks)\n"),
@@ -59,18 +65,61 @@ bool StreamBuffer::Create(
 	if (!CheckBufferSize(BlockSize, MinBlockCount, MaxBlockCount))
 		return false;
 
-	BlockLock Lock(m_Lock);
+	// リングバッファはメモリ上に連続した領域を確保するため DataStorageManager は使用できない
+	if (LIBISDB_TRACE_ERROR_IF((Type == BufferType::LockFreeRing) && (pDataStorageManager != nullptr)))
+		return false;
 
-	m_BlockSize = BlockSize;
-	m_MinBlockCount = MinBlockCount;
-	m_MaxBlockCount = MaxBlockCount;
-	m_Queue.clear();
-	m_SerialPos = 0;
+	if (Type == BufferType::LockFreeRing) {
+		BlockLock Lock(m_Lock);
 
+		m_BlockSize = BlockSize;
+		m_MinBlockCount = MinBlockCount;
+		m_MaxBlockCount = MaxBlockCount;
+		m_Queue.clear();
+		m_SerialPos = 0;
+		m_BufferType = Type;
+		ResetRing();
+
+		if (!AllocateRing(BlockSize * MaxBlockCount)) {
+			m_BlockSize = 0;
+			m_MinBlockCount = 0;
+			m_MaxBlockCount = 0;
+			m_BufferType = BufferType::Queue;
+			return false;
+		}
+		m_DataStorageManager.reset();
+		return true;
+	}
+
+	std::shared_ptr<DataStorageManager> StorageManager;
 	if (pDataStorageManager != nullptr)
-		m_DataStorageManager.reset(pDataStorageManager);
+		StorageManager.reset(pDataStorageManager);
 	else
-		m_DataStorageManager = std::make_shared<MemoryDataStorageManager>();
+		StorageManager = std::make_shared<MemoryDataStorageManager>();
+
+	InitializeQueue(BlockSize, MinBlockCount, MaxBlockCount, std::move(StorageManager));
+
+	return true;
+}
+
+
+bool StreamBuffer::Create(
+	size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount,
+	const std::shared_ptr<DataStorageManager> &StorageManager)
+{
+	LIBISDB_TRACE(
+		LIBISDB_STR("StreamBuffer::Create() : %zu bytes (%zu - %zu blocks, shared storage)\n"),
+		BlockSize, MinBlockCount, MaxBlockCount);
+
+	if (LIBISDB_TRACE_ERROR_IF(!StorageManager))
+		return false;
+
+	if (!CheckBufferSize(BlockSize, MinBlockCount, MaxBlockCount))
+		return false;
+
+	InitializeQueue(
+		BlockSize, MinBlockCount, MaxBlockCount,
+		std::shared_ptr<DataStorageManager>(StorageManager));
 
 	return true;
 }
@@ -86,6 +135,8 @@ void StreamBuffer::Destroy()
 	m_MaxBlockCount = 0;
 	m_SerialPos = 0;
 	m_DataStorageManager.reset();
+	ResetRing();
+	m_BufferType = BufferType::Queue;
 }
 
 
@@ -97,6 +148,11 @@ bool StreamBuffer::IsCreated() const noexcept
 
 void StreamBuffer::Clear()
 {
+	if (IsRing()) {
+		AdvanceRingBeginPos(m_RingEndPos.load(std::memory_order_acquire));
+		return;
+	}
+
 	BlockLock Lock(m_Lock);
 
 	m_Queue.clear();
@@ -114,6 +170,36 @@ bool StreamBuffer::SetSize(size_t BlockSize, size_t MinBlockCount, size_t MaxBlo
 
 	BlockLock Lock(m_Lock);
 
+	if (IsRing()) {
+		// 書き込み・読み込み中に呼ばれないことが前提
+		const size_t RingSize = BlockSize * MaxBlockCount;
+
+		if (RingSize != m_RingSize) {
+			std::unique_ptr<uint8_t[]> OldBuffer(std::move(m_RingBuffer));
+			const size_t OldSize = m_RingSize;
+			const PosType End = m_RingEndPos.load(std::memory_order_relaxed);
+			PosType Begin = m_RingBeginPos.load(std::memory_order_relaxed);
+			if (End - Begin > static_cast<PosType>(RingSize))
+				Begin = End - RingSize;
+
+			if (!AllocateRing(RingSize)) {
+				m_RingBuffer = std::move(OldBuffer);
+				m_RingSize = OldSize;
+				return false;
+			}
+
+			for (PosType Pos = Begin; Pos < End; Pos++)
+				m_RingBuffer[static_cast<size_t>(Pos % RingSize)] = OldBuffer[static_cast<size_t>(Pos % OldSize)];
+			m_RingBeginPos.store(Begin, std::memory_order_release);
+		}
+
+		m_BlockSize = BlockSize;
+		m_MinBlockCount = MinBlockCount;
+		m_MaxBlockCount = MaxBlockCount;
+
+		return true;
+	}
+
 	if (m_BlockSize != BlockSize) {
 		m_BlockSize = BlockSize;
 		m_MinBlockCount = MinBlockCount;
@@ -163,6 +249,9 @@ bool StreamBuffer::SetSize(size_t BlockSize, size_t MinBlockCount, size_t MaxBlo
 
 bool StreamBuffer::IsEmpty() const
 {
+	if (IsRing())
+		return m_RingBeginPos.load(std::memory_order_acquire) >= m_RingEndPos.load(std::memory_order_acquire);
+
 	BlockLock Lock(m_Lock);
 
 	return m_Queue.empty();
@@ -171,6 +260,9 @@ bool StreamBuffer::IsEmpty() const
 
 bool StreamBuffer::IsFull() const
 {
+	if (IsRing())
+		return GetRingFreeSpace() == 0;
+
 	BlockLock Lock(m_Lock);
 
 	if (m_MaxBlockCount == 0)
@@ -184,6 +276,9 @@ bool StreamBuffer::IsFull() const
 
 size_t StreamBuffer::GetFreeSpace() const
 {
+	if (IsRing())
+		return GetRingFreeSpace();
+
 	BlockLock Lock(m_Lock);
 
 	size_t Free = 0;
@@ -229,6 +324,9 @@ size_t StreamBuffer::PushBack(const uint8_t *pData, size_t DataSize)
 	if (m_BlockSize == 0)
 		return 0;
 
+	if (IsRing())
+		return PushBackRing(pData, DataSize);
+
 	BlockLock Lock(m_Lock);
 
 	size_t Pos = 0;
@@ -320,6 +418,9 @@ StreamBuffer::QueueBlock * StreamBuffer::GetBlockBySerialPos(PosType Pos)
 
 bool StreamBuffer::SetReaderPos(Reader *pReader, PosType Pos)
 {
+	if (IsRing())
+		return SetRingReaderPos(pReader, Pos);
+
 	BlockLock Lock(m_Lock);
 
 	m_ReaderPosList.insert_or_assign(pReader, Pos);
@@ -332,6 +433,9 @@ bool StreamBuffer::SetReaderPos(Reader *pReader, PosType Pos)
 
 bool StreamBuffer::ResetReaderPos(Reader *pReader)
 {
+	if (IsRing())
+		return ResetRingReaderPos(pReader);
+
 	BlockLock Lock(m_Lock);
 
 	auto it = m_ReaderPosList.find(pReader);
@@ -348,6 +452,9 @@ bool StreamBuffer::ResetReaderPos(Reader *pReader)
 
 StreamBuffer::PosType StreamBuffer::GetBeginPos() const
 {
+	if (IsRing())
+		return m_RingBeginPos.load(std::memory_order_acquire);
+
 	BlockLock Lock(m_Lock);
 
 	if (m_Queue.empty())
@@ -359,6 +466,9 @@ StreamBuffer::PosType StreamBuffer::GetBeginPos() const
 
 StreamBuffer::PosType StreamBuffer::GetEndPos() const
 {
+	if (IsRing())
+		return m_RingEndPos.load(std::memory_order_acquire);
+
 	BlockLock Lock(m_Lock);
 
 	if (m_Queue.empty())
@@ -370,6 +480,14 @@ StreamBuffer::PosType StreamBuffer::GetEndPos() const
 
 bool StreamBuffer::GetDataRange(ReturnArg<PosType> Begin, ReturnArg<PosType> End) const
 {
+	if (IsRing()) {
+		const PosType EndPos = m_RingEndPos.load(std::memory_order_acquire);
+		const PosType BeginPos = m_RingBeginPos.load(std::memory_order_acquire);
+		Begin = BeginPos;
+		End = EndPos;
+		return EndPos > BeginPos;
+	}
+
 	BlockLock Lock(m_Lock);
 
 	if (m_Queue.empty()) {
@@ -411,6 +529,9 @@ void StreamBuffer::FreeUnusedBlocks()
 
 size_t StreamBuffer::Read(PosType *pPos, void *pBuffer, size_t Size)
 {
+	if (IsRing())
+		return ReadRing(pPos, pBuffer, Size);
+
 	BlockLock Lock(m_Lock);
 
 	PosType Pos = *pPos;
@@ -452,6 +573,177 @@ size_t StreamBuffer::Read(PosType *pPos, void *pBuffer, size_t Size)
 }
 
 
+bool StreamBuffer::AllocateRing(size_t Size)
+{
+	m_RingBuffer.reset(new(std::nothrow) uint8_t[Size]);
+	if (!m_RingBuffer) {
+		m_RingSize = 0;
+		return false;
+	}
+
+	m_RingSize = Size;
+
+	return true;
+}
+
+
+void StreamBuffer::ResetRing()
+{
+	m_RingBuffer.reset();
+	m_RingSize = 0;
+	m_RingBeginPos.store(0, std::memory_order_relaxed);
+	m_RingEndPos.store(0, std::memory_order_relaxed);
+	m_pRingReader.store(nullptr, std::memory_order_relaxed);
+	m_RingReaderPos.store(POS_INVALID, std::memory_order_relaxed);
+}
+
+
+size_t StreamBuffer::GetRingFreeSpace() const
+{
+	const PosType ReaderPos = m_RingReaderPos.load(std::memory_order_acquire);
+	if (ReaderPos < 0)
+		return m_RingSize;
+
+	const PosType End = m_RingEndPos.load(std::memory_order_acquire);
+	const PosType Begin = std::max(ReaderPos, m_RingBeginPos.load(std::memory_order_acquire));
+	if (End - Begin >= static_cast<PosType>(m_RingSize))
+		return 0;
+	if (End <= Begin)
+		return m_RingSize;
+
+	return m_RingSize - static_cast<size_t>(End - Begin);
+}
+
+
+/*
+	リングバッファへの書き込み
+
+	読み込み位置が設定されている場合は未読のデータを上書きしない。
+	上書きする範囲は書き込む前に開始位置を進めて無効にし、
+	ReadRing() は読み込み後に開始位置を再確認して上書きされたデータを破棄する。
+*/
+size_t StreamBuffer::PushBackRing(const uint8_t *pData, size_t DataSize)
+{
+	const PosType RingSize = static_cast<PosType>(m_RingSize);
+	const PosType End = m_RingEndPos.load(std::memory_order_relaxed);
+	const PosType ReaderPos = m_RingReaderPos.load(std::memory_order_acquire);
+	size_t WriteSize = DataSize;
+
+	if (ReaderPos >= 0) {
+		const PosType Limit = std::max(ReaderPos, m_RingBeginPos.load(std::memory_order_acquire)) + RingSize;
+		if (Limit <= End)
+			return 0;
+		if (static_cast<PosType>(WriteSize) > Limit - End)
+			WriteSize = static_cast<size_t>(Limit - End);
+	}
+
+	// 読み込み位置が無い場合は、バッファに収まらない分の先頭を捨てる
+	size_t Skip = 0;
+	if (WriteSize > m_RingSize) {
+		Skip = WriteSize - m_RingSize;
+	}
+
+	const PosType NewEnd = End + static_cast<PosType>(WriteSize);
+
+	AdvanceRingBeginPos(NewEnd - RingSize);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const uint8_t *pSrc = pData + Skip;
+	size_t Remain = WriteSize - Skip;
+	size_t Offset = static_cast<size_t>((End + static_cast<PosType>(Skip)) % RingSize);
+	while (Remain > 0) {
+		const size_t CopySize = std::min(Remain, m_RingSize - Offset);
+		std::memcpy(&m_RingBuffer[Offset], pSrc, CopySize);
+		pSrc += CopySize;
+		Remain -= CopySize;
+		Offset = 0;
+	}
+
+	m_RingEndPos.store(NewEnd, std::memory_order_release);
+
+	return WriteSize;
+}
+
+
+bool StreamBuffer::SetRingReaderPos(Reader *pReader, PosType Pos)
+{
+	Reader *pCurReader = m_pRingReader.load(std::memory_order_acquire);
+
+	if (pCurReader != pReader) {
+		// リングバッファの読み込みは一つのみ
+		if (pCurReader != nullptr)
+			return false;
+		if (!m_pRingReader.compare_exchange_strong(pCurReader, pReader, std::memory_order_acq_rel))
+			return false;
+	}
+
+	m_RingReaderPos.store(Pos, std::memory_order_release);
+
+	return true;
+}
+
+
+bool StreamBuffer::ResetRingReaderPos(Reader *pReader)
+{
+	if (m_pRingReader.load(std::memory_order_acquire) != pReader)
+		return false;
+
+	m_RingReaderPos.store(POS_INVALID, std::memory_order_release);
+	m_pRingReader.store(nullptr, std::memory_order_release);
+
+	return true;
+}
+
+
+void StreamBuffer::AdvanceRingBeginPos(PosType Pos)
+{
+	PosType Begin = m_RingBeginPos.load(std::memory_order_relaxed);
+
+	while (Begin < Pos) {
+		if (m_RingBeginPos.compare_exchange_weak(Begin, Pos, std::memory_order_relaxed))
+			break;
+	}
+}
+
+
+size_t StreamBuffer::ReadRing(PosType *pPos, void *pBuffer, size_t Size)
+{
+	const PosType RingSize = static_cast<PosType>(m_RingSize);
+	uint8_t *pDst = static_cast<uint8_t *>(pBuffer);
+	PosType Pos = *pPos;
+
+	for (;;) {
+		const PosType End = m_RingEndPos.load(std::memory_order_acquire);
+		const PosType Begin = m_RingBeginPos.load(std::memory_order_acquire);
+
+		if (Pos < Begin)
+			Pos = Begin;
+		if (Pos >= End) {
+			if (Pos != *pPos)
+				*pPos = Pos;
+			return 0;
+		}
+
+		const size_t ReadSize = static_cast<size_t>(std::min(static_cast<PosType>(Size), End - Pos));
+		size_t Offset = static_cast<size_t>(Pos % RingSize);
+		size_t Copied = 0;
+		while (Copied < ReadSize) {
+			const size_t CopySize = std::min(ReadSize - Copied, m_RingSize - Offset);
+			std::memcpy(pDst + Copied, &m_RingBuffer[Offset], CopySize);
+			Copied += CopySize;
+			Offset = 0;
+		}
+
+		// 読み込み中に上書きされていないか確認する
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_RingBeginPos.load(std::memory_order_relaxed) <= Pos) {
+			*pPos = Pos + static_cast<PosType>(ReadSize);
+			return ReadSize;
+		}
+	}
+}
+
+
 bool StreamBuffer::CheckBufferSize(size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount)
 {
 	if ((BlockSize == 0) || (MaxBlockCount == 0))
@@ -464,6 +756,23 @@ bool StreamBuffer::CheckBufferSize(size_t BlockSize, size_t MinBlockCount, size_
 }
 
 
+void StreamBuffer::InitializeQueue(
+	size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount,
+	std::shared_ptr<DataStorageManager> &&StorageManager)
+{
+	BlockLock Lock(m_Lock);
+
+	m_BlockSize = BlockSize;
+	m_MinBlockCount = MinBlockCount;
+	m_MaxBlockCount = MaxBlockCount;
+	m_Queue.clear();
+	m_SerialPos = 0;
+	m_BufferType = BufferType::Queue;
+	ResetRing();
+	m_DataStorageManager = std::move(StorageManager);
+}
+
+
 
 
 StreamBuffer::QueueBlock::QueueBlock() noexcept
@@ -629,7 +938,11 @@ bool StreamBuffer::SequentialReader::Open(const std::shared_ptr<StreamBuffer> &B
 		return false;
 
 	m_Pos = m_Buffer->GetBeginPos();
-	m_Buffer->SetReaderPos(this, m_Pos);
+	if (!m_Buffer->SetReaderPos(this, m_Pos)) {
+		m_Pos = StreamBuffer::POS_INVALID;
+		Reader::Close();
+		return false;
+	}
 
 	return true;
 }
@@ -718,6 +1031,25 @@ bool StreamBuffer::SequentialReader::IsDataAvailable() const
 }
 
 
+size_t StreamBuffer::SequentialReader::GetAvailableSize() const
+{
+	if (m_Pos == StreamBuffer::POS_INVALID)
+		return 0;
+
+	PosType Begin, End;
+
+	if (!m_Buffer->GetDataRange(&Begin, &End))
+		return 0;
+
+	if ((m_Pos == StreamBuffer::POS_BEGIN) || (m_Pos < Begin))
+		return static_cast<size_t>(End - Begin);
+	if (End <= m_Pos)
+		return 0;
+
+	return static_cast<size_t>(End - m_Pos);
+}
+
+
 void StreamBuffer::SequentialReader::ResetPos()
 {
 	if (m_Buffer)
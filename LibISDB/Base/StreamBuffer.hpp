@@ -34,6 +34,7 @@
 #include <memory>
 #include <deque>
 #include <map>
+#include <atomic>
 
 
 namespace LibISDB
@@ -48,6 +49,12 @@ namespace LibISDB
 		static constexpr PosType POS_BEGIN   = -1;
 		static constexpr PosType POS_INVALID = -2;
 
+		/** バッファの種類 */
+		enum class BufferType {
+			Queue,        /**< ブロックのキュー */
+			LockFreeRing, /**< ロックフリーのリングバッファ(書き込み・読み込みともに単一スレッド) */
+		};
+
 		class Reader
 		{
 		public:
@@ -79,6 +86,7 @@ namespace LibISDB
 			bool SeekToBegin() override;
 			bool SeekToEnd() override;
 			bool IsDataAvailable() const override;
+			size_t GetAvailableSize() const;
 
 		protected:
 			void ResetPos();
@@ -91,7 +99,11 @@ namespace LibISDB
 
 		bool Create(
 			size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount,
-			DataStorageManager *pDataStorageManager = nullptr);
+			DataStorageManager *pDataStorageManager = nullptr,
+			BufferType Type = BufferType::Queue);
+		bool Create(
+			size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount,
+			const std::shared_ptr<DataStorageManager> &StorageManager);
 		void Destroy();
 		bool IsCreated() const noexcept;
 		void Clear();
@@ -102,6 +114,7 @@ namespace LibISDB
 		size_t GetBlockSize() const noexcept { return m_BlockSize; }
 		size_t GetMinBlockCount() const noexcept { return m_MinBlockCount; }
 		size_t GetMaxBlockCount() const noexcept { return m_MaxBlockCount; }
+		BufferType GetBufferType() const noexcept { return m_BufferType; }
 
 		size_t PushBack(const uint8_t *pData, size_t DataSize);
 		size_t PushBack(const DataBuffer *pData);
@@ -147,6 +160,19 @@ namespace LibISDB
 		void FreeUnusedBlocks();
 		size_t Read(PosType *pPos, void *pBuffer, size_t Size);
 
+		bool IsRing() const noexcept { return m_BufferType == BufferType::LockFreeRing; }
+		bool AllocateRing(size_t Size);
+		void ResetRing();
+		size_t GetRingFreeSpace() const;
+		size_t PushBackRing(const uint8_t *pData, size_t DataSize);
+		bool SetRingReaderPos(Reader *pReader, PosType Pos);
+		bool ResetRingReaderPos(Reader *pReader);
+		void AdvanceRingBeginPos(PosType Pos);
+		size_t ReadRing(PosType *pPos, void *pBuffer, size_t Size);
+
+		void InitializeQueue(
+			size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount,
+			std::shared_ptr<DataStorageManager> &&StorageManager);
 		static bool CheckBufferSize(size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount);
 
 		size_t m_BlockSize;
@@ -157,6 +183,14 @@ namespace LibISDB
 		mutable MutexLock m_Lock;
 		std::shared_ptr<DataStorageManager> m_DataStorageManager;
 		std::map<Reader *, PosType> m_ReaderPosList;
+
+		BufferType m_BufferType;
+		std::unique_ptr<uint8_t[]> m_RingBuffer;
+		size_t m_RingSize;
+		std::atomic<PosType> m_RingBeginPos;
+		std::atomic<PosType> m_RingEndPos;
+		std::atomic<Reader *> m_pRingReader;
+		std::atomic<PosType> m_RingReaderPos;
 	};
 
 }	// namespace LibISDB
@@ -37,6 +37,13 @@ StreamingThread::StreamingThread()
 	: m_StreamingThreadEndSignal(false)
 	, m_StreamingThreadTimeout(10 * 1000)
 	, m_StreamingThreadIdleWait(10)
+	, m_StreamingThreadEventWait(500)
+	, m_StreamingThreadFlushDelay(20)
+	, m_StreamingThreadWakeupWatermark(0)
+	, m_StreamingThreadPendingSize(0)
+	, m_StreamingThreadSignaled(false)
+	, m_StreamingThreadWaiting(false)
+	, m_StreamingThreadIdle(false)
 {
 }
 
@@ -65,6 +72,10 @@ void StreamingThread::StopStreamingThread()
 {
 	if (IsStarted()) {
 		m_StreamingThreadEndSignal.store(true, std::memory_order_release);
+		{
+			// 待機に入る直前の通知が失われないようにする
+			BlockLock Lock(m_StreamingThreadLock);
+		}
 		m_StreamingThreadCondition.NotifyOne();
 
 		if (!((m_StreamingThreadTimeout.count() > 0) ? Wait(m_StreamingThreadTimeout) : Wait())) {
@@ -99,11 +110,44 @@ void StreamingThread::StreamingLoop()
 {
 	LockGuard Lock(m_StreamingThreadLock);
 	std::chrono::milliseconds Wait(0);
+	bool DataArrived = false;
 
 	for (;;) {
-		m_StreamingThreadCondition.WaitFor(m_StreamingThreadLock, Wait);
+		const bool EventWait = (Wait.count() > 0) && IsStreamingThreadEventDriven();
+
+		if (EventWait) {
+			// 通知があるまで待つ。
+			// 前回の待機中にデータが来ていれば、watermark に満たなくても一定時間で処理する。
+			// データが来ていなければ長めに待ち、最初のデータが来た時点で通知を受ける。
+			bool Idle = !DataArrived;
+			if (Idle) {
+				m_StreamingThreadIdle.store(true, std::memory_order_seq_cst);
+				if (m_StreamingThreadPendingSize.load(std::memory_order_seq_cst) > 0) {
+					m_StreamingThreadIdle.store(false, std::memory_order_relaxed);
+					Idle = false;
+				}
+			}
+			m_StreamingThreadWaiting.store(true, std::memory_order_seq_cst);
+			m_StreamingThreadCondition.WaitFor(
+				m_StreamingThreadLock, Idle ? m_StreamingThreadEventWait : m_StreamingThreadFlushDelay,
+				[this]() -> bool {
+					return m_StreamingThreadSignaled.load(std::memory_order_seq_cst)
+						|| m_StreamingThreadEndSignal.load(std::memory_order_acquire);
+				});
+			m_StreamingThreadWaiting.store(false, std::memory_order_relaxed);
+			m_StreamingThreadIdle.store(false, std::memory_order_relaxed);
+		} else {
+			m_StreamingThreadCondition.WaitFor(m_StreamingThreadLock, Wait);
+		}
 		if (m_StreamingThreadEndSignal.load(std::memory_order_acquire))
 			break;
+		// 待機中にデータが来たか
+		const bool Signaled = m_StreamingThreadSignaled.exchange(false, std::memory_order_relaxed);
+		const bool Arrived = (m_StreamingThreadPendingSize.exchange(0, std::memory_order_relaxed) > 0) || Signaled;
+		if (EventWait)
+			DataArrived = Arrived;
+		else
+			DataArrived |= Arrived;
 		Lock.Unlock();
 
 		if (ProcessStream()) {
@@ -117,4 +161,52 @@ void StreamingThread::StreamingLoop()
 }
 
 
+void StreamingThread::SetStreamingThreadWakeupWatermark(size_t Watermark)
+{
+	m_StreamingThreadWakeupWatermark.store(Watermark, std::memory_order_release);
+	m_StreamingThreadPendingSize.store(0, std::memory_order_relaxed);
+}
+
+
+bool StreamingThread::IsStreamingThreadEventDriven() const noexcept
+{
+	return m_StreamingThreadWakeupWatermark.load(std::memory_order_acquire) > 0;
+}
+
+
+bool StreamingThread::AddStreamingThreadPendingSize(size_t Size)
+{
+	const size_t Watermark = m_StreamingThreadWakeupWatermark.load(std::memory_order_acquire);
+	if (Watermark == 0)
+		return false;
+
+	const size_t PendingSize = m_StreamingThreadPendingSize.fetch_add(Size, std::memory_order_seq_cst);
+	if (PendingSize + Size < Watermark) {
+		// 待機中のスレッドが長めに待っている場合は、最初のデータで起こす
+		return (PendingSize == 0) && (Size > 0)
+			&& m_StreamingThreadIdle.load(std::memory_order_seq_cst);
+	}
+
+	m_StreamingThreadPendingSize.store(0, std::memory_order_relaxed);
+
+	return true;
+}
+
+
+void StreamingThread::NotifyStreamingThread(size_t Size)
+{
+	if (!AddStreamingThreadPendingSize(Size))
+		return;
+
+	m_StreamingThreadSignaled.store(true, std::memory_order_seq_cst);
+
+	if (m_StreamingThreadWaiting.load(std::memory_order_seq_cst)) {
+		{
+			BlockLock Lock(m_StreamingThreadLock);
+		}
+		m_StreamingThreadCondition.NotifyOne();
+	}
+}
+
+
 }	// namespace LibISDB
@@ -54,11 +54,23 @@ namespace LibISDB
 		virtual void StreamingLoop();
 		virtual bool ProcessStream() = 0;
 
+		void SetStreamingThreadWakeupWatermark(size_t Watermark);
+		bool IsStreamingThreadEventDriven() const noexcept;
+		bool AddStreamingThreadPendingSize(size_t Size);
+		void NotifyStreamingThread(size_t Size);
+
 		MutexLock m_StreamingThreadLock;
 		ConditionVariable m_StreamingThreadCondition;
 		std::atomic<bool> m_StreamingThreadEndSignal;
 		std::chrono::milliseconds m_StreamingThreadTimeout;
 		std::chrono::milliseconds m_StreamingThreadIdleWait;
+		std::chrono::milliseconds m_StreamingThreadEventWait;
+		std::chrono::milliseconds m_StreamingThreadFlushDelay;
+		std::atomic<size_t> m_StreamingThreadWakeupWatermark;
+		std::atomic<size_t> m_StreamingThreadPendingSize;
+		std::atomic<bool> m_StreamingThreadSignaled;
+		std::atomic<bool> m_StreamingThreadWaiting;
+		std::atomic<bool> m_StreamingThreadIdle;
 	};
 
 }	// namespace LibISDB
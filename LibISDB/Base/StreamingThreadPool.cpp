@@ -0,0 +1,345 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   StreamingThreadPool.cpp
+ @brief  ストリーミングスレッドプール
+ @author DBCTRADO
+*/
+
+
+#include "../LibISDBPrivate.hpp"
+#include "StreamingThreadPool.hpp"
+#include <algorithm>
+#include "DebugDef.hpp"
+
+
+namespace LibISDB
+{
+
+
+namespace
+{
+
+// 現在のスレッドで処理中のタスク
+thread_local const void *g_pCurrentPool = nullptr;
+thread_local const void *g_pCurrentTask = nullptr;
+
+}
+
+
+
+
+StreamingThreadPool::StreamingThreadPool() noexcept
+	: m_EndSignal(false)
+	, m_DelayedCount(0)
+{
+}
+
+
+StreamingThreadPool::~StreamingThreadPool()
+{
+	Stop();
+}
+
+
+bool StreamingThreadPool::Start(size_t ThreadCount)
+{
+	if (LIBISDB_TRACE_ERROR_IF(ThreadCount == 0))
+		return false;
+
+	LockGuard Lock(m_Lock);
+
+	if (!m_ThreadList.empty())
+		return false;
+
+	m_EndSignal = false;
+
+	for (size_t i = 0; i < ThreadCount; i++) {
+		std::unique_ptr<WorkerThread> Worker = std::make_unique<WorkerThread>(this, i);
+		if (!Worker->Start()) {
+			Lock.Unlock();
+			Stop();
+			return false;
+		}
+		m_ThreadList.emplace_back(std::move(Worker));
+	}
+
+	return true;
+}
+
+
+void StreamingThreadPool::Stop()
+{
+	std::vector<std::unique_ptr<WorkerThread>> ThreadList;
+
+	{
+		BlockLock Lock(m_Lock);
+
+		m_EndSignal = true;
+		m_QueueCondition.NotifyAll();
+		ThreadList.swap(m_ThreadList);
+	}
+
+	for (auto &Worker : ThreadList) {
+		Worker->Wait();
+		Worker->Stop();
+	}
+}
+
+
+bool StreamingThreadPool::IsStarted() const
+{
+	BlockLock Lock(m_Lock);
+
+	return !m_ThreadList.empty();
+}
+
+
+size_t StreamingThreadPool::GetThreadCount() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_ThreadList.size();
+}
+
+
+bool StreamingThreadPool::AddTask(Task *pTask)
+{
+	if (LIBISDB_TRACE_ERROR_IF(pTask == nullptr))
+		return false;
+
+	BlockLock Lock(m_Lock);
+
+	auto Result = m_TaskList.emplace(pTask, TaskState());
+	if (!Result.second)
+		return false;
+
+	pTask->m_Scheduled.store(false, std::memory_order_relaxed);
+	pTask->m_DelayScheduled.store(false, std::memory_order_relaxed);
+	EnqueueTask(pTask, Result.first->second);
+
+	return true;
+}
+
+
+bool StreamingThreadPool::RemoveTask(Task *pTask)
+{
+	BlockLock Lock(m_Lock);
+
+	auto it = m_TaskList.find(pTask);
+	if ((it == m_TaskList.end()) || it->second.Removed)
+		return false;
+
+	it->second.Removed = true;
+	CancelDelay(it->second);
+
+	if (it->second.Queued) {
+		auto itQueue = std::find(m_Queue.begin(), m_Queue.end(), pTask);
+		if (itQueue != m_Queue.end())
+			m_Queue.erase(itQueue);
+	}
+
+	if (it->second.Running && (g_pCurrentPool == this) && (g_pCurrentTask == pTask)) {
+		// タスク自身から呼ばれた場合は、待つとデッドロックするため処理が終わった時点で取り除く
+		it->second.EraseOnFinish = true;
+		return true;
+	}
+
+	// 処理中であれば終わるまで待つ
+	m_TaskCondition.Wait(m_Lock, [&]() -> bool { return !it->second.Running; });
+
+	m_TaskList.erase(it);
+
+	return true;
+}
+
+
+void StreamingThreadPool::NotifyTask(Task *pTask)
+{
+	// 既に処理待ちであれば何もしない
+	if (pTask->m_Scheduled.exchange(true, std::memory_order_acq_rel))
+		return;
+
+	BlockLock Lock(m_Lock);
+
+	auto it = m_TaskList.find(pTask);
+	if (it != m_TaskList.end())
+		EnqueueTask(pTask, it->second);
+}
+
+
+void StreamingThreadPool::NotifyTaskDelayed(Task *pTask, const std::chrono::milliseconds &Delay)
+{
+	// 既に処理待ちか、遅延通知済みであれば何もしない
+	if (pTask->m_Scheduled.load(std::memory_order_acquire)
+			|| pTask->m_DelayScheduled.exchange(true, std::memory_order_acq_rel))
+		return;
+
+	BlockLock Lock(m_Lock);
+
+	auto it = m_TaskList.find(pTask);
+	if ((it == m_TaskList.end()) || it->second.Removed || it->second.Delayed)
+		return;
+
+	it->second.Delayed = true;
+	it->second.Deadline = m_Clock.Get() + static_cast<TickClock::ClockType>(Delay.count()) * (TickClock::ClocksPerSec / 1000);
+	m_DelayedCount++;
+
+	// 期限なしで待機しているスレッドを起こし、待機時間を設定し直させる
+	m_QueueCondition.NotifyOne();
+}
+
+
+void StreamingThreadPool::EnqueueTask(Task *pTask, TaskState &State)
+{
+	if (State.Queued || State.Running || State.Removed)
+		return;
+
+	State.Queued = true;
+	m_Queue.push_back(pTask);
+	m_QueueCondition.NotifyOne();
+}
+
+
+void StreamingThreadPool::CancelDelay(TaskState &State)
+{
+	if (State.Delayed) {
+		State.Delayed = false;
+		m_DelayedCount--;
+	}
+}
+
+
+TickClock::ClockType StreamingThreadPool::EnqueueDelayedTasks()
+{
+	// 期限が来たタスクを待ち行列に追加し、次の期限を返す
+	const TickClock::ClockType Now = m_Clock.Get();
+	TickClock::ClockType Next = 0;
+
+	for (auto &e : m_TaskList) {
+		TaskState &State = e.second;
+		if (!State.Delayed)
+			continue;
+		if (State.Deadline <= Now) {
+			CancelDelay(State);
+			// 処理中であれば終わった後に再度処理させる
+			e.first->m_Scheduled.store(true, std::memory_order_release);
+			EnqueueTask(e.first, State);
+		} else if ((Next == 0) || (State.Deadline < Next)) {
+			Next = State.Deadline;
+		}
+	}
+
+	return Next;
+}
+
+
+void StreamingThreadPool::WorkerLoop()
+{
+	LockGuard Lock(m_Lock);
+
+	while (!m_EndSignal) {
+		if (m_Queue.empty()) {
+			if (m_DelayedCount == 0) {
+				// 処理するものが無ければ通知があるまで待つ
+				m_QueueCondition.Wait(m_Lock);
+			} else {
+				const TickClock::ClockType Next = EnqueueDelayedTasks();
+				const TickClock::ClockType Now = m_Clock.Get();
+				if (m_Queue.empty() && (Next > Now)) {
+					// 次の期限まで待つ
+					const TickClock::ClockType ClocksPerMs = TickClock::ClocksPerSec / 1000;
+					m_QueueCondition.WaitFor(
+						m_Lock,
+						std::chrono::milliseconds((Next - Now + ClocksPerMs - 1) / ClocksPerMs));
+				}
+			}
+			continue;
+		}
+
+		Task *pTask = m_Queue.front();
+		m_Queue.pop_front();
+
+		TaskState &State = m_TaskList[pTask];
+		State.Queued = false;
+		State.Running = true;
+		// 処理中に読み込まれるため、遅延通知は取り消す
+		CancelDelay(State);
+		pTask->m_Scheduled.store(false, std::memory_order_release);
+		pTask->m_DelayScheduled.store(false, std::memory_order_release);
+
+		Lock.Unlock();
+
+		g_pCurrentPool = this;
+		g_pCurrentTask = pTask;
+
+		bool Continue;
+		try {
+			Continue = pTask->ProcessTask();
+		} catch (...) {
+			LIBISDB_TRACE_ERROR(LIBISDB_STR("Exception in StreamingThreadPool task [%p]\n"), pTask);
+			Continue = false;
+		}
+
+		g_pCurrentPool = nullptr;
+		g_pCurrentTask = nullptr;
+
+		Lock.Lock();
+
+		State.Running = false;
+
+		if (State.EraseOnFinish) {
+			m_TaskList.erase(pTask);
+		} else if (State.Removed) {
+			m_TaskCondition.NotifyAll();
+		} else if (Continue || pTask->m_Scheduled.load(std::memory_order_acquire)) {
+			// 公平性のため、処理が残っていても待ち行列の最後に回す
+			EnqueueTask(pTask, State);
+		}
+	}
+}
+
+
+
+
+StreamingThreadPool::WorkerThread::WorkerThread(StreamingThreadPool *pPool, size_t Index) noexcept
+	: m_pPool(pPool)
+	, m_Index(Index)
+{
+}
+
+
+StreamingThreadPool::WorkerThread::~WorkerThread()
+{
+	Stop();
+}
+
+
+void StreamingThreadPool::WorkerThread::ThreadMain()
+{
+	LIBISDB_TRACE(LIBISDB_STR("Start thread StreamingThreadPool[%p] #%zu\n"), m_pPool, m_Index);
+
+	m_pPool->WorkerLoop();
+
+	LIBISDB_TRACE(LIBISDB_STR("End thread StreamingThreadPool[%p] #%zu\n"), m_pPool, m_Index);
+}
+
+
+}	// namespace LibISDB
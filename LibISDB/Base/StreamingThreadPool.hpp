@@ -0,0 +1,132 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   StreamingThreadPool.hpp
+ @brief  ストリーミングスレッドプール
+ @author DBCTRADO
+*/
+
+
+#ifndef LIBISDB_STREAMING_THREAD_POOL_H
+#define LIBISDB_STREAMING_THREAD_POOL_H
+
+
+#include "../Utilities/Thread.hpp"
+#include "../Utilities/ConditionVariable.hpp"
+#include "../Utilities/Clock.hpp"
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <atomic>
+
+
+namespace LibISDB
+{
+
+	/**
+		ストリーミングスレッドプールクラス
+
+		複数のタスクの処理を少数のスレッドで共有する。
+		タスクは一度に一つのスレッドでのみ処理され、一回の処理が終わると待ち行列の最後に回される。
+		ProcessTask() が false を返したタスクは、NotifyTask() か NotifyTaskDelayed() で通知されるまで処理されない。
+		処理待ちのタスクが無い間、スレッドは通知があるまで待機する。
+	*/
+	class StreamingThreadPool
+	{
+	public:
+		/** タスク基底クラス */
+		class Task
+		{
+		public:
+			virtual ~Task() = default;
+
+		protected:
+			virtual bool ProcessTask() = 0;
+
+		private:
+			std::atomic<bool> m_Scheduled {false};
+			std::atomic<bool> m_DelayScheduled {false};
+
+			friend class StreamingThreadPool;
+		};
+
+		StreamingThreadPool() noexcept;
+		~StreamingThreadPool();
+
+		StreamingThreadPool(const StreamingThreadPool &) = delete;
+		StreamingThreadPool & operator = (const StreamingThreadPool &) = delete;
+
+		bool Start(size_t ThreadCount);
+		void Stop();
+		bool IsStarted() const;
+		size_t GetThreadCount() const;
+
+		bool AddTask(Task *pTask);
+		// 処理中のタスクは終わるまで待つ。タスク自身の ProcessTask() から呼んだ場合は待たずに戻り、処理が終わった時点で取り除かれる
+		bool RemoveTask(Task *pTask);
+		void NotifyTask(Task *pTask);
+		void NotifyTaskDelayed(Task *pTask, const std::chrono::milliseconds &Delay);
+
+	private:
+		class WorkerThread
+			: public Thread
+		{
+		public:
+			WorkerThread(StreamingThreadPool *pPool, size_t Index) noexcept;
+			~WorkerThread();
+
+		private:
+			const CharType * GetThreadName() const noexcept override { return LIBISDB_STR("StreamingThreadPool"); }
+			void ThreadMain() override;
+
+			StreamingThreadPool *m_pPool;
+			size_t m_Index;
+		};
+
+		struct TaskState {
+			bool Queued = false;
+			bool Running = false;
+			bool Removed = false;
+			bool EraseOnFinish = false;
+			bool Delayed = false;
+			TickClock::ClockType Deadline = 0;
+		};
+
+		void WorkerLoop();
+		void EnqueueTask(Task *pTask, TaskState &State);
+		void CancelDelay(TaskState &State);
+		TickClock::ClockType EnqueueDelayedTasks();
+
+		std::vector<std::unique_ptr<WorkerThread>> m_ThreadList;
+		std::map<Task *, TaskState> m_TaskList;
+		std::deque<Task *> m_Queue;
+		mutable MutexLock m_Lock;
+		ConditionVariable m_QueueCondition;
+		ConditionVariable m_TaskCondition;
+		bool m_EndSignal;
+		size_t m_DelayedCount;
+		TickClock m_Clock;
+	};
+
+}	// namespace LibISDB
+
+
+#endif	// ifndef LIBISDB_STREAMING_THREAD_POOL_H
@@ -0,0 +1,222 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   StringPool.cpp
+ @brief  文字列プール
+ @author DBCTRADO
+*/
+
+
+#include "../LibISDBPrivate.hpp"
+#include "StringPool.hpp"
+#include <algorithm>
+#include "DebugDef.hpp"
+
+
+namespace LibISDB
+{
+
+
+const String PooledString::m_EmptyString;
+
+
+PooledString::PooledString(const String &Str)
+{
+	if (!Str.empty())
+		m_String = std::make_shared<const String>(Str);
+}
+
+
+PooledString::PooledString(String &&Str)
+{
+	if (!Str.empty())
+		m_String = MakeString(std::move(Str));
+}
+
+
+PooledString::PooledString(const CharType *pStr)
+{
+	if ((pStr != nullptr) && (*pStr != LIBISDB_CHAR('\0')))
+		m_String = std::make_shared<const String>(pStr);
+}
+
+
+PooledString & PooledString::operator = (const String &Str)
+{
+	if (Str.empty())
+		m_String.reset();
+	else
+		m_String = std::make_shared<const String>(Str);
+	return *this;
+}
+
+
+PooledString & PooledString::operator = (String &&Str)
+{
+	if (Str.empty())
+		m_String.reset();
+	else
+		m_String = MakeString(std::move(Str));
+	return *this;
+}
+
+
+PooledString & PooledString::operator = (const CharType *pStr)
+{
+	if ((pStr == nullptr) || (*pStr == LIBISDB_CHAR('\0')))
+		m_String.reset();
+	else
+		m_String = std::make_shared<const String>(pStr);
+	return *this;
+}
+
+
+bool PooledString::operator == (const PooledString &rhs) const noexcept
+{
+	// プールされた文字列同士はオブジェクトの比較のみで済む
+	if (m_String == rhs.m_String)
+		return true;
+	if (!m_String || !rhs.m_String)
+		return false;
+	return *m_String == *rhs.m_String;
+}
+
+
+// 共有オブジェクトの管理領域を除いた、文字列オブジェクトが確保しているサイズを取得する
+size_t PooledString::GetAllocatedSize() const noexcept
+{
+	if (!m_String)
+		return 0;
+
+	// 短い文字列はオブジェクト内に格納される
+	static const size_t LocalCapacity = String().capacity();
+
+	size_t Size = sizeof(String);
+	if (m_String->capacity() > LocalCapacity)
+		Size += (m_String->capacity() + 1) * sizeof(CharType);
+
+	return Size;
+}
+
+
+std::shared_ptr<const String> PooledString::MakeString(String &&Str)
+{
+	// 変更されることはないため、余分な領域は解放しておく
+	std::shared_ptr<String> NewString = std::make_shared<String>(std::move(Str));
+	NewString->shrink_to_fit();
+	return NewString;
+}
+
+
+
+
+PooledString StringPool::Intern(const String &Str)
+{
+	return Intern(StringView(Str));
+}
+
+
+PooledString StringPool::Intern(StringView Str)
+{
+	if (Str.empty())
+		return PooledString();
+
+	BlockLock Lock(m_Lock);
+
+	auto it = m_StringMap.find(Str);
+	if (it != m_StringMap.end())
+		return PooledString(std::shared_ptr<const String>(it->second));
+
+	PurgeIfNeeded();
+
+	std::shared_ptr<const String> NewString = std::make_shared<const String>(Str);
+	m_StringMap.emplace(StringView(*NewString), NewString);
+
+	return PooledString(std::move(NewString));
+}
+
+
+PooledString StringPool::Intern(const PooledString &Str)
+{
+	if (Str.empty())
+		return PooledString();
+
+	BlockLock Lock(m_Lock);
+
+	auto it = m_StringMap.find(StringView(*Str.m_String));
+	if (it != m_StringMap.end())
+		return PooledString(std::shared_ptr<const String>(it->second));
+
+	PurgeIfNeeded();
+
+	// 文字列は変更されないため、オブジェクトをそのまま登録する
+	m_StringMap.emplace(StringView(*Str.m_String), Str.m_String);
+
+	return Str;
+}
+
+
+void StringPool::Purge()
+{
+	BlockLock Lock(m_Lock);
+
+	PurgeUnreferenced();
+}
+
+
+void StringPool::Clear()
+{
+	BlockLock Lock(m_Lock);
+
+	m_StringMap.clear();
+	m_PurgeThreshold = MIN_PURGE_THRESHOLD;
+}
+
+
+size_t StringPool::GetStringCount() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_StringMap.size();
+}
+
+
+void StringPool::PurgeIfNeeded()
+{
+	if (m_StringMap.size() >= m_PurgeThreshold)
+		PurgeUnreferenced();
+}
+
+
+void StringPool::PurgeUnreferenced()
+{
+	// プールからのみ参照されている文字列は、ロック中に他から参照されることはない
+	for (auto it = m_StringMap.begin(); it != m_StringMap.end();) {
+		if (it->second.use_count() == 1)
+			it = m_StringMap.erase(it);
+		else
+			++it;
+	}
+
+	m_PurgeThreshold = std::max(m_StringMap.size() * 2, MIN_PURGE_THRESHOLD);
+}
+
+
+}	// namespace LibISDB
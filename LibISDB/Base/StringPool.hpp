@@ -0,0 +1,134 @@
+/*
+  LibISDB
+  Copyright(c) 2017-2020 DBCTRADO
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ @file   StringPool.hpp
+ @brief  文字列プール
+ @author DBCTRADO
+*/
+
+
+#ifndef LIBISDB_STRING_POOL_H
+#define LIBISDB_STRING_POOL_H
+
+
+#include "../Utilities/Lock.hpp"
+#include <memory>
+#include <unordered_map>
+
+
+namespace LibISDB
+{
+
+	/**
+		共有される変更不可の文字列クラス
+
+		文字列は参照カウントされるオブジェクトに保持され、コピーしても複製されない。
+		StringPool::Intern() で取得したものは、同じ内容の文字列とオブジェクトを共有する。
+		const String & に暗黙に変換できるため、読み込みは String と同様に行える。
+	*/
+	class PooledString
+	{
+	public:
+		PooledString() noexcept = default;
+		PooledString(const String &Str);
+		PooledString(String &&Str);
+		PooledString(const CharType *pStr);
+
+		PooledString & operator = (const String &Str);
+		PooledString & operator = (String &&Str);
+		PooledString & operator = (const CharType *pStr);
+
+		bool operator == (const PooledString &rhs) const noexcept;
+		bool operator != (const PooledString &rhs) const noexcept { return !(*this == rhs); }
+
+		operator const String & () const noexcept { return Get(); }
+		const String & Get() const noexcept { return m_String ? *m_String : m_EmptyString; }
+		const CharType * c_str() const noexcept { return Get().c_str(); }
+		const CharType * data() const noexcept { return Get().data(); }
+		size_t length() const noexcept { return m_String ? m_String->length() : 0; }
+		size_t size() const noexcept { return length(); }
+		bool empty() const noexcept { return !m_String; }
+		void clear() noexcept { m_String.reset(); }
+		String::const_iterator begin() const noexcept { return Get().begin(); }
+		String::const_iterator end() const noexcept { return Get().end(); }
+
+		bool IsShared(const PooledString &Str) const noexcept { return m_String == Str.m_String; }
+		size_t GetAllocatedSize() const noexcept;
+
+	private:
+		PooledString(std::shared_ptr<const String> &&Str) noexcept : m_String(std::move(Str)) {}
+
+		static std::shared_ptr<const String> MakeString(String &&Str);
+
+		/** 空文字列の場合は nullptr */
+		std::shared_ptr<const String> m_String;
+
+		static const String m_EmptyString;
+
+		friend class StringPool;
+	};
+
+	inline bool operator == (const PooledString &lhs, const String &rhs) noexcept { return lhs.Get() == rhs; }
+	inline bool operator == (const String &lhs, const PooledString &rhs) noexcept { return lhs == rhs.Get(); }
+	inline bool operator == (const PooledString &lhs, const CharType *rhs) noexcept { return lhs.Get() == rhs; }
+	inline bool operator == (const CharType *lhs, const PooledString &rhs) noexcept { return lhs == rhs.Get(); }
+	inline bool operator != (const PooledString &lhs, const String &rhs) noexcept { return !(lhs == rhs); }
+	inline bool operator != (const String &lhs, const PooledString &rhs) noexcept { return !(lhs == rhs); }
+	inline bool operator != (const PooledString &lhs, const CharType *rhs) noexcept { return !(lhs == rhs); }
+	inline bool operator != (const CharType *lhs, const PooledString &rhs) noexcept { return !(lhs == rhs); }
+
+	/**
+		文字列プールクラス
+
+		同じ内容の文字列を 1 つのオブジェクトで共有させる。スレッドセーフ。
+		どこからも参照されなくなった文字列は、登録数が前回破棄した時の 2 倍に達した時にまとめて破棄される。
+		Clear() しても、取得済みの PooledString はそのまま利用できる。
+	*/
+	class StringPool
+	{
+	public:
+		StringPool() = default;
+
+		StringPool(const StringPool &) = delete;
+		StringPool & operator = (const StringPool &) = delete;
+
+		PooledString Intern(const String &Str);
+		PooledString Intern(StringView Str);
+		PooledString Intern(const PooledString &Str);
+		void Purge();
+		void Clear();
+		size_t GetStringCount() const;
+
+	private:
+		static constexpr size_t MIN_PURGE_THRESHOLD = 1024;
+
+		void PurgeIfNeeded();
+		void PurgeUnreferenced();
+
+		mutable MutexLock m_Lock;
+		/** キーは値の文字列を参照する */
+		std::unordered_map<StringView, std::shared_ptr<const String>> m_StringMap;
+		size_t m_PurgeThreshold = MIN_PURGE_THRESHOLD;
+	};
+
+}	// namespace LibISDB
+
+
+#endif	// ifndef LIBISDB_STRING_POOL_H
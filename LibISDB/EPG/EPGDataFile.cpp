@@ -29,6 +29,8 @@
 #include "../Base/FileStream.hpp"
 #include "../Utilities/StringUtilities.hpp"
 #include "../Utilities/CRC.hpp"
+#include <algorithm>
+#include <cstddef>
 #include <new>
 #include "../Base/DebugDef.hpp"
 
@@ -98,6 +100,22 @@ namespace
 	│└───────────────────┘│
 	│ ...                                      │
 	└─────────────────────┘
+
+	索引付きの形式 (FileHeader::Version = 1)
+
+	FileHeader
+	ServiceInfo ～ ServiceEnd (サービスのセグメント。内容はバージョン 0 と同じ)
+	 ...
+	IndexHeader + IndexEntry x ServiceCount
+	IndexFooter
+	ServiceInfo ～ ServiceEnd (追記された、変更されたサービスのセグメント)
+	 ...
+	IndexHeader + IndexEntry x ServiceCount
+	IndexFooter
+
+	保存時は変更されたサービスのセグメントと、それを含む新しい索引を末尾に追記する。
+	読み込み時は末尾の IndexFooter から最新の索引を参照する。
+	索引が壊れている場合は先頭から走査し、後にあるセグメントを優先する。
 */
 
 
@@ -119,6 +137,8 @@ namespace Tag {
 	constexpr uint8_t EventText         = 0x0A_u8;
 	constexpr uint8_t EventExtendedText = 0x0B_u8;
 	constexpr uint8_t EventGroup        = 0x0C_u8;
+	constexpr uint8_t Index             = 0x10_u8;
+	constexpr uint8_t IndexFooter       = 0x11_u8;
 }
 
 struct ChunkHeader {
@@ -141,6 +161,7 @@ struct FileHeader {
 
 const char FileHeader_Type[8] = {'E', 'P', 'G', '-', 'D', 'A', 'T', 'A'};
 const uint32_t FileHeader_Version = 0;
+const uint32_t FileHeader_Version_Indexed = 1;
 
 struct EPGDateTime {
 	uint16_t Year;
@@ -263,6 +284,31 @@ struct EventGroupInfo {
 	uint16_t TransportStreamID;
 } LIBISDB_ATTRIBUTE_PACKED;
 
+struct IndexHeader {
+	uint32_t ServiceCount;
+	uint32_t CRC;          /**< IndexEntry の CRC */
+	uint64_t UpdateCount;
+} LIBISDB_ATTRIBUTE_PACKED;
+
+struct IndexEntry {
+	uint16_t NetworkID;
+	uint16_t TransportStreamID;
+	uint16_t ServiceID;
+	uint16_t EventCount;
+	uint64_t Offset;       /**< セグメントのファイル先頭からの位置 */
+	uint32_t Size;         /**< セグメントのサイズ */
+	uint32_t CRC;          /**< セグメントの CRC */
+} LIBISDB_ATTRIBUTE_PACKED;
+
+struct IndexFooter {
+	uint64_t IndexOffset;
+	char Type[8];
+} LIBISDB_ATTRIBUTE_PACKED;
+
+const char IndexFooter_Type[8] = {'E', 'P', 'G', '-', 'I', 'N', 'D', 'X'};
+
+constexpr size_t INDEX_FOOTER_SIZE = CHUNK_HEADER_SIZE + sizeof(IndexFooter);
+
 
 LIBISDB_PRAGMA_PACK_POP
 
@@ -272,6 +318,94 @@ LIBISDB_PRAGMA_PACK_POP
 
 constexpr uint16_t MAX_EPG_TEXT_LENGTH = 4096;
 
+// 追記形式で書き直しを行う最小のファイルサイズ
+constexpr uint64_t COMPACT_MIN_FILE_SIZE = 1024 * 1024;
+
+
+// メモリ上のデータを読み込むストリーム
+class MemoryReadStream
+	: public Stream
+{
+public:
+	MemoryReadStream(const uint8_t *pData, size_t Size) noexcept
+		: m_pData(pData)
+		, m_Size(Size)
+		, m_Pos(0)
+	{
+	}
+
+	bool Close() override { return true; }
+	bool IsOpen() const override { return true; }
+
+	size_t Read(void *pBuff, size_t Size) override
+	{
+		if (Size > m_Size - m_Pos)
+			Size = m_Size - m_Pos;
+		std::memcpy(pBuff, m_pData + m_Pos, Size);
+		m_Pos += Size;
+		return Size;
+	}
+
+	size_t Write(const void *, size_t) override { return 0; }
+	bool Flush() override { return true; }
+	SizeType GetSize() override { return m_Size; }
+	OffsetType GetPos() override { return static_cast<OffsetType>(m_Pos); }
+
+	bool SetPos(OffsetType Pos, SetPosType Type) override
+	{
+		switch (Type) {
+		case SetPosType::Begin:                         break;
+		case SetPosType::Current: Pos += m_Pos;         break;
+		case SetPosType::End:     Pos += m_Size;        break;
+		default:
+			return false;
+		}
+		if ((Pos < 0) || (static_cast<SizeType>(Pos) > m_Size))
+			return false;
+		m_Pos = static_cast<size_t>(Pos);
+		return true;
+	}
+
+	bool IsEnd() const override { return m_Pos >= m_Size; }
+
+private:
+	const uint8_t *m_pData;
+	size_t m_Size;
+	size_t m_Pos;
+};
+
+
+// メモリ上に追加して書き出すストリーム
+class MemoryWriteStream
+	: public Stream
+{
+public:
+	MemoryWriteStream(std::vector<uint8_t> *pBuffer) noexcept
+		: m_pBuffer(pBuffer)
+	{
+	}
+
+	bool Close() override { return true; }
+	bool IsOpen() const override { return true; }
+	size_t Read(void *, size_t) override { return 0; }
+
+	size_t Write(const void *pBuff, size_t Size) override
+	{
+		const uint8_t *p = static_cast<const uint8_t *>(pBuff);
+		m_pBuffer->insert(m_pBuffer->end(), p, p + Size);
+		return Size;
+	}
+
+	bool Flush() override { return true; }
+	SizeType GetSize() override { return m_pBuffer->size(); }
+	OffsetType GetPos() override { return static_cast<OffsetType>(m_pBuffer->size()); }
+	bool SetPos(OffsetType, SetPosType) override { return false; }
+	bool IsEnd() const override { return true; }
+
+private:
+	std::vector<uint8_t> *m_pBuffer;
+};
+
 
 void ReadData(Stream &File, void *pData, size_t DataSize, size_t *pSizeLimit)
 {
@@ -296,7 +430,15 @@ void ReadChunkHeader(Stream &File, EPGData::ChunkHeader *pHeader, size_t *pSizeL
 }
 
 
-void ReadString(Stream &File, String *pString, size_t *pSizeLimit)
+bool CheckChunkHeader(const uint8_t *pData, uint8_t Tag, size_t Size)
+{
+	uint16_t ChunkSize;
+	std::memcpy(&ChunkSize, pData + 1, sizeof(uint16_t));
+	return (pData[0] == Tag) && (ChunkSize == Size);
+}
+
+
+void ReadString(Stream &File, PooledString *pString, size_t *pSizeLimit)
 {
 	uint16_t Length;
 
@@ -307,8 +449,9 @@ void ReadString(Stream &File, String *pString, size_t *pSizeLimit)
 		throw EPGDataFile::Exception::FormatError;
 
 	if (Length > 0) {
-		pString->resize(Length);
-		ReadData(File, pString->data(), Length * sizeof(CharType), pSizeLimit);
+		String Str(Length, LIBISDB_CHAR('\0'));
+		ReadData(File, Str.data(), Length * sizeof(CharType), pSizeLimit);
+		*pString = std::move(Str);
 	}
 }
 
@@ -385,6 +528,9 @@ EPGDataFile::EPGDataFile() noexcept
 	, m_OpenFlags(OpenFlag::None)
 	, m_UpdateCount(0)
 	, m_SourceID()
+	, m_FileVersion(0)
+	, m_IndexLoaded(false)
+	, m_FileSize(0)
 {
 }
 
@@ -412,6 +558,11 @@ void EPGDataFile::Close()
 	m_pEPGDatabase = nullptr;
 	m_FileName.clear();
 	m_OpenFlags = OpenFlag::None;
+	m_FileVersion = 0;
+	m_MappedFile.Close();
+	m_Index.clear();
+	m_IndexLoaded = false;
+	m_FileSize = 0;
 }
 
 
@@ -427,76 +578,30 @@ bool EPGDataFile::Load()
 			(m_pEPGDatabase == nullptr) || m_FileName.empty() || !(m_OpenFlags & OpenFlag::Read)))
 		return false;
 
-	BufferedFileStream File;
-
-	FileStream::OpenFlag FileOpenFlags =
-		FileStream::OpenFlag::Read |
-		FileStream::OpenFlag::SequentialRead;
-	if (!!(m_OpenFlags & OpenFlag::ShareRead))
-		FileOpenFlags |= FileStream::OpenFlag::ShareRead;
-	if (!!(m_OpenFlags & OpenFlag::PriorityLow))
-		FileOpenFlags |= FileStream::OpenFlag::PriorityLow;
-	else if (!!(m_OpenFlags & OpenFlag::PriorityIdle))
-		FileOpenFlags |= FileStream::OpenFlag::PriorityIdle;
-
-	if (!File.Open(m_FileName, FileOpenFlags)) {
-		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルを開けません。"));
+	if (!OpenIndex(true))
 		return false;
-	}
 
-	EPGData::FileHeader FileHeader;
-
-	if (File.Read(&FileHeader, sizeof(EPGData::FileHeader)) != sizeof(EPGData::FileHeader)) {
-		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルのヘッダを読み込めません。"));
-		return false;
-	}
-	if (std::memcmp(FileHeader.Type, EPGData::FileHeader_Type, sizeof(FileHeader.Type)) != 0) {
-		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルが未知の形式のため読み込めません。"));
-		return false;
-	}
-	if (FileHeader.Version > EPGData::FileHeader_Version) {
-		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルが非対応のバージョンのため読み込めません。"));
-		return false;
+	bool Result = true;
+
+	// 壊れているサービスがあっても、他のサービスは読み込む
+	for (IndexEntry &Entry : m_Index) {
+		try {
+			ServiceInfo Service;
+
+			DecodeService(Entry, &Service);
+			SetServiceEventList(&Entry, std::move(Service));
+		} catch (Exception Code) {
+			ExceptionLog(Code);
+			Result = false;
+		} catch (std::bad_alloc) {
+			ExceptionLog(Exception::MemoryAllocate);
+			Result = false;
+		}
 	}
 
-	m_UpdateCount = FileHeader.UpdateCount;
-
-	try {
-		EPGData::ChunkHeader ChunkHeader;
-
-		do {
-			size_t Size = EPGData::CHUNK_HEADER_SIZE;
-			ReadChunkHeader(File, &ChunkHeader, &Size);
-
-			if ((ChunkHeader.Tag == EPGData::Tag::Service) && (ChunkHeader.Size == sizeof(EPGData::ServiceInfo))) {
-				ServiceInfo Service;
-
-				LoadService(File, &Service);
-
-				if (!Service.EventList.empty()) {
-					if (m_SourceID != 0) {
-						for (EventInfo &Event : Service.EventList)
-							Event.SourceID = m_SourceID;
-					}
-
-					m_pEPGDatabase->SetServiceEventList(Service.Info, std::move(Service.EventList));
-				}
-			} else {
-				if (ChunkHeader.Size > 0) {
-					if (!File.SetPos(ChunkHeader.Size, Stream::SetPosType::Current))
-						throw Exception::Seek;
-				}
-			}
-		} while (ChunkHeader.Tag != EPGData::Tag::End);
-	} catch (Exception Code) {
-		ExceptionLog(Code);
-		return false;
-	} catch (std::bad_alloc) {
-		ExceptionLog(Exception::MemoryAllocate);
-		return false;
-	}
+	m_MappedFile.Close();
 
-	return true;
+	return Result;
 }
 
 
@@ -538,10 +643,74 @@ bool EPGDataFile::LoadHeader()
 		return false;
 	if (std::memcmp(FileHeader.Type, EPGData::FileHeader_Type, sizeof(FileHeader.Type)) != 0)
 		return false;
-	if (FileHeader.Version > EPGData::FileHeader_Version)
+	if (FileHeader.Version > EPGData::FileHeader_Version_Indexed)
 		return false;
 
 	m_UpdateCount = FileHeader.UpdateCount;
+	m_FileVersion = FileHeader.Version;
+
+	return true;
+}
+
+
+bool EPGDataFile::LoadIndex()
+{
+	if (LIBISDB_TRACE_ERROR_IF(
+			(m_pEPGDatabase == nullptr) || m_FileName.empty() || !(m_OpenFlags & OpenFlag::Read)))
+		return false;
+
+	if (!OpenIndex(true))
+		return false;
+
+	// マップしたままにすると他からの保存を妨げるため、必要な時にのみマップする
+	m_MappedFile.Close();
+
+	return true;
+}
+
+
+bool EPGDataFile::LoadService(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID)
+{
+	if (LIBISDB_TRACE_ERROR_IF((m_pEPGDatabase == nullptr) || !m_IndexLoaded))
+		return false;
+
+	auto it = FindIndexEntry(m_Index, EPGDatabase::ServiceInfo(NetworkID, TransportStreamID, ServiceID));
+	if (it == m_Index.end())
+		return false;
+
+	if (!MapFile()) {
+		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルを開けません。"));
+		return false;
+	}
+
+	bool Result = false;
+
+	try {
+		ServiceInfo Service;
+
+		DecodeService(*it, &Service);
+		Result = SetServiceEventList(&*it, std::move(Service));
+	} catch (Exception Code) {
+		ExceptionLog(Code);
+	} catch (std::bad_alloc) {
+		ExceptionLog(Exception::MemoryAllocate);
+	}
+
+	m_MappedFile.Close();
+
+	return Result;
+}
+
+
+bool EPGDataFile::GetServiceList(ReturnArg<EPGDatabase::ServiceList> List) const
+{
+	if (!List || !m_IndexLoaded)
+		return false;
+
+	List->clear();
+	List->reserve(m_Index.size());
+	for (const IndexEntry &Entry : m_Index)
+		List->push_back(Entry.Info);
 
 	return true;
 }
@@ -553,10 +722,21 @@ bool EPGDataFile::Save()
 			(m_pEPGDatabase == nullptr) || m_FileName.empty() || !(m_OpenFlags & OpenFlag::Write)))
 		return false;
 
+	if (!!(m_OpenFlags & OpenFlag::Incremental))
+		return SaveIncremental();
+
+	m_MappedFile.Close();
+	m_Index.clear();
+	m_IndexLoaded = false;
+
+	// 他でマップされているファイルを切り詰めないように、一時ファイルに書き出してから置き換える
+	String TempFileName = m_FileName;
+	TempFileName += LIBISDB_STR(".tmp");
+
 	BufferedFileStream File;
 
 	if (!File.Open(
-				m_FileName,
+				TempFileName,
 				FileStream::OpenFlag::Write |
 				FileStream::OpenFlag::Create |
 				FileStream::OpenFlag::Truncate)) {
@@ -567,10 +747,7 @@ bool EPGDataFile::Save()
 	BlockLock Lock(m_pEPGDatabase->GetLock());
 
 	DateTime EarliestTime;
-	if (!!(m_OpenFlags & OpenFlag::DiscardOld)) {
-		GetCurrentEPGTime(&EarliestTime);
-		EarliestTime.OffsetHours(-1);
-	}
+	GetEarliestTime(&EarliestTime);
 
 	EPGDatabase::ServiceList ServiceList;
 	m_pEPGDatabase->GetServiceList(&ServiceList);
@@ -609,9 +786,9 @@ bool EPGDataFile::Save()
 		File.Close();
 
 #ifdef LIBISDB_WINDOWS
-		::DeleteFile(m_FileName.c_str());
+		::DeleteFile(TempFileName.c_str());
 #else
-		std::remove(m_FileName.c_str());
+		std::remove(TempFileName.c_str());
 #endif
 	};
 
@@ -644,6 +821,315 @@ bool EPGDataFile::Save()
 		return false;
 	}
 
+	File.Close();
+
+	if (!ReplaceWithTempFile(TempFileName)) {
+		ErrorCleanup();
+		return false;
+	}
+
+	m_FileVersion = EPGData::FileHeader_Version;
+
+	return true;
+}
+
+
+bool EPGDataFile::Compact()
+{
+	if (LIBISDB_TRACE_ERROR_IF(
+			(m_pEPGDatabase == nullptr) || m_FileName.empty() || !(m_OpenFlags & OpenFlag::Write)))
+		return false;
+
+	// 既存のファイルにのみあるサービスは、そのままコピーする
+	if (!m_IndexLoaded)
+		OpenIndex(false);
+	if (!m_Index.empty() && !MapFile()) {
+		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルを開けません。"));
+		return false;
+	}
+
+	String TempFileName = m_FileName;
+	TempFileName += LIBISDB_STR(".tmp");
+
+	BufferedFileStream File;
+
+	if (!File.Open(
+				TempFileName,
+				FileStream::OpenFlag::Write |
+				FileStream::OpenFlag::Create |
+				FileStream::OpenFlag::Truncate)) {
+		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルが開けません。"));
+		m_MappedFile.Close();
+		return false;
+	}
+
+	auto ErrorCleanup = [&]() {
+		File.Close();
+		m_MappedFile.Close();
+
+#ifdef LIBISDB_WINDOWS
+		::DeleteFile(TempFileName.c_str());
+#else
+		std::remove(TempFileName.c_str());
+#endif
+	};
+
+	// データベースをロックする前に、既存のセグメントを検証しておく
+	std::vector<bool> SegmentValid;
+	SegmentValid.reserve(m_Index.size());
+	for (const IndexEntry &Entry : m_Index)
+		SegmentValid.push_back(CheckSegment(Entry));
+
+	// SourceList は NewIndex の各セグメントのコピー元で、nullptr であれば Buffer から書き出す
+	IndexList NewIndex;
+	std::vector<const IndexEntry *> SourceList;
+	std::vector<uint8_t> Buffer;
+	size_t DroppedCount = 0;
+	uint64_t FilePos = sizeof(EPGData::FileHeader);
+
+	try {
+		{
+			// データベースのロックはメモリ上に書き出す間のみ保持する
+			BlockLock Lock(m_pEPGDatabase->GetLock());
+
+			DateTime EarliestTime;
+			GetEarliestTime(&EarliestTime);
+
+			EPGDatabase::ServiceList ServiceList;
+			m_pEPGDatabase->GetServiceList(&ServiceList);
+			std::sort(ServiceList.begin(), ServiceList.end());
+
+			NewIndex.reserve(std::max(ServiceList.size(), m_Index.size()));
+			SourceList.reserve(NewIndex.capacity());
+
+			auto CopyEntry = [&](IndexList::const_iterator it) -> bool {
+				if (!SegmentValid[it - m_Index.cbegin()])
+					return false;
+				NewIndex.push_back(*it);
+				SourceList.push_back(&*it);
+				return true;
+			};
+
+			auto itFile = m_Index.cbegin();
+
+			for (const EPGDatabase::ServiceInfo &Service : ServiceList) {
+				for (; (itFile != m_Index.cend()) && (itFile->Info < Service); ++itFile) {
+					if (!CopyEntry(itFile))
+						DroppedCount++;
+				}
+
+				const uint64_t Generation = m_pEPGDatabase->GetServiceGeneration(
+					Service.NetworkID, Service.TransportStreamID, Service.ServiceID);
+
+				if ((itFile != m_Index.cend()) && (itFile->Info == Service)) {
+					auto itEntry = itFile++;
+
+					// ファイルの内容がデータベースと同じであればコピーする
+					if ((itEntry->Generation == Generation)
+							&& !(m_OpenFlags & OpenFlag::DiscardOld)
+							&& CopyEntry(itEntry))
+						continue;
+				}
+
+				const size_t Offset = Buffer.size();
+				const uint16_t EventCount = SerializeService(Service, EarliestTime, &Buffer);
+				if (EventCount == 0)
+					continue;
+
+				IndexEntry &Entry = NewIndex.emplace_back();
+				Entry.Info = Service;
+				Entry.EventCount = EventCount;
+				Entry.Offset = Offset;
+				Entry.Size = static_cast<uint32_t>(Buffer.size() - Offset);
+				Entry.CRC = CRC32MPEG2::Calc(Buffer.data() + Offset, Entry.Size);
+				Entry.Generation = Generation;
+				SourceList.push_back(nullptr);
+			}
+
+			for (; itFile != m_Index.cend(); ++itFile) {
+				if (!CopyEntry(itFile))
+					DroppedCount++;
+			}
+		}
+
+		if (DroppedCount > 0) {
+			Log(Logger::LogType::Warning,
+				LIBISDB_STR("EPGファイルの壊れている %zu 個のサービスを破棄しました。"),
+				DroppedCount);
+		}
+
+		EPGData::FileHeader FileHeader;
+
+		std::memcpy(FileHeader.Type, EPGData::FileHeader_Type, sizeof(FileHeader.Type));
+		FileHeader.Version = EPGData::FileHeader_Version_Indexed;
+		FileHeader.ServiceCount = static_cast<uint32_t>(NewIndex.size());
+		FileHeader.UpdateCount = ++m_UpdateCount;
+
+		WriteData(File, FileHeader);
+
+		for (size_t i = 0; i < NewIndex.size(); i++) {
+			IndexEntry &Entry = NewIndex[i];
+			const uint8_t *pData =
+				(SourceList[i] != nullptr) ?
+					m_MappedFile.GetData() + SourceList[i]->Offset :
+					Buffer.data() + Entry.Offset;
+
+			WriteData(File, pData, Entry.Size);
+			Entry.Offset = FilePos;
+			FilePos += Entry.Size;
+		}
+
+		Buffer.clear();
+		SerializeIndex(NewIndex, FilePos, &Buffer);
+		WriteData(File, Buffer.data(), Buffer.size());
+		FilePos += Buffer.size();
+
+		if (!!(m_OpenFlags & OpenFlag::Flush))
+			File.Flush();
+	} catch (Exception Code) {
+		ExceptionLog(Code);
+		ErrorCleanup();
+		return false;
+	} catch (std::bad_alloc) {
+		ExceptionLog(Exception::MemoryAllocate);
+		ErrorCleanup();
+		return false;
+	}
+
+	File.Close();
+	m_MappedFile.Close();
+
+	if (!ReplaceWithTempFile(TempFileName)) {
+		ErrorCleanup();
+		return false;
+	}
+
+	m_Index = std::move(NewIndex);
+	m_IndexLoaded = true;
+	m_FileVersion = EPGData::FileHeader_Version_Indexed;
+	m_FileSize = FilePos;
+
+	return true;
+}
+
+
+bool EPGDataFile::SaveIncremental()
+{
+	if (!m_IndexLoaded)
+		OpenIndex(false);
+	if (!m_IndexLoaded || (m_FileVersion != EPGData::FileHeader_Version_Indexed))
+		return Compact();
+
+	m_MappedFile.Close();
+
+	FileStream File;
+
+	if (!File.Open(m_FileName, FileStream::OpenFlag::Write)) {
+		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルが開けません。"));
+		return false;
+	}
+
+	// 読み込んだ後に他から書き換えられているか、末尾が壊れている
+	if (File.GetSize() != m_FileSize) {
+		File.Close();
+		return Compact();
+	}
+
+	IndexList NewIndex(m_Index);
+	std::vector<uint8_t> Buffer;
+	bool Changed = false;
+
+	try {
+		// データベースのロックはメモリ上に書き出す間のみ保持する
+		{
+			BlockLock Lock(m_pEPGDatabase->GetLock());
+
+			DateTime EarliestTime;
+			GetEarliestTime(&EarliestTime);
+
+			EPGDatabase::ServiceList ServiceList;
+			m_pEPGDatabase->GetServiceList(&ServiceList);
+
+			// 前回から変更されたサービスのみを書き出す
+			for (const EPGDatabase::ServiceInfo &Service : ServiceList) {
+				const uint64_t Generation = m_pEPGDatabase->GetServiceGeneration(
+					Service.NetworkID, Service.TransportStreamID, Service.ServiceID);
+				auto it = FindIndexEntry(NewIndex, Service);
+				if ((it != NewIndex.end()) && (it->Generation == Generation))
+					continue;
+
+				const size_t Offset = Buffer.size();
+				const uint16_t EventCount = SerializeService(Service, EarliestTime, &Buffer);
+
+				if (EventCount == 0) {
+					if (it != NewIndex.end()) {
+						NewIndex.erase(it);
+						Changed = true;
+					}
+					continue;
+				}
+
+				IndexEntry Entry;
+				Entry.Info = Service;
+				Entry.EventCount = EventCount;
+				Entry.Offset = m_FileSize + Offset;
+				Entry.Size = static_cast<uint32_t>(Buffer.size() - Offset);
+				Entry.CRC = CRC32MPEG2::Calc(Buffer.data() + Offset, Entry.Size);
+				Entry.Generation = Generation;
+
+				if (it != NewIndex.end())
+					*it = Entry;
+				else
+					NewIndex.insert(std::upper_bound(NewIndex.begin(), NewIndex.end(), Entry), Entry);
+				Changed = true;
+			}
+		}
+
+		if (!Changed)
+			return true;
+
+		EPGData::FileHeader FileHeader;
+
+		std::memcpy(FileHeader.Type, EPGData::FileHeader_Type, sizeof(FileHeader.Type));
+		FileHeader.Version = EPGData::FileHeader_Version_Indexed;
+		FileHeader.ServiceCount = static_cast<uint32_t>(NewIndex.size());
+		FileHeader.UpdateCount = ++m_UpdateCount;
+
+		SerializeIndex(NewIndex, m_FileSize, &Buffer);
+
+		// 追記が完了してからヘッダを書き換える
+		if (!File.SetPos(m_FileSize, Stream::SetPosType::Begin))
+			throw Exception::Seek;
+		WriteData(File, Buffer.data(), Buffer.size());
+		if (!File.SetPos(0, Stream::SetPosType::Begin))
+			throw Exception::Seek;
+		WriteData(File, FileHeader);
+
+		if (!!(m_OpenFlags & OpenFlag::Flush))
+			File.Flush();
+	} catch (Exception Code) {
+		ExceptionLog(Code);
+		return false;
+	} catch (std::bad_alloc) {
+		ExceptionLog(Exception::MemoryAllocate);
+		return false;
+	}
+
+	File.Close();
+
+	m_Index = std::move(NewIndex);
+	m_FileSize += Buffer.size();
+
+	// 無効なセグメントが有効なデータより多くなったら書き直す
+	uint64_t ValidSize = sizeof(EPGData::FileHeader) + EPGData::INDEX_FOOTER_SIZE +
+		EPGData::CHUNK_HEADER_SIZE + sizeof(EPGData::IndexHeader) +
+		m_Index.size() * sizeof(EPGData::IndexEntry);
+	for (const IndexEntry &Entry : m_Index)
+		ValidSize += Entry.Size;
+
+	if ((m_FileSize >= COMPACT_MIN_FILE_SIZE) && (m_FileSize - ValidSize > ValidSize))
+		return Compact();
+
 	return true;
 }
 
@@ -1052,6 +1538,401 @@ void EPGDataFile::SaveEvent(Stream &File, const EventInfo &Event)
 }
 
 
+uint16_t EPGDataFile::SerializeService(
+	const EPGDatabase::ServiceInfo &Info, const DateTime &EarliestTime,
+	std::vector<uint8_t> *pBuffer)
+{
+	const size_t Offset = pBuffer->size();
+	MemoryWriteStream Stream(pBuffer);
+	size_t EventCount = 0;
+
+	EPGData::ServiceInfo ServiceHeader;
+	ServiceHeader.NetworkID         = Info.NetworkID;
+	ServiceHeader.TransportStreamID = Info.TransportStreamID;
+	ServiceHeader.ServiceID         = Info.ServiceID;
+	ServiceHeader.EventCount        = 0;
+	WriteChunk(Stream, EPGData::Tag::Service, ServiceHeader);
+
+	m_pEPGDatabase->EnumEventsSortedByTime(
+		Info.NetworkID, Info.TransportStreamID, Info.ServiceID,
+		!!(m_OpenFlags & OpenFlag::DiscardOld) ? &EarliestTime : nullptr, nullptr,
+		[&](const EventInfo &Event) -> bool {
+			if (EventCount == 0xFFFF)
+				return false;
+			SaveEvent(Stream, Event);
+			EventCount++;
+			return true;
+		});
+
+	if (EventCount == 0) {
+		pBuffer->resize(Offset);
+		return 0;
+	}
+
+	WriteChunkHeader(Stream, EPGData::Tag::ServiceEnd);
+
+	// イベント数は書き出した後で設定する
+	ServiceHeader.EventCount = static_cast<uint16_t>(EventCount);
+	std::memcpy(
+		pBuffer->data() + Offset + EPGData::CHUNK_HEADER_SIZE + offsetof(EPGData::ServiceInfo, EventCount),
+		&ServiceHeader.EventCount, sizeof(uint16_t));
+
+	return ServiceHeader.EventCount;
+}
+
+
+void EPGDataFile::SerializeIndex(const IndexList &Index, uint64_t BaseOffset, std::vector<uint8_t> *pBuffer)
+{
+	const uint64_t IndexOffset = BaseOffset + pBuffer->size();
+	MemoryWriteStream Stream(pBuffer);
+
+	std::vector<EPGData::IndexEntry> EntryList;
+	EntryList.reserve(Index.size());
+
+	for (const IndexEntry &Entry : Index) {
+		EPGData::IndexEntry &Data = EntryList.emplace_back();
+
+		Data.NetworkID         = Entry.Info.NetworkID;
+		Data.TransportStreamID = Entry.Info.TransportStreamID;
+		Data.ServiceID         = Entry.Info.ServiceID;
+		Data.EventCount        = Entry.EventCount;
+		Data.Offset            = Entry.Offset;
+		Data.Size              = Entry.Size;
+		Data.CRC               = Entry.CRC;
+	}
+
+	const size_t EntrySize = EntryList.size() * sizeof(EPGData::IndexEntry);
+
+	EPGData::IndexHeader Header;
+	Header.ServiceCount = static_cast<uint32_t>(EntryList.size());
+	Header.CRC = CRC32MPEG2::Calc(reinterpret_cast<const uint8_t *>(EntryList.data()), EntrySize);
+	Header.UpdateCount = m_UpdateCount;
+
+	// IndexEntry はチャンクのサイズに含めない
+	WriteChunk(Stream, EPGData::Tag::Index, Header);
+	WriteData(Stream, EntryList.data(), EntrySize);
+
+	EPGData::IndexFooter Footer;
+	Footer.IndexOffset = IndexOffset;
+	std::memcpy(Footer.Type, EPGData::IndexFooter_Type, sizeof(Footer.Type));
+	WriteChunk(Stream, EPGData::Tag::IndexFooter, Footer);
+}
+
+
+bool EPGDataFile::CheckSegment(const IndexEntry &Entry) const
+{
+	if ((Entry.Offset > m_MappedFile.GetSize()) || (Entry.Size > m_MappedFile.GetSize() - Entry.Offset))
+		return false;
+
+	return CRC32MPEG2::Calc(m_MappedFile.GetData() + Entry.Offset, Entry.Size) == Entry.CRC;
+}
+
+
+bool EPGDataFile::ReplaceWithTempFile(const String &TempFileName)
+{
+	// 既存のファイルを書き換えずに置き換えるため、他でマップされていても影響しない
+#ifdef LIBISDB_WINDOWS
+	if (!::MoveFileEx(TempFileName.c_str(), m_FileName.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+	if (std::rename(TempFileName.c_str(), m_FileName.c_str()) != 0) {
+#endif
+		Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルを置き換えられません。"));
+		return false;
+	}
+
+	return true;
+}
+
+
+bool EPGDataFile::OpenIndex(bool LogError)
+{
+	m_MappedFile.Close();
+	m_Index.clear();
+	m_IndexLoaded = false;
+	m_FileVersion = 0;
+	m_FileSize = 0;
+
+	if (!m_MappedFile.Open(m_FileName)) {
+		if (LogError)
+			Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルを開けません。"));
+		return false;
+	}
+
+	EPGData::FileHeader FileHeader;
+
+	if (m_MappedFile.GetSize() < sizeof(EPGData::FileHeader)) {
+		if (LogError)
+			Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルのヘッダを読み込めません。"));
+		m_MappedFile.Close();
+		return false;
+	}
+	std::memcpy(&FileHeader, m_MappedFile.GetData(), sizeof(EPGData::FileHeader));
+	if (std::memcmp(FileHeader.Type, EPGData::FileHeader_Type, sizeof(FileHeader.Type)) != 0) {
+		if (LogError)
+			Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルが未知の形式のため読み込めません。"));
+		m_MappedFile.Close();
+		return false;
+	}
+	if (FileHeader.Version > EPGData::FileHeader_Version_Indexed) {
+		if (LogError)
+			Log(Logger::LogType::Error, LIBISDB_STR("EPGファイルが非対応のバージョンのため読み込めません。"));
+		m_MappedFile.Close();
+		return false;
+	}
+
+	m_FileVersion = FileHeader.Version;
+	m_UpdateCount = FileHeader.UpdateCount;
+	m_FileSize = m_MappedFile.GetSize();
+
+	try {
+		if ((m_FileVersion != EPGData::FileHeader_Version_Indexed) || !ReadIndex()) {
+			if (m_FileVersion == EPGData::FileHeader_Version_Indexed)
+				Log(Logger::LogType::Warning, LIBISDB_STR("EPGファイルの索引が壊れているため、ファイル全体を走査します。"));
+			ScanIndex();
+		}
+	} catch (std::bad_alloc) {
+		ExceptionLog(Exception::MemoryAllocate);
+		m_Index.clear();
+		m_MappedFile.Close();
+		return false;
+	}
+
+	m_IndexLoaded = true;
+
+	return true;
+}
+
+
+bool EPGDataFile::ReadIndex()
+{
+	const uint8_t *pData = m_MappedFile.GetData();
+
+	if (m_FileSize < sizeof(EPGData::FileHeader) + EPGData::INDEX_FOOTER_SIZE)
+		return false;
+
+	const uint64_t FooterOffset = m_FileSize - EPGData::INDEX_FOOTER_SIZE;
+	EPGData::IndexFooter Footer;
+
+	if (!CheckChunkHeader(&pData[FooterOffset], EPGData::Tag::IndexFooter, sizeof(EPGData::IndexFooter)))
+		return false;
+	std::memcpy(&Footer, &pData[FooterOffset + EPGData::CHUNK_HEADER_SIZE], sizeof(EPGData::IndexFooter));
+	if (std::memcmp(Footer.Type, EPGData::IndexFooter_Type, sizeof(Footer.Type)) != 0)
+		return false;
+
+	const uint64_t IndexOffset = Footer.IndexOffset;
+	constexpr size_t IndexHeaderSize = EPGData::CHUNK_HEADER_SIZE + sizeof(EPGData::IndexHeader);
+
+	if ((IndexOffset < sizeof(EPGData::FileHeader))
+			|| (IndexOffset > FooterOffset)
+			|| (FooterOffset - IndexOffset < IndexHeaderSize)
+			|| !CheckChunkHeader(&pData[IndexOffset], EPGData::Tag::Index, sizeof(EPGData::IndexHeader)))
+		return false;
+
+	EPGData::IndexHeader Header;
+	std::memcpy(&Header, &pData[IndexOffset + EPGData::CHUNK_HEADER_SIZE], sizeof(EPGData::IndexHeader));
+
+	const uint8_t *pEntryData = &pData[IndexOffset + IndexHeaderSize];
+	const uint64_t EntrySize = FooterOffset - (IndexOffset + IndexHeaderSize);
+	if ((EntrySize != static_cast<uint64_t>(Header.ServiceCount) * sizeof(EPGData::IndexEntry))
+			|| (CRC32MPEG2::Calc(pEntryData, static_cast<size_t>(EntrySize)) != Header.CRC))
+		return false;
+
+	m_Index.resize(Header.ServiceCount);
+
+	for (uint32_t i = 0; i < Header.ServiceCount; i++) {
+		EPGData::IndexEntry Data;
+		std::memcpy(&Data, pEntryData + i * sizeof(EPGData::IndexEntry), sizeof(EPGData::IndexEntry));
+
+		if ((Data.Offset < sizeof(EPGData::FileHeader))
+				|| (Data.Offset > IndexOffset)
+				|| (Data.Size > IndexOffset - Data.Offset)) {
+			m_Index.clear();
+			return false;
+		}
+
+		IndexEntry &Entry = m_Index[i];
+		Entry.Info.NetworkID         = Data.NetworkID;
+		Entry.Info.TransportStreamID = Data.TransportStreamID;
+		Entry.Info.ServiceID         = Data.ServiceID;
+		Entry.EventCount = Data.EventCount;
+		Entry.Offset     = Data.Offset;
+		Entry.Size       = Data.Size;
+		Entry.CRC        = Data.CRC;
+		Entry.Generation = 0;
+	}
+
+	std::sort(m_Index.begin(), m_Index.end());
+
+	// 追記中に中断された場合はヘッダが更新されていない
+	if (m_UpdateCount < Header.UpdateCount)
+		m_UpdateCount = Header.UpdateCount;
+
+	return true;
+}
+
+
+void EPGDataFile::ScanIndex()
+{
+	m_Index.clear();
+
+	const uint64_t FileSize = m_FileSize;
+	MemoryReadStream File(
+		m_MappedFile.GetData() + sizeof(EPGData::FileHeader),
+		static_cast<size_t>(FileSize - sizeof(EPGData::FileHeader)));
+	uint64_t ValidSize = sizeof(EPGData::FileHeader);
+
+	try {
+		EPGData::ChunkHeader ChunkHeader;
+
+		while (!File.IsEnd()) {
+			const uint64_t Offset = sizeof(EPGData::FileHeader) + File.GetPos();
+			size_t Size = EPGData::CHUNK_HEADER_SIZE;
+
+			ReadChunkHeader(File, &ChunkHeader, &Size);
+
+			if (ChunkHeader.Tag == EPGData::Tag::End) {
+				ValidSize = Offset + EPGData::CHUNK_HEADER_SIZE;
+				break;
+			}
+
+			if ((ChunkHeader.Tag == EPGData::Tag::Service) && (ChunkHeader.Size == sizeof(EPGData::ServiceInfo))) {
+				EPGData::ServiceInfo ServiceHeader;
+
+				Size = sizeof(ServiceHeader);
+				ReadData(File, ServiceHeader, &Size);
+
+				// イベントのチャンクも同じ形式なので、ServiceEnd まで読み飛ばす
+				do {
+					Size = EPGData::CHUNK_HEADER_SIZE;
+					ReadChunkHeader(File, &ChunkHeader, &Size);
+					if ((ChunkHeader.Size > 0)
+							&& !File.SetPos(ChunkHeader.Size, Stream::SetPosType::Current))
+						throw Exception::Seek;
+				} while (ChunkHeader.Tag != EPGData::Tag::ServiceEnd);
+
+				IndexEntry Entry;
+				Entry.Info.NetworkID         = ServiceHeader.NetworkID;
+				Entry.Info.TransportStreamID = ServiceHeader.TransportStreamID;
+				Entry.Info.ServiceID         = ServiceHeader.ServiceID;
+				Entry.EventCount = ServiceHeader.EventCount;
+				Entry.Offset     = Offset;
+				Entry.Size       = static_cast<uint32_t>(sizeof(EPGData::FileHeader) + File.GetPos() - Offset);
+				Entry.CRC        = CRC32MPEG2::Calc(m_MappedFile.GetData() + Offset, Entry.Size);
+				Entry.Generation = 0;
+
+				// 後にあるセグメントが新しい
+				auto it = std::find_if(
+					m_Index.begin(), m_Index.end(),
+					[&](const IndexEntry &e) -> bool { return e.Info == Entry.Info; });
+				if (it != m_Index.end())
+					*it = Entry;
+				else
+					m_Index.push_back(Entry);
+			} else if ((ChunkHeader.Tag == EPGData::Tag::Index) && (ChunkHeader.Size == sizeof(EPGData::IndexHeader))) {
+				EPGData::IndexHeader IndexHeader;
+
+				Size = sizeof(IndexHeader);
+				ReadData(File, IndexHeader, &Size);
+				if (!File.SetPos(
+							static_cast<Stream::OffsetType>(IndexHeader.ServiceCount) * sizeof(EPGData::IndexEntry),
+							Stream::SetPosType::Current))
+					throw Exception::Seek;
+			} else {
+				if ((ChunkHeader.Size > 0)
+						&& !File.SetPos(ChunkHeader.Size, Stream::SetPosType::Current))
+					throw Exception::Seek;
+			}
+
+			ValidSize = sizeof(EPGData::FileHeader) + File.GetPos();
+		}
+	} catch (Exception) {
+		// 途中で途切れている場合は、そこまでを有効とする
+	}
+
+	std::sort(m_Index.begin(), m_Index.end());
+
+	// 壊れた部分の後に追記しないように、有効な部分までをファイルサイズとする
+	m_FileSize = ValidSize;
+}
+
+
+bool EPGDataFile::MapFile()
+{
+	if (m_MappedFile.IsOpen() && (m_MappedFile.GetSize() >= m_FileSize))
+		return true;
+
+	m_MappedFile.Close();
+
+	if (!m_MappedFile.Open(m_FileName))
+		return false;
+	if (m_MappedFile.GetSize() < m_FileSize) {
+		m_MappedFile.Close();
+		return false;
+	}
+
+	return true;
+}
+
+
+void EPGDataFile::DecodeService(const IndexEntry &Entry, ServiceInfo *pServiceInfo)
+{
+	if ((Entry.Offset > m_MappedFile.GetSize()) || (Entry.Size > m_MappedFile.GetSize() - Entry.Offset))
+		throw Exception::FormatError;
+
+	const uint8_t *pData = m_MappedFile.GetData() + Entry.Offset;
+	if (CRC32MPEG2::Calc(pData, Entry.Size) != Entry.CRC)
+		throw Exception::FormatError;
+
+	MemoryReadStream File(pData, Entry.Size);
+	EPGData::ChunkHeader ChunkHeader;
+	size_t Size = EPGData::CHUNK_HEADER_SIZE;
+
+	ReadChunkHeader(File, &ChunkHeader, &Size);
+	if ((ChunkHeader.Tag != EPGData::Tag::Service) || (ChunkHeader.Size != sizeof(EPGData::ServiceInfo)))
+		throw Exception::FormatError;
+
+	LoadService(File, pServiceInfo);
+}
+
+
+bool EPGDataFile::SetServiceEventList(IndexEntry *pEntry, ServiceInfo &&Service)
+{
+	if (Service.EventList.empty())
+		return false;
+
+	if (m_SourceID != 0) {
+		for (EventInfo &Event : Service.EventList)
+			Event.SourceID = m_SourceID;
+	}
+
+	// 読み込んだ時点の更新番号を記録し、保存時に変更されたかを判定する
+	return m_pEPGDatabase->SetServiceEventList(
+		Service.Info, std::move(Service.EventList), &pEntry->Generation);
+}
+
+
+void EPGDataFile::GetEarliestTime(DateTime *pTime) const
+{
+	if (!!(m_OpenFlags & OpenFlag::DiscardOld)) {
+		GetCurrentEPGTime(pTime);
+		pTime->OffsetHours(-1);
+	}
+}
+
+
+EPGDataFile::IndexList::iterator EPGDataFile::FindIndexEntry(IndexList &Index, const EPGDatabase::ServiceInfo &Info)
+{
+	IndexEntry Key;
+	Key.Info = Info;
+
+	auto it = std::lower_bound(Index.begin(), Index.end(), Key);
+	if ((it == Index.end()) || !(it->Info == Info))
+		return Index.end();
+
+	return it;
+}
+
+
 void EPGDataFile::ExceptionLog(Exception Code)
 {
 	const CharType *pText;
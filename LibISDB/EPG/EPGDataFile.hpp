@@ -30,13 +30,22 @@
 
 #include "../Base/ObjectBase.hpp"
 #include "../Base/Stream.hpp"
+#include "../Base/MappedFile.hpp"
 #include "EPGDatabase.hpp"
+#include <vector>
 
 
 namespace LibISDB
 {
 
-	/** EPG データファイルクラス */
+	/**
+		EPG データファイルクラス
+
+		OpenFlag::Incremental を指定すると、サービス毎のセグメントと索引からなる形式で保存される。
+		この形式では変更されたサービスのセグメントと新しい索引のみを追記し、
+		無効になったセグメントが多くなった時点でファイル全体を書き直す。
+		読み込み時はファイルをメモリにマップし、LoadService() でサービス毎に読み込むことができる。
+	*/
 	class EPGDataFile
 		: public ObjectBase
 	{
@@ -51,6 +60,7 @@ namespace LibISDB
 			PriorityIdle = 0x0020U, /**< 最低優先度 */
 			DiscardOld   = 0x0040U, /**< 古い情報を破棄 */
 			Flush        = 0x0080U, /**< 書き出し時にフラッシュする */
+			Incremental  = 0x0100U, /**< 索引付きの形式で追記して保存する */
 		};
 
 		enum class Exception {
@@ -73,12 +83,17 @@ namespace LibISDB
 		bool Load();
 		bool LoadMerged();
 		bool LoadHeader();
+		bool LoadIndex();
+		bool LoadService(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID);
+		bool GetServiceList(ReturnArg<EPGDatabase::ServiceList> List) const;
 		bool Save();
+		bool Compact();
 
 		EPGDatabase * GetEPGDatabase() const noexcept { return m_pEPGDatabase; }
 		const String & GetFileName() const noexcept { return m_FileName; }
 		OpenFlag GetOpenFlags() const noexcept { return m_OpenFlags; }
 		uint64_t GetUpdateCount() const noexcept { return m_UpdateCount; }
+		uint32_t GetFileVersion() const noexcept { return m_FileVersion; }
 		void SetSourceID(EventInfo::SourceIDType ID) noexcept { m_SourceID = ID; }
 		EventInfo::SourceIDType GetSourceID() const noexcept { return m_SourceID; }
 
@@ -88,6 +103,19 @@ namespace LibISDB
 			EPGDatabase::EventList EventList;
 		};
 
+		struct IndexEntry {
+			EPGDatabase::ServiceInfo Info;
+			uint16_t EventCount;
+			uint64_t Offset;
+			uint32_t Size;
+			uint32_t CRC;
+			uint64_t Generation; /**< データベースと同じ内容の場合、そのサービスの更新番号 */
+
+			bool operator < (const IndexEntry &rhs) const noexcept { return Info < rhs.Info; }
+		};
+
+		typedef std::vector<IndexEntry> IndexList;
+
 		void LoadService(Stream &File, ServiceInfo *pServiceInfo);
 		void LoadEvent(Stream &File, const ServiceInfo *pServiceInfo, EventInfo *pEvent);
 		void SaveService(
@@ -96,11 +124,32 @@ namespace LibISDB
 		void SaveEvent(Stream &File, const EventInfo &Event);
 		void ExceptionLog(Exception Code);
 
+		bool OpenIndex(bool LogError);
+		bool ReadIndex();
+		void ScanIndex();
+		bool MapFile();
+		void DecodeService(const IndexEntry &Entry, ServiceInfo *pServiceInfo);
+		bool SetServiceEventList(IndexEntry *pEntry, ServiceInfo &&Service);
+		uint16_t SerializeService(
+			const EPGDatabase::ServiceInfo &Info, const DateTime &EarliestTime,
+			std::vector<uint8_t> *pBuffer);
+		void SerializeIndex(const IndexList &Index, uint64_t BaseOffset, std::vector<uint8_t> *pBuffer);
+		bool CheckSegment(const IndexEntry &Entry) const;
+		bool ReplaceWithTempFile(const String &TempFileName);
+		bool SaveIncremental();
+		void GetEarliestTime(DateTime *pTime) const;
+		static IndexList::iterator FindIndexEntry(IndexList &Index, const EPGDatabase::ServiceInfo &Info);
+
 		EPGDatabase *m_pEPGDatabase;
 		String m_FileName;
 		OpenFlag m_OpenFlags;
 		uint64_t m_UpdateCount;
 		EventInfo::SourceIDType m_SourceID;
+		uint32_t m_FileVersion;
+		MappedFile m_MappedFile;
+		IndexList m_Index;
+		bool m_IndexLoaded;
+		uint64_t m_FileSize;
 	};
 
 	LIBISDB_ENUM_FLAGS(EPGDataFile::OpenFlag)
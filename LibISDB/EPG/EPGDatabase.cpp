@@ -28,6 +28,7 @@
 #include "EPGDatabase.hpp"
 #include <algorithm>
 #include "../Base/ARIBTime.hpp"
+#include "../Base/ARIBStringCache.hpp"
 #include "../Utilities/Utilities.hpp"
 #include "../Base/DebugDef.hpp"
 
@@ -61,28 +62,122 @@ unsigned long long GetScheduleTime(unsigned long long CurTime, uint16_t TableID,
 
 
 
+/** サービスマップの共有ロック(データベースのロックを保持しているスレッドではロックしない) */
+class EPGDatabase::ServiceMapReadLock
+{
+public:
+	ServiceMapReadLock(const EPGDatabase &Database)
+		: m_pLock(Database.m_DatabaseLock.IsOwnedByCurrentThread() ? nullptr : &Database.m_ServiceMapLock)
+	{
+		if (m_pLock != nullptr)
+			m_pLock->LockShared();
+	}
+
+	~ServiceMapReadLock()
+	{
+		Unlock();
+	}
+
+	ServiceMapReadLock(const ServiceMapReadLock &) = delete;
+	ServiceMapReadLock & operator = (const ServiceMapReadLock &) = delete;
+
+	void Unlock()
+	{
+		if (m_pLock != nullptr) {
+			m_pLock->UnlockShared();
+			m_pLock = nullptr;
+		}
+	}
+
+private:
+	SharedLock *m_pLock;
+};
+
+
+
+
 EPGDatabase::EPGDatabase() noexcept
-	: m_IsUpdated(false)
+	: m_DatabaseLock(m_ServiceMapLock)
+	, m_CompatibleLock(m_DatabaseLock)
+	, m_IsUpdated(false)
 	, m_ScheduleOnly(false)
 	, m_NoPastEvents(true)
 	, m_StringDecodeFlags(ARIBStringDecoder::DecodeFlag::UseCharSize)
+	, m_pStringCache(nullptr)
 	, m_CurTOTSeconds(0)
 {
 }
 
 
+template<typename TFunc> bool EPGDatabase::ReadService(const ServiceInfo &Info, TFunc Func) const
+{
+	ServiceMapReadLock MapLock(*this);
+
+	auto it = m_ServiceMap.find(Info);
+	if (it == m_ServiceMap.end())
+		return false;
+
+	SharedBlockLock ServiceLock(it->second.Lock);
+
+	Func(static_cast<const ServiceEventMap &>(it->second.Events));
+
+	return true;
+}
+
+
+template<typename TFunc> bool EPGDatabase::WriteService(
+	const ServiceInfo &Info, bool Create, TFunc Func, uint64_t *pGeneration)
+{
+	{
+		ServiceMapReadLock MapLock(*this);
+
+		auto it = m_ServiceMap.find(Info);
+		if (it != m_ServiceMap.end()) {
+			BlockLock ServiceLock(it->second.Lock);
+
+			it->second.Snapshot.reset();
+			Func(it->second.Events, false);
+			it->second.Generation = NextServiceGeneration();
+			if (pGeneration != nullptr)
+				*pGeneration = it->second.Generation;
+
+			return true;
+		}
+	}
+
+	if (!Create)
+		return false;
+
+	// サービスの追加はデータベース全体をロックして行う
+	BlockLock Lock(m_DatabaseLock);
+
+	bool Inserted;
+	ServiceEntry &Entry = InsertService(Info, &Inserted);
+
+	Entry.Snapshot.reset();
+	Func(Entry.Events, Inserted);
+	Entry.Generation = NextServiceGeneration();
+	if (pGeneration != nullptr)
+		*pGeneration = Entry.Generation;
+
+	return true;
+}
+
+
 void EPGDatabase::Clear()
 {
-	BlockLock Lock(m_Lock);
+	BlockLock Lock(m_DatabaseLock);
 
 	m_ServiceMap.clear();
 	m_PendingServiceMap.clear();
+
+	m_StringPool.Purge();
 }
 
 
 int EPGDatabase::GetServiceCount() const
 {
-	BlockLock Lock(m_Lock);
+	ServiceMapReadLock Lock(*this);
 
 	return static_cast<int>(m_ServiceMap.size());
 }
@@ -93,7 +188,7 @@ bool EPGDatabase::GetServiceList(ServiceList *pList) const
 	if (LIBISDB_TRACE_ERROR_IF(pList == nullptr))
 		return false;
 
-	BlockLock Lock(m_Lock);
+	ServiceMapReadLock Lock(*this);
 
 	pList->resize(m_ServiceMap.size());
 
@@ -109,28 +204,48 @@ bool EPGDatabase::GetServiceList(ServiceList *pList) const
 
 bool EPGDatabase::IsServiceUpdated(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID) const
 {
-	BlockLock Lock(m_Lock);
+	bool IsUpdated = false;
 
-	auto it = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (it == m_ServiceMap.end())
-		return false;
-	return it->second.IsUpdated;
+	ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) { IsUpdated = Service.IsUpdated; });
+
+	return IsUpdated;
 }
 
 
 bool EPGDatabase::ResetServiceUpdated(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID)
 {
-	BlockLock Lock(m_Lock);
+	ServiceMapReadLock MapLock(*this);
 
-	auto it = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (it == m_ServiceMap.end())
+	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
+	if (itService == m_ServiceMap.end())
 		return false;
-	it->second.IsUpdated = false;
+
+	// スナップショットの内容は変わらないので破棄しない
+	BlockLock ServiceLock(itService->second.Lock);
+	itService->second.Events.IsUpdated = false;
 
 	return true;
 }
 
 
+// サービスの更新番号を取得する
+// 番組情報が変わる度に全てのデータベースで重複しない番号に更新される(サービスが無い場合は 0)
+uint64_t EPGDatabase::GetServiceGeneration(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID) const
+{
+	ServiceMapReadLock MapLock(*this);
+
+	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
+	if (itService == m_ServiceMap.end())
+		return 0;
+
+	SharedBlockLock ServiceLock(itService->second.Lock);
+
+	return itService->second.Generation;
+}
+
+
 bool EPGDatabase::GetEventList(
 	uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID,
 	ReturnArg<EventList> List, OptionalReturnArg<TimeEventMap> TimeMap) const
@@ -140,34 +255,29 @@ bool EPGDatabase::GetEventList(
 
 	List->clear();
 
-	BlockLock Lock(m_Lock);
-
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService == m_ServiceMap.end())
-		return false;
-
-	const ServiceEventMap &Service = itService->second;
-
-	List->reserve(Service.EventMap.size());
-
-	if (TimeMap) {
-		TimeMap->clear();
-		for (auto &Time : Service.TimeMap) {
-			auto itEvent = Service.EventMap.find(Time.EventID);
-			if ((itEvent != Service.EventMap.end())
-					&& IsEventValid(itEvent->second)) {
-				List->push_back(itEvent->second);
-				TimeMap->insert(Time);
+	return ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) {
+			List->reserve(Service.EventMap.size());
+
+			if (TimeMap) {
+				TimeMap->clear();
+				TimeMap->reserve(Service.TimeMap.size());
+				for (auto &Time : Service.TimeMap) {
+					auto itEvent = Service.EventMap.find(Time.EventID);
+					if ((itEvent != Service.EventMap.end())
+							&& IsEventValid(itEvent->second)) {
+						List->push_back(itEvent->second);
+						TimeMap->insert(Time);
+					}
+				}
+			} else {
+				for (auto &Event : Service.EventMap) {
+					if (IsEventValid(Event.second))
+						List->push_back(Event.second);
+				}
 			}
-		}
-	} else {
-		for (auto &Event : Service.EventMap) {
-			if (IsEventValid(Event.second))
-				List->push_back(Event.second);
-		}
-	}
-
-	return true;
+		});
 }
 
 
@@ -180,25 +290,54 @@ bool EPGDatabase::GetEventListSortedByTime(
 
 	List->clear();
 
-	BlockLock Lock(m_Lock);
+	return ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) {
+			List->reserve(Service.EventMap.size());
+
+			for (auto &Time : Service.TimeMap) {
+				auto itEvent = Service.EventMap.find(Time.EventID);
+				if ((itEvent != Service.EventMap.end())
+						&& IsEventValid(itEvent->second)) {
+					List->push_back(itEvent->second);
+				}
+			}
+		});
+}
+
+
+EPGDatabase::EventListSnapshotPtr EPGDatabase::GetEventListSnapshot(
+	uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID) const
+{
+	ServiceMapReadLock MapLock(*this);
 
 	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
 	if (itService == m_ServiceMap.end())
-		return false;
+		return nullptr;
 
-	const ServiceEventMap &Service = itService->second;
+	const ServiceEntry &Entry = itService->second;
+	SharedBlockLock ServiceLock(Entry.Lock);
+	BlockLock SnapshotLock(Entry.SnapshotLock);
 
-	List->reserve(Service.EventMap.size());
+	// 更新されるまでは同じスナップショットを共有する
+	if (!Entry.Snapshot) {
+		const ServiceEventMap &Service = Entry.Events;
+		EventList List;
 
-	for (auto &Time : Service.TimeMap) {
-		auto itEvent = Service.EventMap.find(Time.EventID);
-		if ((itEvent != Service.EventMap.end())
-				&& IsEventValid(itEvent->second)) {
-			List->push_back(itEvent->second);
+		List.reserve(Service.EventMap.size());
+
+		for (auto &Time : Service.TimeMap) {
+			auto itEvent = Service.EventMap.find(Time.EventID);
+			if ((itEvent != Service.EventMap.end())
+					&& IsEventValid(itEvent->second)) {
+				List.push_back(itEvent->second);
+			}
 		}
+
+		Entry.Snapshot = std::make_shared<EventListSnapshot>(itService->first, std::move(List));
 	}
 
-	return true;
+	return Entry.Snapshot;
 }
 
 
@@ -209,20 +348,24 @@ bool EPGDatabase::GetEventInfo(
 	if (!Info)
 		return false;
 
-	BlockLock Lock(m_Lock);
+	bool Found = false;
 
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService != m_ServiceMap.end()) {
-		auto itEvent = itService->second.EventMap.find(EventID);
-		if ((itEvent != itService->second.EventMap.end())
-				&& IsEventValid(itEvent->second)) {
-			*Info = itEvent->second;
-			SetCommonEventInfo(&*Info);
-			return true;
-		}
-	}
+	ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) {
+			auto itEvent = Service.EventMap.find(EventID);
+			if ((itEvent != Service.EventMap.end())
+					&& IsEventValid(itEvent->second)) {
+				*Info = itEvent->second;
+				Found = true;
+			}
+		});
 
-	return false;
+	// 共有イベントの参照先はこのサービスのロックを解放してから取得する
+	if (Found)
+		SetCommonEventInfo(&*Info);
+
+	return Found;
 }
 
 
@@ -233,26 +376,28 @@ bool EPGDatabase::GetEventInfo(
 	if (!Info)
 		return false;
 
-	BlockLock Lock(m_Lock);
-
 	bool Found = false;
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService != m_ServiceMap.end()) {
-		TimeEventInfo Key(Time);
-		auto itTime = itService->second.TimeMap.upper_bound(Key);
-		if (itTime != itService->second.TimeMap.begin()) {
-			--itTime;
-			if (itTime->StartTime + itTime->Duration > Key.StartTime) {
-				auto itEvent = itService->second.EventMap.find(itTime->EventID);
-				if ((itEvent != itService->second.EventMap.end())
-						&& IsEventValid(itEvent->second)) {
-					*Info = itEvent->second;
-					SetCommonEventInfo(&*Info);
-					Found = true;
+
+	ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) {
+			TimeEventInfo Key(Time);
+			auto itTime = Service.TimeMap.upper_bound(Key);
+			if (itTime != Service.TimeMap.begin()) {
+				--itTime;
+				if (itTime->StartTime + itTime->Duration > Key.StartTime) {
+					auto itEvent = Service.EventMap.find(itTime->EventID);
+					if ((itEvent != Service.EventMap.end())
+							&& IsEventValid(itEvent->second)) {
+						*Info = itEvent->second;
+						Found = true;
+					}
 				}
 			}
-		}
-	}
+		});
+
+	if (Found)
+		SetCommonEventInfo(&*Info);
 
 	return Found;
 }
@@ -265,23 +410,25 @@ bool EPGDatabase::GetNextEventInfo(
 	if (!Info)
 		return false;
 
-	BlockLock Lock(m_Lock);
-
 	bool Found = false;
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService != m_ServiceMap.end()) {
-		TimeEventInfo Key(Time);
-		auto itTime = itService->second.TimeMap.upper_bound(Key);
-		if (itTime != itService->second.TimeMap.end()) {
-			auto itEvent = itService->second.EventMap.find(itTime->EventID);
-			if ((itEvent != itService->second.EventMap.end())
-					&& IsEventValid(itEvent->second)) {
-				*Info = itEvent->second;
-				SetCommonEventInfo(&*Info);
-				Found = true;
+
+	ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) {
+			TimeEventInfo Key(Time);
+			auto itTime = Service.TimeMap.upper_bound(Key);
+			if (itTime != Service.TimeMap.end()) {
+				auto itEvent = Service.EventMap.find(itTime->EventID);
+				if ((itEvent != Service.EventMap.end())
+						&& IsEventValid(itEvent->second)) {
+					*Info = itEvent->second;
+					Found = true;
+				}
 			}
-		}
-	}
+		});
+
+	if (Found)
+		SetCommonEventInfo(&*Info);
 
 	return Found;
 }
@@ -294,18 +441,18 @@ bool EPGDatabase::EnumEventsUnsorted(
 	if (!Callback)
 		return false;
 
-	BlockLock Lock(m_Lock);
+	EventList List;
 
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService == m_ServiceMap.end())
+	if (!ReadService(
+			ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+			[&](const ServiceEventMap &Service) {
+				List.reserve(Service.EventMap.size());
+				for (auto &Event : Service.EventMap)
+					List.push_back(Event.second);
+			}))
 		return false;
 
-	for (auto &Event : itService->second.EventMap) {
-		if (!Callback(Event.second))
-			break;
-	}
-
-	return true;
+	return CallEventCallback(List, Callback);
 }
 
 
@@ -316,21 +463,21 @@ bool EPGDatabase::EnumEventsSortedByTime(
 	if (!Callback)
 		return false;
 
-	BlockLock Lock(m_Lock);
+	EventList List;
 
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService == m_ServiceMap.end())
+	if (!ReadService(
+			ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+			[&](const ServiceEventMap &Service) {
+				List.reserve(Service.EventMap.size());
+				for (auto &Time : Service.TimeMap) {
+					auto itEvent = Service.EventMap.find(Time.EventID);
+					if (itEvent != Service.EventMap.end())
+						List.push_back(itEvent->second);
+				}
+			}))
 		return false;
 
-	for (auto &Time : itService->second.TimeMap) {
-		auto itEvent = itService->second.EventMap.find(Time.EventID);
-		if (itEvent != itService->second.EventMap.end()) {
-			if (!Callback(itEvent->second))
-				break;
-		}
-	}
-
-	return true;
+	return CallEventCallback(List, Callback);
 }
 
 
@@ -342,64 +489,109 @@ bool EPGDatabase::EnumEventsSortedByTime(
 	if (!Callback)
 		return false;
 
-	BlockLock Lock(m_Lock);
+	EventList List;
+
+	if (!ReadService(
+			ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+			[&](const ServiceEventMap &Service) {
+				TimeEventMap::const_iterator itTime, itEnd;
+
+				if ((pEarliest != nullptr) && pEarliest->IsValid()) {
+					TimeEventInfo Key(*pEarliest);
+					itTime = Service.TimeMap.upper_bound(Key);
+					if (itTime != Service.TimeMap.begin()) {
+						auto itPrev = itTime;
+						--itPrev;
+						if (itPrev->StartTime + itPrev->Duration > Key.StartTime)
+							itTime = itPrev;
+					}
+				} else {
+					itTime = Service.TimeMap.begin();
+				}
+
+				if ((pLatest != nullptr) && pLatest->IsValid()) {
+					itEnd = Service.TimeMap.lower_bound(TimeEventInfo(*pLatest));
+				} else {
+					itEnd = Service.TimeMap.end();
+				}
+
+				for (;itTime != itEnd; ++itTime) {
+					auto itEvent = Service.EventMap.find(itTime->EventID);
+					if (itEvent != Service.EventMap.end())
+						List.push_back(itEvent->second);
+				}
+			}))
+		return false;
+
+	return CallEventCallback(List, Callback);
+}
+
+
+bool EPGDatabase::GetServiceMemoryUsage(
+	uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID,
+	ReturnArg<MemoryUsage> Usage) const
+{
+	if (!Usage)
+		return false;
+
+	*Usage = MemoryUsage();
+
+	ServiceMapReadLock MapLock(*this);
 
 	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
 	if (itService == m_ServiceMap.end())
 		return false;
 
-	TimeEventMap::const_iterator itTime, itEnd;
+	std::unordered_set<const String *> StringSet;
+	AddServiceMemoryUsage(itService->second, &*Usage, &StringSet);
 
-	if ((pEarliest != nullptr) && pEarliest->IsValid()) {
-		TimeEventInfo Key(*pEarliest);
-		itTime = itService->second.TimeMap.upper_bound(Key);
-		if (itTime != itService->second.TimeMap.begin()) {
-			auto itPrev = itTime;
-			--itPrev;
-			if (itPrev->StartTime + itPrev->Duration > Key.StartTime)
-				itTime = itPrev;
-		}
-	} else {
-		itTime = itService->second.TimeMap.begin();
-	}
+	return true;
+}
 
-	if ((pLatest != nullptr) && pLatest->IsValid()) {
-		itEnd = itService->second.TimeMap.lower_bound(TimeEventInfo(*pLatest));
-	} else {
-		itEnd = itService->second.TimeMap.end();
-	}
 
-	for (;itTime != itEnd; ++itTime) {
-		auto itEvent = itService->second.EventMap.find(itTime->EventID);
-		if (itEvent != itService->second.EventMap.end()) {
-			if (!Callback(itEvent->second))
-				break;
-		}
-	}
+bool EPGDatabase::GetMemoryUsage(ReturnArg<MemoryUsage> Usage) const
+{
+	if (!Usage)
+		return false;
+
+	*Usage = MemoryUsage();
+
+	ServiceMapReadLock MapLock(*this);
+
+	// サービス間で共有されている文字列は 1 回のみ数える
+	std::unordered_set<const String *> StringSet;
+	for (auto &Service : m_ServiceMap)
+		AddServiceMemoryUsage(Service.second, &*Usage, &StringSet);
 
 	return true;
 }
 
 
-bool EPGDatabase::SetServiceEventList(const ServiceInfo &Info, EventList &&List)
+bool EPGDatabase::SetServiceEventList(
+	const ServiceInfo &Info, EventList &&List, OptionalReturnArg<uint64_t> Generation)
 {
-	BlockLock Lock(m_Lock);
+	uint64_t NewGeneration;
 
-	auto it = m_ServiceMap.find(Info);
-	if (it != m_ServiceMap.end())
-		m_ServiceMap.erase(it);
+	WriteService(
+		Info, true,
+		[&](ServiceEventMap &Service, bool) {
+			Service = ServiceEventMap();
+			Service.EventMap.rehash(300);
 
-	ServiceEventMap &Service = m_ServiceMap.emplace(
-		std::piecewise_construct,
-		std::forward_as_tuple(Info),
-		std::forward_as_tuple()).first->second;
+			std::vector<TimeEventInfo> TimeList;
+			TimeList.reserve(List.size());
 
-	Service.EventMap.rehash(300);
+			for (EventInfo &Event : List) {
+				TimeList.emplace_back(Event);
+				Event.InternStrings(m_StringPool);
+				Service.EventMap.emplace(Event.EventID, std::move(Event));
+			}
 
-	for (EventInfo &Event : List) {
-		Service.EventMap.emplace(Event.EventID, std::move(Event));
-		Service.TimeMap.emplace(Event);
-	}
+			Service.TimeMap.InsertBatch(std::move(TimeList));
+		},
+		&NewGeneration);
+
+	Generation = NewGeneration;
 
 	return true;
 }
@@ -412,10 +604,18 @@ bool EPGDatabase::Merge(
 	if (LIBISDB_TRACE_ERROR_IF(pSrcDatabase == nullptr))
 		return false;
 
-	BlockLock Lock(m_Lock);
+	BlockLock SrcLock(pSrcDatabase->m_DatabaseLock);
 
+	// サービス毎にロックするため、他のサービスの参照や更新はブロックされない
 	for (auto &SrcService : pSrcDatabase->m_ServiceMap) {
-		MergeEventMap(SrcService.first, SrcService.second, Flags, SourceID);
+		if (SrcService.second.Events.EventMap.empty())
+			continue;
+
+		WriteService(
+			SrcService.first, true,
+			[&](ServiceEventMap &Service, bool Created) {
+				MergeEventMap(SrcService.first, Service, Created, SrcService.second.Events, Flags, SourceID);
+			});
 	}
 
 	return true;
@@ -430,14 +630,20 @@ bool EPGDatabase::MergeService(
 	if (LIBISDB_TRACE_ERROR_IF(pSrcDatabase == nullptr))
 		return false;
 
+	BlockLock SrcLock(pSrcDatabase->m_DatabaseLock);
+
 	const ServiceInfo Key(NetworkID, TransportStreamID, ServiceID);
 	auto itSrcService = pSrcDatabase->m_ServiceMap.find(Key);
 	if (itSrcService == pSrcDatabase->m_ServiceMap.end())
 		return false;
 
-	BlockLock Lock(m_Lock);
-
-	MergeEventMap(itSrcService->first, itSrcService->second, Flags, SourceID);
+	if (!itSrcService->second.Events.EventMap.empty()) {
+		WriteService(
+			Key, true,
+			[&](ServiceEventMap &Service, bool Created) {
+				MergeEventMap(Key, Service, Created, itSrcService->second.Events, Flags, SourceID);
+			});
+	}
 
 	return true;
 }
@@ -445,25 +651,27 @@ bool EPGDatabase::MergeService(
 
 bool EPGDatabase::IsScheduleComplete(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID, bool Extended) const
 {
-	BlockLock Lock(m_Lock);
+	bool IsComplete = false;
 
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService == m_ServiceMap.end())
-		return false;
+	ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) {
+			IsComplete = Service.Schedule.IsComplete(m_CurTOTTime.Hour, Extended);
+		});
 
-	return itService->second.Schedule.IsComplete(m_CurTOTTime.Hour, Extended);
+	return IsComplete;
 }
 
 
 bool EPGDatabase::HasSchedule(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID, bool Extended) const
 {
-	BlockLock Lock(m_Lock);
+	bool Has = false;
 
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService == m_ServiceMap.end())
-		return false;
+	ReadService(
+		ServiceInfo(NetworkID, TransportStreamID, ServiceID),
+		[&](const ServiceEventMap &Service) { Has = Service.Schedule.HasSchedule(Extended); });
 
-	return itService->second.Schedule.HasSchedule(Extended);
+	return Has;
 }
 
 
@@ -471,16 +679,16 @@ void EPGDatabase::ResetScheduleStatus()
 {
 	LIBISDB_TRACE(LIBISDB_STR("EPGDatabase::ResetScheduleStatus()\n"));
 
-	BlockLock Lock(m_Lock);
+	BlockLock Lock(m_DatabaseLock);
 
 	for (auto &e : m_ServiceMap)
-		e.second.Schedule.Reset();
+		e.second.Events.Schedule.Reset();
 }
 
 
 void EPGDatabase::SetScheduleOnly(bool ScheduleOnly)
 {
-	BlockLock Lock(m_Lock);
+	BlockLock Lock(m_DatabaseLock);
 
 	m_ScheduleOnly = ScheduleOnly;
 }
@@ -488,7 +696,7 @@ void EPGDatabase::SetScheduleOnly(bool ScheduleOnly)
 
 void EPGDatabase::SetNoPastEvents(bool NoPastEvents)
 {
-	BlockLock Lock(m_Lock);
+	BlockLock Lock(m_DatabaseLock);
 
 	m_NoPastEvents = NoPastEvents;
 }
@@ -496,12 +704,22 @@ void EPGDatabase::SetNoPastEvents(bool NoPastEvents)
 
 void EPGDatabase::SetStringDecodeFlags(ARIBStringDecoder::DecodeFlag Flags)
 {
-	BlockLock Lock(m_Lock);
+	BlockLock Lock(m_DatabaseLock);
 
 	m_StringDecodeFlags = Flags;
 }
 
 
+// 文字列のデコード結果のキャッシュを設定する
+// 異なるサービスの更新は並行して行われるため、スレッドセーフなキャッシュのみ受け付ける
+void EPGDatabase::SetStringCache(ConcurrentARIBStringCache *pCache)
+{
+	BlockLock Lock(m_DatabaseLock);
+
+	m_pStringCache = pCache;
+}
+
+
 bool EPGDatabase::AddEventListener(EventListener *pEventListener)
 {
 	return m_EventListenerList.AddEventListener(pEventListener);
@@ -525,27 +743,37 @@ bool EPGDatabase::UpdateSection(
 	if ((TableID < 0x4E) || (TableID > 0x6F))
 		return false;
 
-	BlockLock Lock(m_Lock);
-
 	const bool IsSchedule = (TableID >= 0x50);
 	const bool IsExtended = (IsSchedule && ((TableID & 0x08) != 0));
-	if (m_ScheduleOnly && !IsSchedule)
-		return false;
 
 	const ServiceInfo Key(
 		pEITTable->GetOriginalNetworkID(),
 		pEITTable->GetTransportStreamID(),
 		pEITTable->GetServiceID());
-	auto [itService, ServiceInserted] = m_ServiceMap.emplace(
-		std::piecewise_construct,
-		std::forward_as_tuple(Key),
-		std::forward_as_tuple());
-	ServiceEventMap &Service = itService->second;
-	if (ServiceInserted) {
-		Service.EventMap.rehash(300);
-		Service.ScheduleUpdatedTime = m_CurTOTTime;
+
+	{
+		ServiceMapReadLock MapLock(*this);
+		if (m_ScheduleOnly && !IsSchedule)
+			return false;
 	}
 
+	CreateService(Key);
+
+	ServiceMapReadLock MapLock(*this);
+
+	auto itService = m_ServiceMap.find(Key);
+	if (itService == m_ServiceMap.end())
+		return false;	// Clear() された
+
+	// 他のサービスの参照と更新はブロックしない
+	LockGuard ServiceLock(itService->second.Lock);
+	itService->second.Snapshot.reset();
+	ServiceEventMap &Service = itService->second.Events;
+	ServiceEventMap *pPendingService = nullptr;
+	ARIBStringDecoder StringDecoder;
+	StringDecoder.SetCache(m_pStringCache);
+	bool IsScheduleReset = false, IsServiceCompleted = false;
+
 	DateTime CurSysTime;
 	if (m_NoPastEvents)
 		GetCurrentEPGTime(&CurSysTime);
@@ -559,6 +787,8 @@ bool EPGDatabase::UpdateSection(
 		const uint16_t TransportStreamID = pEITTable->GetTransportStreamID();
 		const uint16_t ServiceID = pEITTable->GetServiceID();
 		ARIBString StrBuf;
+		CStringView TextBuf;
+		std::vector<TimeEventInfo> TimeBatch;
 
 		for (int i = 0; i < EventCount; i++) {
 			const EITTable::EventInfo *pEventInfo = pEITTable->GetEventInfo(i);
@@ -600,12 +830,14 @@ bool EPGDatabase::UpdateSection(
 			}
 
 			ServiceEventMap *pService = &Service;
-			ServiceEventMap *pPendingService = nullptr;
 			if (m_CurTOTSeconds == 0) {
-				pPendingService = &m_PendingServiceMap.emplace(
-					std::piecewise_construct,
-					std::forward_as_tuple(Key),
-					std::forward_as_tuple()).first->second;
+				if (pPendingService == nullptr) {
+					BlockLock PendingLock(m_PendingLock);
+					pPendingService = &m_PendingServiceMap.emplace(
+						std::piecewise_construct,
+						std::forward_as_tuple(Key),
+						std::forward_as_tuple()).first->second;
+				}
 				if (IsPending) {
 					pService = pPendingService;
 
@@ -631,11 +863,19 @@ bool EPGDatabase::UpdateSection(
 				TimeEvent.EventID = pEventInfo->EventID;
 				TimeEvent.UpdatedTime = m_CurTOTSeconds;
 
-				bool TimeUpdated = false;
-				if (!UpdateTimeMap(*pService, TimeEvent, &TimeUpdated))
-					continue;
-				if (TimeUpdated && !IsPending)
-					IsUpdated = true;
+				// TOT 取得後は、既存の番組と重ならない番組の索引はまとめて追加する
+				if ((m_CurTOTSeconds == 0) || !AddTimeMapBatch(*pService, TimeEvent, &TimeBatch)) {
+					if (!TimeBatch.empty()) {
+						Service.TimeMap.InsertBatch(std::move(TimeBatch));
+						TimeBatch.clear();
+					}
+
+					bool TimeUpdated = false;
+					if (!UpdateTimeMap(*pService, TimeEvent, &TimeUpdated))
+						continue;
+					if (TimeUpdated && !IsPending)
+						IsUpdated = true;
+				}
 			}
 
 			// イベントを追加 or 既存のイベントを取得
@@ -703,14 +943,23 @@ bool EPGDatabase::UpdateSection(
 			const ShortEventDescriptor *pShortEvent =
 				pDescBlock->GetDescriptor<ShortEventDescriptor>();
 			if (pShortEvent != nullptr) {
-				if (pShortEvent->GetEventName(&StrBuf))
-					m_StringDecoder.Decode(StrBuf, &pEvent->EventName, m_StringDecodeFlags);
-				if (pShortEvent->GetEventDescription(&StrBuf))
-					m_StringDecoder.Decode(StrBuf, &pEvent->EventText, m_StringDecodeFlags);
+				if (pShortEvent->GetEventName(&StrBuf)) {
+					StringDecoder.Decode(StrBuf, &TextBuf, m_StringDecodeFlags);
+					pEvent->EventName = m_StringPool.Intern(TextBuf);
+				}
+				if (pShortEvent->GetEventDescription(&StrBuf)) {
+					StringDecoder.Decode(StrBuf, &TextBuf, m_StringDecodeFlags);
+					pEvent->EventText = m_StringPool.Intern(TextBuf);
+				}
 			}
 
 			// 拡張形式イベント記述子
-			if (!GetEventExtendedTextList(pDescBlock, m_StringDecoder, m_StringDecodeFlags, &pEvent->ExtendedText)) {
+			if (GetEventExtendedTextList(pDescBlock, StringDecoder, m_StringDecodeFlags, &pEvent->ExtendedText)) {
+				for (EventInfo::ExtendedTextInfo &Text : pEvent->ExtendedText) {
+					Text.Description = m_StringPool.Intern(Text.Description);
+					Text.Text = m_StringPool.Intern(Text.Text);
+				}
+			} else {
 				if (!IsExtended)
 					MergeEventExtendedInfo(*pService, pEvent);
 			}
@@ -726,8 +975,10 @@ bool EPGDatabase::UpdateSection(
 						Info.ComponentType = pComponentDesc->GetComponentType();
 						Info.ComponentTag = pComponentDesc->GetComponentTag();
 						Info.LanguageCode = pComponentDesc->GetLanguageCode();
-						if (pComponentDesc->GetText(&StrBuf))
-							m_StringDecoder.Decode(StrBuf, &Info.Text, m_StringDecodeFlags);
+						if (pComponentDesc->GetText(&StrBuf)) {
+							StringDecoder.Decode(StrBuf, &TextBuf, m_StringDecodeFlags);
+							Info.Text = m_StringPool.Intern(TextBuf);
+						}
 					});
 			}
 
@@ -748,8 +999,10 @@ bool EPGDatabase::UpdateSection(
 						Info.SamplingRate = pAudioDesc->GetSamplingRate();
 						Info.LanguageCode = pAudioDesc->GetLanguageCode();
 						Info.LanguageCode2 = pAudioDesc->GetLanguageCode2();
-						if (pAudioDesc->GetText(&StrBuf))
-							m_StringDecoder.Decode(StrBuf, &Info.Text);
+						if (pAudioDesc->GetText(&StrBuf)) {
+							StringDecoder.Decode(StrBuf, &TextBuf);
+							Info.Text = m_StringPool.Intern(TextBuf);
+						}
 					});
 			}
 
@@ -804,6 +1057,8 @@ bool EPGDatabase::UpdateSection(
 					MergeEventMapEvent(*pPendingService, EventInfo(*pEvent), MergeFlag::MergeBasicExtended);
 			}
 		}
+
+		Service.TimeMap.InsertBatch(std::move(TimeBatch));
 	} else {
 		// このセグメントで開始するイベントが無い場合
 
@@ -819,7 +1074,7 @@ bool EPGDatabase::UpdateSection(
 						break;
 					LIBISDB_TRACE(LIBISDB_STR("Segment removed\n"));
 					RemoveEvent(Service.EventMap, it->EventID);
-					Service.TimeMap.erase(it++);
+					it = Service.TimeMap.erase(it);
 					IsUpdated = true;
 				}
 			}
@@ -828,6 +1083,7 @@ bool EPGDatabase::UpdateSection(
 
 	if (IsUpdated) {
 		Service.IsUpdated = true;
+		itService->second.Generation = NextServiceGeneration();
 		m_IsUpdated = true;
 	}
 
@@ -843,13 +1099,7 @@ bool EPGDatabase::UpdateSection(
 					itService->first.TransportStreamID,
 					itService->first.ServiceID);
 				Service.Schedule.Reset();
-
-				m_EventListenerList.CallEventListener(
-					&EventListener::OnScheduleStatusReset,
-					this,
-					itService->first.NetworkID,
-					itService->first.TransportStreamID,
-					itService->first.ServiceID);
+				IsScheduleReset = true;
 			}
 		}
 
@@ -868,17 +1118,27 @@ bool EPGDatabase::UpdateSection(
 					itService->first.TransportStreamID,
 					itService->first.ServiceID);
 
-				m_EventListenerList.CallEventListener(
-					&EventListener::OnServiceCompleted,
-					this,
-					itService->first.NetworkID,
-					itService->first.TransportStreamID,
-					itService->first.ServiceID,
-					IsExtended);
+				IsServiceCompleted = true;
 			}
 		}
 	}
 
+	// リスナからデータベースを参照できるように、ロックを解放してから通知する
+	ServiceLock.Unlock();
+	MapLock.Unlock();
+
+	if (IsScheduleReset) {
+		m_EventListenerList.CallEventListener(
+			&EventListener::OnScheduleStatusReset,
+			this, Key.NetworkID, Key.TransportStreamID, Key.ServiceID);
+	}
+
+	if (IsServiceCompleted) {
+		m_EventListenerList.CallEventListener(
+			&EventListener::OnServiceCompleted,
+			this, Key.NetworkID, Key.TransportStreamID, Key.ServiceID, IsExtended);
+	}
+
 	return true;
 }
 
@@ -893,7 +1153,7 @@ bool EPGDatabase::UpdateTOT(const TOTTable *pTOTTable)
 	if (!pTOTTable->GetDateTime(&Time))
 		return false;
 
-	BlockLock Lock(m_Lock);
+	BlockLock Lock(m_DatabaseLock);
 
 	m_CurTOTTime = Time;
 	m_CurTOTSeconds = Time.GetLinearSeconds();
@@ -909,7 +1169,16 @@ bool EPGDatabase::UpdateTOT(const TOTTable *pTOTTable)
 				Event.second.UpdatedTime = m_CurTOTSeconds;
 			Service.second.ScheduleUpdatedTime = m_CurTOTTime;
 
-			MergeEventMap(Service.first, Service.second, MergeFlag::MergeBasicExtended | MergeFlag::SetServiceUpdated);
+			if (Service.second.EventMap.empty())
+				continue;
+
+			bool Inserted;
+			ServiceEntry &Entry = InsertService(Service.first, &Inserted);
+			Entry.Snapshot.reset();
+			MergeEventMap(
+				Service.first, Entry.Events, Inserted, Service.second,
+				MergeFlag::MergeBasicExtended | MergeFlag::SetServiceUpdated);
+			Entry.Generation = NextServiceGeneration();
 		}
 
 		m_PendingServiceMap.clear();
@@ -921,15 +1190,51 @@ bool EPGDatabase::UpdateTOT(const TOTTable *pTOTTable)
 
 void EPGDatabase::ResetTOTTime()
 {
+	BlockLock Lock(m_DatabaseLock);
+
 	m_CurTOTTime.Reset();
 	m_CurTOTSeconds = 0;
 }
 
 
+void EPGDatabase::CreateService(const ServiceInfo &Info)
+{
+	{
+		ServiceMapReadLock MapLock(*this);
+		if (m_ServiceMap.find(Info) != m_ServiceMap.end())
+			return;
+	}
+
+	BlockLock Lock(m_DatabaseLock);
+
+	bool Inserted;
+	InsertService(Info, &Inserted);
+}
+
+
+EPGDatabase::ServiceEntry & EPGDatabase::InsertService(const ServiceInfo &Info, bool *pInserted)
+{
+	// 呼び出し側で m_DatabaseLock をロックする
+
+	auto [itService, Inserted] = m_ServiceMap.try_emplace(Info);
+
+	if (Inserted) {
+		itService->second.Events.EventMap.rehash(300);
+		itService->second.Events.ScheduleUpdatedTime = m_CurTOTTime;
+	}
+
+	*pInserted = Inserted;
+
+	return itService->second;
+}
+
+
 bool EPGDatabase::MergeEventMap(
-	const ServiceInfo &Info, ServiceEventMap &Map,
+	[[maybe_unused]] const ServiceInfo &Info, ServiceEventMap &Service, bool IsNewService, ServiceEventMap &Map,
 	MergeFlag Flags, std::optional<EventInfo::SourceIDType> SourceID)
 {
+	// 呼び出し側で Service の排他ロックを行う
+
 	if (Map.EventMap.empty())
 		return false;
 
@@ -938,16 +1243,19 @@ bool EPGDatabase::MergeEventMap(
 			Event.second.SourceID = *SourceID;
 	}
 
-	auto itService = m_ServiceMap.find(Info);
-	if (itService == m_ServiceMap.end()) {
+	// 文字列はこのデータベースのプールで共有する
+	for (auto &Event : Map.EventMap)
+		Event.second.InternStrings(m_StringPool);
+	for (auto &Event : Map.EventExtendedMap)
+		Event.second.InternStrings(m_StringPool);
+
+	if (IsNewService) {
 		// 新規サービスの追加
-		m_ServiceMap.emplace(Info, std::move(Map));
+		Service = std::move(Map);
 		m_IsUpdated = true;
 		return true;
 	}
 
-	ServiceEventMap &Service = itService->second;
-
 	if (!!(Flags & MergeFlag::DiscardOldEvents)) {
 		// 古い番組情報を破棄する場合
 		Service = std::move(Map);
@@ -1103,26 +1411,26 @@ bool EPGDatabase::UpdateTimeMap(ServiceEventMap &Service, const TimeEventInfo &T
 		}
 
 		// 時間が被っていないか調べる
+		// (被っている番組はまとめて索引から削除する)
 		bool Skip = false;
-		auto it = itCur;
+		auto itFirst = itCur, itLast = itCur;
 
-		for (++it; it != Service.TimeMap.end();) {
-			if (it->StartTime >= Time.StartTime + Time.Duration)
+		for (++itLast; itLast != Service.TimeMap.end(); ++itLast) {
+			if (itLast->StartTime >= Time.StartTime + Time.Duration)
 				break;
-			if (it->UpdatedTime > Time.UpdatedTime) {
+			if (itLast->UpdatedTime > Time.UpdatedTime) {
 				Skip = true;
 				break;
 			}
 			LIBISDB_TRACE(LIBISDB_STR("Event overlapped\n"));
-			RemoveEvent(Service.EventMap, it->EventID);
-			Service.TimeMap.erase(it++);
+			RemoveEvent(Service.EventMap, itLast->EventID);
 			IsUpdated = true;
 		}
+		Service.TimeMap.erase(itCur + 1, itLast);
 
-		if (!Skip && (itCur != Service.TimeMap.begin())) {
-			it = itCur;
-			--it;
-			for (;;) {
+		if (!Skip) {
+			while (itFirst != Service.TimeMap.begin()) {
+				auto it = itFirst - 1;
 				if (it->StartTime + it->Duration <= Time.StartTime)
 					break;
 				if (it->UpdatedTime > Time.UpdatedTime) {
@@ -1132,12 +1440,9 @@ bool EPGDatabase::UpdateTimeMap(ServiceEventMap &Service, const TimeEventInfo &T
 				LIBISDB_TRACE(LIBISDB_STR("Event overlapped\n"));
 				RemoveEvent(Service.EventMap, it->EventID);
 				IsUpdated = true;
-				if (it == Service.TimeMap.begin()) {
-					Service.TimeMap.erase(it);
-					break;
-				}
-				Service.TimeMap.erase(it--);
+				itFirst = it;
 			}
+			itCur = Service.TimeMap.erase(itFirst, itCur);
 		}
 
 		if (Skip) {
@@ -1157,8 +1462,7 @@ bool EPGDatabase::UpdateTimeMap(ServiceEventMap &Service, const TimeEventInfo &T
 	}
 
 	if (!TimeResult.second) {
-		Service.TimeMap.erase(itCur);
-		Service.TimeMap.insert(Time);
+		Service.TimeMap.Replace(itCur, Time);
 		IsUpdated = true;
 	}
 
@@ -1169,45 +1473,72 @@ bool EPGDatabase::UpdateTimeMap(ServiceEventMap &Service, const TimeEventInfo &T
 }
 
 
-const EventInfo * EPGDatabase::GetEventInfoByIDs(
-	uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID, uint16_t EventID) const
+bool EPGDatabase::AddTimeMapBatch(const ServiceEventMap &Service, const TimeEventInfo &Time, std::vector<TimeEventInfo> *pBatch)
 {
-	auto itService = m_ServiceMap.find(ServiceInfo(NetworkID, TransportStreamID, ServiceID));
-	if (itService == m_ServiceMap.end())
-		return nullptr;
+	// UpdateTimeMap() で索引が変更されない場合のみ追加する
+	// (既存の番組や追加済みの番組と時間が被っておらず、開始時刻順に並んでいる)
+	if (!pBatch->empty()) {
+		const TimeEventInfo &Last = pBatch->back();
+		if (Last.StartTime + Last.Duration > Time.StartTime)
+			return false;
+	}
 
-	auto itEvent = itService->second.EventMap.find(EventID);
-	if (itEvent == itService->second.EventMap.end())
-		return nullptr;
+	auto it = Service.TimeMap.lower_bound(Time);
+	if ((it != Service.TimeMap.end()) && (it->StartTime < Time.StartTime + Time.Duration))
+		return false;
+	if (it != Service.TimeMap.begin()) {
+		--it;
+		if (it->StartTime + it->Duration > Time.StartTime)
+			return false;
+	}
 
-	return &itEvent->second;
+	pBatch->push_back(Time);
+
+	return true;
+}
+
+
+bool EPGDatabase::CallEventCallback(
+	const EventList &List, const std::function<bool(const EventInfo &Event)> &Callback)
+{
+	// コールバックからデータベースにアクセスできるように、ロックを解放した状態で呼ぶ
+	for (const EventInfo &Event : List) {
+		if (!Callback(Event))
+			break;
+	}
+
+	return true;
 }
 
 
 bool EPGDatabase::SetCommonEventInfo(EventInfo *pInfo) const
 {
 	// イベント共有の参照先から情報を取得する
+	// サービスのロックを保持していない状態で呼ぶ
+	bool Found = false;
+
 	if (pInfo->IsCommonEvent) {
-		const EventInfo *pCommonEvent = GetEventInfoByIDs(
-			pInfo->NetworkID,
-			pInfo->TransportStreamID,
-			pInfo->CommonEvent.ServiceID,
-			pInfo->CommonEvent.EventID);
-
-		if (pCommonEvent != nullptr) {
-			pInfo->EventName     = pCommonEvent->EventName;
-			pInfo->EventText     = pCommonEvent->EventText;
-			pInfo->ExtendedText  = pCommonEvent->ExtendedText;
-			pInfo->FreeCAMode    = pCommonEvent->FreeCAMode;
-			pInfo->VideoList     = pCommonEvent->VideoList;
-			pInfo->AudioList     = pCommonEvent->AudioList;
-			pInfo->ContentNibble = pCommonEvent->ContentNibble;
+		ReadService(
+			ServiceInfo(pInfo->NetworkID, pInfo->TransportStreamID, pInfo->CommonEvent.ServiceID),
+			[&](const ServiceEventMap &Service) {
+				auto itEvent = Service.EventMap.find(pInfo->CommonEvent.EventID);
+				if (itEvent != Service.EventMap.end()) {
+					const EventInfo &CommonEvent = itEvent->second;
+
+					pInfo->EventName     = CommonEvent.EventName;
+					pInfo->EventText     = CommonEvent.EventText;
+					pInfo->ExtendedText  = CommonEvent.ExtendedText;
+					pInfo->FreeCAMode    = CommonEvent.FreeCAMode;
+					pInfo->VideoList     = CommonEvent.VideoList;
+					pInfo->AudioList     = CommonEvent.AudioList;
+					pInfo->ContentNibble = CommonEvent.ContentNibble;
 
-			return true;
-		}
+					Found = true;
+				}
+			});
 	}
 
-	return false;
+	return Found;
 }
 
 
@@ -1258,6 +1589,65 @@ bool EPGDatabase::MergeEventExtendedInfo(ServiceEventMap &Service, EventInfo *pE
 }
 
 
+void EPGDatabase::AddServiceMemoryUsage(
+	const ServiceEntry &Entry, MemoryUsage *pUsage, std::unordered_set<const String *> *pStringSet) const
+{
+	SharedBlockLock ServiceLock(Entry.Lock);
+	const ServiceEventMap &Service = Entry.Events;
+
+	pUsage->ServiceCount++;
+
+	// 共有されている文字列はオブジェクトのアドレスで判定する
+	for (const EventMapType *pMap : {&Service.EventMap, &Service.EventExtendedMap}) {
+		pUsage->EventCount += pMap->size();
+		pUsage->EventBytes +=
+			pMap->size() * (sizeof(EventMapType::value_type) + sizeof(void *)) +
+			pMap->bucket_count() * sizeof(void *);
+
+		for (auto &Event : *pMap) {
+			Event.second.EnumStrings(
+				[&](const PooledString &Str) {
+					const size_t Size = Str.GetAllocatedSize();
+					if (Size > 0) {
+						if (pStringSet->insert(&Str.Get()).second) {
+							pUsage->StringCount++;
+							pUsage->StringBytes += Size;
+						} else {
+							pUsage->SharedStringBytes += Size;
+						}
+					}
+				});
+
+			pUsage->ListBytes += Event.second.GetAllocatedSize();
+		}
+	}
+
+	pUsage->IndexBytes += Service.TimeMap.capacity() * sizeof(TimeEventInfo);
+
+	EventListSnapshotPtr Snapshot;
+	{
+		BlockLock SnapshotLock(Entry.SnapshotLock);
+		Snapshot = Entry.Snapshot;
+	}
+	if (Snapshot) {
+		pUsage->SnapshotBytes +=
+			sizeof(EventListSnapshot) +
+			Snapshot->GetEventList().capacity() * sizeof(EventInfo) +
+			Snapshot->GetEventCount() * sizeof(uint32_t);
+		for (const EventInfo &Event : *Snapshot)
+			pUsage->SnapshotBytes += Event.GetAllocatedSize();
+	}
+}
+
+
+uint64_t EPGDatabase::NextServiceGeneration() noexcept
+{
+	static std::atomic<uint64_t> Generation(0);
+
+	return ++Generation;
+}
+
+
 bool EPGDatabase::RemoveEvent(EventMapType &Map, uint16_t EventID)
 {
 	auto it = Map.find(EventID);
@@ -1279,6 +1669,121 @@ bool EPGDatabase::RemoveEvent(EventMapType &Map, uint16_t EventID)
 
 
 
+EPGDatabase::EventListSnapshot::EventListSnapshot(const ServiceInfo &Info, EventList &&List)
+	: m_ServiceInfo(Info)
+	, m_EventList(std::move(List))
+{
+	m_EventIDIndex.resize(m_EventList.size());
+	for (uint32_t i = 0; i < m_EventIDIndex.size(); i++)
+		m_EventIDIndex[i] = i;
+	std::sort(
+		m_EventIDIndex.begin(), m_EventIDIndex.end(),
+		[this](uint32_t Index1, uint32_t Index2) -> bool {
+			return m_EventList[Index1].EventID < m_EventList[Index2].EventID;
+		});
+}
+
+
+const EventInfo * EPGDatabase::EventListSnapshot::GetEventByID(uint16_t EventID) const
+{
+	auto it = std::lower_bound(
+		m_EventIDIndex.begin(), m_EventIDIndex.end(), EventID,
+		[this](uint32_t Index, uint16_t ID) -> bool { return m_EventList[Index].EventID < ID; });
+	if ((it == m_EventIDIndex.end()) || (m_EventList[*it].EventID != EventID))
+		return nullptr;
+
+	return &m_EventList[*it];
+}
+
+
+const EventInfo * EPGDatabase::EventListSnapshot::GetEventByTime(const DateTime &Time) const
+{
+	const TimeEventInfo Key(Time);
+
+	auto it = std::upper_bound(
+		m_EventList.begin(), m_EventList.end(), Key.StartTime,
+		[](unsigned long long Time, const EventInfo &Event) -> bool {
+			return Time < Event.StartTime.GetLinearSeconds();
+		});
+	if (it == m_EventList.begin())
+		return nullptr;
+
+	--it;
+	if (it->StartTime.GetLinearSeconds() + it->Duration <= Key.StartTime)
+		return nullptr;
+
+	return &*it;
+}
+
+
+
+
+void EPGDatabase::DatabaseLock::Lock()
+{
+	if (IsOwnedByCurrentThread()) {
+		m_LockCount++;
+		return;
+	}
+
+	m_Lock.Lock();
+	m_OwnerThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+	m_LockCount = 1;
+}
+
+
+void EPGDatabase::DatabaseLock::Unlock()
+{
+	LIBISDB_ASSERT(IsOwnedByCurrentThread() && (m_LockCount > 0));
+
+	if (--m_LockCount == 0) {
+		m_OwnerThread.store(std::thread::id(), std::memory_order_relaxed);
+		m_Lock.Unlock();
+	}
+}
+
+
+bool EPGDatabase::DatabaseLock::TryLock()
+{
+	if (IsOwnedByCurrentThread()) {
+		m_LockCount++;
+		return true;
+	}
+
+	if (!m_Lock.TryLock())
+		return false;
+
+	m_OwnerThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+	m_LockCount = 1;
+
+	return true;
+}
+
+
+bool EPGDatabase::DatabaseLock::TryLock(const std::chrono::milliseconds &Timeout)
+{
+	if (IsOwnedByCurrentThread()) {
+		m_LockCount++;
+		return true;
+	}
+
+	if (!m_Lock.TryLock(Timeout))
+		return false;
+
+	m_OwnerThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+	m_LockCount = 1;
+
+	return true;
+}
+
+
+bool EPGDatabase::DatabaseLock::IsOwnedByCurrentThread() const noexcept
+{
+	return m_OwnerThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+
+
+
 EPGDatabase::TimeEventInfo::TimeEventInfo(unsigned long long Time)
 	: StartTime(Time)
 {
@@ -1293,15 +1798,101 @@ EPGDatabase::TimeEventInfo::TimeEventInfo(const DateTime &StartTime)
 
 EPGDatabase::TimeEventInfo::TimeEventInfo(const EventInfo &Info)
 	: StartTime(Info.StartTime.GetLinearSeconds())
+	, UpdatedTime(Info.UpdatedTime)
 	, Duration(Info.Duration)
 	, EventID(Info.EventID)
-	, UpdatedTime(Info.UpdatedTime)
 {
 }
 
 
 
 
+EPGDatabase::TimeEventIndex::const_iterator EPGDatabase::TimeEventIndex::find(const TimeEventInfo &Key) const
+{
+	auto it = lower_bound(Key);
+	if ((it == m_List.end()) || (it->StartTime != Key.StartTime))
+		return m_List.end();
+	return it;
+}
+
+
+EPGDatabase::TimeEventIndex::const_iterator EPGDatabase::TimeEventIndex::lower_bound(const TimeEventInfo &Key) const
+{
+	return std::lower_bound(m_List.begin(), m_List.end(), Key);
+}
+
+
+EPGDatabase::TimeEventIndex::const_iterator EPGDatabase::TimeEventIndex::upper_bound(const TimeEventInfo &Key) const
+{
+	return std::upper_bound(m_List.begin(), m_List.end(), Key);
+}
+
+
+std::pair<EPGDatabase::TimeEventIndex::const_iterator, bool> EPGDatabase::TimeEventIndex::insert(const TimeEventInfo &Time)
+{
+	// 番組は大抵時刻順に追加されるので末尾を先に調べる
+	if (m_List.empty() || (m_List.back() < Time)) {
+		m_List.push_back(Time);
+		return std::make_pair(m_List.end() - 1, true);
+	}
+
+	auto it = std::lower_bound(m_List.begin(), m_List.end(), Time);
+	if (it->StartTime == Time.StartTime)
+		return std::make_pair(const_iterator(it), false);
+
+	return std::make_pair(const_iterator(m_List.insert(it, Time)), true);
+}
+
+
+void EPGDatabase::TimeEventIndex::InsertBatch(std::vector<TimeEventInfo> &&List)
+{
+	if (List.empty())
+		return;
+
+	// 既存のものと開始時刻が同じ場合は既存のものを残す(insert() と同じ)
+	std::stable_sort(List.begin(), List.end());
+
+	if (m_List.empty()) {
+		m_List = std::move(List);
+	} else {
+		const size_t Middle = m_List.size();
+		m_List.insert(m_List.end(), List.begin(), List.end());
+		std::inplace_merge(m_List.begin(), m_List.begin() + Middle, m_List.end());
+	}
+
+	m_List.erase(
+		std::unique(
+			m_List.begin(), m_List.end(),
+			[](const TimeEventInfo &Time1, const TimeEventInfo &Time2) -> bool {
+				return Time1.StartTime == Time2.StartTime;
+			}),
+		m_List.end());
+}
+
+
+EPGDatabase::TimeEventIndex::const_iterator EPGDatabase::TimeEventIndex::erase(const_iterator Pos)
+{
+	return m_List.erase(Pos);
+}
+
+
+EPGDatabase::TimeEventIndex::const_iterator EPGDatabase::TimeEventIndex::erase(const_iterator First, const_iterator Last)
+{
+	return m_List.erase(First, Last);
+}
+
+
+void EPGDatabase::TimeEventIndex::Replace(const_iterator Pos, const TimeEventInfo &Time)
+{
+	// 開始時刻が同じでなければ順序が崩れる
+	LIBISDB_ASSERT(Pos->StartTime == Time.StartTime);
+
+	m_List[Pos - m_List.begin()] = Time;
+}
+
+
+
+
 void EPGDatabase::ScheduleInfo::Reset()
 {
 	m_Basic.TableCount = 0;
@@ -34,15 +34,29 @@
 #include "../TS/Tables.hpp"
 #include <map>
 #include <unordered_map>
-#include <set>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <atomic>
+#include <thread>
 
 
 namespace LibISDB
 {
 
-	/** 番組情報データベースクラス */
+	class ConcurrentARIBStringCache;
+
+	/**
+		番組情報データベースクラス
+
+		サービス毎に共有/排他ロックを持ち、異なるサービスの更新と参照は並行して行われる。
+		GetLock() で取得されるロックは互換性のためのもので、保持している間は
+		他のスレッドからの全ての操作がブロックされる。
+		従来通り MutexLock として返されるが、Lock() 等の LockBase のメンバ関数でのみ使用でき、
+		Native() や ConditionVariable と組み合わせて使うことはできない。
+	*/
 	class EPGDatabase
 	{
 	public:
@@ -110,9 +124,9 @@ namespace LibISDB
 
 		struct TimeEventInfo {
 			unsigned long long StartTime;
+			unsigned long long UpdatedTime;
 			uint32_t Duration;
 			uint16_t EventID;
-			unsigned long long UpdatedTime;
 
 			TimeEventInfo(unsigned long long Time);
 			TimeEventInfo(const DateTime &StartTime);
@@ -124,7 +138,96 @@ namespace LibISDB
 			}
 		};
 
-		typedef std::set<TimeEventInfo> TimeEventMap;
+		/**
+			開始時刻順の番組の索引
+
+			開始時刻でソートした配列で保持し、範囲の列挙を連続したメモリの走査で行う。
+			std::set と同様に、開始時刻が同じ番組は一つのみ保持される。
+		*/
+		class TimeEventIndex
+		{
+		public:
+			typedef std::vector<TimeEventInfo>::const_iterator const_iterator;
+			typedef const_iterator iterator;
+			typedef std::vector<TimeEventInfo>::const_reverse_iterator const_reverse_iterator;
+
+			const_iterator begin() const noexcept { return m_List.begin(); }
+			const_iterator end() const noexcept { return m_List.end(); }
+			const_reverse_iterator rbegin() const noexcept { return m_List.rbegin(); }
+			const_reverse_iterator rend() const noexcept { return m_List.rend(); }
+			bool empty() const noexcept { return m_List.empty(); }
+			size_t size() const noexcept { return m_List.size(); }
+			size_t capacity() const noexcept { return m_List.capacity(); }
+			void clear() noexcept { m_List.clear(); }
+			void reserve(size_t Size) { m_List.reserve(Size); }
+
+			const_iterator find(const TimeEventInfo &Key) const;
+			const_iterator lower_bound(const TimeEventInfo &Key) const;
+			const_iterator upper_bound(const TimeEventInfo &Key) const;
+			std::pair<const_iterator, bool> insert(const TimeEventInfo &Time);
+			template<typename... TArgs> std::pair<const_iterator, bool> emplace(TArgs&&... Args)
+			{
+				return insert(TimeEventInfo(std::forward<TArgs>(Args)...));
+			}
+			void InsertBatch(std::vector<TimeEventInfo> &&List);
+			const_iterator erase(const_iterator Pos);
+			const_iterator erase(const_iterator First, const_iterator Last);
+			void Replace(const_iterator Pos, const TimeEventInfo &Time);
+
+		private:
+			std::vector<TimeEventInfo> m_List;
+		};
+
+		typedef TimeEventIndex TimeEventMap;
+
+		/**
+			サービスの番組情報のスナップショット
+
+			内容は変更されないため、取得後はロックせずに参照できる。
+			データベースが更新されても既に取得されたスナップショットは変わらない。
+		*/
+		class EventListSnapshot
+		{
+		public:
+			EventListSnapshot(const ServiceInfo &Info, EventList &&List);
+
+			const ServiceInfo & GetServiceInfo() const noexcept { return m_ServiceInfo; }
+			const EventList & GetEventList() const noexcept { return m_EventList; }
+			size_t GetEventCount() const noexcept { return m_EventList.size(); }
+			EventList::const_iterator begin() const noexcept { return m_EventList.begin(); }
+			EventList::const_iterator end() const noexcept { return m_EventList.end(); }
+			const EventInfo * GetEventByID(uint16_t EventID) const;
+			const EventInfo * GetEventByTime(const DateTime &Time) const;
+
+		private:
+			ServiceInfo m_ServiceInfo;
+			EventList m_EventList;               /**< 開始時刻順の番組 */
+			std::vector<uint32_t> m_EventIDIndex; /**< event_id 順の m_EventList のインデックス */
+		};
+
+		typedef std::shared_ptr<const EventListSnapshot> EventListSnapshotPtr;
+
+		/**
+			メモリ使用量
+
+			番組情報の文字列はデータベースの StringPool で共有されるため、同じ文字列オブジェクトは 1 回のみ数える。
+		*/
+		struct MemoryUsage {
+			size_t ServiceCount = 0;      /**< サービス数 */
+			size_t EventCount = 0;        /**< 番組数(拡張形式のみの番組を含む) */
+			size_t EventBytes = 0;        /**< 番組情報とマップのノードのサイズ */
+			size_t StringCount = 0;       /**< 文字列オブジェクトの数 */
+			size_t StringBytes = 0;       /**< 文字列オブジェクトが確保しているサイズ */
+			size_t SharedStringBytes = 0; /**< 文字列の共有により、番組毎に確保する場合より削減されているサイズ */
+			size_t ListBytes = 0;         /**< 番組情報内のリストが確保しているサイズ */
+			size_t IndexBytes = 0;        /**< 時刻の索引のサイズ */
+			size_t SnapshotBytes = 0;     /**< 保持されているスナップショットのサイズ */
+
+			size_t GetTotalBytes() const noexcept
+			{
+				return EventBytes + StringBytes + ListBytes + IndexBytes + SnapshotBytes;
+			}
+		};
 
 		enum class MergeFlag : unsigned int {
 			None               = 0x0000U,
@@ -142,6 +245,7 @@ namespace LibISDB
 		bool GetServiceList(ServiceList *pList) const;
 		bool IsServiceUpdated(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID) const;
 		bool ResetServiceUpdated(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID);
+		uint64_t GetServiceGeneration(uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID) const;
 
 		bool GetEventList(
 			uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID,
@@ -149,6 +253,8 @@ namespace LibISDB
 		bool GetEventListSortedByTime(
 			uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID,
 			ReturnArg<EventList> List) const;
+		EventListSnapshotPtr GetEventListSnapshot(
+			uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID) const;
 
 		bool GetEventInfo(
 			uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID,
@@ -171,7 +277,14 @@ namespace LibISDB
 			const DateTime *pEarliest, const DateTime *pLatest,
 			const std::function<bool(const EventInfo &Event)> &Callback) const;
 
-		bool SetServiceEventList(const ServiceInfo &Info, EventList &&List);
+		bool GetServiceMemoryUsage(
+			uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID,
+			ReturnArg<MemoryUsage> Usage) const;
+		bool GetMemoryUsage(ReturnArg<MemoryUsage> Usage) const;
+
+		bool SetServiceEventList(
+			const ServiceInfo &Info, EventList &&List,
+			OptionalReturnArg<uint64_t> Generation = std::nullopt);
 
 		bool Merge(
 			EPGDatabase *pSrcDatabase,
@@ -191,8 +304,8 @@ namespace LibISDB
 			bool Extended = false) const;
 		void ResetScheduleStatus();
 
-		bool IsUpdated() const noexcept { return m_IsUpdated; }
-		void SetUpdated(bool Updated) { m_IsUpdated = Updated; }
+		bool IsUpdated() const noexcept { return m_IsUpdated.load(std::memory_order_acquire); }
+		void SetUpdated(bool Updated) { m_IsUpdated.store(Updated, std::memory_order_release); }
 
 		void SetScheduleOnly(bool ScheduleOnly);
 		bool GetScheduleOnly() const noexcept { return m_ScheduleOnly; }
@@ -200,6 +313,8 @@ namespace LibISDB
 		bool GetNoPastEvents() const noexcept { return m_NoPastEvents; }
 		void SetStringDecodeFlags(ARIBStringDecoder::DecodeFlag Flags);
 		ARIBStringDecoder::DecodeFlag GetStringDecodeFlags() const noexcept { return m_StringDecodeFlags; }
+		void SetStringCache(ConcurrentARIBStringCache *pCache);
+		ConcurrentARIBStringCache * GetStringCache() const noexcept { return m_pStringCache; }
 
 		bool AddEventListener(EventListener *pEventListener);
 		bool RemoveEventListener(EventListener *pEventListener);
@@ -210,9 +325,54 @@ namespace LibISDB
 		bool UpdateTOT(const TOTTable *pTOTTable);
 		void ResetTOTTime();
 
-		MutexLock & GetLock() noexcept { return m_Lock; }
+		MutexLock & GetLock() noexcept { return m_CompatibleLock; }
 
 	protected:
+		/** データベース全体の排他ロック(再帰可) */
+		class DatabaseLock
+			: public LockBase
+		{
+		public:
+			DatabaseLock(SharedLock &Lock) noexcept : m_Lock(Lock), m_OwnerThread(std::thread::id()), m_LockCount(0) {}
+
+		// LockBase
+			void Lock() override;
+			void Unlock() override;
+			bool TryLock() override;
+			bool TryLock(const std::chrono::milliseconds &Timeout) override;
+
+		// DatabaseLock
+			bool IsOwnedByCurrentThread() const noexcept;
+
+		private:
+			SharedLock &m_Lock;
+			std::atomic<std::thread::id> m_OwnerThread;
+			int m_LockCount;
+		};
+
+		/**
+			GetLock() の互換性のためのロック
+
+			DatabaseLock に転送し、MutexLock 自体のミューテックスは使用しない。
+		*/
+		class CompatibleDatabaseLock
+			: public MutexLock
+		{
+		public:
+			CompatibleDatabaseLock(DatabaseLock &Lock) noexcept : m_Lock(Lock) {}
+
+		// LockBase
+			void Lock() override { m_Lock.Lock(); }
+			void Unlock() override { m_Lock.Unlock(); }
+			bool TryLock() override { return m_Lock.TryLock(); }
+			bool TryLock(const std::chrono::milliseconds &Timeout) override { return m_Lock.TryLock(Timeout); }
+
+		private:
+			DatabaseLock &m_Lock;
+		};
+
+		class ServiceMapReadLock;
+
 		class ScheduleInfo
 		{
 		public:
@@ -256,33 +416,65 @@ namespace LibISDB
 
 		typedef std::map<ServiceInfo, ServiceEventMap> ServiceMap;
 
-		ServiceMap m_ServiceMap;
+		struct ServiceEntry {
+			mutable SharedLock Lock;
+			ServiceEventMap Events;
+			mutable MutexLock SnapshotLock;
+			mutable EventListSnapshotPtr Snapshot; /**< 更新時に破棄し、参照時に作成する */
+			uint64_t Generation = 0;               /**< 番組情報が変わる度に更新される番号 */
+		};
+
+		typedef std::map<ServiceInfo, ServiceEntry> ServiceEntryMap;
+
+		/*
+			ロックの順序
+			m_ServiceMapLock (共有) -> ServiceEntry::Lock -> m_PendingLock
+			ServiceEntry::Lock -> ServiceEntry::SnapshotLock
+			ServiceEntry::Lock は同時に 1 つのみ保持する。
+			ServiceEntry::Snapshot は Lock の排他ロック中は SnapshotLock なしで破棄できる。
+			m_ServiceMap へのサービスの追加と削除、TOT の更新、設定の変更は
+			m_ServiceMapLock を排他ロックして行う。
+		*/
+		ServiceEntryMap m_ServiceMap;
 		ServiceMap m_PendingServiceMap;
-		mutable MutexLock m_Lock;
-		bool m_IsUpdated;
+		mutable SharedLock m_ServiceMapLock;
+		mutable DatabaseLock m_DatabaseLock;
+		CompatibleDatabaseLock m_CompatibleLock;
+		MutexLock m_PendingLock;
+		std::atomic<bool> m_IsUpdated;
 		bool m_ScheduleOnly;
 		bool m_NoPastEvents;
-		ARIBStringDecoder m_StringDecoder;
 		ARIBStringDecoder::DecodeFlag m_StringDecodeFlags;
+		ConcurrentARIBStringCache *m_pStringCache;
+		StringPool m_StringPool;
 		DateTime m_CurTOTTime;
 		unsigned long long m_CurTOTSeconds;
 		EventListenerList<EventListener> m_EventListenerList;
 
+		template<typename TFunc> bool ReadService(const ServiceInfo &Info, TFunc Func) const;
+		template<typename TFunc> bool WriteService(
+			const ServiceInfo &Info, bool Create, TFunc Func, uint64_t *pGeneration = nullptr);
+		void CreateService(const ServiceInfo &Info);
+		ServiceEntry & InsertService(const ServiceInfo &Info, bool *pInserted);
 		bool MergeEventMap(
-			const ServiceInfo &Info, ServiceEventMap &Map,
+			const ServiceInfo &Info, ServiceEventMap &Service, bool IsNewService, ServiceEventMap &Map,
 			MergeFlag Flags = MergeFlag::None,
 			std::optional<EventInfo::SourceIDType> SourceID = std::nullopt);
 		bool MergeEventMapEvent(
 			ServiceEventMap &Service, EventInfo &&NewEvent,
 			MergeFlag Flags = MergeFlag::None);
 		bool UpdateTimeMap(ServiceEventMap &Service, const TimeEventInfo &Time, bool *pIsUpdated);
-		const EventInfo * GetEventInfoByIDs(
-			uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID, uint16_t EventID) const;
+		static bool AddTimeMapBatch(const ServiceEventMap &Service, const TimeEventInfo &Time, std::vector<TimeEventInfo> *pBatch);
+		static bool CallEventCallback(const EventList &List, const std::function<bool(const EventInfo &Event)> &Callback);
 		bool SetCommonEventInfo(EventInfo *pInfo) const;
 		bool CopyEventExtendedText(EventInfo *pDstInfo, const EventInfo &SrcInfo) const;
 		bool MergeEventExtendedInfo(ServiceEventMap &Service, EventInfo *pEvent);
 
+		void AddServiceMemoryUsage(
+			const ServiceEntry &Entry, MemoryUsage *pUsage, std::unordered_set<const String *> *pStringSet) const;
+
 		static bool RemoveEvent(EventMapType &Map, uint16_t EventID);
+		static uint64_t NextServiceGeneration() noexcept;
 	};
 
 	LIBISDB_ENUM_FLAGS(EPGDatabase::MergeFlag)
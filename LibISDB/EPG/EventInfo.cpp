@@ -264,6 +264,55 @@ const EventInfo::AudioInfo * EventInfo::GetMainAudioInfo() const
 }
 
 
+void EventInfo::EnumStrings(const std::function<void(const PooledString &Str)> &Callback) const
+{
+	Callback(EventName);
+	Callback(EventText);
+	for (const ExtendedTextInfo &Text : ExtendedText) {
+		Callback(Text.Description);
+		Callback(Text.Text);
+	}
+	for (const VideoInfo &Video : VideoList)
+		Callback(Video.Text);
+	for (const AudioInfo &Audio : AudioList)
+		Callback(Audio.Text);
+}
+
+
+void EventInfo::InternStrings(StringPool &Pool)
+{
+	EventName = Pool.Intern(EventName);
+	EventText = Pool.Intern(EventText);
+	for (ExtendedTextInfo &Text : ExtendedText) {
+		Text.Description = Pool.Intern(Text.Description);
+		Text.Text = Pool.Intern(Text.Text);
+	}
+	for (VideoInfo &Video : VideoList)
+		Video.Text = Pool.Intern(Video.Text);
+	for (AudioInfo &Audio : AudioList)
+		Audio.Text = Pool.Intern(Audio.Text);
+}
+
+
+/*
+	EventInfo 自体のサイズを除いた、動的に確保されているメモリのサイズを取得する
+	(文字列は他の番組情報と共有されるため含まない)
+*/
+size_t EventInfo::GetAllocatedSize() const noexcept
+{
+	size_t Size =
+		ExtendedText.capacity() * sizeof(ExtendedTextInfo) +
+		VideoList.capacity() * sizeof(VideoInfo) +
+		AudioList.capacity() * sizeof(AudioInfo) +
+		EventGroupList.capacity() * sizeof(EventGroupInfo);
+
+	for (const EventGroupInfo &Group : EventGroupList)
+		Size += Group.EventList.capacity() * sizeof(EventGroupDescriptor::EventInfo);
+
+	return Size;
+}
+
+
 
 
 // EPGの日時(UTC+9)からUTCに変換する
@@ -401,7 +450,7 @@ bool GetEventExtendedTextList(const DescriptorBlock *pDescBlock, ReturnArg<Event
 }
 
 
-static void CanonicalizeExtendedText(const String &Src, ReturnArg<String> Dst)
+static void CanonicalizeExtendedText(StringView Src, ReturnArg<String> Dst)
 {
 	for (auto it = Src.begin(); it != Src.end();) {
 		if (*it == LIBISDB_CHAR('\r')) {
@@ -432,13 +481,18 @@ bool GetEventExtendedTextList(
 	List->clear();
 	List->reserve(TextList.size());
 
-	String Buffer;
+	CStringView Buffer;
+	String Str;
 
 	for (auto const &e : TextList) {
 		EventInfo::ExtendedTextInfo &Text = List->emplace_back();
-		StringDecoder.Decode(e.Description, &Text.Description, DecodeFlags);
-		if (StringDecoder.Decode(e.Text, &Buffer, DecodeFlags))
-			CanonicalizeExtendedText(Buffer, &Text.Text);
+		if (StringDecoder.Decode(e.Description, &Buffer, DecodeFlags))
+			Text.Description = String(Buffer);
+		if (StringDecoder.Decode(e.Text, &Buffer, DecodeFlags)) {
+			Str.clear();
+			CanonicalizeExtendedText(Buffer, &Str);
+			Text.Text = Str;
+		}
 	}
 
 	return true;
@@ -454,7 +508,7 @@ bool GetConcatenatedEventExtendedText(
 
 	Text->clear();
 
-	String Buffer;
+	CStringView Buffer;
 
 	for (auto &e : List) {
 		if (StringDecoder.Decode(e.Description, &Buffer, DecodeFlags)) {
@@ -30,18 +30,25 @@
 
 #include "../TS/Descriptors.hpp"
 #include "../TS/DescriptorBlock.hpp"
+#include "../Base/StringPool.hpp"
+#include <functional>
 
 
 namespace LibISDB
 {
 
-	/** 番組情報クラス */
+	/**
+		番組情報クラス
+
+		文字列は PooledString で保持され、コピーしても文字列は複製されない。
+		InternStrings() で StringPool に登録すると、同じ内容の文字列が共有される。
+	*/
 	class EventInfo
 	{
 	public:
 		struct ExtendedTextInfo {
-			String Description;
-			String Text;
+			PooledString Description;
+			PooledString Text;
 
 			bool operator == (const ExtendedTextInfo &rhs) const noexcept
 			{
@@ -60,7 +67,7 @@ namespace LibISDB
 			uint8_t ComponentType = COMPONENT_TYPE_INVALID;
 			uint8_t ComponentTag = COMPONENT_TAG_INVALID;
 			uint32_t LanguageCode = LANGUAGE_CODE_INVALID;
-			String Text;
+			PooledString Text;
 
 			bool operator == (const VideoInfo &rhs) const noexcept
 			{
@@ -88,7 +95,7 @@ namespace LibISDB
 			uint8_t SamplingRate;
 			uint32_t LanguageCode;
 			uint32_t LanguageCode2;
-			String Text;
+			PooledString Text;
 
 			bool operator == (const AudioInfo &rhs) const noexcept
 			{
@@ -199,8 +206,8 @@ namespace LibISDB
 		uint32_t Duration;
 		uint8_t RunningStatus;
 		bool FreeCAMode;
-		String EventName;
-		String EventText;
+		PooledString EventName;
+		PooledString EventText;
 		ExtendedTextInfoList ExtendedText;
 		VideoInfoList VideoList;
 		AudioInfoList AudioList;
@@ -236,6 +243,10 @@ namespace LibISDB
 
 		int GetMainAudioIndex() const;
 		const AudioInfo * GetMainAudioInfo() const;
+
+		void EnumStrings(const std::function<void(const PooledString &Str)> &Callback) const;
+		void InternStrings(StringPool &Pool);
+		size_t GetAllocatedSize() const noexcept;
 	};
 
 	LIBISDB_ENUM_FLAGS(EventInfo::TypeFlag)
@@ -26,6 +26,7 @@
 
 #include "../LibISDBPrivate.hpp"
 #include "AnalyzerFilter.hpp"
+#include "../Base/ARIBStringCache.hpp"
 #include "../Utilities/Sort.hpp"
 #include "../Base/DebugDef.hpp"
 
@@ -1285,9 +1286,14 @@ bool AnalyzerFilter::GetEventInfo(int ServiceIndex, ReturnArg<EventInfo> Info, b
 	Info->RunningStatus = pEITTable->GetRunningStatus();
 	Info->FreeCAMode = pEITTable->GetFreeCAMode();
 
-	if (!GetEventName(ServiceIndex, &Info->EventName, Next))
+	String Name, Text;
+	if (GetEventName(ServiceIndex, &Name, Next))
+		Info->EventName = std::move(Name);
+	else
 		Info->EventName.clear();
-	if (!GetEventText(ServiceIndex, &Info->EventText, Next))
+	if (GetEventText(ServiceIndex, &Text, Next))
+		Info->EventText = std::move(Text);
+	else
 		Info->EventText.clear();
 	if (!GetEventExtendedText(ServiceIndex, &Info->ExtendedText, UseEventGroup, Next))
 		Info->ExtendedText.clear();
@@ -1491,7 +1497,7 @@ const ComponentDescriptor *AnalyzerFilter::GetComponentDescByComponentTag(const
 		for (int i = 0; i < pDescBlock->GetDescriptorCount(); i++) {
 			const DescriptorBase *pDesc = pDescBlock->GetDescriptorByIndex(i);
 
-			if (pDesc->GetTag() == ComponentDescriptor::TAG) {
+			if ((pDesc != nullptr) && (pDesc->GetTag() == ComponentDescriptor::TAG)) {
 				const ComponentDescriptor *pComponentDesc = dynamic_cast<const ComponentDescriptor *>(pDesc);
 
 				if ((pComponentDesc != nullptr)
@@ -1511,7 +1517,7 @@ const AudioComponentDescriptor *AnalyzerFilter::GetAudioComponentDescByComponent
 		for (int i = 0; i < pDescBlock->GetDescriptorCount(); i++) {
 			const DescriptorBase *pDesc = pDescBlock->GetDescriptorByIndex(i);
 
-			if (pDesc->GetTag() == AudioComponentDescriptor::TAG) {
+			if ((pDesc != nullptr) && (pDesc->GetTag() == AudioComponentDescriptor::TAG)) {
 				const AudioComponentDescriptor *pAudioDesc = dynamic_cast<const AudioComponentDescriptor *>(pDesc);
 
 				if ((pAudioDesc != nullptr)
@@ -1533,7 +1539,9 @@ void AnalyzerFilter::ComponentDescToVideoInfo(const ComponentDescriptor *pCompon
 	Info->LanguageCode = pComponentDesc->GetLanguageCode();
 	ARIBString Text;
 	pComponentDesc->GetText(&Text);
-	m_StringDecoder.Decode(Text, &Info->Text);
+	String DecodedText;
+	m_StringDecoder.Decode(Text, &DecodedText);
+	Info->Text = std::move(DecodedText);
 }
 
 
@@ -1551,7 +1559,9 @@ void AnalyzerFilter::AudioComponentDescToAudioInfo(const AudioComponentDescripto
 	Info->LanguageCode2 = pAudioDesc->GetLanguageCode2();
 	ARIBString Text;
 	pAudioDesc->GetText(&Text);
-	m_StringDecoder.Decode(Text, &Info->Text);
+	String DecodedText;
+	m_StringDecoder.Decode(Text, &DecodedText);
+	Info->Text = std::move(DecodedText);
 }
 
 
@@ -1774,6 +1784,25 @@ bool AnalyzerFilter::RemoveEventListener(EventListener *pEventListener)
 }
 
 
+// 文字列のデコード結果のキャッシュを設定する
+// 他のデコーダと共有されることがあるため、スレッドセーフなキャッシュのみ受け付ける
+void AnalyzerFilter::SetStringCache(ConcurrentARIBStringCache *pCache)
+{
+	BlockLock Lock(m_FilterLock);
+
+	m_StringDecoder.SetCache(pCache);
+}
+
+
+ConcurrentARIBStringCache * AnalyzerFilter::GetStringCache() const
+{
+	BlockLock Lock(m_FilterLock);
+
+	// SetStringCache() でのみ設定される
+	return static_cast<ConcurrentARIBStringCache *>(m_StringDecoder.GetCache());
+}
+
+
 void AnalyzerFilter::OnPATSection(const PSITableBase *pTable, const PSISection *pSection)
 {
 	// PAT が更新された
@@ -49,6 +49,8 @@
 namespace LibISDB
 {
 
+	class ConcurrentARIBStringCache;
+
 	/** 解析フィルタクラス */
 	class AnalyzerFilter
 		: public SingleIOFilter
@@ -310,6 +312,9 @@ namespace LibISDB
 		bool AddEventListener(EventListener *pEventListener);
 		bool RemoveEventListener(EventListener *pEventListener);
 
+		void SetStringCache(ConcurrentARIBStringCache *pCache);
+		ConcurrentARIBStringCache * GetStringCache() const;
+
 	protected:
 #ifdef LIBISDB_ANALYZER_FILTER_EIT_SUPPORT
 		const class EITTable * GetEITPfTableByServiceID(uint16_t ServiceID, bool Next = false) const;
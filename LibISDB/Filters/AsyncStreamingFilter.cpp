@@ -98,9 +98,11 @@ bool AsyncStreamingFilter::ReceiveData(DataStream *pData)
 	BlockLock Lock(m_FilterLock);
 
 	if (m_BufferingEnabled && m_StreamBuffer) {
+		size_t PushedSize = 0;
 		do {
-			m_StreamBuffer->PushBack(pData->GetData());
+			PushedSize += m_StreamBuffer->PushBack(pData->GetData());
 		} while (pData->Next());
+		NotifyStreamingThread(PushedSize);
 	}
 
 	return true;
@@ -215,6 +217,20 @@ bool AsyncStreamingFilter::SetOutputBufferSize(size_t Size)
 }
 
 
+bool AsyncStreamingFilter::SetWakeupWatermark(size_t Size)
+{
+	SetStreamingThreadWakeupWatermark(Size);
+
+	return true;
+}
+
+
+size_t AsyncStreamingFilter::GetWakeupWatermark() const noexcept
+{
+	return m_StreamingThreadWakeupWatermark.load(std::memory_order_acquire);
+}
+
+
 bool AsyncStreamingFilter::SetSourceFilter(SourceFilter *pSourceFilter)
 {
 	if (IsStarted())
@@ -73,6 +73,8 @@ namespace LibISDB
 		bool GetClearOnReset() const noexcept { return m_ClearOnReset; }
 		bool SetOutputBufferSize(size_t Size);
 		size_t GetOutputBufferSize() const noexcept { return m_OutputBufferSize; }
+		bool SetWakeupWatermark(size_t Size);
+		size_t GetWakeupWatermark() const noexcept;
 
 		bool SetSourceFilter(SourceFilter *pSourceFilter);
 
@@ -96,7 +96,7 @@ void RecorderFilter::SetLogger(Logger *pLogger)
 std::shared_ptr<RecorderFilter::RecordingTask> RecorderFilter::CreateTask(
 	StreamWriter *pWriter, const RecordingOptions *pOptions)
 {
-	std::shared_ptr<RecordingTaskImpl> Task(new RecordingTaskImpl(pWriter, pOptions));
+	std::shared_ptr<RecordingTaskImpl> Task(new RecordingTaskImpl(pWriter, pOptions, GetWriterThreadPool()));
 
 	Task->AddEventListener(&m_TaskEventListener);
 	Task->SetLogger(m_pLogger);
@@ -172,6 +172,25 @@ int RecorderFilter::GetTaskCount() const
 }
 
 
+bool RecorderFilter::SetWriterThreadPool(const std::shared_ptr<StreamingThreadPool> &ThreadPool)
+{
+	BlockLock Lock(m_FilterLock);
+
+	// 既存のタスクには影響せず、以降に作成されるタスクから適用される
+	m_WriterThreadPool = ThreadPool;
+
+	return true;
+}
+
+
+std::shared_ptr<StreamingThreadPool> RecorderFilter::GetWriterThreadPool() const
+{
+	BlockLock Lock(m_FilterLock);
+
+	return m_WriterThreadPool;
+}
+
+
 std::shared_ptr<RecorderFilter::RecordingTask> RecorderFilter::GetTaskByIndex(int Index) const
 {
 	if (static_cast<unsigned int>(Index) >= m_TaskList.size())
@@ -297,6 +316,9 @@ bool RecorderFilter::RecordingDataStreamer::GetRecordingStatistics(RecordingStat
 	else
 		pStatistics->WriteBytes = RecordingStatistics::INVALID_SIZE;
 	pStatistics->WriteErrorCount = Stats.OutputErrorCount;
+	pStatistics->PendingBytes = GetPendingBytes();
+	pStatistics->MaxPendingBytes = Stats.MaxPendingBytes;
+	pStatistics->DroppedBytes = Stats.InputDroppedBytes;
 
 	return true;
 }
@@ -320,7 +342,8 @@ bool RecorderFilter::RecordingDataStreamer::IsOutputValid() const
 
 
 RecorderFilter::RecordingTaskImpl::RecordingTaskImpl(
-	StreamWriter *pWriter, const RecordingOptions *pOptions)
+	StreamWriter *pWriter, const RecordingOptions *pOptions,
+	const std::shared_ptr<StreamingThreadPool> &ThreadPool)
 	: m_Paused(false)
 
 	, m_DataStreamer(pWriter)
@@ -332,6 +355,7 @@ RecorderFilter::RecordingTaskImpl::RecordingTaskImpl(
 	}
 
 	m_DataStreamer.AddEventListener(&m_StreamerEventListener);
+	m_DataStreamer.SetThreadPool(ThreadPool);
 }
 
 
@@ -476,7 +500,7 @@ void RecorderFilter::RecordingTaskImpl::InputPacket(TSPacket *pPacket)
 		TSPacket *pDstPacket = m_StreamSelector.InputPacket(pPacket);
 
 		if (pDstPacket != nullptr)
-			m_DataStreamer.InputData(pDstPacket->GetData(), pDstPacket->GetSize());
+			m_DataStreamer.InputData(pDstPacket);
 	}
 }
 
@@ -68,6 +68,9 @@ namespace LibISDB
 			unsigned long long OutputCount = 0;
 			unsigned long long WriteBytes = INVALID_SIZE;
 			unsigned long WriteErrorCount = 0;
+			unsigned long long PendingBytes = 0;
+			unsigned long long MaxPendingBytes = 0;
+			unsigned long long DroppedBytes = 0;
 		};
 
 		/** 録画タスク */
@@ -128,6 +131,8 @@ namespace LibISDB
 		bool DeleteTask(std::shared_ptr<RecordingTask> &Task);
 		void DeleteAllTasks();
 		bool IsTaskValid(const std::shared_ptr<RecordingTask> &Task) const;
+		bool SetWriterThreadPool(const std::shared_ptr<StreamingThreadPool> &ThreadPool);
+		std::shared_ptr<StreamingThreadPool> GetWriterThreadPool() const;
 
 		int GetTaskCount() const;
 		std::shared_ptr<RecordingTask> GetTaskByIndex(int Index) const;
@@ -167,7 +172,9 @@ namespace LibISDB
 				virtual void OnWriteError(RecordingTaskImpl *pTask) {}
 			};
 
-			RecordingTaskImpl(StreamWriter *pWriter, const RecordingOptions *pOptions);
+			RecordingTaskImpl(
+				StreamWriter *pWriter, const RecordingOptions *pOptions,
+				const std::shared_ptr<StreamingThreadPool> &ThreadPool);
 			~RecordingTaskImpl();
 
 		// RecordingTask
@@ -245,6 +252,7 @@ namespace LibISDB
 		};
 
 		TaskList m_TaskList;
+		std::shared_ptr<StreamingThreadPool> m_WriterThreadPool;
 
 		EventListenerList<EventListener> m_EventListenerList;
 		TaskEventListener m_TaskEventListener;
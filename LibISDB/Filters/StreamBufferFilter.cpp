@@ -26,6 +26,7 @@
 
 #include "../LibISDBPrivate.hpp"
 #include "StreamBufferFilter.hpp"
+#include "../Base/MMapDataStorage.hpp"
 #include "../Base/DebugDef.hpp"
 
 
@@ -82,6 +83,33 @@ bool StreamBufferFilter::CreateMemoryBuffer(
 }
 
 
+bool StreamBufferFilter::CreateMMapBuffer(
+	const CStringView &FileName,
+	size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount, bool Sparse)
+{
+	if (LIBISDB_TRACE_ERROR_IF((BlockSize == 0) || (MaxBlockCount == 0) || (MinBlockCount > MaxBlockCount)))
+		return false;
+
+	std::unique_ptr<MMapDataStorageManager> StorageManager = std::make_unique<MMapDataStorageManager>();
+
+	if (!StorageManager->Create(FileName, BlockSize, MaxBlockCount, Sparse))
+		return false;
+
+	std::shared_ptr<StreamBuffer> Buffer = std::make_shared<StreamBuffer>();
+
+	if (!Buffer->Create(BlockSize, MinBlockCount, MaxBlockCount, StorageManager.get()))
+		return false;
+	StorageManager.release();
+
+	BlockLock Lock(m_FilterLock);
+
+	if (!m_DataStreamer.SetOutputBuffer(Buffer))
+		return false;
+
+	return true;
+}
+
+
 void StreamBufferFilter::DeleteBuffer()
 {
 	BlockLock Lock(m_FilterLock);
@@ -54,6 +54,10 @@ namespace LibISDB
 	// StreamBufferFilter
 		bool CreateMemoryBuffer(
 			size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount);
+		// Sparse を true にするとディスク容量不足時に SIGBUS が発生し得る(MMapBlockFile::Create() を参照)
+		bool CreateMMapBuffer(
+			const CStringView &FileName,
+			size_t BlockSize, size_t MinBlockCount, size_t MaxBlockCount, bool Sparse = false);
 		void DeleteBuffer();
 		bool IsBufferCreated() const;
 		void ClearBuffer();
@@ -26,6 +26,8 @@
 
 #include "../LibISDBPrivate.hpp"
 #include "TSPacketParserFilter.hpp"
+#include "../Base/SIMD.hpp"
+#include "../Utilities/Utilities.hpp"
 #include "../Base/DebugDef.hpp"
 
 
@@ -33,17 +35,85 @@ namespace LibISDB
 {
 
 
+namespace
+{
+
+
+constexpr uint8_t SYNC_BYTE = 0x47_u8;
+
+
+// 同期バイトを探す(見付からない場合は Size を返す)
+size_t FindSyncByte(const uint8_t *pData, size_t Size)
+{
+	size_t Pos = 0;
+
+#ifdef LIBISDB_SSE2_SUPPORT
+	if ((Size >= 16) && IsSSE2Enabled()) {
+		const __m128i Sync = _mm_set1_epi8(static_cast<char>(SYNC_BYTE));
+
+		for (; Pos + 16 <= Size; Pos += 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pData + Pos));
+			const unsigned int Mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, Sync)));
+			if (Mask != 0)
+				return Pos + BitScanForward32(Mask);
+		}
+	}
+#endif
+
+	for (; Pos < Size; Pos++) {
+		if (pData[Pos] == SYNC_BYTE)
+			break;
+	}
+
+	return Pos;
+}
+
+
+// 先頭から TS_PACKET_SIZE 間隔で同期バイトが並んでいるパケット数を数える
+size_t CountSyncedPackets(const uint8_t *pData, size_t Size)
+{
+	const size_t MaxCount = Size / TS_PACKET_SIZE;
+	size_t Count = 0;
+
+	// 4パケット単位でまとめて判定する
+	for (; Count + 4 <= MaxCount; Count += 4) {
+		const uint8_t *p = pData + Count * TS_PACKET_SIZE;
+		if ((p[TS_PACKET_SIZE * 0] != SYNC_BYTE)
+				|| (p[TS_PACKET_SIZE * 1] != SYNC_BYTE)
+				|| (p[TS_PACKET_SIZE * 2] != SYNC_BYTE)
+				|| (p[TS_PACKET_SIZE * 3] != SYNC_BYTE))
+			break;
+	}
+
+	for (; Count < MaxCount; Count++) {
+		if (pData[Count * TS_PACKET_SIZE] != SYNC_BYTE)
+			break;
+	}
+
+	return Count;
+}
+
+
+}	// namespace
+
+
 TSPacketParserFilter::TSPacketParserFilter()
-	: m_OutOfSyncCount(0)
+	: m_pBatchData(nullptr)
+	, m_pReferenceData(nullptr)
+	, m_ReferencePacketCount(0)
+	, m_ReferenceBatchIndex(0)
+	, m_OutOfSyncCount(0)
 
 	, m_OutputSequence(true)
 	, m_MaxSequencePacketCount(64)
 	, m_OutputNullPacket(false)
 	, m_OutputErrorPacket(false)
-	, m_Generate1SegPAT(true)
 
+	, m_PIDPacketCountFoldRemain(PID_PACKET_COUNT_FOLD_INTERVAL)
 	, m_InputBytes(0)
 	, m_TotalInputBytes(0)
+
+	, m_Generate1SegPAT(true)
 {
 	m_ContinuityCounter.fill(0x10);
 }
@@ -56,9 +126,10 @@ void TSPacketParserFilter::Reset()
 	m_TotalPacketCount += m_PacketCount;
 	m_PacketCount.Reset();
 
-	for (size_t i = 0; i < m_PIDPacketCount.size(); i++) {
-		m_PIDTotalPacketCount[i] += m_PIDPacketCount[i];
-		m_PIDPacketCount[i].Reset();
+	FoldPIDPacketCount();
+	for (size_t i = 0; i < m_PIDFoldedPacketCount.size(); i++) {
+		m_PIDTotalPacketCount[i] += m_PIDFoldedPacketCount[i];
+		m_PIDFoldedPacketCount[i] = PIDPacketCount64();
 	}
 
 	m_TotalInputBytes += m_InputBytes;
@@ -68,6 +139,9 @@ void TSPacketParserFilter::Reset()
 
 	m_Packet.ClearSize();
 	m_PacketSequence.SetDataCount(0);
+	m_pBatchData = nullptr;
+	m_pReferenceData = nullptr;
+	m_ReferencePacketCount = 0;
 	m_OutOfSyncCount = 0;
 
 	m_PATGenerator.Reset();
@@ -97,10 +171,7 @@ bool TSPacketParserFilter::ReceiveData(DataStream *pData)
 		SyncPacket(pBuffer->GetData(), pBuffer->GetSize());
 	} while (pData->Next());
 
-	if (m_PacketSequence.GetDataCount() > 0) {
-		OutputData(m_PacketSequence);
-		m_PacketSequence.SetDataCount(0);
-	}
+	FlushPacketSequence();
 
 	return true;
 }
@@ -158,7 +229,7 @@ TSPacketParserFilter::PacketCountInfo TSPacketParserFilter::GetPacketCount(uint1
 
 	BlockLock Lock(m_FilterLock);
 
-	return m_PIDPacketCount[PID];
+	return GetPIDPacketCount(PID);
 }
 
 
@@ -177,7 +248,15 @@ TSPacketParserFilter::PacketCountInfo TSPacketParserFilter::GetTotalPacketCount(
 
 	BlockLock Lock(m_FilterLock);
 
-	return m_PIDTotalPacketCount[PID] + m_PIDPacketCount[PID];
+	PacketCountInfo Count = GetPIDPacketCount(PID);
+	const PIDPacketCount64 &Total = m_PIDTotalPacketCount[PID];
+
+	Count.Input           += Total.Input;
+	Count.Output          += Total.Output;
+	Count.ContinuityError += Total.ContinuityError;
+	Count.Scrambled       += Total.Scrambled;
+
+	return Count;
 }
 
 
@@ -228,7 +307,6 @@ void TSPacketParserFilter::SyncPacket(const uint8_t *pData, size_t Size)
 {
 	m_InputBytes += Size;
 
-	static const uint8_t SYNC_BYTE = 0x47_u8;
 	size_t CurPos = 0;
 
 	while (CurPos < Size) {
@@ -236,14 +314,54 @@ void TSPacketParserFilter::SyncPacket(const uint8_t *pData, size_t Size)
 
 		if (CurSize == 0) {
 			// 同期バイト待ち中
-			do {
-				if (pData[CurPos++] == SYNC_BYTE) {
-					// 同期バイト発見
-					m_Packet.AddByte(SYNC_BYTE);
-					break;
+			const size_t SyncPos = CurPos + FindSyncByte(&pData[CurPos], Size - CurPos);
+			m_OutOfSyncCount += SyncPos - CurPos;
+			CurPos = SyncPos;
+			if (CurPos == Size)
+				break;
+
+			// 再同期の判定が不要であれば、同期の取れているパケットをまとめて処理する
+			if (m_OutOfSyncCount <= TS_PACKET_SIZE_MAX - TS_PACKET_SIZE) {
+				const size_t PacketCount = CountSyncedPackets(&pData[CurPos], Size - CurPos);
+
+				if (PacketCount > 0) {
+					// 入力データを直接参照し、パケット毎のコピーを行わない
+					// ヘッダはまとめて解析する
+					for (size_t i = 0; i < PacketCount;) {
+						m_pBatchData = &pData[CurPos];
+						const size_t BatchCount = TSPacket::ParsePackets(
+							m_pBatchData, PacketCount - i, &m_HeaderBatch, m_ContinuityCounter.data());
+
+						for (size_t j = 0; j < BatchCount; j++) {
+							const TSPacket::ParseResult Result = m_HeaderBatch.Result[j];
+							const uint16_t PID = m_HeaderBatch.PID[j];
+							const bool Scrambled = (m_HeaderBatch.Flags[j] & TSPacketHeaderBatch::HeaderFlag::Scrambled) != 0;
+
+							if (ProcessPacket(Result, PID, Scrambled, nullptr, j)) {
+								if ((Result == TSPacket::ParseResult::OK)
+										|| (Result == TSPacket::ParseResult::ContinuityError))
+									OutputPacketReference(j);
+								else
+									OutputPacket(*GetReferencePacket(j));
+							}
+
+							CurPos += TS_PACKET_SIZE;
+						}
+
+						// 出力するパケットのヘッダは解析結果を参照するため、次の解析の前に出力する
+						FlushPacketReference();
+
+						i += BatchCount;
+					}
+					m_pBatchData = nullptr;
+					m_OutOfSyncCount = 0;
+					continue;
 				}
-				m_OutOfSyncCount++;
-			} while (CurPos < Size);
+			}
+
+			// 同期バイト発見
+			m_Packet.AddByte(SYNC_BYTE);
+			CurPos++;
 		} else {
 			if (CurSize < TS_PACKET_SIZE) {
 				// データ待ち中
@@ -274,20 +392,30 @@ void TSPacketParserFilter::SyncPacket(const uint8_t *pData, size_t Size)
 						continue;
 				}
 
-				ProcessPacket(Result);
+				if (ProcessPacket(Result, m_Packet.GetPID(), m_Packet.IsScrambled(), &m_Packet))
+					OutputPacket(m_Packet);
+				m_Packet.ClearSize();
 
 				m_OutOfSyncCount = 0;
 			}
 		}
 	}
+
+	// 参照しているデータはこの呼び出しの間のみ有効
+	FlushPacketReference();
 }
 
 
-void TSPacketParserFilter::ProcessPacket(TSPacket::ParseResult Result)
+bool TSPacketParserFilter::ProcessPacket(
+	TSPacket::ParseResult Result, uint16_t PID, bool Scrambled, TSPacket *pPacket, size_t BatchIndex)
 {
 	++m_PacketCount.Input;
 
-	const uint16_t PID = m_Packet.GetPID();
+	// 32ビットのカウンタが溢れる前に 64ビットのカウンタに移す
+	// (PAT の生成により出力数は入力数を上回ることがあるため、間隔には余裕を持たせている)
+	if (--m_PIDPacketCountFoldRemain == 0)
+		FoldPIDPacketCount();
+
 	bool Output = false;
 
 	switch (Result) {
@@ -299,7 +427,7 @@ void TSPacketParserFilter::ProcessPacket(TSPacket::ParseResult Result)
 		{
 			++m_PIDPacketCount[PID].Input;
 
-			if (m_Packet.IsScrambled()) {
+			if (Scrambled) {
 				++m_PacketCount.Scrambled;
 				++m_PIDPacketCount[PID].Scrambled;
 			}
@@ -311,9 +439,13 @@ void TSPacketParserFilter::ProcessPacket(TSPacket::ParseResult Result)
 				break;
 			}
 #endif
-			if (m_PATGenerator.StorePacket(&m_Packet) && m_Generate1SegPAT) {
-				if (m_PATGenerator.GetPATPacket(&m_PATPacket))
-					OutputPacket(m_PATPacket);
+			if (OneSegPATGenerator::IsTargetPID(PID)) {
+				if (pPacket == nullptr)
+					pPacket = GetReferencePacket(BatchIndex);
+				if (m_PATGenerator.StorePacket(pPacket) && m_Generate1SegPAT) {
+					if (m_PATGenerator.GetPATPacket(&m_PATPacket))
+						OutputPacket(m_PATPacket);
+				}
 			}
 
 			if (m_OutputNullPacket || (PID != PID_NULL))
@@ -336,10 +468,7 @@ void TSPacketParserFilter::ProcessPacket(TSPacket::ParseResult Result)
 		break;
 	}
 
-	if (Output)
-		OutputPacket(m_Packet);
-
-	m_Packet.ClearSize();
+	return Output;
 }
 
 
@@ -350,12 +479,13 @@ void TSPacketParserFilter::OutputPacket(TSPacket &Packet)
 	++m_PacketCount.Output;
 	++m_PIDPacketCount[PID].Output;
 
+	FlushPacketReference();
+
 	if (m_OutputSequence) {
 		if ((m_PacketSequence.GetDataCount() >= m_MaxSequencePacketCount)
 				|| ((m_PacketSequence.GetDataCount() > 0)
 					&& (m_PacketSequence[0].GetPID() != Packet.GetPID()))) {
-			OutputData(m_PacketSequence);
-			m_PacketSequence.SetDataCount(0);
+			FlushPacketSequence();
 		}
 
 		m_PacketSequence.AddData(Packet);
@@ -365,4 +495,92 @@ void TSPacketParserFilter::OutputPacket(TSPacket &Packet)
 }
 
 
+void TSPacketParserFilter::OutputPacketReference(size_t BatchIndex)
+{
+	const uint8_t *pData = m_pBatchData + BatchIndex * TS_PACKET_SIZE;
+	const uint16_t PID = m_HeaderBatch.PID[BatchIndex];
+
+	++m_PacketCount.Output;
+	++m_PIDPacketCount[PID].Output;
+
+	if (m_OutputSequence) {
+		// 同一 PID で連続しているパケットはまとめて出力する
+		if ((m_ReferencePacketCount > 0)
+				&& ((m_ReferencePacketCount >= m_MaxSequencePacketCount)
+					|| (m_pReferenceData + m_ReferencePacketCount * TS_PACKET_SIZE != pData)
+					|| (m_HeaderBatch.PID[m_ReferenceBatchIndex] != PID))) {
+			FlushPacketReference();
+		}
+
+		FlushPacketSequence();
+
+		if (m_ReferencePacketCount == 0) {
+			m_pReferenceData = pData;
+			m_ReferenceBatchIndex = BatchIndex;
+		}
+		m_ReferencePacketCount++;
+	} else {
+		OutputData(GetReferencePacket(BatchIndex));
+	}
+}
+
+
+TSPacket * TSPacketParserFilter::GetReferencePacket(size_t BatchIndex)
+{
+	m_ReferencePacket.SetReference(m_pBatchData + BatchIndex * TS_PACKET_SIZE, m_HeaderBatch, BatchIndex);
+
+	return &m_ReferencePacket;
+}
+
+
+void TSPacketParserFilter::FoldPIDPacketCount()
+{
+	for (size_t i = 0; i < m_PIDPacketCount.size(); i++) {
+		m_PIDFoldedPacketCount[i] += m_PIDPacketCount[i];
+		m_PIDPacketCount[i] = PIDPacketCount32();
+	}
+
+	m_PIDPacketCountFoldRemain = PID_PACKET_COUNT_FOLD_INTERVAL;
+}
+
+
+TSPacketParserFilter::PacketCountInfo TSPacketParserFilter::GetPIDPacketCount(uint16_t PID) const
+{
+	const PIDPacketCount32 &Count = m_PIDPacketCount[PID];
+	const PIDPacketCount64 &Folded = m_PIDFoldedPacketCount[PID];
+	PacketCountInfo Info;
+
+	Info.Input           = Folded.Input + Count.Input;
+	Info.Output          = Folded.Output + Count.Output;
+	Info.ContinuityError = Folded.ContinuityError + Count.ContinuityError;
+	Info.Scrambled       = Folded.Scrambled + Count.Scrambled;
+
+	return Info;
+}
+
+
+void TSPacketParserFilter::FlushPacketSequence()
+{
+	if (m_PacketSequence.GetDataCount() > 0) {
+		OutputData(m_PacketSequence);
+		m_PacketSequence.SetDataCount(0);
+	}
+}
+
+
+void TSPacketParserFilter::FlushPacketReference()
+{
+	if (m_ReferencePacketCount > 0) {
+		TSPacketViewStream Stream(
+			m_pReferenceData, m_ReferencePacketCount, &m_HeaderBatch, m_ReferenceBatchIndex,
+			&m_ReferencePacketList[m_ReferenceBatchIndex]);
+
+		m_pReferenceData = nullptr;
+		m_ReferencePacketCount = 0;
+
+		OutputData(&Stream);
+	}
+}
+
+
 }	// namespace LibISDB
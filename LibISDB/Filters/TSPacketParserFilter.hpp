@@ -107,12 +107,62 @@ namespace LibISDB
 		bool SetTransportStreamID(uint16_t TransportStreamID);
 
 	private:
+		/** PID 毎のパケット数(更新頻度が高いため 32ビットで保持する) */
+		struct PIDPacketCount32 {
+			uint32_t Input = 0;
+			uint32_t Output = 0;
+			uint32_t ContinuityError = 0;
+			uint32_t Scrambled = 0;
+		};
+
+		/** PID 毎のパケット数(PID 毎にはフォーマットエラー等は数えない) */
+		struct PIDPacketCount64 {
+			unsigned long long Input = 0;
+			unsigned long long Output = 0;
+			unsigned long long ContinuityError = 0;
+			unsigned long long Scrambled = 0;
+
+			PIDPacketCount64 & operator += (const PIDPacketCount32 &rhs) noexcept
+			{
+				Input           += rhs.Input;
+				Output          += rhs.Output;
+				ContinuityError += rhs.ContinuityError;
+				Scrambled       += rhs.Scrambled;
+				return *this;
+			}
+
+			PIDPacketCount64 & operator += (const PIDPacketCount64 &rhs) noexcept
+			{
+				Input           += rhs.Input;
+				Output          += rhs.Output;
+				ContinuityError += rhs.ContinuityError;
+				Scrambled       += rhs.Scrambled;
+				return *this;
+			}
+		};
+
+		/** 32ビットのカウンタを 64ビットのカウンタに加算する間隔(入力パケット数) */
+		static constexpr uint32_t PID_PACKET_COUNT_FOLD_INTERVAL = 0x40000000_u32;
+
 		void SyncPacket(const uint8_t *pData, size_t Size);
-		void ProcessPacket(TSPacket::ParseResult Result);
+		bool ProcessPacket(TSPacket::ParseResult Result, uint16_t PID, bool Scrambled, TSPacket *pPacket, size_t BatchIndex = 0);
 		void OutputPacket(TSPacket &Packet);
+		void OutputPacketReference(size_t BatchIndex);
+		TSPacket * GetReferencePacket(size_t BatchIndex);
+		void FlushPacketSequence();
+		void FlushPacketReference();
+		void FoldPIDPacketCount();
+		PacketCountInfo GetPIDPacketCount(uint16_t PID) const;
 
 		TSPacket m_Packet;
+		TSPacket m_ReferencePacket;
+		TSPacket m_ReferencePacketList[TSPacketHeaderBatch::MAX_PACKET_COUNT];
+		TSPacketHeaderBatch m_HeaderBatch;
+		const uint8_t *m_pBatchData;
 		DataStreamSequence<TSPacket> m_PacketSequence;
+		const uint8_t *m_pReferenceData;
+		size_t m_ReferencePacketCount;
+		size_t m_ReferenceBatchIndex;
 		size_t m_OutOfSyncCount;
 
 		bool m_OutputSequence;
@@ -122,8 +172,10 @@ namespace LibISDB
 
 		PacketCountInfo m_PacketCount;
 		PacketCountInfo m_TotalPacketCount;
-		std::array<PacketCountInfo, PID_MAX + 1> m_PIDPacketCount;
-		std::array<PacketCountInfo, PID_MAX + 1> m_PIDTotalPacketCount;
+		std::array<PIDPacketCount32, PID_MAX + 1> m_PIDPacketCount;
+		std::array<PIDPacketCount64, PID_MAX + 1> m_PIDFoldedPacketCount;
+		std::array<PIDPacketCount64, PID_MAX + 1> m_PIDTotalPacketCount;
+		uint32_t m_PIDPacketCountFoldRemain;
 		std::array<uint8_t, PID_MAX> m_ContinuityCounter;
 		unsigned long long m_InputBytes;
 		unsigned long long m_TotalInputBytes;
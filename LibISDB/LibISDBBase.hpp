@@ -59,6 +59,9 @@
 #define LIBISDB_SSE_SUPPORT
 #ifndef LIBISDB_NO_SSE2
 #define LIBISDB_SSE2_SUPPORT
+#ifndef LIBISDB_NO_PCLMULQDQ
+#define LIBISDB_PCLMULQDQ_SUPPORT
+#endif	// ifndef LIBISDB_NO_PCLMULQDQ
 #endif	// ifndef LIBISDB_NO_SSE2
 #endif	// ifndef LIBISDB_NO_SSE
 #endif
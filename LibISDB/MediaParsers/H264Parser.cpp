@@ -64,15 +64,15 @@ bool H264AccessUnit::ParseHeader()
 			break;
 
 		const uint8_t NALUnitType = m_pData[Pos++] & 0x1F;
-		size_t NALUnitSize = NextPos - 3 - Pos;
+		const size_t NALUnitSize = NextPos - 3 - Pos;
 
-		NALUnitSize = EBSPToRBSP(&m_pData[Pos], NALUnitSize);
-		if (NALUnitSize == static_cast<size_t>(-1))
+		// データは変更せず、エミュレーション防止バイトの検査のみ行う
+		if (!IsValidEBSP(&m_pData[Pos], NALUnitSize))
 			break;
 
 		if (NALUnitType == 0x07) {
 			// Sequence parameter set
-			BitstreamReader Bitstream(&m_pData[Pos], NALUnitSize);
+			RBSPBitstreamReader Bitstream(&m_pData[Pos], NALUnitSize);
 
 			m_Header.SPS.ProfileIDC = static_cast<uint8_t>(Bitstream.GetBits(8));
 			m_Header.SPS.ConstraintSet0Flag = Bitstream.GetFlag();
@@ -70,15 +70,15 @@ bool H265AccessUnit::ParseHeader()
 		// nuh_layer_id	u(6)
 		// nuh_temporal_id_plus1	u(3)
 		Pos += 2;
-		size_t NALUnitSize = NextPos - 3 - Pos;
+		const size_t NALUnitSize = NextPos - 3 - Pos;
 
-		NALUnitSize = EBSPToRBSP(&m_pData[Pos], NALUnitSize);
-		if (NALUnitSize == (size_t)-1)
+		// データは変更せず、エミュレーション防止バイトの検査のみ行う
+		if (!IsValidEBSP(&m_pData[Pos], NALUnitSize))
 			break;
 
 		if (NALUnitType == 0x21) {
 			// Sequence parameter set
-			BitstreamReader Bitstream(&m_pData[Pos], NALUnitSize);
+			RBSPBitstreamReader Bitstream(&m_pData[Pos], NALUnitSize);
 
 			m_Header.SPS.SPSVideoParameterSetID = static_cast<uint8_t>(Bitstream.GetBits(4));
 			m_Header.SPS.SPSMaxSubLayersMinus1 = static_cast<uint8_t>(Bitstream.GetBits(3));
@@ -26,12 +26,138 @@
 
 #include "../LibISDBPrivate.hpp"
 #include "MPEGVideoParser.hpp"
+#include "../Utilities/Utilities.hpp"
+#include "../Base/SIMD.hpp"
+#include <cstring>
 #include "../Base/DebugDef.hpp"
 
 
 namespace LibISDB
 {
 
+namespace
+{
+
+
+// スタートコードを検索する
+// 見付かった場合はスタートコードの最後のバイトの位置を、見付からなかった場合は Size を返す
+// スタートコードの先頭は 00 00 であるため、SSE2 で 00 00 が現れる位置を探し、それ以外は読み飛ばす
+size_t FindStartCode(
+	const uint8_t *pData, size_t Size, uint32_t *pSyncState, uint32_t StartCode, uint32_t StartCodeMask)
+{
+	uint32_t SyncState = *pSyncState;
+	size_t Pos = 0;
+
+#ifdef LIBISDB_SSE2_SUPPORT
+	if (IsSSE2Enabled()) {
+		// 先頭の3バイトは前回からの状態を引き継いで判定する
+		for (; (Pos < 3) && (Pos < Size); Pos++) {
+			SyncState = (SyncState << 8) | pData[Pos];
+			if ((SyncState & StartCodeMask) == StartCode) {
+				*pSyncState = SyncState;
+				return Pos;
+			}
+		}
+
+		// Pos で終わるスタートコードの 00 00 は Pos - 3 から始まる
+		if (Pos + 14 <= Size) {
+			const __m128i Zero = _mm_setzero_si128();
+
+			do {
+				const uint8_t *p = &pData[Pos - 3];
+				const __m128i Zero0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), Zero);
+				const __m128i Zero1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1)), Zero);
+				const uint32_t Mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(Zero0, Zero1)));
+
+				if (Mask == 0) {
+					Pos += 16;
+				} else {
+					Pos += BitScanForward32(Mask);
+					if (Pos >= Size)
+						break;
+					SyncState = Load32(&pData[Pos - 3]);
+					if ((SyncState & StartCodeMask) == StartCode) {
+						*pSyncState = SyncState;
+						return Pos;
+					}
+					Pos++;
+				}
+			} while (Pos + 14 <= Size);
+
+			// 読み飛ばした位置からシフトレジスタを再構成する
+			if (Pos > Size)
+				Pos = Size;
+			SyncState = Load32(&pData[Pos - 4]);
+		}
+	}
+#endif
+
+	for (; Pos < Size; Pos++) {
+		SyncState = (SyncState << 8) | pData[Pos];
+		if ((SyncState & StartCodeMask) == StartCode)
+			break;
+	}
+
+	*pSyncState = SyncState;
+
+	return Pos;
+}
+
+
+// 00 00 が現れる位置を探す
+// 見付からなかった場合は Size を返す
+size_t FindZeroPair(const uint8_t *pData, size_t Size, size_t Pos)
+{
+#ifdef LIBISDB_SSE2_SUPPORT
+	if (IsSSE2Enabled()) {
+		const __m128i Zero = _mm_setzero_si128();
+
+		for (; Pos + 17 <= Size; Pos += 16) {
+			const uint8_t *p = &pData[Pos];
+			const __m128i Zero0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), Zero);
+			const __m128i Zero1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1)), Zero);
+			const uint32_t Mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(Zero0, Zero1)));
+			if (Mask != 0)
+				return Pos + BitScanForward32(Mask);
+		}
+	}
+#endif
+
+	for (; Pos + 1 < Size; Pos++) {
+		if ((pData[Pos] == 0x00) && (pData[Pos + 1] == 0x00))
+			return Pos;
+	}
+
+	return Size;
+}
+
+
+// 次のエミュレーション防止バイト(00 00 03 の 03)の位置を探す
+// 見付からなかった場合は DataSize を、不正なデータであれば -1 を返す
+size_t FindEmulationPreventionByte(const uint8_t *pData, size_t DataSize, size_t Pos)
+{
+	for (;;) {
+		Pos = FindZeroPair(pData, DataSize, Pos);
+		if (Pos + 2 >= DataSize)
+			return DataSize;
+
+		const uint8_t Next = pData[Pos + 2];
+		if (Next < 0x03)
+			return static_cast<size_t>(-1);
+		if (Next == 0x03) {
+			if ((Pos + 3 < DataSize) && (pData[Pos + 3] > 0x03))
+				return static_cast<size_t>(-1);
+			return Pos + 2;
+		}
+
+		Pos += 3;
+	}
+}
+
+
+}	// namespace
+
+
 
 MPEGVideoParserBase::MPEGVideoParserBase()
 	: m_SyncState(0xFFFFFFFF_u32)
@@ -71,23 +197,7 @@ bool MPEGVideoParserBase::ParseSequence(
 		// スタートコードを検索する
 		const size_t Remain = Size - Pos;
 
-		if (StartCodeMask == 0xFFFFFFFF_u32) {
-			for (Start = 0; Start < Remain; Start++) {
-				SyncState = (SyncState << 8) | pData[Start + Pos];
-				if (SyncState == StartCode) {
-					// スタートコード発見
-					break;
-				}
-			}
-		} else {
-			for (Start = 0; Start < Remain; Start++) {
-				SyncState = (SyncState << 8) | pData[Start + Pos];
-				if ((SyncState & StartCodeMask) == StartCode) {
-					// スタートコード発見
-					break;
-				}
-			}
-		}
+		Start = FindStartCode(&pData[Pos], Remain, &SyncState, StartCode, StartCodeMask);
 
 		if (Start < Remain) {
 			Start++;
@@ -137,30 +247,95 @@ bool MPEGVideoParserBase::ParseSequence(
 size_t EBSPToRBSP(uint8_t *pData, size_t DataSize)
 {
 	size_t ConvertedSize = 0;
-	int Count = 0;
 
-	for (size_t i = 0; i < DataSize; i++) {
-		if (Count == 2) {
-			if (pData[i] < 0x03)
-				return static_cast<size_t>(-1);
-			if (pData[i] == 0x03) {
-				if ((i < DataSize - 1) && (pData[i + 1] > 0x03))
-					return static_cast<size_t>(-1);
-				if (i == DataSize - 1)
-					break;
-				i++;
-				Count = 0;
-			}
-		}
-		pData[ConvertedSize++] = pData[i];
-		if (pData[i] == 0x00)
-			Count++;
-		else
-			Count = 0;
+	for (size_t Pos = 0;;) {
+		const size_t EscapePos = FindEmulationPreventionByte(pData, DataSize, Pos);
+		if (EscapePos == static_cast<size_t>(-1))
+			return static_cast<size_t>(-1);
+
+		// エミュレーション防止バイトの間を前に詰める
+		const size_t Length = EscapePos - Pos;
+		if (ConvertedSize != Pos)
+			std::memmove(&pData[ConvertedSize], &pData[Pos], Length);
+		ConvertedSize += Length;
+
+		if (EscapePos >= DataSize)
+			break;
+		Pos = EscapePos + 1;
 	}
 
 	return ConvertedSize;
 }
 
 
+// データを変更せずにエミュレーション防止バイトを取り除く
+// エミュレーション防止バイトがなければ元のデータを返し、あれば取り除いたものを pBuffer に格納して返す
+const uint8_t * EBSPToRBSP(const uint8_t *pData, size_t DataSize, ReturnArg<size_t> RBSPSize, DataBuffer *pBuffer)
+{
+	size_t EscapePos = FindEmulationPreventionByte(pData, DataSize, 0);
+	if (EscapePos == static_cast<size_t>(-1))
+		return nullptr;
+
+	if (EscapePos >= DataSize) {
+		RBSPSize = DataSize;
+		return pData;
+	}
+
+	if (LIBISDB_TRACE_ERROR_IF(pBuffer == nullptr))
+		return nullptr;
+
+	pBuffer->ClearSize();
+	pBuffer->AllocateBuffer(DataSize);
+
+	for (size_t Pos = 0;;) {
+		pBuffer->AddData(&pData[Pos], EscapePos - Pos);
+		if (EscapePos >= DataSize)
+			break;
+		Pos = EscapePos + 1;
+		EscapePos = FindEmulationPreventionByte(pData, DataSize, Pos);
+		if (EscapePos == static_cast<size_t>(-1))
+			return nullptr;
+	}
+
+	RBSPSize = pBuffer->GetSize();
+
+	return pBuffer->GetData();
+}
+
+
+// エミュレーション防止バイトの検査のみを行う
+bool IsValidEBSP(const uint8_t *pData, size_t DataSize)
+{
+	for (size_t Pos = 0;;) {
+		const size_t EscapePos = FindEmulationPreventionByte(pData, DataSize, Pos);
+		if (EscapePos == static_cast<size_t>(-1))
+			return false;
+		if (EscapePos >= DataSize)
+			break;
+		Pos = EscapePos + 1;
+	}
+
+	return true;
+}
+
+
+
+
+RBSPBitstreamReader::RBSPBitstreamReader(const uint8_t *pData, size_t DataSize)
+	: BitstreamReader(pData, 0)
+{
+	size_t RBSPSize;
+	const uint8_t *pRBSP = EBSPToRBSP(pData, DataSize, &RBSPSize, &m_Buffer);
+
+	if (pRBSP != nullptr) {
+		m_pBits = pRBSP;
+		m_BitSize = RBSPSize << 3;
+		m_IsValid = true;
+	} else {
+		MarkOverrun();
+		m_IsValid = false;
+	}
+}
+
+
 }	// namespace LibISDB
@@ -29,6 +29,7 @@
 
 
 #include "../TS/PESPacket.hpp"
+#include "../Base/BitstreamReader.hpp"
 
 
 namespace LibISDB
@@ -56,6 +57,30 @@ namespace LibISDB
 	};
 
 	size_t EBSPToRBSP(uint8_t *pData, size_t DataSize);
+	const uint8_t * EBSPToRBSP(const uint8_t *pData, size_t DataSize, ReturnArg<size_t> RBSPSize, DataBuffer *pBuffer);
+	bool IsValidEBSP(const uint8_t *pData, size_t DataSize);
+
+	/**
+		RBSP ビット列読み込みクラス
+
+		EBSP からエミュレーション防止バイトを取り除いて読み込む。
+		エミュレーション防止バイトがなければコピーせずに元のデータを読み込む。
+	*/
+	class RBSPBitstreamReader
+		: public BitstreamReader
+	{
+	public:
+		RBSPBitstreamReader(const uint8_t *pData, size_t DataSize);
+
+		RBSPBitstreamReader(const RBSPBitstreamReader &) = delete;
+		RBSPBitstreamReader & operator = (const RBSPBitstreamReader &) = delete;
+
+		bool IsValid() const noexcept { return m_IsValid; }
+
+	private:
+		DataBuffer m_Buffer;
+		bool m_IsValid;
+	};
 
 }	// namespace LibISDB
 
@@ -305,11 +305,12 @@ bool CaptionParser::ParseUnitData(const uint8_t *pData, uint32_t *pDataSize)
 	if ((UnitSize > 0) && (m_pHandler != nullptr)) {
 		ARIBStringDecoder::DecodeFlag Flags =
 			m_1Seg ? ARIBStringDecoder::DecodeFlag::OneSeg : ARIBStringDecoder::DecodeFlag::None;
-		ARIBStringDecoder::FormatList FormatList;
-		String Text;
+		CStringView Text;
 
-		if (m_StringDecoder.DecodeCaption(&pData[5], UnitSize, &Text, Flags, &FormatList, m_pDRCSMap)) {
-			OnCaption(Text.c_str(), &FormatList);
+		// 文字列とフォーマットのバッファは使い回す
+		m_FormatList.clear();
+		if (m_StringDecoder.DecodeCaption(&pData[5], UnitSize, &Text, Flags, &m_FormatList, m_pDRCSMap)) {
+			OnCaption(Text.c_str(), &m_FormatList);
 		}
 	}
 
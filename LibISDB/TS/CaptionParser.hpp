@@ -126,6 +126,8 @@ namespace LibISDB
 		DRCSMap *m_pDRCSMap;
 		bool m_1Seg;
 
+		ARIBStringDecoder::FormatList m_FormatList;
+
 		std::vector<LanguageInfo> m_LanguageList;
 		uint8_t m_DataGroupVersion;
 		uint8_t m_DataGroupID;
@@ -27,6 +27,7 @@
 #include "../LibISDBPrivate.hpp"
 #include "DescriptorBlock.hpp"
 #include "Descriptors.hpp"
+#include <algorithm>
 #include "../Base/DebugDef.hpp"
 
 
@@ -34,15 +35,97 @@ namespace LibISDB
 {
 
 
+std::unique_ptr<DescriptorBase> DescriptorPool::Get(uint8_t Tag)
+{
+	BlockLock Lock(m_Lock);
+
+	for (auto &e : m_FreeList) {
+		if (e.Tag == Tag) {
+			if (e.List.empty())
+				break;
+			std::unique_ptr<DescriptorBase> Descriptor(std::move(e.List.back()));
+			e.List.pop_back();
+			m_PooledCount--;
+			m_ReusedCount++;
+			return Descriptor;
+		}
+	}
+
+	return nullptr;
+}
+
+
+void DescriptorPool::Release(uint8_t Tag, std::unique_ptr<DescriptorBase> &&Descriptor)
+{
+	if (!Descriptor)
+		return;
+
+	BlockLock Lock(m_Lock);
+
+	auto it = std::find_if(
+		m_FreeList.begin(), m_FreeList.end(),
+		[Tag](const FreeList &List) -> bool { return List.Tag == Tag; });
+	if (it == m_FreeList.end()) {
+		it = m_FreeList.emplace(m_FreeList.end());
+		it->Tag = Tag;
+	}
+
+	it->List.push_back(std::move(Descriptor));
+	m_PooledCount++;
+}
+
+
+void DescriptorPool::Clear()
+{
+	BlockLock Lock(m_Lock);
+
+	m_FreeList.clear();
+	m_PooledCount = 0;
+}
+
+
+size_t DescriptorPool::GetPooledCount() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_PooledCount;
+}
+
+
+unsigned long long DescriptorPool::GetReusedCount() const
+{
+	BlockLock Lock(m_Lock);
+
+	return m_ReusedCount;
+}
+
+
+
+
 DescriptorBlock::DescriptorBlock(const DescriptorBlock &Src)
 {
 	*this = Src;
 }
 
 
-DescriptorBlock::DescriptorBlock(DescriptorBlock &&Src)
+DescriptorBlock::DescriptorBlock(DescriptorBlock &&Src) noexcept
+	: m_DescriptorList(std::move(Src.m_DescriptorList))
+	, m_LazyDecode(Src.m_LazyDecode)
+	, m_RawData(std::move(Src.m_RawData))
+	, m_LazyList(std::move(Src.m_LazyList))
+	, m_LazyCount(Src.m_LazyCount)
+	, m_LazyCapacity(Src.m_LazyCapacity)
+	, m_LazyDecodedCount(Src.m_LazyDecodedCount.load(std::memory_order_relaxed))
+	, m_LazyValidCount(Src.m_LazyValidCount.load(std::memory_order_relaxed))
+{
+	Src.m_LazyCount = 0;
+	Src.m_LazyCapacity = 0;
+}
+
+
+DescriptorBlock::~DescriptorBlock()
 {
-	*this = std::move(Src);
+	ReleaseDescriptors();
 }
 
 
@@ -51,10 +134,29 @@ DescriptorBlock & DescriptorBlock::operator = (const DescriptorBlock &Src)
 	if (&Src != this) {
 		Reset();
 		m_DescriptorList.reserve(Src.m_DescriptorList.size());
-
 		for (auto &e : Src.m_DescriptorList) {
 			m_DescriptorList.push_back(std::unique_ptr<DescriptorBase>(e->Clone()));
 		}
+
+		m_LazyDecode = Src.m_LazyDecode;
+		m_RawData = Src.m_RawData;
+
+		// 遅延デコードで未解析の記述子はそのまま未解析とする
+		if (Src.m_LazyCount > 0) {
+			ReserveLazyList(Src.m_LazyCount);
+			for (size_t i = 0; i < Src.m_LazyCount; i++) {
+				const LazyDescriptor &SrcEntry = Src.m_LazyList[i];
+				LazyDescriptor &Entry = m_LazyList[i];
+				const DescriptorBase *pDescriptor = SrcEntry.Decoded.load(std::memory_order_acquire);
+				Entry.Offset = SrcEntry.Offset;
+				Entry.Tag    = SrcEntry.Tag;
+				Entry.Length = SrcEntry.Length;
+				Entry.Decoded.store((pDescriptor != nullptr) ? pDescriptor->Clone() : nullptr, std::memory_order_relaxed);
+			}
+			m_LazyCount = Src.m_LazyCount;
+			m_LazyDecodedCount.store(Src.m_LazyDecodedCount.load(std::memory_order_acquire), std::memory_order_relaxed);
+			m_LazyValidCount.store(Src.m_LazyValidCount.load(std::memory_order_acquire), std::memory_order_relaxed);
+		}
 	}
 
 	return *this;
@@ -66,6 +168,13 @@ DescriptorBlock & DescriptorBlock::operator = (DescriptorBlock &&Src)
 	if (&Src != this) {
 		Reset();
 		m_DescriptorList.swap(Src.m_DescriptorList);
+		m_LazyDecode = Src.m_LazyDecode;
+		m_RawData.swap(Src.m_RawData);
+		m_LazyList.swap(Src.m_LazyList);
+		std::swap(m_LazyCount, Src.m_LazyCount);
+		std::swap(m_LazyCapacity, Src.m_LazyCapacity);
+		m_LazyDecodedCount.store(Src.m_LazyDecodedCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		m_LazyValidCount.store(Src.m_LazyValidCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
 	}
 
 	return *this;
@@ -79,6 +188,9 @@ int DescriptorBlock::ParseBlock(const uint8_t *pData, size_t DataLength)
 	if ((pData == nullptr) || (DataLength < 2) || (DataLength > 0xFFFF))
 		return 0;
 
+	if (m_LazyDecode)
+		return IndexBlock(pData, DataLength);
+
 	size_t Pos = 0;
 
 	do {
@@ -107,44 +219,78 @@ const DescriptorBase * DescriptorBlock::ParseBlock(const uint8_t *pData, size_t
 
 void DescriptorBlock::Reset()
 {
-	m_DescriptorList.clear();
+	ReleaseDescriptors();
+	m_RawData.clear();
 }
 
 
 int DescriptorBlock::GetDescriptorCount() const
 {
-	return static_cast<int>(m_DescriptorList.size());
+	return static_cast<int>(GetEntryCount());
+}
+
+
+int DescriptorBlock::GetDecodedDescriptorCount() const
+{
+	if (m_LazyCount == 0)
+		return static_cast<int>(m_DescriptorList.size());
+
+	int Count = 0;
+	for (size_t i = 0; i < m_LazyCount; i++) {
+		if (m_LazyList[i].Decoded.load(std::memory_order_acquire) != nullptr)
+			Count++;
+	}
+	return Count;
 }
 
 
 const DescriptorBase * DescriptorBlock::GetDescriptorByIndex(int Index) const
 {
-	if (static_cast<unsigned int>(Index) >= m_DescriptorList.size())
+	if (m_LazyCount == 0) {
+		if (static_cast<unsigned int>(Index) >= m_DescriptorList.size())
+			return nullptr;
+		return m_DescriptorList[Index].get();
+	}
+
+	if ((static_cast<unsigned int>(Index) >= m_LazyCount)
+			|| (DecodeLazyDescriptors(Index + 1) <= static_cast<size_t>(Index)))
 		return nullptr;
-	return m_DescriptorList[Index].get();
+	return m_LazyList[Index].Decoded.load(std::memory_order_acquire);
 }
 
 
 const DescriptorBase * DescriptorBlock::GetDescriptorByTag(uint8_t Tag) const
 {
-	for (auto &e : m_DescriptorList){
-		if (e->GetTag() == Tag)
-			return e.get();
+	// 遅延デコードでは、先頭から見つかった位置までのみ解析される
+	const size_t Count = (m_LazyCount == 0) ? m_DescriptorList.size() : m_LazyCount;
+	for (size_t i = 0; i < Count; i++) {
+		const DescriptorBase *pDescriptor = GetDescriptorByTagAt(i, Tag);
+		if (pDescriptor != nullptr)
+			return pDescriptor;
 	}
 
 	return nullptr;
 }
 
 
-std::unique_ptr<DescriptorBase> DescriptorBlock::ParseDescriptor(const uint8_t *pData, uint16_t DataLength)
+std::unique_ptr<DescriptorBase> DescriptorBlock::ParseDescriptor(const uint8_t *pData, uint16_t DataLength) const
 {
 	if ((pData == nullptr) || (DataLength < 2))
 		return nullptr;
 
-	std::unique_ptr<DescriptorBase> Descriptor(CreateDescriptorInstance(pData[0]));
+	const uint8_t Tag = pData[0];
+	std::unique_ptr<DescriptorBase> Descriptor;
+
+	if (m_pDescriptorPool != nullptr)
+		Descriptor = m_pDescriptorPool->Get(Tag);
+	if (!Descriptor)
+		Descriptor.reset(CreateDescriptorInstance(Tag));
 
-	if (!Descriptor->Parse(pData, DataLength))
+	if (!Descriptor->Parse(pData, DataLength)) {
+		if (m_pDescriptorPool != nullptr)
+			m_pDescriptorPool->Release(Tag, std::move(Descriptor));
 		return nullptr;
+	}
 
 	return Descriptor;
 }
@@ -197,4 +343,136 @@ DescriptorBase * DescriptorBlock::CreateDescriptorInstance(uint8_t Tag)
 }
 
 
+void DescriptorBlock::ReleaseDescriptors()
+{
+	if (m_pDescriptorPool != nullptr) {
+		// 解析された記述子のタグは生成時のタグと一致する
+		for (auto &e : m_DescriptorList) {
+			if (e)
+				m_pDescriptorPool->Release(e->GetTag(), std::move(e));
+		}
+	}
+
+	m_DescriptorList.clear();
+
+	for (size_t i = 0; i < m_LazyCount; i++) {
+		std::unique_ptr<DescriptorBase> Descriptor(m_LazyList[i].Decoded.exchange(nullptr, std::memory_order_relaxed));
+		if (Descriptor && (m_pDescriptorPool != nullptr))
+			m_pDescriptorPool->Release(m_LazyList[i].Tag, std::move(Descriptor));
+	}
+	m_LazyCount = 0;
+	m_LazyDecodedCount.store(0, std::memory_order_relaxed);
+	m_LazyValidCount.store(0, std::memory_order_relaxed);
+}
+
+
+int DescriptorBlock::IndexBlock(const uint8_t *pData, size_t DataLength)
+{
+	size_t Pos = 0, Count = 0;
+
+	do {
+		const uint8_t Length = pData[Pos + 1];
+
+		// タグと長さの範囲のみ検査する
+		// 長さが 0 の記述子は解析に失敗するため、通常の解析と同様にそこで打ち切る
+		if ((Length == 0) || (Pos + 2 + Length > DataLength))
+			break;
+
+		Pos += 2 + Length;
+		Count++;
+	} while (Pos + 2 <= DataLength);
+
+	if (Count > 0) {
+		m_RawData.assign(pData, pData + Pos);
+		ReserveLazyList(Count);
+
+		Pos = 0;
+		for (size_t i = 0; i < Count; i++) {
+			LazyDescriptor &Entry = m_LazyList[i];
+			Entry.Offset = static_cast<uint16_t>(Pos);
+			Entry.Tag    = pData[Pos];
+			Entry.Length = pData[Pos + 1];
+			Entry.Decoded.store(nullptr, std::memory_order_relaxed);
+			Pos += 2 + Entry.Length;
+		}
+
+		m_LazyCount = Count;
+		m_LazyValidCount.store(Count, std::memory_order_relaxed);
+	}
+
+	return static_cast<int>(Count);
+}
+
+
+void DescriptorBlock::ReserveLazyList(size_t Count)
+{
+	// 再解析時に確保し直さないように、確保した領域は Reset() では解放しない
+	if (m_LazyCapacity < Count) {
+		m_LazyList.reset(new LazyDescriptor[Count]);
+		m_LazyCapacity = Count;
+	}
+}
+
+
+size_t DescriptorBlock::GetEntryCount() const
+{
+	if (m_LazyCount == 0)
+		return m_DescriptorList.size();
+
+	return DecodeLazyDescriptors(m_LazyCount);
+}
+
+
+// 先頭から Count 個までの記述子を解析し、取得できる記述子の数を返す
+size_t DescriptorBlock::DecodeLazyDescriptors(size_t Count) const
+{
+	size_t Decoded = m_LazyDecodedCount.load(std::memory_order_acquire);
+	if (Decoded >= Count)
+		return Count;
+
+	// 通常の解析と同様に、解析に失敗した記述子以降は取得できないようにする
+	const size_t ValidCount = m_LazyValidCount.load(std::memory_order_acquire);
+
+	for (; (Decoded < Count) && (Decoded < ValidCount); Decoded++) {
+		LazyDescriptor &Entry = m_LazyList[Decoded];
+
+		if (Entry.Decoded.load(std::memory_order_acquire) != nullptr)
+			continue;
+
+		std::unique_ptr<DescriptorBase> Descriptor(ParseDescriptor(&m_RawData[Entry.Offset], Entry.Length + 2));
+		if (!Descriptor) {
+			m_LazyValidCount.store(Decoded, std::memory_order_release);
+			break;
+		}
+
+		// 他のスレッドが先に記録した場合はそちらを使う
+		DescriptorBase *pExpected = nullptr;
+		if (Entry.Decoded.compare_exchange_strong(pExpected, Descriptor.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+			Descriptor.release();
+		else if (m_pDescriptorPool != nullptr)
+			m_pDescriptorPool->Release(Entry.Tag, std::move(Descriptor));
+	}
+
+	size_t Current = m_LazyDecodedCount.load(std::memory_order_relaxed);
+	while ((Current < Decoded)
+			&& !m_LazyDecodedCount.compare_exchange_weak(Current, Decoded, std::memory_order_release, std::memory_order_relaxed));
+
+	return Decoded;
+}
+
+
+const DescriptorBase * DescriptorBlock::GetDescriptorByTagAt(size_t Index, uint8_t Tag) const
+{
+	if (m_LazyCount == 0) {
+		const DescriptorBase *pDescriptor = m_DescriptorList[Index].get();
+		return (pDescriptor->GetTag() == Tag) ? pDescriptor : nullptr;
+	}
+
+	if ((m_LazyList[Index].Tag != Tag) || (DecodeLazyDescriptors(Index + 1) <= Index))
+		return nullptr;
+
+	return m_LazyList[Index].Decoded.load(std::memory_order_acquire);
+}
+
+
 }	// namespace LibISDB
@@ -29,21 +29,66 @@
 
 
 #include "DescriptorBase.hpp"
+#include "../Utilities/Lock.hpp"
 #include <vector>
 #include <memory>
+#include <atomic>
 
 
 namespace LibISDB
 {
 
-	/** 記述子ブロッククラス */
+	/**
+		記述子プールクラス
+
+		解析済みの記述子オブジェクトをタグ毎に保持し、再利用する。
+		テーブルが持ち、その記述子ブロックで共有する。
+		遅延デコードでは const のメンバ関数からも使われるため、スレッドセーフになっている。
+	*/
+	class DescriptorPool
+	{
+	public:
+		DescriptorPool() = default;
+		DescriptorPool(const DescriptorPool &) = delete;
+		DescriptorPool & operator = (const DescriptorPool &) = delete;
+
+		std::unique_ptr<DescriptorBase> Get(uint8_t Tag);
+		void Release(uint8_t Tag, std::unique_ptr<DescriptorBase> &&Descriptor);
+		void Clear();
+		size_t GetPooledCount() const;
+		unsigned long long GetReusedCount() const;
+
+	protected:
+		struct FreeList {
+			uint8_t Tag;
+			std::vector<std::unique_ptr<DescriptorBase>> List;
+		};
+
+		mutable MutexLock m_Lock;
+		std::vector<FreeList> m_FreeList;
+		size_t m_PooledCount = 0;
+		unsigned long long m_ReusedCount = 0;
+	};
+
+	/**
+		記述子ブロッククラス
+
+		遅延デコードを有効にすると、ParseBlock() では記述子のタグと長さの範囲のみを検査して
+		データを保持し、記述子が取得された時に先頭からその記述子までが解析される。
+		通常の解析と同様に、内容の解析に失敗した記述子以降は取得できず、記述子の数にも含まれない。
+		そのため、GetDescriptorCount() では全ての記述子が解析され、
+		ParseBlock() が返す解析前の記述子の数より少なくなる場合がある。
+		解析結果はアトミックに記録されるため、const のメンバ関数は複数のスレッドから同時に呼び出せる。
+
+		記述子プールはコピーやムーブでは引き継がれず、代入先は自身のプールを使い続ける。
+	*/
 	class DescriptorBlock
 	{
 	public:
 		DescriptorBlock() = default;
 		DescriptorBlock(const DescriptorBlock &Src);
-		DescriptorBlock(DescriptorBlock &&Src);
-		virtual ~DescriptorBlock() = default;
+		DescriptorBlock(DescriptorBlock &&Src) noexcept;
+		virtual ~DescriptorBlock();
 		DescriptorBlock & operator = (const DescriptorBlock &Src);
 		DescriptorBlock & operator = (DescriptorBlock &&Src);
 
@@ -52,6 +97,12 @@ namespace LibISDB
 
 		virtual void Reset();
 
+		void SetDescriptorPool(DescriptorPool *pPool) noexcept { m_pDescriptorPool = pPool; }
+		DescriptorPool * GetDescriptorPool() const noexcept { return m_pDescriptorPool; }
+		void SetLazyDecode(bool Lazy) noexcept { m_LazyDecode = Lazy; }
+		bool IsLazyDecode() const noexcept { return m_LazyDecode; }
+		int GetDecodedDescriptorCount() const;
+
 		int GetDescriptorCount() const;
 		const DescriptorBase * GetDescriptorByIndex(int Index) const;
 		const DescriptorBase * GetDescriptorByTag(uint8_t Tag) const;
@@ -61,9 +112,11 @@ namespace LibISDB
 
 		template<typename TDesc, typename TPred> void EnumDescriptors(TPred Pred) const
 		{
-			for (auto &e : m_DescriptorList) {
-				if (e->GetTag() == TDesc::TAG) {
-					const TDesc *pDesc = dynamic_cast<const TDesc *>(e.get());
+			const size_t Count = GetEntryCount();
+			for (size_t i = 0; i < Count; i++) {
+				const DescriptorBase *pBase = GetDescriptorByTagAt(i, TDesc::TAG);
+				if (pBase != nullptr) {
+					const TDesc *pDesc = dynamic_cast<const TDesc *>(pBase);
 					if (pDesc != nullptr)
 						Pred(pDesc);
 				}
@@ -71,10 +124,32 @@ namespace LibISDB
 		}
 
 	protected:
-		std::unique_ptr<DescriptorBase> ParseDescriptor(const uint8_t *pData, uint16_t DataLength);
+		/** 遅延デコード用の記述子の位置 */
+		struct LazyDescriptor {
+			uint16_t Offset;                       /**< m_RawData 内の位置 */
+			uint8_t Tag;                           /**< descriptor_tag */
+			uint8_t Length;                        /**< descriptor_length */
+			std::atomic<DescriptorBase *> Decoded; /**< 解析済みの記述子 */
+		};
+
+		std::unique_ptr<DescriptorBase> ParseDescriptor(const uint8_t *pData, uint16_t DataLength) const;
 		static DescriptorBase * CreateDescriptorInstance(uint8_t Tag);
+		void ReleaseDescriptors();
+		int IndexBlock(const uint8_t *pData, size_t DataLength);
+		void ReserveLazyList(size_t Count);
+		size_t GetEntryCount() const;
+		size_t DecodeLazyDescriptors(size_t Count) const;
+		const DescriptorBase * GetDescriptorByTagAt(size_t Index, uint8_t Tag) const;
 
 		std::vector<std::unique_ptr<DescriptorBase>> m_DescriptorList;
+		DescriptorPool *m_pDescriptorPool = nullptr;
+		bool m_LazyDecode = false;
+		std::vector<uint8_t> m_RawData;
+		std::unique_ptr<LazyDescriptor[]> m_LazyList;
+		size_t m_LazyCount = 0;
+		size_t m_LazyCapacity = 0;
+		mutable std::atomic<size_t> m_LazyDecodedCount {0}; /**< 先頭から解析に成功した記述子の数 */
+		mutable std::atomic<size_t> m_LazyValidCount {0};   /**< 解析に失敗した記述子の位置 */
 	};
 
 }	// namespace LibISDB
@@ -46,6 +46,11 @@ namespace LibISDB
 		bool GetPATPacket(TSPacket *pPacket);
 		bool SetTransportStreamID(uint16_t TransportStreamID);
 
+		static constexpr bool IsTargetPID(uint16_t PID) noexcept
+		{
+			return (PID == PID_PAT) || (PID == PID_NIT) || Is1SegPMTPID(PID);
+		}
+
 	protected:
 		void OnNITSection(const PSITableBase *pTable, const PSISection *pSection);
 
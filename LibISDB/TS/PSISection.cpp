@@ -187,6 +187,8 @@ PSISectionParser::PSISectionParser(
 	, m_IsPayloadStoring(false)
 	, m_StoreSize(0)
 	, m_CRCErrorCount(0)
+	, m_DuplicateSectionFilter(false)
+	, m_DuplicateSectionCount(0)
 {
 }
 
@@ -259,6 +261,8 @@ void PSISectionParser::Reset()
 	m_StoreSize = 0;
 	m_CRCErrorCount = 0;
 	m_PSISection.Reset();
+	m_TableFingerprintMap.clear();
+	m_DuplicateSectionCount = 0;
 }
 
 
@@ -274,6 +278,20 @@ unsigned long PSISectionParser::GetCRCErrorCount() const
 }
 
 
+void PSISectionParser::SetDuplicateSectionFilter(bool Enable)
+{
+	m_DuplicateSectionFilter = Enable;
+	if (!Enable)
+		m_TableFingerprintMap.clear();
+}
+
+
+void PSISectionParser::ResetDuplicateSectionCache()
+{
+	m_TableFingerprintMap.clear();
+}
+
+
 bool PSISectionParser::StoreHeader(const uint8_t *pData, uint8_t *pRemain)
 {
 	if (m_IsPayloadStoring) {
@@ -322,13 +340,25 @@ bool PSISectionParser::StorePayload(const uint8_t *pData, uint8_t *pRemain)
 
 	m_PSISection.AddData(pData, StoreRemain);
 
-	// CRC チェック
 	if (CRC32MPEG2::Calc(m_PSISection.GetData(), m_PSISection.GetSize()) == 0) {
-		if (m_pPSISectionHandler != nullptr)
-			m_pPSISectionHandler->OnPSISection(this, &m_PSISection);
-		LIBISDB_TRACE_VERBOSE(
-			LIBISDB_STR("PSISection Stored: table_id %02X | %zu / %u bytes\n"),
-			m_PSISection.GetTableID(), m_PSISection.GetSize(), m_StoreSize);
+		const bool DuplicateFilterTarget = IsDuplicateFilterTarget();
+
+		if (DuplicateFilterTarget && IsDuplicateSection()) {
+			// 前回と同じ内容のセクションはハンドラへの通知を省略する
+			m_DuplicateSectionCount++;
+			LIBISDB_TRACE_VERBOSE(
+				LIBISDB_STR("PSISection Duplicated: table_id %02X | %zu / %u bytes\n"),
+				m_PSISection.GetTableID(), m_PSISection.GetSize(), m_StoreSize);
+		} else {
+			// ハンドラ内でキャッシュがリセットされる場合があるため、先に登録する
+			if (DuplicateFilterTarget)
+				AddSectionFingerprint();
+			if (m_pPSISectionHandler != nullptr)
+				m_pPSISectionHandler->OnPSISection(this, &m_PSISection);
+			LIBISDB_TRACE_VERBOSE(
+				LIBISDB_STR("PSISection Stored: table_id %02X | %zu / %u bytes\n"),
+				m_PSISection.GetTableID(), m_PSISection.GetSize(), m_StoreSize);
+		}
 	} else {
 		if (m_CRCErrorCount < std::numeric_limits<unsigned long>::max())
 			m_CRCErrorCount++;
@@ -346,4 +376,66 @@ bool PSISectionParser::StorePayload(const uint8_t *pData, uint8_t *pRemain)
 }
 
 
+bool PSISectionParser::IsDuplicateFilterTarget() const noexcept
+{
+	return m_DuplicateSectionFilter
+		&& m_PSISection.IsExtendedSection()
+		&& (m_PSISection.GetSize() >= 3 + 9);
+}
+
+
+uint32_t PSISectionParser::GetTableFingerprintKey() const noexcept
+{
+	return (static_cast<uint32_t>(m_PSISection.GetTableID()) << 16) | m_PSISection.GetTableIDExtension();
+}
+
+
+bool PSISectionParser::IsDuplicateSection() const
+{
+	auto it = m_TableFingerprintMap.find(GetTableFingerprintKey());
+	if (it == m_TableFingerprintMap.end())
+		return false;
+
+	const TableFingerprint &Table = it->second;
+	const uint8_t SectionNumber = m_PSISection.GetSectionNumber();
+	if ((Table.VersionNumber != m_PSISection.GetVersionNumber())
+			|| (SectionNumber >= Table.SectionList.size()))
+		return false;
+
+	const SectionFingerprint &Fingerprint = Table.SectionList[SectionNumber];
+
+	return (Fingerprint.SectionLength == m_PSISection.GetSectionLength())
+		&& (Fingerprint.CRC == Load32(m_PSISection.GetData() + m_PSISection.GetSize() - 4));
+}
+
+
+void PSISectionParser::AddSectionFingerprint()
+{
+	const uint32_t Key = GetTableFingerprintKey();
+	const uint8_t VersionNumber = m_PSISection.GetVersionNumber();
+	auto it = m_TableFingerprintMap.find(Key);
+
+	if (it == m_TableFingerprintMap.end()) {
+		// 上限に達した場合は全体ではなく 1 テーブル分のみ破棄する
+		if (m_TableFingerprintMap.size() >= MAX_TABLE_FINGERPRINT_COUNT)
+			m_TableFingerprintMap.erase(m_TableFingerprintMap.begin());
+		it = m_TableFingerprintMap.emplace(Key, TableFingerprint()).first;
+		it->second.VersionNumber = VersionNumber;
+	} else if (it->second.VersionNumber != VersionNumber) {
+		// バージョンが変わったテーブルの以前の情報は不要になる
+		it->second.VersionNumber = VersionNumber;
+		it->second.SectionList.clear();
+	}
+
+	std::vector<SectionFingerprint> &SectionList = it->second.SectionList;
+	const uint8_t SectionNumber = m_PSISection.GetSectionNumber();
+	if (SectionNumber >= SectionList.size())
+		SectionList.resize(std::max(SectionNumber, m_PSISection.GetLastSectionNumber()) + 1);
+
+	SectionFingerprint &Fingerprint = SectionList[SectionNumber];
+	Fingerprint.CRC = Load32(m_PSISection.GetData() + m_PSISection.GetSize() - 4);
+	Fingerprint.SectionLength = m_PSISection.GetSectionLength();
+}
+
+
 }	// namespace LibISDB
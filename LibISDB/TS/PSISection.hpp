@@ -29,6 +29,8 @@
 
 
 #include "TSPacket.hpp"
+#include <unordered_map>
+#include <vector>
 
 
 namespace LibISDB
@@ -100,9 +102,36 @@ namespace LibISDB
 
 		unsigned long GetCRCErrorCount() const;
 
+		void SetDuplicateSectionFilter(bool Enable);
+		bool GetDuplicateSectionFilter() const noexcept { return m_DuplicateSectionFilter; }
+		void ResetDuplicateSectionCache();
+		unsigned long long GetDuplicateSectionCount() const noexcept { return m_DuplicateSectionCount; }
+
 	private:
+		/** 受信済みセクションの識別情報(SectionLength が 0 の場合は未登録) */
+		struct SectionFingerprint {
+			uint32_t CRC = 0;
+			uint16_t SectionLength = 0;
+		};
+
+		/** テーブル(table_id と table_id_extension の組)毎の受信済みセクションの識別情報 */
+		struct TableFingerprint {
+			uint8_t VersionNumber = 0;
+			std::vector<SectionFingerprint> SectionList; /**< section_number 毎の識別情報 */
+		};
+
+		/**
+			識別情報を保持するテーブル数の上限
+			(超えた場合は 1 テーブル分ずつ破棄する。1 テーブルのセクション数は最大 256)
+		*/
+		static constexpr size_t MAX_TABLE_FINGERPRINT_COUNT = 16384;
+
 		bool StoreHeader(const uint8_t *pData, uint8_t *pRemain);
 		bool StorePayload(const uint8_t *pData, uint8_t *pRemain);
+		bool IsDuplicateFilterTarget() const noexcept;
+		uint32_t GetTableFingerprintKey() const noexcept;
+		bool IsDuplicateSection() const;
+		void AddSectionFingerprint();
 
 		PSISectionHandler *m_pPSISectionHandler;
 		PSISection m_PSISection;
@@ -112,6 +141,10 @@ namespace LibISDB
 		bool m_IsPayloadStoring;
 		uint16_t m_StoreSize;
 		unsigned long m_CRCErrorCount;
+
+		bool m_DuplicateSectionFilter;
+		std::unordered_map<uint32_t, TableFingerprint> m_TableFingerprintMap;
+		unsigned long long m_DuplicateSectionCount;
 	};
 
 }	// namespace LibISDB
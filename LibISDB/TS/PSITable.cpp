@@ -26,6 +26,7 @@
 
 #include "../LibISDBPrivate.hpp"
 #include "PSITable.hpp"
+#include <algorithm>
 #include "../Base/DebugDef.hpp"
 
 
@@ -36,6 +37,7 @@ namespace LibISDB
 PSITableBase::PSITableBase(bool ExtendedSection, bool IgnoreSectionNumber)
 	: m_PSISectionParser(this, ExtendedSection, IgnoreSectionNumber)
 	, m_UniqueID(0)
+	, m_pParentTable(nullptr)
 {
 }
 
@@ -43,6 +45,9 @@ PSITableBase::PSITableBase(bool ExtendedSection, bool IgnoreSectionNumber)
 void PSITableBase::Reset()
 {
 	m_PSISectionParser.Reset();
+
+	if (m_pParentTable != nullptr)
+		m_pParentTable->ResetDuplicateSectionCache();
 }
 
 
@@ -52,6 +57,29 @@ unsigned long PSITableBase::GetCRCErrorCount() const
 }
 
 
+void PSITableBase::SetDuplicateSectionFilter(bool Enable)
+{
+	m_PSISectionParser.SetDuplicateSectionFilter(Enable);
+}
+
+
+unsigned long long PSITableBase::GetDuplicateSectionCount() const
+{
+	return m_PSISectionParser.GetDuplicateSectionCount();
+}
+
+
+void PSITableBase::ResetDuplicateSectionCache()
+{
+	// 重複セクションが破棄されるとテーブルが再構築されなくなるため、
+	// セクションを受け取るパーサのキャッシュをリセットする
+	m_PSISectionParser.ResetDuplicateSectionCache();
+
+	if (m_pParentTable != nullptr)
+		m_pParentTable->ResetDuplicateSectionCache();
+}
+
+
 void PSITableBase::SetSectionHandler(const SectionHandler &Handler)
 {
 	m_SectionHandler = Handler;
@@ -80,6 +108,7 @@ void PSITableBase::OnPIDUnmapped(uint16_t PID)
 PSITable::PSITable()
 	: m_LastUpdatedSectionIndex(-1)
 	, m_LastUpdatedSectionNumber(0xFFFF_u16)
+	, m_TableIndexMapBits(0)
 {
 }
 
@@ -89,6 +118,8 @@ void PSITable::Reset()
 	PSITableBase::Reset();
 
 	m_TableList.clear();
+	m_TableIndexMap.clear();
+	m_TableIndexMapBits = 0;
 
 	m_LastUpdatedSectionIndex = -1;
 	m_LastUpdatedSectionNumber = 0xFFFF_u16;
@@ -136,21 +167,29 @@ int PSITable::GetTableIndexByTableID(uint8_t TableID) const
 
 int PSITable::GetTableIndexByTableIDs(uint8_t TableID, unsigned long long UniqueID) const
 {
-	for (size_t Index = 0; Index < m_TableList.size(); Index++) {
-		if ((m_TableList[Index].TableID == TableID)
-				&& (m_TableList[Index].UniqueID == UniqueID))
-			return static_cast<int>(Index);
-	}
+	// UniqueID は m_TableList 内で一意
+	const int Index = GetTableIndexByUniqueID(UniqueID);
 
-	return -1;
+	if ((Index < 0) || (m_TableList[Index].TableID != TableID))
+		return -1;
+
+	return Index;
 }
 
 
 int PSITable::GetTableIndexByUniqueID(unsigned long long UniqueID) const
 {
-	for (size_t Index = 0; Index < m_TableList.size(); Index++) {
+	if (m_TableIndexMap.empty())
+		return -1;
+
+	const size_t Mask = m_TableIndexMap.size() - 1;
+
+	for (size_t Pos = GetTableIndexMapPos(UniqueID);; Pos = (Pos + 1) & Mask) {
+		const int Index = m_TableIndexMap[Pos];
+		if (Index == TABLE_INDEX_EMPTY)
+			break;
 		if (m_TableList[Index].UniqueID == UniqueID)
-			return static_cast<int>(Index);
+			return Index;
 	}
 
 	return -1;
@@ -198,6 +237,8 @@ bool PSITable::ResetTable(int Index)
 		Section.IsUpdated = false;
 	}
 
+	ResetDuplicateSectionCache();
+
 	return true;
 }
 
@@ -217,6 +258,8 @@ bool PSITable::ResetSection(int Index, uint16_t SectionNumber)
 	Section.Table.reset();
 	Section.IsUpdated = false;
 
+	ResetDuplicateSectionCache();
+
 	return true;
 }
 
@@ -256,9 +299,7 @@ bool PSITable::OnPSISection(const PSISectionParser *pSectionParser, const PSISec
 
 	if (Index < 0) {
 		// 新規テーブルの追加
-		Index = static_cast<int>(m_TableList.size());
-		m_TableList.emplace_back();
-		m_TableList[Index].UniqueID = UniqueID;
+		Index = AddTable(UniqueID);
 		m_TableList[Index].TableID = pSection->GetTableID();
 		m_TableList[Index].LastSectionNumber = pSection->GetLastSectionNumber();
 		m_TableList[Index].VersionNumber = pSection->GetVersionNumber();
@@ -303,6 +344,46 @@ unsigned long long PSITable::GetSectionTableUniqueID(const PSISection *pSection)
 }
 
 
+int PSITable::AddTable(unsigned long long UniqueID)
+{
+	const int Index = static_cast<int>(m_TableList.size());
+
+	m_TableList.emplace_back();
+	m_TableList[Index].UniqueID = UniqueID;
+
+	// 負荷率が 1/2 を超えたら拡張する
+	if (m_TableList.size() * 2 > m_TableIndexMap.size()) {
+		m_TableIndexMapBits = std::max(m_TableIndexMapBits + 1, TABLE_INDEX_MAP_MIN_BITS);
+		m_TableIndexMap.assign(size_t(1) << m_TableIndexMapBits, TABLE_INDEX_EMPTY);
+		for (int i = 0; i <= Index; i++)
+			InsertTableIndex(i);
+	} else {
+		InsertTableIndex(Index);
+	}
+
+	return Index;
+}
+
+
+void PSITable::InsertTableIndex(int Index)
+{
+	const size_t Mask = m_TableIndexMap.size() - 1;
+	size_t Pos = GetTableIndexMapPos(m_TableList[Index].UniqueID);
+
+	while (m_TableIndexMap[Pos] != TABLE_INDEX_EMPTY)
+		Pos = (Pos + 1) & Mask;
+
+	m_TableIndexMap[Pos] = Index;
+}
+
+
+size_t PSITable::GetTableIndexMapPos(unsigned long long UniqueID) const noexcept
+{
+	// Fibonacci hashing
+	return static_cast<size_t>((UniqueID * 0x9E3779B97F4A7C15_u64) >> (64 - m_TableIndexMapBits));
+}
+
+
 
 
 PSISingleTable::PSISingleTable(bool ExtendedSection)
@@ -417,8 +498,11 @@ bool PSITableSet::MapTable(uint8_t TableID, PSITableBase *pTable)
 
 	UnmapTable(TableID);
 
+	pTable->m_pParentTable = this;
 	m_TableMap.emplace(TableID, pTable);
 
+	ResetDuplicateSectionCache();
+
 	return true;
 }
 
@@ -432,6 +516,8 @@ bool PSITableSet::UnmapTable(uint8_t TableID)
 
 	m_TableMap.erase(it);
 
+	ResetDuplicateSectionCache();
+
 	return true;
 }
 
@@ -439,6 +525,8 @@ bool PSITableSet::UnmapTable(uint8_t TableID)
 void PSITableSet::UnmapAllTables()
 {
 	m_TableMap.clear();
+
+	ResetDuplicateSectionCache();
 }
 
 
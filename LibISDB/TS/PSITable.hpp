@@ -67,6 +67,9 @@ namespace LibISDB
 		virtual void Reset();
 
 		unsigned long GetCRCErrorCount() const;
+		// 前回と同じ内容のセクションを通知しないようにする(デフォルトは無効)
+		void SetDuplicateSectionFilter(bool Enable);
+		unsigned long long GetDuplicateSectionCount() const;
 
 		void SetUniqueID(unsigned long long UniqueID) noexcept { m_UniqueID = UniqueID; }
 		unsigned long long GetUniqueID() const noexcept { return m_UniqueID; }
@@ -78,9 +81,14 @@ namespace LibISDB
 		void OnPIDUnmapped(uint16_t PID) override;
 
 	protected:
+		void ResetDuplicateSectionCache();
+
 		PSISectionParser m_PSISectionParser;
 		unsigned long long m_UniqueID;
 		SectionHandler m_SectionHandler;
+		PSITableBase *m_pParentTable;
+
+		friend class PSITableSet;
 	};
 
 	/** PSI テーブルクラス */
@@ -133,6 +141,18 @@ namespace LibISDB
 
 		int m_LastUpdatedSectionIndex;
 		uint16_t m_LastUpdatedSectionNumber;
+
+	private:
+		int AddTable(unsigned long long UniqueID);
+		void InsertTableIndex(int Index);
+		size_t GetTableIndexMapPos(unsigned long long UniqueID) const noexcept;
+
+		static constexpr int TABLE_INDEX_EMPTY = -1;
+		static constexpr unsigned int TABLE_INDEX_MAP_MIN_BITS = 4;
+
+		/** UniqueID から m_TableList のインデックスを引くオープンアドレス法のハッシュテーブル */
+		std::vector<int> m_TableIndexMap;
+		unsigned int m_TableIndexMapBits;
 	};
 
 	/** 単独 PSI テーブルクラス */
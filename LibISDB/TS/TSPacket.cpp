@@ -27,6 +27,7 @@
 #include "../LibISDBPrivate.hpp"
 #include "TSPacket.hpp"
 #include "../Utilities/Utilities.hpp"
+#include "../Base/SIMD.hpp"
 #ifdef LIBISDB_TS_PACKET_PAYLOAD_ALIGN
 #include "../Utilities/AlignedAlloc.hpp"
 #endif
@@ -37,9 +38,151 @@ namespace LibISDB
 {
 
 
+namespace
+{
+
+
+void ParsePacketHeader(const uint8_t *pData, TSPacketHeaderBatch *pBatch, size_t Index)
+{
+	typedef TSPacketHeaderBatch::HeaderFlag HeaderFlag;
+
+	const uint32_t Header = Load32(pData);
+	const uint16_t PID = static_cast<uint16_t>((Header >> 8) & 0x1FFF);
+	const uint8_t AdaptationFieldControl = static_cast<uint8_t>((Header >> 4) & 0x03);
+	const uint8_t AdaptationFieldLength = (AdaptationFieldControl & 0x02) ? pData[4] : 0_u8;
+	uint16_t Flags = 0;
+
+	if ((Header >> 24) != 0x47_u32)
+		Flags |= HeaderFlag::SyncError;
+	if (Header & 0x800000_u32)
+		Flags |= HeaderFlag::TransportErrorIndicator;
+	if (Header & 0x400000_u32)
+		Flags |= HeaderFlag::PayloadUnitStartIndicator;
+	if (Header & 0x200000_u32)
+		Flags |= HeaderFlag::TransportPriority;
+	if (Header & 0x80_u32)
+		Flags |= HeaderFlag::Scrambled;
+	if (AdaptationFieldControl & 0x02)
+		Flags |= HeaderFlag::AdaptationField;
+	if (AdaptationFieldControl & 0x01)
+		Flags |= HeaderFlag::Payload;
+	if ((AdaptationFieldLength > 0) && (pData[5] & 0x80))
+		Flags |= HeaderFlag::DiscontinuityIndicator;
+	if (((PID >= 0x0002_u16) && (PID <= 0x000F_u16))
+			|| ((Header & 0xC0_u32) == 0x40_u32)
+			|| (AdaptationFieldControl == 0x00_u8)
+			|| ((AdaptationFieldControl == 0x02_u8) && (AdaptationFieldLength > 183_u8))
+			|| ((AdaptationFieldControl == 0x03_u8) && (AdaptationFieldLength > 182_u8)))
+		Flags |= HeaderFlag::FormatError;
+
+	uint8_t PayloadOffset = 0;
+	if (!(Flags & (HeaderFlag::SyncError | HeaderFlag::FormatError))) {
+		if (AdaptationFieldControl == 0x01_u8)
+			PayloadOffset = 4;
+		else if (AdaptationFieldControl == 0x03_u8)
+			PayloadOffset = AdaptationFieldLength + 5;
+	}
+
+	pBatch->PID[Index] = PID;
+	pBatch->Flags[Index] = Flags;
+	pBatch->ContinuityCounter[Index] = static_cast<uint8_t>(Header & 0x0F);
+	pBatch->PayloadOffset[Index] = PayloadOffset;
+	pBatch->TransportScramblingControl[Index] = static_cast<uint8_t>((Header >> 6) & 0x03);
+	pBatch->AdaptationFieldLength[Index] = AdaptationFieldLength;
+	pBatch->AdaptationFieldFlags[Index] = (AdaptationFieldLength > 0) ? pData[5] : 0_u8;
+}
+
+
+#ifdef LIBISDB_SSE2_SUPPORT
+
+// 4パケット分のヘッダを解析する
+// 結果は 32ビット x 4 のレーンに格納される
+LIBISDB_FORCE_INLINE void ParsePacketHeader4SSE2(
+	const uint8_t *pData, __m128i *pPID, __m128i *pFlags, __m128i *pCounter, __m128i *pPayloadOffset,
+	__m128i *pScramblingControl, __m128i *pAdaptationFieldLength, __m128i *pAdaptationFieldFlags)
+{
+	typedef TSPacketHeaderBatch::HeaderFlag HeaderFlag;
+
+	const __m128i Header = _mm_set_epi32(
+		Load32(pData + TS_PACKET_SIZE * 3),
+		Load32(pData + TS_PACKET_SIZE * 2),
+		Load32(pData + TS_PACKET_SIZE * 1),
+		Load32(pData + TS_PACKET_SIZE * 0));
+	const __m128i AdaptationField = _mm_set_epi32(
+		Load16(pData + TS_PACKET_SIZE * 3 + 4),
+		Load16(pData + TS_PACKET_SIZE * 2 + 4),
+		Load16(pData + TS_PACKET_SIZE * 1 + 4),
+		Load16(pData + TS_PACKET_SIZE * 0 + 4));
+	const __m128i Zero = _mm_setzero_si128();
+	const __m128i AllOnes = _mm_cmpeq_epi32(Zero, Zero);
+
+	auto Equal = [&](int Mask, int Value) -> __m128i {
+		return _mm_cmpeq_epi32(_mm_and_si128(Header, _mm_set1_epi32(Mask)), _mm_set1_epi32(Value));
+	};
+	auto Flag = [](__m128i Cond, uint16_t Flag) -> __m128i {
+		return _mm_and_si128(Cond, _mm_set1_epi32(Flag));
+	};
+
+	const __m128i PID = _mm_and_si128(_mm_srli_epi32(Header, 8), _mm_set1_epi32(0x1FFF));
+	const __m128i HasAdaptationField = Equal(0x20, 0x20);
+	const __m128i AdaptationFieldOnly = Equal(0x30, 0x20);
+	const __m128i AdaptationFieldAndPayload = Equal(0x30, 0x30);
+	const __m128i AdaptationFieldLength =
+		_mm_and_si128(_mm_srli_epi32(AdaptationField, 8), HasAdaptationField);
+	const __m128i AdaptationFieldEmpty = _mm_cmpeq_epi32(AdaptationFieldLength, Zero);
+	const __m128i AdaptationFieldFlags =
+		_mm_andnot_si128(AdaptationFieldEmpty, _mm_and_si128(AdaptationField, _mm_set1_epi32(0xFF)));
+	const __m128i Discontinuity = _mm_andnot_si128(
+		AdaptationFieldEmpty,
+		_mm_cmpeq_epi32(_mm_and_si128(AdaptationField, _mm_set1_epi32(0x80)), _mm_set1_epi32(0x80)));
+
+	const __m128i SyncError = _mm_xor_si128(
+		_mm_cmpeq_epi32(_mm_srli_epi32(Header, 24), _mm_set1_epi32(0x47)), AllOnes);
+	const __m128i FormatError = _mm_or_si128(
+		_mm_or_si128(
+			_mm_and_si128(_mm_cmpgt_epi32(PID, _mm_set1_epi32(0x0001)), _mm_cmplt_epi32(PID, _mm_set1_epi32(0x0010))),
+			_mm_or_si128(Equal(0xC0, 0x40), Equal(0x30, 0x00))),
+		_mm_or_si128(
+			_mm_and_si128(AdaptationFieldOnly, _mm_cmpgt_epi32(AdaptationFieldLength, _mm_set1_epi32(183))),
+			_mm_and_si128(AdaptationFieldAndPayload, _mm_cmpgt_epi32(AdaptationFieldLength, _mm_set1_epi32(182)))));
+
+	__m128i Flags = Flag(SyncError, HeaderFlag::SyncError);
+	Flags = _mm_or_si128(Flags, Flag(FormatError, HeaderFlag::FormatError));
+	Flags = _mm_or_si128(Flags, Flag(Equal(0x800000, 0x800000), HeaderFlag::TransportErrorIndicator));
+	Flags = _mm_or_si128(Flags, Flag(Equal(0x400000, 0x400000), HeaderFlag::PayloadUnitStartIndicator));
+	Flags = _mm_or_si128(Flags, Flag(Equal(0x200000, 0x200000), HeaderFlag::TransportPriority));
+	Flags = _mm_or_si128(Flags, Flag(Equal(0x80, 0x80), HeaderFlag::Scrambled));
+	Flags = _mm_or_si128(Flags, Flag(HasAdaptationField, HeaderFlag::AdaptationField));
+	Flags = _mm_or_si128(Flags, Flag(Equal(0x10, 0x10), HeaderFlag::Payload));
+	Flags = _mm_or_si128(Flags, Flag(Discontinuity, HeaderFlag::DiscontinuityIndicator));
+
+	const __m128i PayloadOffset = _mm_andnot_si128(
+		_mm_or_si128(SyncError, FormatError),
+		_mm_or_si128(
+			_mm_and_si128(Equal(0x30, 0x10), _mm_set1_epi32(4)),
+			_mm_and_si128(AdaptationFieldAndPayload, _mm_add_epi32(AdaptationFieldLength, _mm_set1_epi32(5)))));
+
+	*pPID = PID;
+	*pFlags = Flags;
+	*pCounter = _mm_and_si128(Header, _mm_set1_epi32(0x0F));
+	*pPayloadOffset = PayloadOffset;
+	*pScramblingControl = _mm_and_si128(_mm_srli_epi32(Header, 6), _mm_set1_epi32(0x03));
+	*pAdaptationFieldLength = AdaptationFieldLength;
+	*pAdaptationFieldFlags = AdaptationFieldFlags;
+}
+
+#endif	// LIBISDB_SSE2_SUPPORT
+
+
+}	// namespace
+
+
+
+
 TSPacket::TSPacket()
 	: m_Header()
 	, m_AdaptationField()
+	, m_Reference(false)
 {
 	m_TypeID = TypeID;
 
@@ -48,6 +191,7 @@ TSPacket::TSPacket()
 
 
 TSPacket::TSPacket(const TSPacket &Src)
+	: m_Reference(false)
 {
 	m_TypeID = TypeID;
 
@@ -56,6 +200,7 @@ TSPacket::TSPacket(const TSPacket &Src)
 
 
 TSPacket::TSPacket(TSPacket &&Src)
+	: m_Reference(false)
 {
 	m_TypeID = TypeID;
 
@@ -69,6 +214,19 @@ TSPacket::~TSPacket()
 }
 
 
+TSPacket & TSPacket::operator = (const TSPacket &Src)
+{
+	if (&Src != this) {
+		// 参照中のパケットからのコピーでもデータは自身のバッファに複製する
+		DataBuffer::operator = (Src);
+		m_Header = Src.m_Header;
+		m_AdaptationField = Src.m_AdaptationField;
+	}
+
+	return *this;
+}
+
+
 TSPacket & TSPacket::operator = (TSPacket &&Src)
 {
 	// move 不可
@@ -77,6 +235,14 @@ TSPacket & TSPacket::operator = (TSPacket &&Src)
 
 
 TSPacket::ParseResult TSPacket::ParsePacket(uint8_t *pContinuityCounter)
+{
+	ParseHeader();
+
+	return TSPacketView(m_pData).ParsePacket(pContinuityCounter);
+}
+
+
+void TSPacket::ParseHeader()
 {
 	// TSパケットヘッダ解析
 	const uint32_t Header = Load32(m_pData);
@@ -105,38 +271,87 @@ TSPacket::ParseResult TSPacket::ParsePacket(uint8_t *pContinuityCounter)
 			}
 		}
 	}
+}
 
-	if (m_Header.SyncByte != 0x47_u8)
-		return ParseResult::FormatError;	// 同期バイト不正
-	if (m_Header.TransportErrorIndicator)
-		return ParseResult::TransportError;	// ビット誤りあり
-	if ((m_Header.PID >= 0x0002_u16) && (m_Header.PID <= 0x000F_u16))
-		return ParseResult::FormatError;	// 未定義PID範囲
-	if (m_Header.TransportScramblingControl == 0x01_u8)
-		return ParseResult::FormatError;	// 未定義スクランブル制御値
-	if (m_Header.AdaptationFieldControl == 0x00_u8)
-		return ParseResult::FormatError;	// 未定義アダプテーションフィールド制御値
-	if ((m_Header.AdaptationFieldControl == 0x02_u8) && (m_AdaptationField.AdaptationFieldLength > 183_u8))
-		return ParseResult::FormatError;	// アダプテーションフィールド長異常
-	if ((m_Header.AdaptationFieldControl == 0x03_u8) && (m_AdaptationField.AdaptationFieldLength > 182_u8))
-		return ParseResult::FormatError;	// アダプテーションフィールド長異常
-
-	if ((pContinuityCounter != nullptr) && (m_Header.PID != PID_NULL)) {
-		// 連続性チェック
-		const uint8_t OldCounter = pContinuityCounter[m_Header.PID];
-		const uint8_t NewCounter = (m_Header.AdaptationFieldControl & 0x01_u8) ? m_Header.ContinuityCounter : 0x10_u8;
-		pContinuityCounter[m_Header.PID] = NewCounter;
 
-		if (!m_AdaptationField.DiscontinuityIndicator) {
-			if ((OldCounter < 0x10_u8) && (NewCounter < 0x10_u8)) {
-				if (((OldCounter + 1) & 0x0F) != NewCounter) {
-					return ParseResult::ContinuityError;
-				}
-			}
+size_t TSPacket::ParsePackets(
+	const uint8_t *pData, size_t PacketCount, TSPacketHeaderBatch *pBatch, uint8_t *pContinuityCounter)
+{
+	typedef TSPacketHeaderBatch::HeaderFlag HeaderFlag;
+
+	if (LIBISDB_TRACE_ERROR_IF((pData == nullptr) || (pBatch == nullptr)))
+		return 0;
+
+	if (PacketCount > TSPacketHeaderBatch::MAX_PACKET_COUNT)
+		PacketCount = TSPacketHeaderBatch::MAX_PACKET_COUNT;
+
+	size_t i = 0;
+
+#ifdef LIBISDB_SSE2_SUPPORT
+	if (IsSSE2Enabled()) {
+		for (; i + 8 <= PacketCount; i += 8) {
+			const uint8_t *p = pData + i * TS_PACKET_SIZE;
+			__m128i PID[2], Flags[2], Counter[2], PayloadOffset[2];
+			__m128i ScramblingControl[2], AdaptationFieldLength[2], AdaptationFieldFlags[2];
+
+			ParsePacketHeader4SSE2(
+				p, &PID[0], &Flags[0], &Counter[0], &PayloadOffset[0],
+				&ScramblingControl[0], &AdaptationFieldLength[0], &AdaptationFieldFlags[0]);
+			ParsePacketHeader4SSE2(
+				p + TS_PACKET_SIZE * 4, &PID[1], &Flags[1], &Counter[1], &PayloadOffset[1],
+				&ScramblingControl[1], &AdaptationFieldLength[1], &AdaptationFieldFlags[1]);
+
+			// 32ビット x 8 を 16ビット x 8 / 8ビット x 8 に詰める
+			auto Store8 = [](uint8_t *pDst, __m128i Value0, __m128i Value1) {
+				const __m128i Value16 = _mm_packs_epi32(Value0, Value1);
+				_mm_storel_epi64(reinterpret_cast<__m128i *>(pDst), _mm_packus_epi16(Value16, Value16));
+			};
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(&pBatch->PID[i]), _mm_packs_epi32(PID[0], PID[1]));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(&pBatch->Flags[i]), _mm_packs_epi32(Flags[0], Flags[1]));
+			Store8(&pBatch->ContinuityCounter[i], Counter[0], Counter[1]);
+			Store8(&pBatch->PayloadOffset[i], PayloadOffset[0], PayloadOffset[1]);
+			Store8(&pBatch->TransportScramblingControl[i], ScramblingControl[0], ScramblingControl[1]);
+			Store8(&pBatch->AdaptationFieldLength[i], AdaptationFieldLength[0], AdaptationFieldLength[1]);
+			Store8(&pBatch->AdaptationFieldFlags[i], AdaptationFieldFlags[0], AdaptationFieldFlags[1]);
 		}
 	}
+#endif
 
-	return ParseResult::OK;
+	for (; i < PacketCount; i++)
+		ParsePacketHeader(pData + i * TS_PACKET_SIZE, pBatch, i);
+
+	pBatch->PacketCount = PacketCount;
+
+	// 解析結果の判定
+	// 連続性カウンタは PID 毎に前のパケットに依存するため、順番に処理する
+	for (i = 0; i < PacketCount; i++) {
+		const uint16_t Flags = pBatch->Flags[i];
+		ParseResult Result = ParseResult::OK;
+
+		if (Flags & HeaderFlag::SyncError) {
+			Result = ParseResult::FormatError;
+		} else if (Flags & HeaderFlag::TransportErrorIndicator) {
+			Result = ParseResult::TransportError;
+		} else if (Flags & HeaderFlag::FormatError) {
+			Result = ParseResult::FormatError;
+		} else if ((pContinuityCounter != nullptr) && (pBatch->PID[i] != PID_NULL)) {
+			// 連続性チェック
+			const uint16_t PID = pBatch->PID[i];
+			const uint8_t OldCounter = pContinuityCounter[PID];
+			const uint8_t NewCounter = (Flags & HeaderFlag::Payload) ? pBatch->ContinuityCounter[i] : 0x10_u8;
+			pContinuityCounter[PID] = NewCounter;
+
+			if (!(Flags & HeaderFlag::DiscontinuityIndicator)
+					&& (OldCounter < 0x10_u8) && (NewCounter < 0x10_u8)
+					&& (((OldCounter + 1) & 0x0F) != NewCounter))
+				Result = ParseResult::ContinuityError;
+		}
+
+		pBatch->Result[i] = Result;
+	}
+
+	return PacketCount;
 }
 
 
@@ -217,8 +432,77 @@ uint8_t TSPacket::GetPayloadSize() const
 }
 
 
+void TSPacket::SetReference(const uint8_t *pData)
+{
+	// 以降 pData を直接参照する
+	// バッファサイズを 0 にしておき、データの変更時には自身のバッファに複製されるようにする
+	if (!m_Reference) {
+		FreeBuffer();
+		m_Reference = true;
+	}
+
+	m_pData = const_cast<uint8_t *>(pData);
+	m_DataSize = TS_PACKET_SIZE;
+	m_BufferSize = 0;
+
+	ParseHeader();
+}
+
+
+void TSPacket::SetReference(const uint8_t *pData, const TSPacketHeaderBatch &Batch, size_t Index)
+{
+	typedef TSPacketHeaderBatch::HeaderFlag HeaderFlag;
+
+	LIBISDB_ASSERT(Index < Batch.PacketCount);
+
+	if (!m_Reference) {
+		FreeBuffer();
+		m_Reference = true;
+	}
+
+	m_pData = const_cast<uint8_t *>(pData);
+	m_DataSize = TS_PACKET_SIZE;
+	m_BufferSize = 0;
+
+	// ヘッダは解析済みの結果から設定する
+	const uint16_t Flags = Batch.Flags[Index];
+	const uint8_t AdaptationFieldLength = Batch.AdaptationFieldLength[Index];
+
+	m_Header.SyncByte                   = pData[0];
+	m_Header.TransportErrorIndicator    = (Flags & HeaderFlag::TransportErrorIndicator) != 0;
+	m_Header.PayloadUnitStartIndicator  = (Flags & HeaderFlag::PayloadUnitStartIndicator) != 0;
+	m_Header.TransportPriority          = (Flags & HeaderFlag::TransportPriority) != 0;
+	m_Header.PID                        = Batch.PID[Index];
+	m_Header.TransportScramblingControl = Batch.TransportScramblingControl[Index];
+	m_Header.AdaptationFieldControl     =
+		((Flags & HeaderFlag::AdaptationField) ? 0x02_u8 : 0x00_u8) | ((Flags & HeaderFlag::Payload) ? 0x01_u8 : 0x00_u8);
+	m_Header.ContinuityCounter          = Batch.ContinuityCounter[Index];
+
+	m_AdaptationField.AdaptationFieldLength  = AdaptationFieldLength;
+	m_AdaptationField.Flags                  = Batch.AdaptationFieldFlags[Index];
+	m_AdaptationField.DiscontinuityIndicator = (Flags & HeaderFlag::DiscontinuityIndicator) != 0;
+	m_AdaptationField.OptionSize             = (AdaptationFieldLength > 1) ? AdaptationFieldLength - 1 : 0_u8;
+}
+
+
+void TSPacket::ResetReference()
+{
+	if (m_Reference) {
+		m_pData = nullptr;
+		m_DataSize = 0;
+		m_BufferSize = 0;
+		m_Reference = false;
+
+		AllocateBuffer(TS_PACKET_SIZE);
+	}
+}
+
+
 void TSPacket::SetPID(uint16_t PID)
 {
+	if (!MakeWritable())
+		return;
+
 	Store16(&m_pData[1], ((m_pData[1] & 0xE0) << 8) | (PID & 0x1FFF));
 	m_Header.PID = PID;
 }
@@ -226,6 +510,8 @@ void TSPacket::SetPID(uint16_t PID)
 
 void * TSPacket::Allocate(size_t Size)
 {
+	m_Reference = false;
+
 #ifdef LIBISDB_TS_PACKET_PAYLOAD_ALIGN
 	if (Size <= TS_PACKET_SIZE) {
 		return reinterpret_cast<void *>(
@@ -245,6 +531,11 @@ void * TSPacket::Allocate(size_t Size)
 
 void TSPacket::Free(void *pBuffer) noexcept
 {
+	if (m_Reference) {
+		m_Reference = false;
+		return;
+	}
+
 	if (!((pBuffer >= m_Data) && (pBuffer < m_Data + sizeof(m_Data)))) {
 #ifdef LIBISDB_TS_PACKET_PAYLOAD_ALIGN
 		AlignedFree(pBuffer);
@@ -257,6 +548,13 @@ void TSPacket::Free(void *pBuffer) noexcept
 
 void * TSPacket::ReAllocate(void *pBuffer, size_t Size)
 {
+	if (m_Reference) {
+		void *pNewBuffer = Allocate(Size);
+		if (pNewBuffer != nullptr)
+			std::memcpy(pNewBuffer, pBuffer, std::min(Size, m_DataSize));
+		return pNewBuffer;
+	}
+
 	if ((pBuffer >= m_Data) && (pBuffer < m_Data + sizeof(m_Data))) {
 		const size_t Offset = static_cast<uint8_t *>(pBuffer) - m_Data;
 
@@ -283,4 +581,126 @@ void * TSPacket::ReAllocate(void *pBuffer, size_t Size)
 }
 
 
+TSPacket::ParseResult TSPacketView::ParsePacket(uint8_t *pContinuityCounter) const
+{
+	const uint32_t Header = Load32(m_pData);
+	const uint16_t PID = static_cast<uint16_t>((Header >> 8) & 0x1FFF);
+	const uint8_t AdaptationFieldControl = static_cast<uint8_t>((Header >> 4) & 0x03);
+	const uint8_t AdaptationFieldLength = (AdaptationFieldControl & 0x02) ? m_pData[4] : 0_u8;
+
+	if ((Header >> 24) != 0x47_u32)
+		return TSPacket::ParseResult::FormatError;	// 同期バイト不正
+	if (Header & 0x800000_u32)
+		return TSPacket::ParseResult::TransportError;	// ビット誤りあり
+	if ((PID >= 0x0002_u16) && (PID <= 0x000F_u16))
+		return TSPacket::ParseResult::FormatError;	// 未定義PID範囲
+	if ((Header & 0xC0_u32) == 0x40_u32)
+		return TSPacket::ParseResult::FormatError;	// 未定義スクランブル制御値
+	if (AdaptationFieldControl == 0x00_u8)
+		return TSPacket::ParseResult::FormatError;	// 未定義アダプテーションフィールド制御値
+	if ((AdaptationFieldControl == 0x02_u8) && (AdaptationFieldLength > 183_u8))
+		return TSPacket::ParseResult::FormatError;	// アダプテーションフィールド長異常
+	if ((AdaptationFieldControl == 0x03_u8) && (AdaptationFieldLength > 182_u8))
+		return TSPacket::ParseResult::FormatError;	// アダプテーションフィールド長異常
+
+	if ((pContinuityCounter != nullptr) && (PID != PID_NULL)) {
+		// 連続性チェック
+		const uint8_t OldCounter = pContinuityCounter[PID];
+		const uint8_t NewCounter = (AdaptationFieldControl & 0x01_u8) ? static_cast<uint8_t>(Header & 0x0F) : 0x10_u8;
+		pContinuityCounter[PID] = NewCounter;
+
+		if ((AdaptationFieldLength == 0) || !(m_pData[5] & 0x80)) {
+			if ((OldCounter < 0x10_u8) && (NewCounter < 0x10_u8)) {
+				if (((OldCounter + 1) & 0x0F) != NewCounter) {
+					return TSPacket::ParseResult::ContinuityError;
+				}
+			}
+		}
+	}
+
+	return TSPacket::ParseResult::OK;
+}
+
+
+const uint8_t * TSPacketView::GetPayloadData() const noexcept
+{
+	switch (GetAdaptationFieldControl()) {
+	case 1:	// ペイロードのみ
+		return &m_pData[4];
+
+	case 3:	// アダプテーションフィールド、ペイロードあり
+		return &m_pData[m_pData[4] + 5];
+	}
+
+	// アダプテーションフィールドのみ or 例外
+	return nullptr;
+}
+
+
+uint8_t TSPacketView::GetPayloadSize() const noexcept
+{
+	switch (GetAdaptationFieldControl()) {
+	case 1:	// ペイロードのみ
+		return (uint8_t)(TS_PACKET_SIZE - 4);
+
+	case 3:	// アダプテーションフィールド、ペイロードあり
+		return (uint8_t)(TS_PACKET_SIZE - m_pData[4] - 5);
+	}
+
+	// アダプテーションフィールドのみ or 例外
+	return 0;
+}
+
+
+
+
+TSPacketViewStream::TSPacketViewStream(const uint8_t *pData, size_t PacketCount)
+	: TSPacketViewStream(pData, PacketCount, nullptr, 0, nullptr)
+{
+}
+
+
+TSPacketViewStream::TSPacketViewStream(
+	const uint8_t *pData, size_t PacketCount, const TSPacketHeaderBatch *pBatch, size_t BatchIndex,
+	TSPacket *pPacketList)
+	: m_pData(pData)
+	, m_PacketCount(PacketCount)
+	, m_Current(0)
+	, m_pPacketList(pPacketList)
+{
+	LIBISDB_ASSERT(PacketCount > 0);
+	LIBISDB_ASSERT((pBatch == nullptr) || (BatchIndex + PacketCount <= pBatch->PacketCount));
+
+	if (m_pPacketList == nullptr) {
+		m_PacketList.reset(new TSPacket[PacketCount]);
+		m_pPacketList = m_PacketList.get();
+	}
+
+	// 取得したパケットが他のパケットの取得で変わらないように、パケット毎に参照を設定しておく
+	for (size_t i = 0; i < PacketCount; i++) {
+		if (pBatch != nullptr)
+			m_pPacketList[i].SetReference(pData + i * TS_PACKET_SIZE, *pBatch, BatchIndex + i);
+		else
+			m_pPacketList[i].SetReference(pData + i * TS_PACKET_SIZE);
+	}
+}
+
+
+bool TSPacketViewStream::Next() noexcept
+{
+	if (m_Current + 1 >= m_PacketCount)
+		return false;
+
+	m_Current++;
+
+	return true;
+}
+
+
+void TSPacketViewStream::Rewind() noexcept
+{
+	m_Current = 0;
+}
+
+
 }	//namespace LibISDB
@@ -29,13 +29,24 @@
 
 
 #include "../Base/DataBuffer.hpp"
+#include "../Base/DataStream.hpp"
 #include "../Utilities/Utilities.hpp"
+#include <memory>
 
 
 namespace LibISDB
 {
 
-	/** TS パケットクラス */
+	struct TSPacketHeaderBatch;
+
+	/**
+		TS パケットクラス
+
+		SetReference() で外部のデータを参照している間、データは読み込み専用として扱われ、
+		参照元のデータが有効な間のみ利用できる。
+		データを書き換える場合は、先に MakeWritable() で自身のバッファに複製すること。
+		(SetPID() などデータを変更するメンバ関数は自動的に複製する)
+	*/
 	class TSPacket
 		: public DataBuffer
 	{
@@ -86,11 +97,19 @@ namespace LibISDB
 		TSPacket(TSPacket &&Src);
 		~TSPacket();
 
-		TSPacket & operator = (const TSPacket &) = default;
+		TSPacket & operator = (const TSPacket &Src);
 		TSPacket & operator = (TSPacket &&Src);
 
 		ParseResult ParsePacket(uint8_t *pContinuityCounter = nullptr);
 		void ReparsePacket();
+		static size_t ParsePackets(
+			const uint8_t *pData, size_t PacketCount, TSPacketHeaderBatch *pBatch,
+			uint8_t *pContinuityCounter = nullptr);
+
+		void SetReference(const uint8_t *pData);
+		void SetReference(const uint8_t *pData, const TSPacketHeaderBatch &Batch, size_t Index);
+		void ResetReference();
+		bool IsReference() const noexcept { return m_Reference; }
 
 		uint8_t * GetPayloadData();
 		const uint8_t * GetPayloadData() const;
@@ -123,6 +142,8 @@ namespace LibISDB
 		void Free(void *pBuffer) noexcept override;
 		void * ReAllocate(void *pBuffer, size_t Size) override;
 
+		void ParseHeader();
+
 #ifdef LIBISDB_TS_PACKET_PAYLOAD_ALIGN
 		uint8_t m_Data[LIBISDB_TS_PACKET_PAYLOAD_ALIGN + RoundUp(TS_PACKET_SIZE, (size_t)LIBISDB_TS_PACKET_PAYLOAD_ALIGN)];
 #else
@@ -130,6 +151,101 @@ namespace LibISDB
 #endif
 		TSPacketHeader m_Header;
 		AdaptationFieldHeader m_AdaptationField;
+		bool m_Reference;
+	};
+
+	/** TS パケットヘッダ一括解析結果(パケット毎の値を項目別の配列に格納する) */
+	struct TSPacketHeaderBatch {
+		static constexpr size_t MAX_PACKET_COUNT = 64;
+
+		struct HeaderFlag {
+			static constexpr uint16_t TransportErrorIndicator   = 0x0001_u16;
+			static constexpr uint16_t PayloadUnitStartIndicator = 0x0002_u16;
+			static constexpr uint16_t TransportPriority         = 0x0004_u16;
+			static constexpr uint16_t Scrambled                 = 0x0008_u16;
+			static constexpr uint16_t AdaptationField           = 0x0010_u16;
+			static constexpr uint16_t Payload                   = 0x0020_u16;
+			static constexpr uint16_t DiscontinuityIndicator    = 0x0040_u16;
+			static constexpr uint16_t SyncError                 = 0x0100_u16; /**< 同期バイト不正 */
+			static constexpr uint16_t FormatError               = 0x0200_u16; /**< 同期バイト以外のフォーマットエラー */
+		};
+
+		size_t PacketCount;                                 /**< 格納されているパケット数 */
+		uint16_t PID[MAX_PACKET_COUNT];                     /**< PID */
+		uint16_t Flags[MAX_PACKET_COUNT];                   /**< HeaderFlag の組み合わせ */
+		uint8_t ContinuityCounter[MAX_PACKET_COUNT];        /**< Continuity Counter */
+		uint8_t PayloadOffset[MAX_PACKET_COUNT];            /**< ペイロードの位置(ペイロードが無い場合は 0) */
+		uint8_t TransportScramblingControl[MAX_PACKET_COUNT]; /**< Transport Scrambling Control */
+		uint8_t AdaptationFieldLength[MAX_PACKET_COUNT];    /**< Adaptation Field Length(アダプテーションフィールドが無い場合は 0) */
+		uint8_t AdaptationFieldFlags[MAX_PACKET_COUNT];     /**< アダプテーションフィールドのフラグ(フィールド長が 0 の場合は 0) */
+		TSPacket::ParseResult Result[MAX_PACKET_COUNT];     /**< 解析結果 */
+	};
+
+	/** TS パケット参照クラス(データを保持せず、元のデータを直接解析する) */
+	class TSPacketView
+	{
+	public:
+		TSPacketView() = default;
+		explicit TSPacketView(const uint8_t *pData) noexcept : m_pData(pData) {}
+
+		TSPacket::ParseResult ParsePacket(uint8_t *pContinuityCounter = nullptr) const;
+
+		const uint8_t * GetData() const noexcept { return m_pData; }
+		const uint8_t * GetPayloadData() const noexcept;
+		uint8_t GetPayloadSize() const noexcept;
+
+		uint8_t GetSyncByte() const noexcept { return m_pData[0]; }
+		bool GetTransportErrorIndicator() const noexcept { return (m_pData[1] & 0x80) != 0; }
+		bool GetPayloadUnitStartIndicator() const noexcept { return (m_pData[1] & 0x40) != 0; }
+		bool GetTransportPriority() const noexcept { return (m_pData[1] & 0x20) != 0; }
+		uint16_t GetPID() const noexcept { return Load16(&m_pData[1]) & 0x1FFF_u16; }
+		uint8_t GetTransportScramblingControl() const noexcept { return (m_pData[3] >> 6) & 0x03_u8; }
+		uint8_t GetAdaptationFieldControl() const noexcept { return (m_pData[3] >> 4) & 0x03_u8; }
+		uint8_t GetContinuityCounter() const noexcept { return m_pData[3] & 0x0F_u8; }
+		bool HaveAdaptationField() const noexcept { return (m_pData[3] & 0x20) != 0; }
+		bool HavePayload() const noexcept { return (m_pData[3] & 0x10) != 0; }
+		bool IsScrambled() const noexcept { return (m_pData[3] & 0x80) != 0; }
+		uint8_t GetAdaptationFieldLength() const noexcept { return HaveAdaptationField() ? m_pData[4] : 0_u8; }
+		bool GetDiscontinuityIndicator() const noexcept { return (GetAdaptationFieldLength() > 0) && ((m_pData[5] & 0x80) != 0); }
+
+	private:
+		const uint8_t *m_pData = nullptr;
+	};
+
+	/**
+		連続した TS パケット列を参照するデータストリームクラス
+
+		パケットは元のデータを参照するため、読み込み専用で、受け取った呼び出しの間のみ有効である。
+		TSPacket::ParsePackets() の解析結果を渡した場合、各パケットのヘッダはその結果から設定する。
+		各パケットはそれぞれ別の TSPacket として参照されるため、取得したポインタを保持して
+		複数のパケットを同時に扱うことができる。
+		パケットの TSPacket を呼び出し側で用意する場合は、PacketCount 個の配列を渡す。
+	*/
+	class TSPacketViewStream
+		: public DataStream
+	{
+	public:
+		TSPacketViewStream(const uint8_t *pData, size_t PacketCount);
+		TSPacketViewStream(
+			const uint8_t *pData, size_t PacketCount, const TSPacketHeaderBatch *pBatch, size_t BatchIndex,
+			TSPacket *pPacketList);
+
+	// DataStream
+		DataBuffer * GetData() const noexcept override { return &m_pPacketList[m_Current]; }
+		bool Next() noexcept override;
+		void Rewind() noexcept override;
+		unsigned long GetTypeID() const noexcept override { return TSPacket::TypeID; }
+
+	// TSPacketViewStream
+		TSPacketView GetView() const noexcept { return TSPacketView(m_pData + m_Current * TS_PACKET_SIZE); }
+		size_t GetPacketCount() const noexcept { return m_PacketCount; }
+
+	private:
+		const uint8_t *m_pData;
+		size_t m_PacketCount;
+		size_t m_Current;
+		std::unique_ptr<TSPacket[]> m_PacketList;
+		TSPacket *m_pPacketList;
 	};
 
 }	// namespace LibISDB
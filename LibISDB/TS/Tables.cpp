@@ -203,6 +203,8 @@ bool CATTable::OnTableUpdate(const PSISection *pCurSection, const PSISection *pO
 
 PMTTable::PMTTable()
 {
+	m_DescriptorBlock.SetDescriptorPool(&m_DescriptorPool);
+
 	Reset();
 }
 
@@ -325,17 +327,23 @@ bool PMTTable::OnTableUpdate(const PSISection *pCurSection, const PSISection *pO
 		Item.StreamType = pData[Pos];
 		Item.ESPID      = Load16(&pData[Pos + 1]) & 0x1FFF;
 
+		Item.Descriptors.SetDescriptorPool(&m_DescriptorPool);
 		Item.Descriptors.ParseBlock(&pData[Pos + 5], DescriptorLength);
 	}
 
+	// 要素の再配置でプールが外れた記述子ブロックに設定し直す
+	for (auto &Item : m_ESList)
+		Item.Descriptors.SetDescriptorPool(&m_DescriptorPool);
+
 	return true;
 }
 
 
 
 
-SDTTable::SDTTable(uint8_t TableID)
+SDTTable::SDTTable(uint8_t TableID, const std::shared_ptr<DescriptorPool> &Pool)
 	: m_TableID(TableID)
+	, m_DescriptorPool(Pool ? Pool : std::make_shared<DescriptorPool>())
 {
 	Reset();
 }
@@ -504,19 +512,31 @@ bool SDTTable::OnTableUpdate(const PSISection *pCurSection, const PSISection *pO
 		if (Pos + DescriptorLength > DataSize)
 			break;
 
+		Item.Descriptors.SetDescriptorPool(m_DescriptorPool.get());
 		Item.Descriptors.ParseBlock(&pData[Pos], DescriptorLength);
 		Pos += DescriptorLength;
 	}
 
+	// 要素の再配置でプールが外れた記述子ブロックに設定し直す
+	for (auto &Item : m_ServiceList)
+		Item.Descriptors.SetDescriptorPool(m_DescriptorPool.get());
+
 	return true;
 }
 
 
 
 
+SDTOtherTable::SDTOtherTable()
+	: m_DescriptorPool(std::make_shared<DescriptorPool>())
+{
+}
+
+
 PSITableBase * SDTOtherTable::CreateSectionTable(const PSISection *pSection)
 {
-	return new SDTTable(SDTTable::TABLE_ID_OTHER);
+	// セクションのテーブルが削除されても記述子を再利用できるように、プールを共有する
+	return new SDTTable(SDTTable::TABLE_ID_OTHER, m_DescriptorPool);
 }
 
 
@@ -545,6 +565,8 @@ const SDTOtherTable * SDTTableSet::GetOtherSDTTable() const
 
 NITTable::NITTable()
 {
+	m_NetworkDescriptorBlock.SetDescriptorPool(&m_DescriptorPool);
+
 	Reset();
 }
 
@@ -647,10 +669,15 @@ bool NITTable::OnTableUpdate(const PSISection *pCurSection, const PSISection *pO
 		Item.TransportStreamID = Load16(&pData[Pos + 0]);
 		Item.OriginalNetworkID = Load16(&pData[Pos + 2]);
 		Pos += 6;
+		Item.Descriptors.SetDescriptorPool(&m_DescriptorPool);
 		Item.Descriptors.ParseBlock(&pData[Pos], DescriptorLength);
 		Pos += DescriptorLength;
 	}
 
+	// 要素の再配置でプールが外れた記述子ブロックに設定し直す
+	for (auto &Item : m_TransportStreamList)
+		Item.Descriptors.SetDescriptorPool(&m_DescriptorPool);
+
 	return true;
 }
 
@@ -684,6 +711,13 @@ PSITableBase * NITMultiTable::CreateSectionTable(const PSISection *pSection)
 
 
 EITTable::EITTable()
+	: EITTable(std::make_shared<DescriptorPool>())
+{
+}
+
+
+EITTable::EITTable(const std::shared_ptr<DescriptorPool> &Pool)
+	: m_DescriptorPool(Pool)
 {
 	Reset();
 }
@@ -830,6 +864,8 @@ bool EITTable::OnTableUpdate(const PSISection *pCurSection, const PSISection *pO
 		Info.RunningStatus  = pData[Pos + 10] >> 5;
 		Info.FreeCAMode     = (pData[Pos + 10] & 0x10) != 0;
 
+		Info.Descriptors.SetDescriptorPool(m_DescriptorPool.get());
+
 		const size_t DescriptorLength = ((pData[Pos + 10] & 0x0F) << 8) | pData[Pos + 11];
 		if ((DescriptorLength > 0) && (Pos + 12 + DescriptorLength <= DataSize))
 			Info.Descriptors.ParseBlock(&pData[Pos + 12], DescriptorLength);
@@ -837,12 +873,24 @@ bool EITTable::OnTableUpdate(const PSISection *pCurSection, const PSISection *pO
 		Pos += 12 + DescriptorLength;
 	}
 
+	// 要素の再配置でプールが外れた記述子ブロックに設定し直す
+	for (auto &Info : m_EventList)
+		Info.Descriptors.SetDescriptorPool(m_DescriptorPool.get());
+
 	return true;
 }
 
 
 
 
+EITMultiTable::EITMultiTable()
+	: m_DescriptorPool(std::make_shared<DescriptorPool>())
+{
+	// EIT は同じ内容のセクションが繰り返し送出されるため、重複したセクションを破棄する
+	SetDuplicateSectionFilter(true);
+}
+
+
 const EITTable * EITMultiTable::GetEITTableByServiceID(uint16_t ServiceID, uint16_t SectionNumber) const
 {
 	for (auto &Table : m_TableList) {
@@ -885,7 +933,8 @@ uint16_t EITMultiTable::GetServiceID(int Index) const
 
 PSITableBase * EITMultiTable::CreateSectionTable(const PSISection *pSection)
 {
-	return new EITTable;
+	// セクションのテーブルが削除されても記述子を再利用できるように、プールを共有する
+	return new EITTable(m_DescriptorPool);
 }
 
 
@@ -917,6 +966,7 @@ unsigned long long EITMultiTable::MakeTableUniqueID(
 
 EITPfTable::EITPfTable()
 {
+	SetDuplicateSectionFilter(true);
 	MapTable(EITTable::TABLE_ID_PF_ACTUAL, new EITMultiTable);
 	MapTable(EITTable::TABLE_ID_PF_OTHER, new EITMultiTable);
 }
@@ -956,6 +1006,7 @@ const EITTable * EITPfTable::GetPfOtherTable(uint16_t ServiceID, bool Following)
 
 EITPfActualTable::EITPfActualTable()
 {
+	SetDuplicateSectionFilter(true);
 	MapTable(EITTable::TABLE_ID_PF_ACTUAL, new EITMultiTable);
 }
 
@@ -979,6 +1030,8 @@ const EITTable * EITPfActualTable::GetPfActualTable(uint16_t ServiceID, bool Fol
 
 EITPfScheduleTable::EITPfScheduleTable()
 {
+	SetDuplicateSectionFilter(true);
+
 	// 0x50 - 0x57 [schedule actual basic]
 	// 0x58 - 0x5F [schedule actual extended]
 	// 0x60 - 0x67 [schedule other basic]
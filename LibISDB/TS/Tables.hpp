@@ -130,6 +130,7 @@ namespace LibISDB
 			DescriptorBlock Descriptors; /**< ES Descriptor */
 		};
 
+		DescriptorPool m_DescriptorPool; /**< 記述子プール */
 		std::vector<PMTItem> m_ESList;
 
 		uint16_t m_PCRPID;                 /**< PCR_PID */
@@ -144,7 +145,7 @@ namespace LibISDB
 		static constexpr uint8_t TABLE_ID_ACTUAL = 0x42_u8;
 		static constexpr uint8_t TABLE_ID_OTHER  = 0x46_u8;
 
-		SDTTable(uint8_t TableID = TABLE_ID_ACTUAL);
+		SDTTable(uint8_t TableID = TABLE_ID_ACTUAL, const std::shared_ptr<DescriptorPool> &Pool = nullptr);
 
 	// PSISingleTable
 		void Reset() override;
@@ -185,6 +186,7 @@ namespace LibISDB
 
 		uint8_t m_TableID;
 		uint16_t m_OriginalNetworkID;
+		std::shared_ptr<DescriptorPool> m_DescriptorPool; /**< 記述子プール */
 		std::vector<SDTItem> m_ServiceList;
 	};
 
@@ -192,9 +194,14 @@ namespace LibISDB
 	class SDTOtherTable
 		: public PSITable
 	{
+	public:
+		SDTOtherTable();
+
 	protected:
 	// PSITable
 		PSITableBase * CreateSectionTable(const PSISection *pSection) override;
+
+		std::shared_ptr<DescriptorPool> m_DescriptorPool; /**< 各セクションのテーブルで共有する記述子プール */
 	};
 
 	/** SDT テーブル集合クラス */
@@ -240,6 +247,7 @@ namespace LibISDB
 		};
 
 		uint16_t m_NetworkID;                     /**< network_id */
+		DescriptorPool m_DescriptorPool;          /**< 記述子プール */
 		DescriptorBlock m_NetworkDescriptorBlock; /**< ネットワーク記述子 */
 		std::vector<NITItem> m_TransportStreamList;
 	};
@@ -277,6 +285,7 @@ namespace LibISDB
 		static constexpr uint8_t TABLE_ID_PF_OTHER  = 0x4F_u8;	// p/f other
 
 		EITTable();
+		explicit EITTable(const std::shared_ptr<DescriptorPool> &Pool);
 
 	// PSISingleTable
 		void Reset() override;
@@ -305,6 +314,7 @@ namespace LibISDB
 		uint8_t m_SegmentLastSectionNumber; /**< segment_last_section_number */
 		uint8_t m_LastTableID;              /**< last_table_id */
 
+		std::shared_ptr<DescriptorPool> m_DescriptorPool; /**< 記述子プール */
 		std::vector<EventInfo> m_EventList;
 	};
 
@@ -313,6 +323,8 @@ namespace LibISDB
 		: public PSITable
 	{
 	public:
+		EITMultiTable();
+
 		const EITTable * GetEITTableByServiceID(uint16_t ServiceID, uint16_t SectionNumber) const;
 		bool IsEITSectionComplete(
 			uint16_t NetworkID, uint16_t TransportStreamID, uint16_t ServiceID) const;
@@ -325,6 +337,8 @@ namespace LibISDB
 	// PSITable
 		PSITableBase * CreateSectionTable(const PSISection *pSection) override;
 		unsigned long long GetSectionTableUniqueID(const PSISection *pSection) override;
+
+		std::shared_ptr<DescriptorPool> m_DescriptorPool; /**< 各セクションのテーブルで共有する記述子プール */
 	};
 
 	/** EIT[p/f] テーブルクラス */
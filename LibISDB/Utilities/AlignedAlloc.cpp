@@ -26,6 +26,12 @@
 
 #include "../LibISDBBase.hpp"
 #include "AlignedAlloc.hpp"
+#ifdef LIBISDB_WINDOWS
+#include "../LibISDBWindows.hpp"
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "../Base/Debug.hpp"
 #include "../Base/DebugDef.hpp"
 
@@ -61,7 +67,7 @@ void AlignedFree(void *pBuffer) noexcept
 namespace
 {
 
-const size_t MAX_ALIGNMENT = 256;
+const size_t MAX_ALIGNMENT = 4096;
 const unsigned long ALIGNED_MEMORY_SIGNATURE = 0x416C496EUL;
 
 struct AlignedMemoryInfo {
@@ -160,4 +166,102 @@ void AlignedFree(void *pBuffer) noexcept
 #endif	// !def _MSC_VER
 
 
+
+
+/*
+	ページ単位のメモリ確保
+
+	LargePages が指定された場合、可能であればラージページ(Linux では Transparent Huge Pages)を使用する。
+	解放する際には確保した時と同じサイズを指定する。
+*/
+void * PageAlloc(size_t Size, bool LargePages) noexcept
+{
+	if (LIBISDB_TRACE_ERROR_IF(Size == 0))
+		return nullptr;
+
+#ifdef LIBISDB_WINDOWS
+
+	if (LargePages) {
+		const SIZE_T LargePageSize = ::GetLargePageMinimum();
+		if ((LargePageSize != 0) && (Size % LargePageSize == 0)) {
+			void *pBuffer = ::VirtualAlloc(nullptr, Size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (pBuffer != nullptr)
+				return pBuffer;
+			// SeLockMemoryPrivilege が無い場合は失敗するので通常のページで確保する
+		}
+	}
+
+	return ::VirtualAlloc(nullptr, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+#else	// LIBISDB_WINDOWS
+
+	const size_t PageSize = GetPageSize();
+	if (LIBISDB_TRACE_ERROR_IF(Size > std::numeric_limits<size_t>::max() - PageSize))
+		return nullptr;
+	Size = (Size + (PageSize - 1)) & ~(PageSize - 1);
+
+#ifdef MADV_HUGEPAGE
+	constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	if (LargePages && (Size >= HUGE_PAGE_SIZE) && (Size <= std::numeric_limits<size_t>::max() - HUGE_PAGE_SIZE)) {
+		// ラージページを使えるように 2MiB 境界に揃える
+		void *pMap = ::mmap(nullptr, Size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (pMap == MAP_FAILED)
+			return nullptr;
+
+		uint8_t *pBase = static_cast<uint8_t *>(pMap);
+		uint8_t *pAligned = reinterpret_cast<uint8_t *>(
+			(reinterpret_cast<uintptr_t>(pBase) + (HUGE_PAGE_SIZE - 1)) & ~(HUGE_PAGE_SIZE - 1));
+		if (pAligned > pBase)
+			::munmap(pBase, pAligned - pBase);
+		const size_t Tail = (pBase + Size + HUGE_PAGE_SIZE) - (pAligned + Size);
+		if (Tail > 0)
+			::munmap(pAligned + Size, Tail);
+
+		::madvise(pAligned, Size, MADV_HUGEPAGE);
+
+		return pAligned;
+	}
+#endif
+
+	void *pBuffer = ::mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pBuffer == MAP_FAILED)
+		return nullptr;
+
+	return pBuffer;
+
+#endif	// ndef LIBISDB_WINDOWS
+}
+
+
+void PageFree(void *pBuffer, size_t Size) noexcept
+{
+	if (pBuffer == nullptr)
+		return;
+
+#ifdef LIBISDB_WINDOWS
+	::VirtualFree(pBuffer, 0, MEM_RELEASE);
+#else
+	const size_t PageSize = GetPageSize();
+	::munmap(pBuffer, (Size + (PageSize - 1)) & ~(PageSize - 1));
+#endif
+}
+
+
+size_t GetPageSize() noexcept
+{
+#ifdef LIBISDB_WINDOWS
+	::SYSTEM_INFO Info;
+	::GetSystemInfo(&Info);
+	return Info.dwPageSize;
+#else
+	static const size_t PageSize = [] {
+		const long Size = ::sysconf(_SC_PAGESIZE);
+		return Size > 0 ? static_cast<size_t>(Size) : 4096;
+	}();
+	return PageSize;
+#endif
+}
+
+
 }	// namespace LibISDB
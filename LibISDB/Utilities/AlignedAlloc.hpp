@@ -35,6 +35,10 @@ namespace LibISDB
 	[[nodiscard]] void * AlignedRealloc(void *pBuffer, size_t Size, size_t Align, size_t Offset = 0) noexcept;
 	void AlignedFree(void *pBuffer) noexcept;
 
+	[[nodiscard]] void * PageAlloc(size_t Size, bool LargePages = false) noexcept;
+	void PageFree(void *pBuffer, size_t Size) noexcept;
+	size_t GetPageSize() noexcept;
+
 }	// namespace LibISDB
 
 
@@ -27,6 +27,11 @@
 #include "../LibISDBPrivate.hpp"
 #include "CRC.hpp"
 #include "Utilities.hpp"
+#ifdef LIBISDB_PCLMULQDQ_SUPPORT
+#include "../Base/SIMD.hpp"
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 
 namespace LibISDB
@@ -264,7 +269,7 @@ static const uint32_t g_CRC32MPEG2Table[256] = {
 
 // Dilip V. Sarwate のアルゴリズム
 
-CRC32MPEG2::ValueType CRC32MPEG2::Calc(const uint8_t *pData, size_t DataSize, ValueType CRC) noexcept
+CRC32MPEG2::ValueType CRC32MPEG2::CalcTable(const uint8_t *pData, size_t DataSize, ValueType CRC) noexcept
 {
 	const uint8_t *pEnd = pData + DataSize;
 
@@ -277,7 +282,7 @@ CRC32MPEG2::ValueType CRC32MPEG2::Calc(const uint8_t *pData, size_t DataSize, Va
 
 #else
 
-CRC32MPEG2::ValueType CRC32MPEG2::Calc(const uint8_t *pData, size_t DataSize, ValueType CRC) noexcept
+CRC32MPEG2::ValueType CRC32MPEG2::CalcTable(const uint8_t *pData, size_t DataSize, ValueType CRC) noexcept
 {
 	static CRC32SlicingTable Table(g_CRC32MPEG2Table);
 
@@ -347,4 +352,112 @@ CRC32MPEG2::ValueType CRC32MPEG2::Calc(const uint8_t *pData, size_t DataSize, Va
 #endif
 
 
+CRC32MPEG2::ValueType CRC32MPEG2::Calc(const uint8_t *pData, size_t DataSize, ValueType CRC) noexcept
+{
+#ifdef LIBISDB_PCLMULQDQ_SUPPORT
+	if ((DataSize >= 64) && IsPCLMULQDQEnabled())
+		return CalcPCLMULQDQ(pData, DataSize, CRC);
+#endif
+
+	return CalcTable(pData, DataSize, CRC);
+}
+
+
+#ifdef LIBISDB_PCLMULQDQ_SUPPORT
+
+/*
+	PCLMULQDQ による畳み込み
+	"Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel) の
+	非反転版のアルゴリズムによる
+*/
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LIBISDB_TARGET_PCLMULQDQ __attribute__((target("pclmul,ssse3")))
+#else
+#define LIBISDB_TARGET_PCLMULQDQ
+#endif
+
+namespace
+{
+
+// 各 16 バイトを先頭のビットが最上位になるように並べ替えて読み込む
+LIBISDB_TARGET_PCLMULQDQ
+inline __m128i LoadBigEndian128(const uint8_t *p)
+{
+	const __m128i ByteSwap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), ByteSwap);
+}
+
+// x の上位 64 ビットと下位 64 ビットをそれぞれ k の上位と下位の定数で畳み込み、d に加える
+LIBISDB_TARGET_PCLMULQDQ
+inline __m128i Fold128(__m128i x, __m128i k, __m128i d)
+{
+	return _mm_xor_si128(
+		_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00)),
+		d);
+}
+
+}
+
+LIBISDB_TARGET_PCLMULQDQ
+CRC32MPEG2::ValueType CRC32MPEG2::CalcPCLMULQDQ(const uint8_t *pData, size_t DataSize, ValueType CRC) noexcept
+{
+	if (DataSize < 64)
+		return CalcTable(pData, DataSize, CRC);
+	// x^(512+64) mod P, x^512 mod P
+	const __m128i Fold4 = _mm_set_epi32(0, 0x8833794C, 0, 0xE6228B11);
+	// x^(128+64) mod P, x^128 mod P
+	const __m128i Fold1 = _mm_set_epi32(0, 0xC5B9CD4C, 0, 0xE8A45605);
+	// x^96 mod P, x^64 mod P
+	const __m128i Reduce = _mm_set_epi32(0, 0xF200AA66, 0, 0x490D678D);
+	// floor(x^64 / P), P
+	const __m128i Barrett = _mm_set_epi32(0x00000001, 0x04D101DF, 0x00000001, 0x04C11DB7);
+
+	const uint8_t *p = pData;
+	const uint8_t *pEnd = pData + DataSize;
+
+	// 初期値は先頭 32 ビットに加える
+	__m128i x0 = _mm_xor_si128(LoadBigEndian128(p), _mm_set_epi32(static_cast<int>(CRC), 0, 0, 0));
+	__m128i x1 = LoadBigEndian128(p + 16);
+	__m128i x2 = LoadBigEndian128(p + 32);
+	__m128i x3 = LoadBigEndian128(p + 48);
+	p += 64;
+
+	while (pEnd - p >= 64) {
+		x0 = Fold128(x0, Fold4, LoadBigEndian128(p));
+		x1 = Fold128(x1, Fold4, LoadBigEndian128(p + 16));
+		x2 = Fold128(x2, Fold4, LoadBigEndian128(p + 32));
+		x3 = Fold128(x3, Fold4, LoadBigEndian128(p + 48));
+		p += 64;
+	}
+
+	__m128i x = Fold128(x0, Fold1, x1);
+	x = Fold128(x, Fold1, x2);
+	x = Fold128(x, Fold1, x3);
+
+	while (pEnd - p >= 16) {
+		x = Fold128(x, Fold1, LoadBigEndian128(p));
+		p += 16;
+	}
+
+	// 128 ビット -> 96 ビット (x * x^32)
+	x = _mm_xor_si128(
+		_mm_clmulepi64_si128(x, Reduce, 0x11),
+		_mm_slli_si128(_mm_move_epi64(x), 4));
+	// 96 ビット -> 64 ビット
+	x = _mm_xor_si128(
+		_mm_clmulepi64_si128(_mm_srli_si128(x, 8), Reduce, 0x00),
+		_mm_move_epi64(x));
+	// Barrett reduction
+	__m128i q = _mm_srli_epi64(_mm_clmulepi64_si128(_mm_srli_epi64(x, 32), Barrett, 0x10), 32);
+	x = _mm_xor_si128(x, _mm_clmulepi64_si128(q, Barrett, 0x00));
+
+	CRC = static_cast<uint32_t>(_mm_cvtsi128_si32(x));
+
+	return CalcTable(p, pEnd - p, CRC);
+}
+
+#endif	// LIBISDB_PCLMULQDQ_SUPPORT
+
+
 }	// namespace LibISDB
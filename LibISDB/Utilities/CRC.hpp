@@ -64,6 +64,10 @@ namespace LibISDB
 		static constexpr ValueType InitialValue = 0xFFFFFFFF_u32;
 
 		static ValueType Calc(const uint8_t *pData, size_t DataSize, ValueType CRC = InitialValue) noexcept;
+		static ValueType CalcTable(const uint8_t *pData, size_t DataSize, ValueType CRC = InitialValue) noexcept;
+#ifdef LIBISDB_PCLMULQDQ_SUPPORT
+		static ValueType CalcPCLMULQDQ(const uint8_t *pData, size_t DataSize, ValueType CRC = InitialValue) noexcept;
+#endif
 	};
 
 }	// namespace LibISDB
@@ -42,11 +42,16 @@ namespace LibISDB
 #pragma intrinsic(_lrotl, _lrotr)
 	LIBISDB_FORCE_INLINE uint32_t RotateLeft32(uint32_t v, int shift) noexcept { return _lrotl(v, shift); }
 	LIBISDB_FORCE_INLINE uint32_t RotateRight32(uint32_t v, int shift) noexcept { return _lrotr(v, shift); }
+#define LIBISDB_BIT_SCAN_INTRINSICS
+#pragma intrinsic(_BitScanForward)
+	LIBISDB_FORCE_INLINE int BitScanForward32(uint32_t v) noexcept { unsigned long Index; ::_BitScanForward(&Index, v); return static_cast<int>(Index); }
 #elif defined(__GNUC__) || defined(__clang__)
 #define LIBISDB_BYTE_SWAP_INTRINSICS
 	LIBISDB_FORCE_INLINE uint16_t ByteSwap16(uint16_t v) noexcept { return __builtin_bswap16(v); }
 	LIBISDB_FORCE_INLINE uint32_t ByteSwap32(uint32_t v) noexcept { return __builtin_bswap32(v); }
 	LIBISDB_FORCE_INLINE uint64_t ByteSwap64(uint64_t v) noexcept { return __builtin_bswap64(v); }
+#define LIBISDB_BIT_SCAN_INTRINSICS
+	LIBISDB_FORCE_INLINE int BitScanForward32(uint32_t v) noexcept { return __builtin_ctz(v); }
 #endif
 #endif
 
@@ -93,6 +98,21 @@ namespace LibISDB
 
 #endif	// ifndef LIBISDB_ROTATE_INTRINSICS
 
+#ifndef LIBISDB_BIT_SCAN_INTRINSICS
+
+	// v が 0 の場合は不定
+	LIBISDB_FORCE_INLINE int BitScanForward32(uint32_t v) noexcept
+	{
+		int Index = 0;
+		while (!(v & 1)) {
+			v >>= 1;
+			Index++;
+		}
+		return Index;
+	}
+
+#endif	// ifndef LIBISDB_BIT_SCAN_INTRINSICS
+
 	LIBISDB_FORCE_INLINE uint16_t Load16(const void *p)
 	{
 #if (defined(LIBISDB_X86) || defined(LIBISDB_X64)) && defined(LIBISDB_BYTE_SWAP_INTRINSICS)
@@ -94,6 +94,11 @@ public:
 		m_Out << LIBISDB_STR("\"") << pKey << LIBISDB_STR("\":\"") << EscapeString(Value) << LIBISDB_STR("\"");
 	}
 
+	void OutValue(const LibISDB::CharType *pKey, const LibISDB::PooledString &Value)
+	{
+		OutValue(pKey, Value.Get());
+	}
+
 	void OutValue(const LibISDB::CharType *pKey, const LibISDB::DateTime &Time)
 	{
 		PreValue();
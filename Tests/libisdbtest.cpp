@@ -26,7 +26,10 @@
 
 #include "../LibISDB/LibISDB.hpp"
 
+#include <algorithm>
 #include <clocale>
+#include <chrono>
+#include <cstdio>
 
 #if defined(LIBISDB_WINDOWS) && defined(LIBISDB_WCHAR)
 #define LIBISDB_TEST_WMAIN
@@ -61,6 +64,26 @@ namespace
 		return reinterpret_cast<const uint8_t *>(str);
 	}
 #endif
+
+	void ReportThroughput(const char *name, double count, const char *unit, std::chrono::steady_clock::duration time)
+	{
+		const double seconds = std::chrono::duration<double>(time).count();
+		std::printf("%s: %.0f %s in %.3f ms (%.0f %s/sec)\n",
+			name, count, unit, seconds * 1000.0, seconds > 0.0 ? count / seconds : 0.0, unit);
+	}
+
+	// テストデータ用の擬似乱数 (線形合同法)
+	uint8_t NextRandom(std::uint32_t &seed)
+	{
+		seed = seed * 1103515245 + 12345;
+		return static_cast<uint8_t>(seed >> 16);
+	}
+
+	template<typename T> void FillRandom(T &buffer, std::uint32_t seed = 1)
+	{
+		for (auto &e : buffer)
+			e = NextRandom(seed);
+	}
 }
 
 
@@ -103,6 +126,7 @@ TEST_CASE("AlignedAlloc", "[utility][memory]")
 
 
 #include "../LibISDB/Utilities/CRC.hpp"
+#include "../LibISDB/Base/SIMD.hpp"
 
 TEST_CASE("CRC", "[utility][hash]")
 {
@@ -157,6 +181,77 @@ TEST_CASE("CRC", "[utility][hash]")
 		CHECK(crc32.Calc(u8"jumps over the lazy dog"_b8, 23) == 0xBA62119E_u32);
 		CHECK(crc32.Get() == 0xBA62119E_u32);
 	}
+
+	// CRC-32/MPEG-2 の各実装の結果が一致すること
+	{
+		std::vector<uint8_t> data(4096 + 16);
+		FillRandom(data);
+
+		bool match = true;
+		for (size_t size = 0; size <= 1100; size += (size < 300) ? 1 : 37) {
+			for (size_t offset = 0; offset < 16; offset += 5) {
+				const uint8_t *p = data.data() + offset;
+				const uint32_t crc = LibISDB::CRC32MPEG2::CalcTable(p, size);
+				if (LibISDB::CRC32MPEG2::Calc(p, size) != crc)
+					match = false;
+#ifdef LIBISDB_PCLMULQDQ_SUPPORT
+				if (LibISDB::IsPCLMULQDQAvailable()) {
+					if (LibISDB::CRC32MPEG2::CalcPCLMULQDQ(p, size) != crc)
+						match = false;
+					// 途中の値から継続
+					const size_t half = size / 2;
+					if (LibISDB::CRC32MPEG2::CalcPCLMULQDQ(p + half, size - half, LibISDB::CRC32MPEG2::CalcPCLMULQDQ(p, half)) != crc)
+						match = false;
+				}
+#endif
+			}
+		}
+		CHECK(match);
+
+		CHECK(LibISDB::CRC32MPEG2::Calc(data.data(), 4096) == LibISDB::CRC32MPEG2::CalcTable(data.data(), 4096));
+#ifdef LIBISDB_PCLMULQDQ_SUPPORT
+		const bool enabled = LibISDB::IsPCLMULQDQEnabled();
+		LibISDB::SetPCLMULQDQEnabled(false);
+		CHECK_FALSE(LibISDB::IsPCLMULQDQEnabled());
+		CHECK(LibISDB::CRC32MPEG2::Calc(data.data(), 4096) == LibISDB::CRC32MPEG2::CalcTable(data.data(), 4096));
+		LibISDB::SetPCLMULQDQEnabled(enabled);
+#endif
+	}
+}
+
+TEST_CASE("CRCBenchmark", "[.benchmark][utility][hash]")
+{
+	constexpr size_t size = 4096, repeat = 20000;
+	std::vector<uint8_t> data(size);
+	FillRandom(data);
+
+	uint32_t crc = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < repeat; i++)
+		crc ^= LibISDB::CRC32MPEG2::CalcTable(data.data(), size);
+	ReportThroughput("CRC32MPEG2 table", double(size) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+
+#ifdef LIBISDB_PCLMULQDQ_SUPPORT
+	if (LibISDB::IsPCLMULQDQAvailable()) {
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < repeat; i++)
+			crc ^= LibISDB::CRC32MPEG2::CalcPCLMULQDQ(data.data(), size);
+		ReportThroughput("CRC32MPEG2 PCLMULQDQ", double(size) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+		CHECK(crc == 0);
+	}
+#endif
+
+	// 短いセクションでの比較
+	constexpr size_t sectionSize = 188, sectionRepeat = 400000;
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < sectionRepeat; i++)
+		crc += LibISDB::CRC32MPEG2::CalcTable(data.data() + (i & 255), sectionSize);
+	ReportThroughput("CRC32MPEG2 table (188 bytes)", double(sectionRepeat), "calls", std::chrono::steady_clock::now() - start);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < sectionRepeat; i++)
+		crc += LibISDB::CRC32MPEG2::Calc(data.data() + (i & 255), sectionSize);
+	ReportThroughput("CRC32MPEG2 Calc (188 bytes)", double(sectionRepeat), "calls", std::chrono::steady_clock::now() - start);
+	CHECK(crc != 1);
 }
 
 
@@ -253,7 +348,1537 @@ TEST_CASE("Load", "[utility][load]")
 }
 
 
+#include "../LibISDB/TS/TSPacket.hpp"
+
+TEST_CASE("TSPacket", "[ts][packet]")
+{
+	uint8_t data[LibISDB::TS_PACKET_SIZE * 2] = {};
+
+	for (size_t i = 0; i < 2; i++) {
+		uint8_t *p = data + i * LibISDB::TS_PACKET_SIZE;
+		p[0] = 0x47;
+		p[1] = 0x41;
+		p[2] = 0x11;
+		p[3] = static_cast<uint8_t>(0x10 | i);
+	}
+
+	LibISDB::TSPacketView view(data);
+	CHECK(view.GetPID() == 0x0111_u16);
+	CHECK(view.GetPayloadUnitStartIndicator());
+	CHECK(view.HavePayload());
+	CHECK_FALSE(view.HaveAdaptationField());
+	CHECK(view.GetPayloadSize() == 184);
+	CHECK(view.GetPayloadData() == data + 4);
+
+	uint8_t counter[LibISDB::PID_MAX + 1];
+	std::fill(std::begin(counter), std::end(counter), 0x10_u8);
+	CHECK(view.ParsePacket(counter) == LibISDB::TSPacket::ParseResult::OK);
+	CHECK(LibISDB::TSPacketView(data).ParsePacket(counter) == LibISDB::TSPacket::ParseResult::ContinuityError);
+
+	data[1] |= 0x80;
+	CHECK(view.ParsePacket() == LibISDB::TSPacket::ParseResult::TransportError);
+	data[1] &= 0x7F;
+
+	LibISDB::TSPacketViewStream stream(data, 2);
+	CHECK(stream.Is<LibISDB::TSPacket>());
+	LibISDB::TSPacket *packet = stream.Get<LibISDB::TSPacket>();
+	const LibISDB::TSPacket *constPacket = packet;
+	CHECK(packet->IsReference());
+	CHECK(packet->GetData() == data);
+	CHECK(stream.Next());
+	LibISDB::TSPacket *packet2 = stream.Get<LibISDB::TSPacket>();
+	CHECK(packet2 != packet);
+	CHECK(packet2->GetData() == data + LibISDB::TS_PACKET_SIZE);
+	// 前の要素は Next() 後も同じデータを指している
+	CHECK(constPacket->GetData() == data);
+	CHECK_FALSE(stream.Next());
+	stream.Rewind();
+	CHECK(stream.Get<LibISDB::TSPacket>() == packet);
+
+	LibISDB::TSPacket copy(*packet2);
+	CHECK_FALSE(copy.IsReference());
+	CHECK(copy.GetData() != packet2->GetData());
+	CHECK(copy == *packet2);
+	CHECK(copy.GetPID() == 0x0111_u16);
+
+	// 書き換える場合は参照元を変更せずに複製する
+	packet2->SetPID(0x0222_u16);
+	CHECK_FALSE(packet2->IsReference());
+	CHECK(packet2->GetData() != data + LibISDB::TS_PACKET_SIZE);
+	CHECK(packet2->GetPID() == 0x0222_u16);
+	CHECK(LibISDB::TSPacketView(data + LibISDB::TS_PACKET_SIZE).GetPID() == 0x0111_u16);
+	CHECK(packet->IsReference());
+	CHECK(packet->SetData(data + LibISDB::TS_PACKET_SIZE, LibISDB::TS_PACKET_SIZE) == LibISDB::TS_PACKET_SIZE);
+	CHECK_FALSE(packet->IsReference());
+	CHECK(data[3] == 0x10);
+
+	// DataBuffer として書き換える場合は MakeWritable() で複製する
+	{
+		LibISDB::TSPacketViewStream stream2(data, 2);
+		LibISDB::DataBuffer *buffer = stream2.GetData();
+		CHECK_FALSE(buffer->IsWritable());
+		CHECK(buffer->GetData() == data);
+		CHECK(buffer->GetBuffer() == data);
+		buffer->SetAt(3, 0x1F);
+		CHECK(buffer->IsWritable());
+		CHECK(buffer->GetData() != data);
+		CHECK(data[3] == 0x10);
+		CHECK(stream2.Next());
+		buffer = stream2.GetData();
+		CHECK(buffer->MakeWritable());
+		CHECK(buffer->GetData() != data + LibISDB::TS_PACKET_SIZE);
+		buffer->GetData()[0] = 0x00;
+		CHECK(data[LibISDB::TS_PACKET_SIZE] == 0x47);
+		buffer->TrimHead(4);
+		CHECK(buffer->GetSize() == LibISDB::TS_PACKET_SIZE - 4);
+		CHECK(data[0] == 0x47);
+	}
+
+	// ParsePackets と ParsePacket の結果が一致すること
+	{
+		constexpr size_t count = 45;
+		std::vector<uint8_t> block(LibISDB::TS_PACKET_SIZE * count);
+		FillRandom(block);
+		for (size_t i = 0; i < count; i++) {
+			uint8_t *p = block.data() + i * LibISDB::TS_PACKET_SIZE;
+			if (i % 11 != 5)
+				p[0] = 0x47;
+			if (i % 3 != 0)
+				p[1] &= 0x7F;
+			p[2] = static_cast<uint8_t>(i % 4);
+		}
+
+		LibISDB::TSPacketHeaderBatch batch;
+		uint8_t counter1[LibISDB::PID_MAX + 1], counter2[LibISDB::PID_MAX + 1];
+		std::fill(std::begin(counter1), std::end(counter1), 0x10_u8);
+		std::fill(std::begin(counter2), std::end(counter2), 0x10_u8);
+
+		CHECK(LibISDB::TSPacket::ParsePackets(block.data(), count, &batch, counter1) == count);
+		CHECK(batch.PacketCount == count);
+
+		bool match = true;
+		for (size_t i = 0; i < count; i++) {
+			LibISDB::TSPacket packet;
+			packet.SetData(block.data() + i * LibISDB::TS_PACKET_SIZE, LibISDB::TS_PACKET_SIZE);
+			const LibISDB::TSPacket::ParseResult result = packet.ParsePacket(counter2);
+			const uint8_t *payload = packet.GetPayloadData();
+			LibISDB::TSPacket reference;
+			reference.SetReference(block.data() + i * LibISDB::TS_PACKET_SIZE, batch, i);
+			if ((batch.Result[i] != result)
+					|| (reference.GetPID() != packet.GetPID())
+					|| (reference.GetTransportErrorIndicator() != packet.GetTransportErrorIndicator())
+					|| (reference.GetTransportScramblingControl() != packet.GetTransportScramblingControl())
+					|| (reference.HaveAdaptationField() != packet.HaveAdaptationField())
+					|| (reference.HavePayload() != packet.HavePayload())
+					|| (reference.GetDiscontinuityIndicator() != packet.GetDiscontinuityIndicator())
+					|| (reference.GetRandomAccessIndicator() != packet.GetRandomAccessIndicator())
+					|| (reference.GetOptionSize() != packet.GetOptionSize())
+					|| (reference.GetPayloadSize() != packet.GetPayloadSize())
+					|| (batch.PID[i] != packet.GetPID())
+					|| (((batch.Flags[i] & LibISDB::TSPacketHeaderBatch::HeaderFlag::Scrambled) != 0) != packet.IsScrambled())
+					|| (((batch.Flags[i] & LibISDB::TSPacketHeaderBatch::HeaderFlag::PayloadUnitStartIndicator) != 0) != packet.GetPayloadUnitStartIndicator())
+					|| (!(batch.Flags[i] & (LibISDB::TSPacketHeaderBatch::HeaderFlag::SyncError | LibISDB::TSPacketHeaderBatch::HeaderFlag::FormatError))
+						&& (batch.PayloadOffset[i] != (payload != nullptr ? payload - packet.GetData() : 0))))
+				match = false;
+		}
+		CHECK(match);
+		CHECK(std::equal(std::begin(counter1), std::end(counter1), std::begin(counter2)));
+	}
+}
+
+
+#include "../LibISDB/TS/Tables.hpp"
+#include "../LibISDB/Base/FileStream.hpp"
+#include <cstdlib>
+
+namespace
+{
+
+	// EIT のセクションを 1 パケットに 1 つずつ格納した TS を生成する
+	std::vector<uint8_t> MakeEITPackets(int serviceCount, int sectionCount, uint8_t version)
+	{
+		std::vector<uint8_t> data(static_cast<size_t>(serviceCount) * sectionCount * LibISDB::TS_PACKET_SIZE, 0xFF_u8);
+		uint8_t *p = data.data();
+		uint8_t counter = 0;
+
+		for (int section = 0; section < sectionCount; section++) {
+			for (int service = 0; service < serviceCount; service++) {
+				p[0] = 0x47;
+				p[1] = 0x40;
+				p[2] = 0x12;
+				p[3] = 0x10 | counter;
+				counter = (counter + 1) & 0x0F;
+				p[4] = 0x00;
+
+				uint8_t *s = p + 5;
+				s[0] = 0x50;
+				s[1] = 0xF0;
+				s[2] = 15;
+				s[3] = static_cast<uint8_t>(service >> 8);
+				s[4] = static_cast<uint8_t>(service & 0xFF);
+				s[5] = static_cast<uint8_t>(0xC1 | (version << 1));
+				s[6] = static_cast<uint8_t>(section);
+				s[7] = static_cast<uint8_t>(sectionCount - 1);
+				s[8] = 0x00; // transport_stream_id
+				s[9] = 0x01;
+				s[10] = 0x00; // original_network_id
+				s[11] = 0x04;
+				s[12] = static_cast<uint8_t>(sectionCount - 1);
+				s[13] = 0x50;
+				const uint32_t crc = LibISDB::CRC32MPEG2::Calc(s, 14);
+				s[14] = static_cast<uint8_t>(crc >> 24);
+				s[15] = static_cast<uint8_t>(crc >> 16);
+				s[16] = static_cast<uint8_t>(crc >> 8);
+				s[17] = static_cast<uint8_t>(crc);
+
+				p += LibISDB::TS_PACKET_SIZE;
+			}
+		}
+
+		return data;
+	}
+
+	// TS ファイルから指定 PID のパケットを抽出する
+	std::vector<uint8_t> LoadPIDPackets(const LibISDB::CStringView &fileName, uint16_t pid)
+	{
+		std::vector<uint8_t> data;
+		LibISDB::FileStream file;
+
+		if (file.Open(fileName, LibISDB::FileStream::OpenFlag::Read)) {
+			uint8_t packet[LibISDB::TS_PACKET_SIZE];
+			while (file.Read(packet, sizeof(packet)) == sizeof(packet)) {
+				if ((packet[0] == 0x47) && (LibISDB::TSPacketView(packet).GetPID() == pid))
+					data.insert(data.end(), std::begin(packet), std::end(packet));
+			}
+		}
+
+		return data;
+	}
+
+	size_t StorePackets(LibISDB::PSITableBase &table, std::vector<uint8_t> &data)
+	{
+		const size_t packetCount = data.size() / LibISDB::TS_PACKET_SIZE;
+		LibISDB::TSPacketViewStream stream(data.data(), packetCount);
+
+		do {
+			table.StorePacket(stream.Get<LibISDB::TSPacket>());
+		} while (stream.Next());
+
+		return packetCount;
+	}
+
+	class SectionCountingEITMultiTable
+		: public LibISDB::EITMultiTable
+	{
+	public:
+		size_t SectionCount = 0;
+
+	protected:
+		bool OnPSISection(const LibISDB::PSISectionParser *pSectionParser, const LibISDB::PSISection *pSection) override
+		{
+			SectionCount++;
+			return EITMultiTable::OnPSISection(pSectionParser, pSection);
+		}
+	};
+
+}
+
+TEST_CASE("EITMultiTable", "[ts][table]")
+{
+	constexpr int serviceCount = 300, sectionCount = 2;
+	LibISDB::EITMultiTable table;
+	std::vector<uint8_t> data = MakeEITPackets(serviceCount, sectionCount, 0);
+
+	StorePackets(table, data);
+	CHECK(table.GetCRCErrorCount() == 0);
+	REQUIRE(table.GetTableCount() == serviceCount);
+
+	bool match = true;
+	for (int i = 0; i < serviceCount; i++) {
+		const unsigned long long id = LibISDB::EITMultiTable::MakeTableUniqueID(0x0004, 0x0001, static_cast<uint16_t>(i));
+		const int index = table.GetTableIndexByUniqueID(id);
+		unsigned long long uniqueID;
+		if ((index < 0)
+				|| !table.GetTableUniqueID(index, &uniqueID) || (uniqueID != id)
+				|| (table.GetTableIndexByTableIDs(0x50, id) != index)
+				|| (table.GetServiceID(index) != i)
+				|| !table.IsEITSectionComplete(0x0004, 0x0001, static_cast<uint16_t>(i)))
+			match = false;
+	}
+	CHECK(match);
+	CHECK(table.GetTableIndexByUniqueID(LibISDB::EITMultiTable::MakeTableUniqueID(0x0004, 0x0002, 0)) < 0);
+	CHECK(table.GetTableIndexByTableIDs(0x4E, LibISDB::EITMultiTable::MakeTableUniqueID(0x0004, 0x0001, 0)) < 0);
+
+	// 同じセクションは CRC チェック後に破棄される
+	CHECK(table.GetDuplicateSectionCount() == 0);
+	StorePackets(table, data);
+	CHECK(table.GetDuplicateSectionCount() == serviceCount * sectionCount);
+	CHECK(table.GetTableCount() == serviceCount);
+
+	// CRC の部分が同じでも内容が壊れたセクションは CRC エラーとして数える
+	{
+		std::vector<uint8_t> damaged(data.begin(), data.begin() + LibISDB::TS_PACKET_SIZE);
+		damaged[5 + 13] ^= 0x01;
+		StorePackets(table, damaged);
+		CHECK(table.GetCRCErrorCount() == 1);
+		CHECK(table.GetDuplicateSectionCount() == serviceCount * sectionCount);
+	}
+
+	// EIT 以外のテーブルではデフォルトで重複したセクションも通知する
+	{
+		LibISDB::PSIStreamTable streamTable;
+		size_t notifiedCount = 0;
+		streamTable.SetSectionHandler(
+			[&](const LibISDB::PSITableBase *, const LibISDB::PSISection *) { notifiedCount++; });
+		StorePackets(streamTable, data);
+		StorePackets(streamTable, data);
+		CHECK(streamTable.GetDuplicateSectionCount() == 0);
+		CHECK(notifiedCount == static_cast<size_t>(serviceCount * sectionCount * 2));
+	}
+
+	// テーブルをリセットした場合は再度受け取る
+	REQUIRE(table.ResetTable(table.GetTableIndexByUniqueID(LibISDB::EITMultiTable::MakeTableUniqueID(0x0004, 0x0001, 5))));
+	CHECK_FALSE(table.IsEITSectionComplete(0x0004, 0x0001, 5));
+	StorePackets(table, data);
+	CHECK(table.IsEITSectionComplete(0x0004, 0x0001, 5));
+
+	// バージョン更新ではテーブルは増えない
+	const unsigned long long duplicateCount = table.GetDuplicateSectionCount();
+	data = MakeEITPackets(serviceCount, sectionCount, 1);
+	StorePackets(table, data);
+	CHECK(table.GetTableCount() == serviceCount);
+	CHECK(table.GetDuplicateSectionCount() == duplicateCount);
+
+	table.Reset();
+	CHECK(table.GetTableCount() == 0);
+	CHECK(table.GetDuplicateSectionCount() == 0);
+
+	// テーブルセット内のテーブルがリセットされた場合も再度受け取る
+	LibISDB::EITPfScheduleTable scheduleTable;
+	StorePackets(scheduleTable, data);
+	StorePackets(scheduleTable, data);
+	CHECK(scheduleTable.GetDuplicateSectionCount() == serviceCount * sectionCount);
+	const LibISDB::EITMultiTable *pMultiTable = dynamic_cast<const LibISDB::EITMultiTable *>(scheduleTable.GetTableByID(0x50));
+	REQUIRE(pMultiTable != nullptr);
+	CHECK(pMultiTable->IsEITSectionComplete(0x0004, 0x0001, 5));
+	CHECK(scheduleTable.ResetScheduleService(0x0004, 0x0001, 5));
+	CHECK_FALSE(pMultiTable->IsEITSectionComplete(0x0004, 0x0001, 5));
+	StorePackets(scheduleTable, data);
+	CHECK(pMultiTable->IsEITSectionComplete(0x0004, 0x0001, 5));
+	CHECK(table.GetTableIndexByUniqueID(LibISDB::EITMultiTable::MakeTableUniqueID(0x0004, 0x0001, 0)) < 0);
+
+	// セクション数が多くても重複の判定は破棄されない
+	{
+		constexpr int manyServiceCount = 300, manySectionCount = 230;
+		LibISDB::EITMultiTable manyTable;
+		std::vector<uint8_t> manyData = MakeEITPackets(manyServiceCount, manySectionCount, 0);
+		StorePackets(manyTable, manyData);
+		StorePackets(manyTable, manyData);
+		CHECK(manyTable.GetDuplicateSectionCount() == manyServiceCount * manySectionCount);
+	}
+}
+
+TEST_CASE("EITMultiTableBenchmark", "[.benchmark][ts][table]")
+{
+	// LIBISDB_TEST_EIT_TS で TS ファイルが指定された場合はその EIT の PID を再生する
+	const char *fileName = std::getenv("LIBISDB_TEST_EIT_TS");
+	std::vector<uint8_t> data =
+		(fileName != nullptr) ? LoadPIDPackets(fileName, 0x0012) : MakeEITPackets(800, 8, 0);
+	REQUIRE(!data.empty());
+
+	constexpr int repeat = 20;
+	SectionCountingEITMultiTable table;
+
+	StorePackets(table, data);
+	table.SectionCount = 0;
+	const unsigned long long duplicateCount = table.GetDuplicateSectionCount();
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++)
+		StorePackets(table, data);
+	const auto time = std::chrono::steady_clock::now() - start;
+
+	const unsigned long long skipped = table.GetDuplicateSectionCount() - duplicateCount;
+	const unsigned long long sections = table.SectionCount + skipped;
+	std::printf("EITMultiTable: %d tables, %llu / %llu duplicate sections skipped\n",
+		table.GetTableCount(), skipped, sections);
+	ReportThroughput("EIT replay", static_cast<double>(sections), "sections", time);
+	CHECK(sections > 0);
+}
+
+
+#include "../LibISDB/TS/Descriptors.hpp"
+#include <thread>
+
+TEST_CASE("DescriptorPool", "[ts][descriptor]")
+{
+	const uint8_t data1[] = {
+		0x4D, 0x0B, 'j', 'p', 'n', 0x03, 'a', 'b', 'c', 0x03, 'd', 'e', 'f',	// short_event_descriptor
+		0x54, 0x02, 0x12, 0x34,	// content_descriptor
+		0xF0, 0x01, 0x00,	// 未知の記述子
+	};
+	const uint8_t data2[] = {
+		0x54, 0x04, 0x56, 0x78, 0x9A, 0xBC,
+		0x4D, 0x07, 'j', 'p', 'n', 0x02, 'x', 'y', 0x00,
+	};
+
+	LibISDB::DescriptorPool pool;
+	LibISDB::DescriptorBlock block;
+	block.SetDescriptorPool(&pool);
+
+	REQUIRE(block.ParseBlock(data1, sizeof(data1)) == 3);
+	CHECK(pool.GetPooledCount() == 0);
+	const LibISDB::DescriptorBase *pShortEvent = block.GetDescriptorByTag(LibISDB::ShortEventDescriptor::TAG);
+	const LibISDB::DescriptorBase *pContent = block.GetDescriptorByTag(LibISDB::ContentDescriptor::TAG);
+
+	// コピーはプールを共有しない
+	LibISDB::DescriptorBlock copy(block);
+	CHECK(copy.GetDescriptorPool() == nullptr);
+
+	// 再解析時には同じタグの記述子が再利用される
+	REQUIRE(block.ParseBlock(data2, sizeof(data2)) == 2);
+	CHECK(pool.GetReusedCount() == 2);
+	CHECK(pool.GetPooledCount() == 1);
+	CHECK(block.GetDescriptorByTag(LibISDB::ShortEventDescriptor::TAG) == pShortEvent);
+	CHECK(block.GetDescriptorByTag(LibISDB::ContentDescriptor::TAG) == pContent);
+
+	const LibISDB::ShortEventDescriptor *pShortEventDesc = block.GetDescriptor<LibISDB::ShortEventDescriptor>();
+	REQUIRE(pShortEventDesc != nullptr);
+	LibISDB::ARIBString name, text;
+	CHECK(pShortEventDesc->GetEventName(&name));
+	CHECK(name == LibISDB::ARIBString(reinterpret_cast<const uint8_t *>("xy"), 2));
+	CHECK_FALSE(pShortEventDesc->GetEventDescription(&text));
+	const LibISDB::ContentDescriptor *pContentDesc = block.GetDescriptor<LibISDB::ContentDescriptor>();
+	REQUIRE(pContentDesc != nullptr);
+	CHECK(pContentDesc->GetNibbleCount() == 2);
+
+	// 以前の内容はコピー側に残っている
+	const LibISDB::ShortEventDescriptor *pCopyShortEvent = copy.GetDescriptor<LibISDB::ShortEventDescriptor>();
+	REQUIRE(pCopyShortEvent != nullptr);
+	CHECK(pCopyShortEvent->GetEventName(&name));
+	CHECK(name == LibISDB::ARIBString(reinterpret_cast<const uint8_t *>("abc"), 3));
+
+	// 解析に失敗した記述子もプールに戻される
+	const uint8_t broken[] = {0x54, 0x00, 0x4D, 0x10};
+	CHECK(block.ParseBlock(broken, sizeof(broken)) == 0);
+	CHECK(pool.GetPooledCount() == 3);
+
+	REQUIRE(block.ParseBlock(data1, sizeof(data1)) == 3);
+	CHECK(pool.GetPooledCount() == 0);
+	block.Reset();
+	CHECK(pool.GetPooledCount() == 3);
+	pool.Clear();
+	CHECK(pool.GetPooledCount() == 0);
+
+	// ムーブでもプールは引き継がれない
+	LibISDB::DescriptorPool pool2;
+	LibISDB::DescriptorBlock assigned;
+	assigned.SetDescriptorPool(&pool2);
+	REQUIRE(block.ParseBlock(data1, sizeof(data1)) == 3);
+	LibISDB::DescriptorBlock moved(std::move(block));
+	CHECK(moved.GetDescriptorPool() == nullptr);
+	CHECK(moved.GetDescriptorCount() == 3);
+	assigned = std::move(moved);
+	CHECK(assigned.GetDescriptorPool() == &pool2);
+	CHECK(assigned.GetDescriptorCount() == 3);
+	assigned.Reset();
+	CHECK(pool.GetPooledCount() == 0);
+	CHECK(pool2.GetPooledCount() == 3);
+}
+
+
+TEST_CASE("DescriptorBlockLazyDecode", "[ts][descriptor]")
+{
+	const uint8_t data[] = {
+		0x4D, 0x0B, 'j', 'p', 'n', 0x03, 'a', 'b', 'c', 0x03, 'd', 'e', 'f',	// short_event_descriptor
+		0x54, 0x02, 0x12, 0x34,	// content_descriptor
+		0x4D, 0x02, 'j', 'p',	// 不正な short_event_descriptor
+		0x54, 0x02, 0x56, 0x78,
+		0x00, 0x00,	// 長さ 0
+		0x54, 0x02, 0x9A, 0xBC,
+	};
+
+	LibISDB::DescriptorBlock eager;
+	CHECK(eager.ParseBlock(data, sizeof(data)) == 2);
+
+	LibISDB::DescriptorPool pool;
+	LibISDB::DescriptorBlock block;
+	block.SetDescriptorPool(&pool);
+	block.SetLazyDecode(true);
+	REQUIRE(block.ParseBlock(data, sizeof(data)) == 4);
+	CHECK(block.GetDecodedDescriptorCount() == 0);
+
+	// 取得した記述子までが解析される
+	const LibISDB::ContentDescriptor *pContent = block.GetDescriptor<LibISDB::ContentDescriptor>();
+	REQUIRE(pContent != nullptr);
+	CHECK(block.GetDecodedDescriptorCount() == 2);
+	LibISDB::ContentDescriptor::NibbleInfo nibble, eagerNibble;
+	CHECK(pContent->GetNibble(0, &nibble));
+	CHECK(eager.GetDescriptor<LibISDB::ContentDescriptor>()->GetNibble(0, &eagerNibble));
+	CHECK(nibble == eagerNibble);
+
+	// コピーでは未解析の記述子は未解析のまま
+	LibISDB::DescriptorBlock copy(block);
+	CHECK(copy.IsLazyDecode());
+	CHECK(copy.GetDescriptorPool() == nullptr);
+	CHECK(copy.GetDecodedDescriptorCount() == 2);
+
+	const LibISDB::ShortEventDescriptor *pShortEvent = copy.GetDescriptor<LibISDB::ShortEventDescriptor>();
+	REQUIRE(pShortEvent != nullptr);
+	LibISDB::ARIBString name;
+	CHECK(pShortEvent->GetEventName(&name));
+	CHECK(name == LibISDB::ARIBString(reinterpret_cast<const uint8_t *>("abc"), 3));
+	CHECK(block.GetDecodedDescriptorCount() == 2);
+
+	// 通常の解析と同様に、解析に失敗した記述子以降は取得できない
+	CHECK(block.GetDescriptorCount() == eager.GetDescriptorCount());
+	CHECK(block.GetDescriptorByIndex(2) == nullptr);
+	CHECK(block.GetDescriptorByIndex(3) == nullptr);
+	CHECK(block.GetDecodedDescriptorCount() == 2);
+	int shortEventCount = 0, contentCount = 0;
+	block.EnumDescriptors<LibISDB::ShortEventDescriptor>([&](const LibISDB::ShortEventDescriptor *) { shortEventCount++; });
+	block.EnumDescriptors<LibISDB::ContentDescriptor>([&](const LibISDB::ContentDescriptor *) { contentCount++; });
+	CHECK(shortEventCount == 1);
+	CHECK(contentCount == 1);
+
+	// 遅延デコードの記述子も解析に失敗したものを含めてプールに戻され、再利用される
+	LibISDB::DescriptorBlock moved(std::move(copy));
+	CHECK(moved.GetDecodedDescriptorCount() == 2);
+	CHECK(moved.GetDescriptorCount() == 2);
+	block.Reset();
+	CHECK(block.GetDescriptorCount() == 0);
+	CHECK(pool.GetPooledCount() == 3);
+	REQUIRE(block.ParseBlock(data, 17) == 2);
+	CHECK(block.GetDescriptor<LibISDB::ShortEventDescriptor>() != nullptr);
+	CHECK(pool.GetReusedCount() == 1);
+	CHECK(pool.GetPooledCount() == 2);
+	CHECK(block.ParseBlock(data, 1) == 0);
+	CHECK(pool.GetPooledCount() == 3);
+
+	// 複数のスレッドから同時に参照しても同じ記述子が返される
+	REQUIRE(block.ParseBlock(data, sizeof(data)) == 4);
+	const LibISDB::DescriptorBlock &constBlock = block;
+	std::vector<std::thread> threads;
+	std::vector<const LibISDB::DescriptorBase *> found(4, nullptr);
+	for (size_t i = 0; i < found.size(); i++) {
+		threads.emplace_back(
+			[&constBlock, &found, i]() {
+				for (int j = constBlock.GetDescriptorCount() - 1; j >= 0; j--) {
+					const LibISDB::DescriptorBase *pDesc = constBlock.GetDescriptorByIndex(j);
+					if (j == 1)
+						found[i] = pDesc;
+				}
+			});
+	}
+	for (auto &e : threads)
+		e.join();
+	CHECK(found[0] != nullptr);
+	CHECK(std::all_of(found.begin(), found.end(), [&](const LibISDB::DescriptorBase *p) { return p == found[0]; }));
+	CHECK(block.GetDecodedDescriptorCount() == 2);
+}
+
+
+TEST_CASE("DescriptorBlockMalformed", "[ts][descriptor]")
+{
+	// 不正な記述子を含むブロックで、遅延デコードでも通常の解析と同じ記述子が取得できること
+	const std::vector<std::vector<uint8_t>> blocks = {
+		// 不正な component_descriptor の後に正常な component_descriptor
+		{0x50, 0x02, 0x01, 0x01, 0x50, 0x06, 0xF1, 0xB3, 0x00, 'j', 'p', 'n', 0x54, 0x02, 0x12, 0x34},
+		// 先頭が不正な short_event_descriptor
+		{0x4D, 0x02, 'j', 'p', 0x54, 0x02, 0x12, 0x34},
+		// 長さ 0 の記述子
+		{0x54, 0x02, 0x12, 0x34, 0x50, 0x00, 0x54, 0x02, 0x56, 0x78},
+		// 途中で切れた記述子
+		{0x54, 0x02, 0x12, 0x34, 0x54, 0x05, 0x56},
+		// 正常な記述子のみ
+		{0x54, 0x02, 0x12, 0x34, 0x50, 0x06, 0xF1, 0xB3, 0x00, 'j', 'p', 'n'},
+	};
+	const uint8_t tags[] = {
+		LibISDB::ShortEventDescriptor::TAG,
+		LibISDB::ComponentDescriptor::TAG,
+		LibISDB::ContentDescriptor::TAG,
+	};
+
+	for (size_t i = 0; i < blocks.size(); i++) {
+		CAPTURE(i);
+		const std::vector<uint8_t> &data = blocks[i];
+
+		LibISDB::DescriptorBlock eager;
+		eager.ParseBlock(data.data(), data.size());
+
+		// タグによる取得を先に行い、インデックスによる取得と順序に依らないことを確認する
+		for (const bool byTagFirst : {true, false}) {
+			LibISDB::DescriptorBlock lazy;
+			lazy.SetLazyDecode(true);
+			lazy.ParseBlock(data.data(), data.size());
+
+			if (byTagFirst) {
+				for (uint8_t tag : tags)
+					CHECK((lazy.GetDescriptorByTag(tag) != nullptr) == (eager.GetDescriptorByTag(tag) != nullptr));
+			}
+
+			REQUIRE(lazy.GetDescriptorCount() == eager.GetDescriptorCount());
+			for (int j = 0; j < lazy.GetDescriptorCount(); j++) {
+				const LibISDB::DescriptorBase *pLazy = lazy.GetDescriptorByIndex(j);
+				REQUIRE(pLazy != nullptr);
+				CHECK(pLazy->IsValid());
+				CHECK(pLazy->GetTag() == eager.GetDescriptorByIndex(j)->GetTag());
+			}
+			CHECK(lazy.GetDescriptorByIndex(lazy.GetDescriptorCount()) == nullptr);
+
+			for (uint8_t tag : tags)
+				CHECK((lazy.GetDescriptorByTag(tag) != nullptr) == (eager.GetDescriptorByTag(tag) != nullptr));
+		}
+	}
+}
+
+TEST_CASE("TableDescriptorPool", "[ts][table][descriptor]")
+{
+	struct PoolEITMultiTable : public LibISDB::EITMultiTable { using EITMultiTable::m_DescriptorPool; };
+	struct PoolSDTOtherTable : public LibISDB::SDTOtherTable { using SDTOtherTable::m_DescriptorPool; };
+
+	uint8_t counter = 0;
+	auto makePacket = [&counter](uint16_t pid, std::vector<uint8_t> section) {
+		const size_t length = section.size() - 3 + 4;
+		section[1] = static_cast<uint8_t>(0xF0 | (length >> 8));
+		section[2] = static_cast<uint8_t>(length & 0xFF);
+		const uint32_t crc = LibISDB::CRC32MPEG2::Calc(section.data(), section.size());
+		for (int i = 3; i >= 0; i--)
+			section.push_back(static_cast<uint8_t>(crc >> (i * 8)));
+
+		std::vector<uint8_t> packet(LibISDB::TS_PACKET_SIZE, 0xFF_u8);
+		packet[0] = 0x47;
+		packet[1] = static_cast<uint8_t>(0x40 | (pid >> 8));
+		packet[2] = static_cast<uint8_t>(pid & 0xFF);
+		packet[3] = static_cast<uint8_t>(0x10 | counter);
+		packet[4] = 0x00;
+		counter = (counter + 1) & 0x0F;
+		std::copy(section.begin(), section.end(), packet.begin() + 5);
+		return packet;
+	};
+
+	// セクションのテーブルを削除しても、記述子はテーブル間で共有するプールから再利用される
+	{
+		std::vector<uint8_t> section = {
+			0x50, 0x00, 0x00, 0x00, 0x01, 0xC1, 0x00, 0x00,
+			0x00, 0x01, 0x00, 0x04, 0x00, 0x50,
+		};
+		for (uint8_t eventID = 1; eventID <= 2; eventID++) {
+			const uint8_t event[] = {
+				0x00, eventID, 0xE4, 0x00, 0x12, 0x00, 0x00, 0x00, 0x30, 0x00, 0x80, 0x0D,
+				0x4D, 0x07, 'j', 'p', 'n', 0x02, 'a', 'b', 0x00,	// short_event_descriptor
+				0x54, 0x02, 0x12, 0x34,	// content_descriptor
+			};
+			section.insert(section.end(), std::begin(event), std::end(event));
+		}
+		std::vector<uint8_t> data = makePacket(0x0012, section);
+
+		PoolEITMultiTable table;
+		StorePackets(table, data);
+		REQUIRE(table.GetTableCount() == 1);
+		const LibISDB::EITTable *pEIT = table.GetEITTableByServiceID(0x0001, 0);
+		REQUIRE(pEIT != nullptr);
+		REQUIRE(pEIT->GetEventCount() == 2);
+		CHECK(pEIT->GetItemDescriptorBlock(1)->GetDescriptor<LibISDB::ShortEventDescriptor>() != nullptr);
+		CHECK(table.m_DescriptorPool->GetPooledCount() == 0);
+
+		REQUIRE(table.ResetTable(0));
+		CHECK(table.m_DescriptorPool->GetPooledCount() == 4);
+		data = makePacket(0x0012, section);
+		StorePackets(table, data);
+		pEIT = table.GetEITTableByServiceID(0x0001, 0);
+		REQUIRE(pEIT != nullptr);
+		CHECK(pEIT->GetItemDescriptorBlock(0)->GetDescriptor<LibISDB::ContentDescriptor>() != nullptr);
+		CHECK(table.m_DescriptorPool->GetReusedCount() == 4);
+		CHECK(table.m_DescriptorPool->GetPooledCount() == 0);
+	}
+
+	{
+		const std::vector<uint8_t> section = {
+			0x46, 0x00, 0x00, 0x00, 0x02, 0xC1, 0x00, 0x00,
+			0x00, 0x04, 0xFF,
+			0x00, 0x10, 0xFD, 0x80, 0x07,
+			0x48, 0x05, 0x01, 0x01, 'a', 0x01, 'b',	// service_descriptor
+			0x00, 0x11, 0xFD, 0x80, 0x07,
+			0x48, 0x05, 0x01, 0x01, 'c', 0x01, 'd',
+		};
+		std::vector<uint8_t> data = makePacket(0x0011, section);
+
+		PoolSDTOtherTable table;
+		StorePackets(table, data);
+		REQUIRE(table.GetTableCount() == 1);
+		const LibISDB::SDTTable *pSDT = dynamic_cast<const LibISDB::SDTTable *>(table.GetSection(0, 0));
+		REQUIRE(pSDT != nullptr);
+		REQUIRE(pSDT->GetServiceCount() == 2);
+		CHECK(pSDT->GetItemDescriptorBlock(1)->GetDescriptor<LibISDB::ServiceDescriptor>() != nullptr);
+
+		REQUIRE(table.ResetTable(0));
+		CHECK(table.m_DescriptorPool->GetPooledCount() == 2);
+		data = makePacket(0x0011, section);
+		StorePackets(table, data);
+		pSDT = dynamic_cast<const LibISDB::SDTTable *>(table.GetSection(0, 0));
+		REQUIRE(pSDT != nullptr);
+		CHECK(pSDT->GetServiceCount() == 2);
+		CHECK(table.m_DescriptorPool->GetReusedCount() == 2);
+		CHECK(table.m_DescriptorPool->GetPooledCount() == 0);
+	}
+}
+
+TEST_CASE("DescriptorBlockBenchmark", "[.benchmark][ts][descriptor]")
+{
+	// EIT の番組ループの記述子を模したデータ
+	std::vector<uint8_t> data;
+	auto addDescriptor = [&data](uint8_t tag, size_t length) {
+		data.push_back(tag);
+		data.push_back(static_cast<uint8_t>(length));
+		for (size_t i = 0; i < length; i++)
+			data.push_back(static_cast<uint8_t>(i < 3 ? 'j' : 0x21 + (i % 0x5E)));
+	};
+	{
+		const uint8_t shortEvent[] = {0x4D, 0x0F, 'j', 'p', 'n', 0x05, 0x21, 0x22, 0x23, 0x24, 0x25, 0x05, 0x26, 0x27, 0x28, 0x29, 0x2A};
+		data.insert(data.end(), std::begin(shortEvent), std::end(shortEvent));
+		const uint8_t component[] = {0x50, 0x06, 0xF1, 0xB3, 0x00, 'j', 'p', 'n'};
+		data.insert(data.end(), std::begin(component), std::end(component));
+		const uint8_t audio[] = {0xC4, 0x09, 0xF2, 0x03, 0x10, 0xFF, 0x01, 0x2F, 'j', 'p', 'n'};
+		data.insert(data.end(), std::begin(audio), std::end(audio));
+		const uint8_t content[] = {0x54, 0x02, 0x12, 0x34};
+		data.insert(data.end(), std::begin(content), std::end(content));
+	}
+	addDescriptor(0xD6, 8);
+	addDescriptor(0xC1, 1);
+	addDescriptor(0x4E, 200);
+
+	constexpr int repeat = 200000;
+	LibISDB::DescriptorPool pool;
+
+	for (int lazy = 0; lazy < 2; lazy++) {
+		LibISDB::DescriptorBlock block;
+		block.SetDescriptorPool(&pool);
+		block.SetLazyDecode(lazy != 0);
+		size_t found = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < repeat; i++) {
+			block.ParseBlock(data.data(), data.size());
+			// 短形式イベントとコンテントのみを参照する
+			if (block.GetDescriptor<LibISDB::ShortEventDescriptor>() != nullptr)
+				found++;
+			if (block.GetDescriptor<LibISDB::ContentDescriptor>() != nullptr)
+				found++;
+		}
+		const auto time = std::chrono::steady_clock::now() - start;
+
+		ReportThroughput(lazy ? "DescriptorBlock lazy" : "DescriptorBlock eager", repeat, "blocks", time);
+		CHECK(found == repeat * 2);
+	}
+}
+
+
+#include "../LibISDB/MediaParsers/MPEGVideoParser.hpp"
+
+namespace
+{
+
+	// エミュレーション防止バイトを挿入したランダムな NAL ユニットからなる ES を生成する
+	std::vector<uint8_t> MakeVideoES(size_t nalCount, size_t nalSize, bool hevc)
+	{
+		std::vector<uint8_t> data;
+		std::uint32_t seed = 1;
+
+		data.reserve(nalCount * (nalSize + nalSize / 64 + 8));
+
+		for (size_t i = 0; i < nalCount; i++) {
+			if (i % 8 == 0) {
+				// アクセスユニットデリミタ
+				static const uint8_t aud264[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0};
+				static const uint8_t aud265[] = {0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50};
+				if (hevc)
+					data.insert(data.end(), std::begin(aud265), std::end(aud265));
+				else
+					data.insert(data.end(), std::begin(aud264), std::end(aud264));
+			} else {
+				data.push_back(0x00);
+				data.push_back(0x00);
+				data.push_back(0x01);
+				if (hevc) {
+					data.push_back(0x02);
+					data.push_back(0x01);
+				} else {
+					data.push_back(0x41);
+				}
+			}
+
+			int zeroCount = 0;
+			for (size_t j = 0; j < nalSize; j++) {
+				uint8_t e = NextRandom(seed);
+				if ((seed >> 27) == 0)
+					e = 0x00;
+				if ((zeroCount >= 2) && (e <= 0x03)) {
+					data.push_back(0x03);
+					zeroCount = 0;
+				}
+				data.push_back(e);
+				if (e == 0x00)
+					zeroCount++;
+				else
+					zeroCount = 0;
+			}
+			data.push_back(0x80);
+		}
+
+		return data;
+	}
+
+	class StartCodeTestParser
+		: public LibISDB::MPEGVideoParserBase
+	{
+	public:
+		StartCodeTestParser(uint32_t startCode, uint32_t startCodeMask, bool record)
+			: m_StartCode(startCode)
+			, m_StartCodeMask(startCodeMask)
+			, m_Record(record)
+		{
+		}
+
+		bool StoreES(const uint8_t *pData, size_t Size) override
+		{
+			return ParseSequence(pData, Size, m_StartCode, m_StartCodeMask, &m_Sequence);
+		}
+
+		std::vector<std::vector<uint8_t>> Sequences;
+		size_t SequenceCount = 0;
+
+	private:
+		void OnSequence(LibISDB::DataBuffer *pSequenceData) override
+		{
+			if (m_Record) {
+				Sequences.emplace_back(
+					pSequenceData->GetData(), pSequenceData->GetData() + pSequenceData->GetSize());
+			}
+			SequenceCount++;
+		}
+
+		const uint32_t m_StartCode;
+		const uint32_t m_StartCodeMask;
+		const bool m_Record;
+		LibISDB::DataBuffer m_Sequence;
+	};
+
+}
+
+TEST_CASE("MPEGVideoStartCode", "[mediaparser][video]")
+{
+	for (int hevc = 0; hevc < 2; hevc++) {
+		const uint32_t startCode = hevc ? 0x00000146_u32 : 0x00000109_u32;
+		const uint32_t startCodeMask = hevc ? 0xFFFFFFFE_u32 : 0xFFFFFF1F_u32;
+		std::vector<uint8_t> data = MakeVideoES(200, 300, hevc != 0);
+
+		// ゼロが連続する箇所と、末尾で途切れたスタートコード
+		const uint8_t zeros[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, hevc ? 0x46_u8 : 0x09_u8, 0x10};
+		data.insert(data.begin() + 1000, std::begin(zeros), std::end(zeros));
+		// 様々な位置に現れるスタートコード
+		for (size_t i = 0; i < 200; i++) {
+			data.insert(data.end(), {0x00, 0x00, 0x01, static_cast<uint8_t>(hevc ? 0x47 : 0x29)});
+			data.insert(data.end(), i % 37, static_cast<uint8_t>(0x80 | i));
+		}
+		data.push_back(0x00);
+		data.push_back(0x00);
+
+		// 1バイトずつ判定した場合のシーケンスの位置
+		std::vector<size_t> positions;
+		uint32_t syncState = 0xFFFFFFFF_u32;
+		for (size_t i = 0; i < data.size(); i++) {
+			syncState = (syncState << 8) | data[i];
+			if ((syncState & startCodeMask) == startCode)
+				positions.push_back(i - 3);
+		}
+		REQUIRE(positions.size() == 226);
+
+		// 様々な大きさに分割して入力する
+		for (size_t chunkSize : {size_t(1), size_t(3), size_t(17), size_t(31), size_t(184), size_t(4096), data.size()}) {
+			StartCodeTestParser parser(startCode, startCodeMask, true);
+			for (size_t pos = 0; pos < data.size(); pos += chunkSize)
+				parser.StoreES(&data[pos], std::min(chunkSize, data.size() - pos));
+
+			REQUIRE(parser.Sequences.size() == positions.size() - 1);
+			for (size_t i = 0; i < parser.Sequences.size(); i++) {
+				const std::vector<uint8_t> expected(data.begin() + positions[i], data.begin() + positions[i + 1]);
+				CHECK(parser.Sequences[i] == expected);
+			}
+		}
+	}
+}
+
+namespace
+{
+
+	// 1バイトずつ処理する EBSP から RBSP への変換
+	size_t ReferenceEBSPToRBSP(uint8_t *pData, size_t DataSize)
+	{
+		size_t convertedSize = 0;
+		int count = 0;
+
+		for (size_t i = 0; i < DataSize; i++) {
+			if (count == 2) {
+				if (pData[i] < 0x03)
+					return static_cast<size_t>(-1);
+				if (pData[i] == 0x03) {
+					if ((i < DataSize - 1) && (pData[i + 1] > 0x03))
+						return static_cast<size_t>(-1);
+					if (i == DataSize - 1)
+						break;
+					i++;
+					count = 0;
+				}
+			}
+			pData[convertedSize++] = pData[i];
+			if (pData[i] == 0x00)
+				count++;
+			else
+				count = 0;
+		}
+
+		return convertedSize;
+	}
+
+}
+
+TEST_CASE("EBSPToRBSP", "[mediaparser][video]")
+{
+	std::uint32_t seed = 1;
+	LibISDB::DataBuffer buffer;
+
+	for (int i = 0; i < 2000; i++) {
+		// ゼロと 03 が多く現れるデータ
+		std::vector<uint8_t> ebsp(1 + i % 97);
+		for (auto &e : ebsp) {
+			const uint8_t r = NextRandom(seed);
+			e = (r < 0x60) ? 0x00 : (r < 0x90) ? 0x03 : (r < 0x98) ? static_cast<uint8_t>(r & 0x03) : r;
+		}
+
+		std::vector<uint8_t> expected = ebsp;
+		const size_t expectedSize = ReferenceEBSPToRBSP(expected.data(), expected.size());
+		const bool valid = (expectedSize != static_cast<size_t>(-1));
+
+		std::vector<uint8_t> converted = ebsp;
+		const size_t convertedSize = LibISDB::EBSPToRBSP(converted.data(), converted.size());
+		REQUIRE(convertedSize == expectedSize);
+		if (valid)
+			CHECK(std::equal(converted.begin(), converted.begin() + convertedSize, expected.begin()));
+
+		CHECK(LibISDB::IsValidEBSP(ebsp.data(), ebsp.size()) == valid);
+
+		size_t rbspSize = 0;
+		const uint8_t *pRBSP = LibISDB::EBSPToRBSP(static_cast<const uint8_t *>(ebsp.data()), ebsp.size(), &rbspSize, &buffer);
+		REQUIRE((pRBSP != nullptr) == valid);
+		if (valid) {
+			CHECK(rbspSize == expectedSize);
+			CHECK(std::equal(pRBSP, pRBSP + rbspSize, expected.begin()));
+			// エミュレーション防止バイトがなければコピーされない
+			CHECK((pRBSP == ebsp.data()) == (rbspSize == ebsp.size()));
+		}
+	}
+
+	// エミュレーション防止バイトを取り除いて読み込む
+	const uint8_t sps[] = {0x64, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x01, 0xA0};
+	LibISDB::RBSPBitstreamReader reader(sps, sizeof(sps));
+	REQUIRE(reader.IsValid());
+	CHECK(reader.GetBits(8) == 0x64);
+	CHECK(reader.GetBits(32) == 0x00000000);
+	CHECK(reader.GetBits(8) == 0x01);
+	CHECK(reader.GetUE_V() == 0);
+	CHECK(reader.GetUE_V() == 1);
+	CHECK_FALSE(reader.IsOverrun());
+	CHECK(reader.GetPos() == 52);
+
+	const uint8_t invalid[] = {0x64, 0x00, 0x00, 0x02};
+	LibISDB::RBSPBitstreamReader invalidReader(invalid, sizeof(invalid));
+	CHECK_FALSE(invalidReader.IsValid());
+	CHECK(invalidReader.GetBits(1) == 0);
+	CHECK(invalidReader.IsOverrun());
+}
+
+TEST_CASE("EBSPToRBSPBenchmark", "[.benchmark][mediaparser][video]")
+{
+	// 大きな SEI を模した、エミュレーション防止バイトが時々現れるデータ
+	const std::vector<uint8_t> data = MakeVideoES(1, 1024 * 1024, false);
+	const std::vector<uint8_t> ebsp(data.begin() + 4, data.end());
+	constexpr int repeat = 200;
+	std::vector<uint8_t> work;
+	LibISDB::DataBuffer buffer;
+	size_t total = 0, expectedTotal = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		work = ebsp;
+		expectedTotal += ReferenceEBSPToRBSP(work.data(), work.size());
+	}
+	ReportThroughput("EBSPToRBSP (byte by byte)", double(ebsp.size()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		work = ebsp;
+		total += LibISDB::EBSPToRBSP(work.data(), work.size());
+	}
+	ReportThroughput("EBSPToRBSP (in place)", double(ebsp.size()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+	CHECK(total == expectedTotal);
+
+	total = 0;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		size_t rbspSize = 0;
+		LibISDB::EBSPToRBSP(static_cast<const uint8_t *>(ebsp.data()), ebsp.size(), &rbspSize, &buffer);
+		total += rbspSize;
+	}
+	ReportThroughput("EBSPToRBSP (buffer)", double(ebsp.size()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+	CHECK(total == expectedTotal);
+
+	size_t validCount = 0;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		if (LibISDB::IsValidEBSP(ebsp.data(), ebsp.size()))
+			validCount++;
+	}
+	ReportThroughput("IsValidEBSP", double(ebsp.size()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+	CHECK(validCount == repeat);
+}
+
+TEST_CASE("MPEGVideoStartCodeBenchmark", "[.benchmark][mediaparser][video]")
+{
+	constexpr size_t chunkSize = 64 * 1024;
+	constexpr int repeat = 10;
+
+	for (int hevc = 0; hevc < 2; hevc++) {
+		const std::vector<uint8_t> data = MakeVideoES(8 * 1024, 16 * 1024, hevc != 0);
+		StartCodeTestParser parser(
+			hevc ? 0x00000146_u32 : 0x00000109_u32,
+			hevc ? 0xFFFFFFFE_u32 : 0xFFFFFF1F_u32,
+			false);
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < repeat; i++) {
+			for (size_t pos = 0; pos < data.size(); pos += chunkSize)
+				parser.StoreES(&data[pos], std::min(chunkSize, data.size() - pos));
+		}
+		ReportThroughput(
+			hevc ? "ParseSequence (HEVC)" : "ParseSequence (H.264)",
+			double(data.size()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+		CHECK(parser.SequenceCount == 1024 * repeat - 1);
+	}
+}
+
+
+#include "../LibISDB/Base/StreamBuffer.hpp"
+
+TEST_CASE("StreamBuffer", "[base][buffer]")
+{
+	const LibISDB::StreamBuffer::BufferType type = GENERATE(
+		LibISDB::StreamBuffer::BufferType::Queue,
+		LibISDB::StreamBuffer::BufferType::LockFreeRing);
+
+	std::shared_ptr<LibISDB::StreamBuffer> buffer = std::make_shared<LibISDB::StreamBuffer>();
+	REQUIRE(buffer->Create(16, 4, 4, nullptr, type));
+	CHECK(buffer->GetBufferType() == type);
+	CHECK(buffer->IsEmpty());
+	CHECK(buffer->GetFreeSpace() == 64);
+
+	uint8_t data[100];
+	for (size_t i = 0; i < std::size(data); i++)
+		data[i] = static_cast<uint8_t>(i);
+
+	LibISDB::StreamBuffer::SequentialReader reader;
+	REQUIRE(reader.Open(buffer));
+	CHECK_FALSE(reader.IsDataAvailable());
+
+	// 未読のデータは上書きされない
+	CHECK(buffer->PushBack(data, 40) == 40);
+	CHECK(buffer->PushBack(data + 40, 40) == 24);
+	CHECK(buffer->IsFull());
+	CHECK(buffer->GetFreeSpace() == 0);
+	CHECK(reader.IsDataAvailable());
+
+	uint8_t read[100];
+	CHECK(reader.Read(read, 30) == 30);
+	CHECK(std::equal(read, read + 30, data));
+
+	// 読み込み済みの領域は再利用される
+	const size_t size = buffer->PushBack(data + 64, 36);
+	CHECK(size >= 16);
+	CHECK(size <= 30);
+	CHECK(reader.Read(read, std::size(read)) == 34 + size);
+	CHECK(std::equal(read, read + 34 + size, data + 30));
+	CHECK_FALSE(reader.IsDataAvailable());
+
+	CHECK(buffer->PushBack(data, 10) == 10);
+	CHECK(reader.SeekToEnd());
+	CHECK_FALSE(reader.IsDataAvailable());
+	CHECK(reader.Read(read, std::size(read)) == 0);
+
+	if (type == LibISDB::StreamBuffer::BufferType::LockFreeRing) {
+		LibISDB::StreamBuffer::SequentialReader reader2;
+		CHECK_FALSE(reader2.Open(buffer));
+	}
+
+	// 読み込みが無ければ古いデータを上書きする
+	reader.Close();
+	CHECK(buffer->PushBack(data, std::size(data)) == std::size(data));
+	REQUIRE(reader.Open(buffer));
+	const size_t last = reader.Read(read, std::size(read));
+	CHECK(last >= 48);
+	CHECK(last <= 64);
+	CHECK(std::equal(read, read + last, data + std::size(data) - last));
+}
+
+
+TEST_CASE("PooledMemoryDataStorage", "[base][buffer]")
+{
+	std::shared_ptr<LibISDB::PooledMemoryDataStorageManager> manager =
+		std::make_shared<LibISDB::PooledMemoryDataStorageManager>(2);
+	LibISDB::PooledMemoryDataStorageManager::PoolStatistics stats;
+
+	uint8_t data[256];
+	for (size_t i = 0; i < std::size(data); i++)
+		data[i] = static_cast<uint8_t>(i);
+
+	{
+		LibISDB::StreamBuffer buffer1, buffer2;
+		REQUIRE(buffer1.Create(64, 1, 4, manager));
+		REQUIRE(buffer2.Create(64, 1, 4, manager));
+		CHECK(buffer1.PushBack(data, 192) == 192);
+		CHECK(buffer2.PushBack(data, 64) == 64);
+
+		REQUIRE(manager->GetPoolStatistics(&stats));
+		CHECK(stats.HitCount == 0);
+		CHECK(stats.MissCount == 4);
+	}
+
+	REQUIRE(manager->GetPoolStatistics(&stats));
+	CHECK(stats.ReturnCount == 2);
+	CHECK(stats.DiscardCount == 2);
+	CHECK(stats.PooledBlockCount == 2);
+	CHECK(stats.PooledBytes == 128);
+
+	{
+		std::unique_ptr<LibISDB::DataStorage> storage(manager->CreateDataStorage());
+		REQUIRE(storage->Allocate(64));
+		CHECK(storage->Write(data, 100) == 64);
+		CHECK(storage->SetPos(0));
+		uint8_t read[64];
+		CHECK(storage->Read(read, 64) == 64);
+		CHECK(std::equal(read, read + 64, data));
+	}
+
+	REQUIRE(manager->GetPoolStatistics(&stats));
+	CHECK(stats.HitCount == 1);
+	CHECK(stats.PooledBlockCount == 2);
+
+	CHECK_FALSE(manager->Reserve(32, 4));
+	REQUIRE(manager->GetPoolStatistics(&stats));
+	CHECK(stats.PooledBlockCount == 2);
+	manager->SetMaxPoolBlockCount(4);
+	CHECK(manager->Reserve(32, 2));
+	REQUIRE(manager->GetPoolStatistics(&stats));
+	CHECK(stats.PooledBlockCount == 4);
+	manager->Trim();
+	REQUIRE(manager->GetPoolStatistics(&stats));
+	CHECK(stats.PooledBlockCount == 0);
+	CHECK(stats.PooledBytes == 0);
+}
+
+
+#include "../LibISDB/Base/MMapDataStorage.hpp"
+
+TEST_CASE("MMapDataStorage", "[base][buffer]")
+{
+	const LibISDB::String fileName = LIBISDB_STR("libisdbtest_mmap.tmp");
+
+	LibISDB::MMapDataStorageManager manager;
+	REQUIRE(manager.Create(fileName, 1000, 3));
+	CHECK(manager.GetFreeBlockCount() == 3);
+
+	std::unique_ptr<LibISDB::DataStorage> storage1(manager.CreateDataStorage());
+	std::unique_ptr<LibISDB::DataStorage> storage2(manager.CreateDataStorage());
+	REQUIRE(storage1->Allocate(1000));
+	REQUIRE(storage2->Allocate(1000));
+	CHECK(manager.GetFreeBlockCount() == 1);
+	CHECK(storage1->GetCapacity() == 1000);
+
+	uint8_t data[1200];
+	for (size_t i = 0; i < std::size(data); i++)
+		data[i] = static_cast<uint8_t>(i * 7);
+
+	CHECK(storage1->Write(data, 600) == 600);
+	CHECK(storage1->Write(data + 600, 600) == 400);
+	CHECK(storage1->IsEnd());
+	CHECK(storage2->Write(data + 200, 100) == 100);
+
+	uint8_t read[1000];
+	CHECK(storage1->SetPos(0));
+	CHECK(storage1->Read(read, std::size(read)) == 1000);
+	CHECK(std::equal(read, read + 1000, data));
+	CHECK(storage2->SetPos(0));
+	CHECK(storage2->Read(read, std::size(read)) == 100);
+	CHECK(std::equal(read, read + 100, data + 200));
+
+	storage1.reset();
+	CHECK(manager.GetFreeBlockCount() == 2);
+	manager.Close();
+	storage2.reset();
+
+	LibISDB::FileStream file;
+	CHECK_FALSE(file.Open(fileName, LibISDB::FileStream::OpenFlag::Read));
+
+	LibISDB::MMapDataStorageManager *pManager = new LibISDB::MMapDataStorageManager;
+	REQUIRE(pManager->Create(fileName, 64, 2));
+	std::shared_ptr<LibISDB::StreamBuffer> buffer = std::make_shared<LibISDB::StreamBuffer>();
+	REQUIRE(buffer->Create(64, 1, 2, pManager));
+	LibISDB::StreamBuffer::SequentialReader reader;
+	REQUIRE(reader.Open(buffer));
+	CHECK(buffer->PushBack(data, 200) == 128);
+	CHECK(reader.Read(read, std::size(read)) == 128);
+	CHECK(std::equal(read, read + 128, data));
+	reader.Close();
+	buffer.reset();
+	CHECK_FALSE(file.Open(fileName, LibISDB::FileStream::OpenFlag::Read));
+
+	// 既存のファイルは上書きも削除もしない
+	{
+		LibISDB::FileStream existing;
+		REQUIRE(existing.Open(fileName, LibISDB::FileStream::OpenFlag::Write | LibISDB::FileStream::OpenFlag::New));
+		REQUIRE(existing.Write(data, 100) == 100);
+		existing.Close();
+	}
+	LibISDB::MMapDataStorageManager existingManager;
+	CHECK_FALSE(existingManager.Create(fileName, 1000, 1));
+	existingManager.Close();
+	REQUIRE(file.Open(fileName, LibISDB::FileStream::OpenFlag::Read));
+	CHECK(file.GetSize() == 100);
+	file.Close();
+	std::remove(fileName.c_str());
+}
+
+
+#ifndef LIBISDB_WINDOWS
+
+#include "../LibISDB/Base/AsyncFileStreamWriter.hpp"
+#include <unistd.h>
+
+TEST_CASE("AsyncFileStreamWriter", "[base][writer]")
+{
+	const bool useIOURing = GENERATE(false, true);
+	const bool directIO = GENERATE(false, true);
+	const LibISDB::String fileName = LIBISDB_STR("libisdbtest_writer.tmp");
+
+	std::vector<uint8_t> data(100000);
+	FillRandom(data);
+
+	{
+		LibISDB::AsyncFileStreamWriter writer;
+		CHECK_FALSE(writer.SetBufferSize(1000));
+		REQUIRE(writer.SetBufferSize(8192));
+		REQUIRE(writer.SetQueueDepth(3));
+		writer.SetUseIOURing(useIOURing);
+		writer.SetDirectIO(directIO);
+		writer.SetPreallocationUnit(65536);
+		REQUIRE(writer.Open(fileName, LibISDB::StreamWriter::OpenFlag::Overwrite));
+		if (!useIOURing)
+			CHECK_FALSE(writer.IsIOURingActive());
+
+		size_t pos = 0, chunk = 1;
+		while (pos < data.size()) {
+			const size_t size = std::min(chunk, data.size() - pos);
+			CHECK(writer.Write(data.data() + pos, size) == size);
+			pos += size;
+			chunk = chunk * 3 % 9001 + 1;
+		}
+		CHECK(writer.GetWriteSize() == data.size());
+
+		// pwritev を使う場合も、埋まったバッファは Write() から戻る時点で書き出されている
+		if (!writer.IsIOURingActive()) {
+			LibISDB::FileStream written;
+			REQUIRE(written.Open(fileName, LibISDB::FileStream::OpenFlag::Read));
+			CHECK(written.GetSize() >= data.size() / 8192 * 8192);
+		}
+
+		writer.Close();
+	}
+
+	LibISDB::FileStream file;
+	REQUIRE(file.Open(fileName, LibISDB::FileStream::OpenFlag::Read));
+	CHECK(file.GetSize() == data.size());
+	std::vector<uint8_t> read(data.size() + 1);
+	CHECK(file.Read(read.data(), read.size()) == data.size());
+	CHECK(std::equal(data.begin(), data.end(), read.begin()));
+	file.Close();
+	std::remove(fileName.c_str());
+
+	// 書き込みエラーは Write() の戻り値とエラーコードで分かり、書き出せなかった分は書き込みサイズに含まれない
+	if (!directIO && (::access("/dev/full", W_OK) == 0)) {
+		LibISDB::AsyncFileStreamWriter writer;
+		REQUIRE(writer.SetBufferSize(8192));
+		writer.SetUseIOURing(useIOURing);
+		REQUIRE(writer.Open(LIBISDB_STR("/dev/full"), LibISDB::StreamWriter::OpenFlag::Overwrite));
+		const size_t written = writer.Write(data.data(), 20000);
+		if (!writer.IsIOURingActive()) {
+			CHECK(written == 0);
+			CHECK(writer.GetWriteSize() == 0);
+			CHECK(writer.Write(data.data(), 100) == 0);
+		}
+		writer.Close();
+		CHECK(writer.GetLastErrorCode());
+		CHECK(writer.GetWriteSize() == 0);
+	}
+}
+
+#endif
+
+
+#include "../LibISDB/Base/DataStreamer.hpp"
+#include "../LibISDB/Base/StreamingThreadPool.hpp"
+#include <thread>
+
+namespace
+{
+
+class TestDataStreamer
+	: public LibISDB::DataStreamer
+{
+public:
+	std::vector<uint8_t> Output;
+	std::atomic<size_t> OutputSize {0};
+
+private:
+	size_t OutputData(const uint8_t *pData, size_t DataSize) override
+	{
+		Output.insert(Output.end(), pData, pData + DataSize);
+		OutputSize += DataSize;
+		return DataSize;
+	}
+
+	bool IsOutputValid() const override { return true; }
+};
+
+class SelfRemovingTask
+	: public LibISDB::StreamingThreadPool::Task
+{
+public:
+	LibISDB::StreamingThreadPool *pPool = nullptr;
+	std::atomic<int> ProcessCount {0};
+	std::atomic<bool> RemoveResult {false};
+
+private:
+	bool ProcessTask() override
+	{
+		if (++ProcessCount == 3)
+			RemoveResult = pPool->RemoveTask(this);
+		return true;
+	}
+};
+
+class CountingTask
+	: public LibISDB::StreamingThreadPool::Task
+{
+public:
+	std::atomic<int> ProcessCount {0};
+
+private:
+	bool ProcessTask() override
+	{
+		ProcessCount++;
+		return false;
+	}
+};
+
+}
+
+TEST_CASE("StreamingThreadPool", "[base][thread]")
+{
+	std::shared_ptr<LibISDB::StreamingThreadPool> pool = std::make_shared<LibISDB::StreamingThreadPool>();
+	REQUIRE(pool->Start(2));
+	CHECK(pool->GetThreadCount() == 2);
+
+	constexpr size_t streamerCount = 4;
+	TestDataStreamer streamers[streamerCount];
+	for (auto &e : streamers) {
+		REQUIRE(e.CreateInputBuffer(4096, 1, 64));
+		REQUIRE(e.AllocateOutputCacheBuffer(1000));
+		REQUIRE(e.SetThreadPool(pool));
+		REQUIRE(e.Start());
+		CHECK(e.IsStarted());
+		CHECK_FALSE(e.SetThreadPool(nullptr));
+	}
+
+	uint8_t data[188];
+	for (int i = 0; i < 1000; i++) {
+		for (size_t j = 0; j < streamerCount; j++) {
+			std::fill(std::begin(data), std::end(data), static_cast<uint8_t>(i + j));
+			CHECK(streamers[j].InputData(data, sizeof(data)));
+		}
+	}
+
+	for (size_t j = 0; j < streamerCount; j++) {
+		auto &e = streamers[j];
+		e.Stop();
+		CHECK_FALSE(e.IsStarted());
+		CHECK(e.FlushBuffer());
+		CHECK(e.GetPendingBytes() == 0);
+
+		LibISDB::DataStreamer::Statistics stats;
+		REQUIRE(e.GetStatistics(&stats));
+		CHECK(stats.InputBytes == 1000 * sizeof(data));
+		CHECK(stats.OutputBytes == 1000 * sizeof(data));
+		CHECK(stats.InputDroppedBytes == 0);
+		REQUIRE(e.Output.size() == 1000 * sizeof(data));
+		int mismatch = 0;
+		for (int i = 0; i < 1000; i++) {
+			if (e.Output[i * sizeof(data)] != static_cast<uint8_t>(i + j))
+				mismatch++;
+		}
+		CHECK(mismatch == 0);
+	}
+
+	// タスク自身から取り除いてもデッドロックしない
+	SelfRemovingTask task;
+	task.pPool = pool.get();
+	REQUIRE(pool->AddTask(&task));
+	for (int i = 0; (i < 1000) && (task.ProcessCount < 3); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	REQUIRE(task.ProcessCount >= 3);
+	CHECK_FALSE(pool->RemoveTask(&task));
+	bool added = false;
+	for (int i = 0; (i < 1000) && !(added = pool->AddTask(&task)); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK(added);
+	CHECK(task.RemoveResult);
+	CHECK(pool->RemoveTask(&task));
+
+	pool->Stop();
+	CHECK_FALSE(pool->IsStarted());
+}
+
+
+TEST_CASE("StreamingThreadPoolNotify", "[base][thread]")
+{
+	std::shared_ptr<LibISDB::StreamingThreadPool> pool = std::make_shared<LibISDB::StreamingThreadPool>();
+	REQUIRE(pool->Start(2));
+
+	// 通知が無ければ処理されない
+	CountingTask task;
+	REQUIRE(pool->AddTask(&task));
+	for (int i = 0; (i < 1000) && (task.ProcessCount < 1); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK(task.ProcessCount == 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	CHECK(task.ProcessCount == 1);
+
+	pool->NotifyTask(&task);
+	for (int i = 0; (i < 1000) && (task.ProcessCount < 2); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK(task.ProcessCount == 2);
+
+	// 遅延通知は期限が来てから一回だけ処理される
+	const auto start = std::chrono::steady_clock::now();
+	pool->NotifyTaskDelayed(&task, std::chrono::milliseconds(50));
+	pool->NotifyTaskDelayed(&task, std::chrono::milliseconds(50));
+	for (int i = 0; (i < 1000) && (task.ProcessCount < 3); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	CHECK(task.ProcessCount == 3);
+	CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(40));
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	CHECK(task.ProcessCount == 3);
+
+	// 取り除いたタスクの遅延通知は取り消される
+	pool->NotifyTaskDelayed(&task, std::chrono::milliseconds(20));
+	CHECK(pool->RemoveTask(&task));
+	std::this_thread::sleep_for(std::chrono::milliseconds(60));
+	CHECK(task.ProcessCount == 3);
+
+	// watermark に満たないデータも、遅延通知で処理される
+	TestDataStreamer streamer;
+	REQUIRE(streamer.CreateInputBuffer(4096, 1, 64));
+	REQUIRE(streamer.AllocateOutputCacheBuffer(188));
+	REQUIRE(streamer.SetWakeupWatermark(188 * 100));
+	REQUIRE(streamer.SetThreadPool(pool));
+	REQUIRE(streamer.Start());
+
+	uint8_t data[188] = {};
+	for (int i = 0; i < 10; i++) {
+		const size_t expected = (i + 1) * sizeof(data);
+		CHECK(streamer.InputData(data, sizeof(data)));
+		for (int j = 0; (j < 1000) && (streamer.OutputSize < expected); j++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		CHECK(streamer.OutputSize == expected);
+	}
+
+	streamer.Stop();
+	pool->Stop();
+
+	LibISDB::DataStreamer::Statistics stats;
+	REQUIRE(streamer.GetStatistics(&stats));
+	CHECK(stats.OutputBytes == 10 * sizeof(data));
+	CHECK(stats.MaxProcessLatency < 250 * 1000);
+}
+
+
+TEST_CASE("DataStreamerWakeup", "[base][thread]")
+{
+	TestDataStreamer streamer;
+	REQUIRE(streamer.CreateInputBuffer(4096, 1, 4));
+	REQUIRE(streamer.AllocateOutputCacheBuffer(188));
+	REQUIRE(streamer.SetWakeupWatermark(188));
+	CHECK(streamer.GetWakeupWatermark() == 188);
+	REQUIRE(streamer.Start());
+
+	uint8_t data[188] = {};
+	for (int i = 0; i < 20; i++) {
+		const size_t expected = (i + 1) * sizeof(data);
+		CHECK(streamer.InputData(data, sizeof(data)));
+		for (int j = 0; (j < 1000) && (streamer.OutputSize < expected); j++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		CHECK(streamer.OutputSize == expected);
+	}
+
+	streamer.Stop();
+
+	LibISDB::DataStreamer::Statistics stats;
+	REQUIRE(streamer.GetStatistics(&stats));
+	CHECK(stats.OutputBytes == 20 * sizeof(data));
+	CHECK(stats.ProcessLatencyCount == 20);
+	CHECK(stats.MaxProcessLatency < 400 * 1000);
+	CHECK(stats.TotalProcessLatency <= stats.MaxProcessLatency * stats.ProcessLatencyCount);
+}
+
+
+TEST_CASE("DataStreamerFlushDelay", "[base][thread]")
+{
+	// watermark に満たないデータも、長い待機時間を待たずに処理される
+	TestDataStreamer streamer;
+	REQUIRE(streamer.CreateInputBuffer(4096, 1, 64));
+	REQUIRE(streamer.AllocateOutputCacheBuffer(188));
+	REQUIRE(streamer.SetWakeupWatermark(188 * 100));
+	REQUIRE(streamer.Start());
+
+	uint8_t data[188] = {};
+	for (int i = 0; i < 10; i++) {
+		const size_t expected = (i + 1) * 2 * sizeof(data);
+		CHECK(streamer.InputData(data, sizeof(data)));
+		CHECK(streamer.InputData(data, sizeof(data)));
+		for (int j = 0; (j < 1000) && (streamer.OutputSize < expected); j++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		CHECK(streamer.OutputSize == expected);
+	}
+
+	streamer.Stop();
+
+	LibISDB::DataStreamer::Statistics stats;
+	REQUIRE(streamer.GetStatistics(&stats));
+	CHECK(stats.OutputBytes == 20 * sizeof(data));
+	CHECK(stats.MaxProcessLatency < 250 * 1000);
+}
+
+
 #include "../LibISDB/Base/ARIBString.hpp"
+#include "../LibISDB/Base/ARIBStringCache.hpp"
 
 TEST_CASE("ARIBString", "[base][string]")
 {
@@ -267,6 +1892,169 @@ TEST_CASE("ARIBString", "[base][string]")
 	// "番組内容②"
 	decoder.Decode("\x48\x56\x41\x48\x46\x62\x4d\x46\x1b\x24\x2a\x3b\x1b\x7d\xfe\xe2"_b8, 16, &str);
 	CHECK(str.compare(LIBISDB_STR("\u756a\u7d44\u5185\u5bb9\u2461")) == 0);
+
+	// 連続する文字の処理と、繰り返し・文字サイズの指定
+	// "番組　あいうあああABＡ"
+	decoder.Decode("\x48\x56\x41\x48\x20\xa2\xa4\xa6\x98\x43\xa2\x89\x23\x41\x23\x42\x8a\x23\x41"_b8, 19, &str);
+	CHECK(str.compare(LIBISDB_STR("\u756a\u7d44\u3000\u3042\u3044\u3046\u3042\u3042\u3042AB\uff21")) == 0);
+
+	// 途中で途切れた2バイト文字
+	CHECK_FALSE(decoder.Decode("\x48\x56\x41"_b8, 3, &str));
+	CHECK(str.compare(LIBISDB_STR("\u756a")) == 0);
+
+	// 内部のバッファへのデコード
+	LibISDB::CStringView view;
+	REQUIRE(decoder.Decode("\x48\x56\x41\x48\x46\x62\x4d\x46"_b8, 8, &view));
+	CHECK(view == LIBISDB_STR("\u756a\u7d44\u5185\u5bb9"));
+	CHECK(view.c_str()[view.length()] == LIBISDB_CHAR('\0'));
+	const LibISDB::CharType *pBuffer = view.data();
+	REQUIRE(decoder.Decode("\x48\x56"_b8, 2, &view));
+	CHECK(view == LIBISDB_STR("\u756a"));
+	CHECK(view.data() == pBuffer);
+	decoder.FreeBuffer();
+}
+
+TEST_CASE("ARIBStringBenchmark", "[.benchmark][base][string]")
+{
+	// 番組情報によくある漢字・ひらがな・カタカナ・英数字の混じった文字列
+	LibISDB::ARIBString text;
+	for (int i = 0; i < 8; i++) {
+		text += "\x48\x56\x41\x48\x46\x62\x4d\x46\xa4\xcf\x20"_b8;
+		text += "\x1b\x7c\xc6\xec\xd3\xb7\xe7\xc3\xd4\xf3\xb0\x1b\x7d"_b8;
+		text += "\x23\x34\x23\x4b\xa4\xc7\xca\xfc\xc1\xf7\xa1\xa3"_b8;
+	}
+
+	constexpr int repeat = 100000;
+	LibISDB::ARIBStringDecoder decoder;
+	LibISDB::String str;
+	size_t length = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		decoder.Decode(text, &str);
+		length += str.length();
+	}
+	ReportThroughput("ARIBStringDecoder", double(text.length()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+	CHECK(length > 0);
+
+	// 毎回新しい文字列に出力する場合と、内部のバッファを参照する場合
+	length = 0;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		LibISDB::String newStr;
+		decoder.Decode(text, &newStr);
+		length += newStr.length();
+	}
+	ReportThroughput("ARIBStringDecoder (new string)", double(text.length()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+
+	LibISDB::CStringView view;
+	size_t viewLength = 0;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		decoder.Decode(text, &view);
+		viewLength += view.length();
+	}
+	ReportThroughput("ARIBStringDecoder (view)", double(text.length()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+	CHECK(viewLength == length);
+
+	// 同じ文字列を繰り返しデコードする場合のキャッシュの効果
+	LibISDB::ConcurrentARIBStringCache cache;
+	decoder.SetCache(&cache);
+	viewLength = 0;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) {
+		decoder.Decode(text, &view);
+		viewLength += view.length();
+	}
+	ReportThroughput("ARIBStringDecoder (cached view)", double(text.length()) * repeat / (1024.0 * 1024.0), "MiB", std::chrono::steady_clock::now() - start);
+	CHECK(viewLength == length);
+	CHECK(cache.GetStatistics().HitCount == repeat - 1);
+}
+
+TEST_CASE("ARIBStringCache", "[base][string]")
+{
+	using LibISDB::ARIBStringDecoder;
+
+	LibISDB::ARIBStringCache cache(2);
+	ARIBStringDecoder decoder;
+	decoder.SetCache(&cache);
+	LibISDB::String str;
+
+	// "番組内容"
+	const LibISDB::ARIBString text1 = "\x48\x56\x41\x48\x46\x62\x4d\x46"_b8;
+	// "テレビ"
+	const LibISDB::ARIBString text2 = "\x1b\x7c\xc6\xec\xd3"_b8;
+	// "ＡＢ" / 中型で "AB"
+	const LibISDB::ARIBString text3 = "\x23\x41\x89\x23\x42"_b8;
+
+	REQUIRE(decoder.Decode(text1, &str));
+	CHECK(str == LIBISDB_STR("\u756a\u7d44\u5185\u5bb9"));
+	REQUIRE(decoder.Decode(text1, &str));
+	CHECK(str == LIBISDB_STR("\u756a\u7d44\u5185\u5bb9"));
+	auto stats = cache.GetStatistics();
+	CHECK(stats.HitCount == 1);
+	CHECK(stats.MissCount == 1);
+	CHECK(stats.EntryCount == 1);
+
+	// デコードフラグが異なるものは別のエントリになる
+	REQUIRE(decoder.Decode(text3, &str, ARIBStringDecoder::DecodeFlag::UseCharSize));
+	CHECK(str == LIBISDB_STR("\uff21B"));
+	REQUIRE(decoder.Decode(text3, &str, ARIBStringDecoder::DecodeFlag::None));
+	CHECK(str == LIBISDB_STR("\uff21\uff22"));
+	stats = cache.GetStatistics();
+	CHECK(stats.MissCount == 3);
+	CHECK(stats.EntryCount == 2);
+
+	// 最も長い間参照されていない text1 が破棄される
+	LibISDB::CStringView view;
+	REQUIRE(decoder.Decode(text3, &view, ARIBStringDecoder::DecodeFlag::UseCharSize));
+	CHECK(view == LIBISDB_STR("\uff21B"));
+	REQUIRE(decoder.Decode(text2, &str));
+	CHECK(str == LIBISDB_STR("\u30c6\u30ec\u30d3"));
+	cache.ResetStatistics();
+	REQUIRE(decoder.Decode(text3, &str, ARIBStringDecoder::DecodeFlag::UseCharSize));
+	REQUIRE(decoder.Decode(text1, &str));
+	CHECK(str == LIBISDB_STR("\u756a\u7d44\u5185\u5bb9"));
+	stats = cache.GetStatistics();
+	CHECK(stats.HitCount == 1);
+	CHECK(stats.MissCount == 1);
+	CHECK(stats.EntryCount == 2);
+
+	// デコードに失敗したものはキャッシュされない
+	CHECK_FALSE(decoder.Decode("\x48\x56\x41"_b8, 3, &str));
+	CHECK_FALSE(decoder.Decode("\x48\x56\x41"_b8, 3, &str));
+	CHECK(str == LIBISDB_STR("\u756a"));
+	CHECK(cache.GetStatistics().MissCount == 3);
+
+	cache.SetMaxEntries(1);
+	CHECK(cache.GetStatistics().EntryCount == 1);
+	cache.Clear();
+	CHECK(cache.GetStatistics().EntryCount == 0);
+
+	// 複数のスレッドのデコーダで共有する
+	LibISDB::ConcurrentARIBStringCache sharedCache(16);
+	std::vector<std::thread> threads;
+	std::atomic<int> errorCount(0);
+	for (int i = 0; i < 4; i++) {
+		threads.emplace_back(
+			[&]() {
+				ARIBStringDecoder threadDecoder;
+				LibISDB::String threadStr;
+				threadDecoder.SetCache(&sharedCache);
+				for (int j = 0; j < 1000; j++) {
+					if (!threadDecoder.Decode((j & 1) ? text1 : text2, &threadStr)
+							|| (threadStr != ((j & 1) ? LIBISDB_STR("\u756a\u7d44\u5185\u5bb9") : LIBISDB_STR("\u30c6\u30ec\u30d3"))))
+						errorCount++;
+				}
+			});
+	}
+	for (auto &e : threads)
+		e.join();
+	CHECK(errorCount == 0);
+	stats = sharedCache.GetStatistics();
+	CHECK(stats.HitCount + stats.MissCount == 4000);
+	CHECK(stats.MissCount >= 2);
+	CHECK(stats.EntryCount == 2);
 }
 
 
@@ -352,6 +2140,885 @@ TEST_CASE("DateTime", "[base][time]")
 }
 
 
+#include "../LibISDB/EPG/EPGDatabase.hpp"
+#include "../LibISDB/Base/ARIBTime.hpp"
+
+namespace
+{
+
+	// 30 分毎の番組のリストを生成する
+	LibISDB::EPGDatabase::EventList MakeEPGEventList(uint16_t serviceID, int eventCount, const LibISDB::DateTime &startTime)
+	{
+		LibISDB::EPGDatabase::EventList list(eventCount);
+		LibISDB::DateTime time = startTime;
+
+		for (int i = 0; i < eventCount; i++) {
+			LibISDB::EventInfo &event = list[i];
+			event.NetworkID = 0x0004;
+			event.TransportStreamID = 0x0001;
+			event.ServiceID = serviceID;
+			event.EventID = static_cast<uint16_t>(i + 1);
+			event.StartTime = time;
+			event.Duration = 30 * 60;
+			event.EventName = LIBISDB_STR("Event");
+			time.OffsetMinutes(30);
+		}
+
+		return list;
+	}
+
+	uint8_t ToBCD(int value)
+	{
+		return static_cast<uint8_t>(((value / 10) << 4) | (value % 10));
+	}
+
+	void StoreMJDBCDTime(uint8_t *p, const LibISDB::DateTime &time)
+	{
+		const uint16_t mjd = LibISDB::DateTimeToMJDTime(time);
+		p[0] = static_cast<uint8_t>(mjd >> 8);
+		p[1] = static_cast<uint8_t>(mjd & 0xFF);
+		p[2] = ToBCD(time.Hour);
+		p[3] = ToBCD(time.Minute);
+		p[4] = ToBCD(time.Second);
+	}
+
+	// セクションを 1 パケットに格納する
+	std::vector<uint8_t> MakeSectionPacket(const std::vector<uint8_t> &section)
+	{
+		std::vector<uint8_t> packet(LibISDB::TS_PACKET_SIZE, 0xFF_u8);
+		const uint16_t pid = (section[0] == LibISDB::TOTTable::TABLE_ID) ? 0x0014 : 0x0012;
+		packet[0] = 0x47;
+		packet[1] = static_cast<uint8_t>(0x40 | (pid >> 8));
+		packet[2] = static_cast<uint8_t>(pid & 0xFF);
+		packet[3] = 0x10;
+		packet[4] = 0x00;
+		std::copy(section.begin(), section.end(), packet.begin() + 5);
+		return packet;
+	}
+
+	void AppendSectionCRC(std::vector<uint8_t> &section)
+	{
+		const size_t length = section.size() + 4 - 3;
+		section[1] = static_cast<uint8_t>((section[1] & 0xF0) | (length >> 8));
+		section[2] = static_cast<uint8_t>(length & 0xFF);
+		const uint32_t crc = LibISDB::CRC32MPEG2::Calc(section.data(), section.size());
+		section.push_back(static_cast<uint8_t>(crc >> 24));
+		section.push_back(static_cast<uint8_t>(crc >> 16));
+		section.push_back(static_cast<uint8_t>(crc >> 8));
+		section.push_back(static_cast<uint8_t>(crc));
+	}
+
+	std::vector<uint8_t> MakeTOTPacket(const LibISDB::DateTime &time)
+	{
+		std::vector<uint8_t> section = {LibISDB::TOTTable::TABLE_ID, 0x70, 0x00, 0, 0, 0, 0, 0, 0xF0, 0x00};
+		StoreMJDBCDTime(&section[3], time);
+		AppendSectionCRC(section);
+		return MakeSectionPacket(section);
+	}
+
+	// 記述子の無い番組を含む EIT[schedule basic] のパケットを生成する
+	std::vector<uint8_t> MakeEITSchedulePacket(
+		uint16_t serviceID, uint8_t sectionNumber, uint8_t version,
+		const LibISDB::EPGDatabase::EventList &events)
+	{
+		std::vector<uint8_t> section = {
+			0x50, 0xF0, 0x00,
+			static_cast<uint8_t>(serviceID >> 8), static_cast<uint8_t>(serviceID & 0xFF),
+			static_cast<uint8_t>(0xC1 | (version << 1)), sectionNumber, 0xF8,
+			0x00, 0x01, 0x00, 0x04, 0xF8, 0x50,
+		};
+		for (const LibISDB::EventInfo &event : events) {
+			// 番組名があれば短形式イベント記述子を付加する(LS1 で英数集合を呼び出す)
+			std::vector<uint8_t> descriptors;
+			if (!event.EventName.empty()) {
+				descriptors = {0x4D, 0x00, 'j', 'p', 'n', static_cast<uint8_t>(event.EventName.length() + 1), 0x0E};
+				for (LibISDB::CharType c : event.EventName)
+					descriptors.push_back(static_cast<uint8_t>(c));
+				descriptors.push_back(0x00);
+				descriptors[1] = static_cast<uint8_t>(descriptors.size() - 2);
+			}
+
+			uint8_t item[12];
+			item[0] = static_cast<uint8_t>(event.EventID >> 8);
+			item[1] = static_cast<uint8_t>(event.EventID & 0xFF);
+			StoreMJDBCDTime(&item[2], event.StartTime);
+			item[7] = ToBCD(event.Duration / 3600);
+			item[8] = ToBCD(event.Duration / 60 % 60);
+			item[9] = ToBCD(event.Duration % 60);
+			item[10] = static_cast<uint8_t>(0x80 | (descriptors.size() >> 8));
+			item[11] = static_cast<uint8_t>(descriptors.size() & 0xFF);
+			section.insert(section.end(), std::begin(item), std::end(item));
+			section.insert(section.end(), descriptors.begin(), descriptors.end());
+		}
+		AppendSectionCRC(section);
+		return MakeSectionPacket(section);
+	}
+
+	std::vector<uint16_t> GetSortedEventIDs(const LibISDB::EPGDatabase &database, uint16_t serviceID)
+	{
+		std::vector<uint16_t> ids;
+		database.EnumEventsSortedByTime(
+			0x0004, 0x0001, serviceID,
+			[&](const LibISDB::EventInfo &event) -> bool { ids.push_back(event.EventID); return true; });
+		return ids;
+	}
+
+}
+
+TEST_CASE("EPGDatabaseLock", "[epg][thread]")
+{
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	LibISDB::EPGDatabase database;
+	REQUIRE(database.SetServiceEventList(LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 1), MakeEPGEventList(1, 48, startTime)));
+	REQUIRE(database.SetServiceEventList(LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 2), MakeEPGEventList(2, 48, startTime)));
+	CHECK(database.GetServiceCount() == 2);
+
+	LibISDB::EPGDatabase::EventList list;
+	CHECK(database.GetEventListSortedByTime(0x0004, 0x0001, 1, &list));
+	REQUIRE(list.size() == 48);
+	CHECK(list.front().EventID == 1);
+	LibISDB::EventInfo event;
+	LibISDB::DateTime time = startTime;
+	time.OffsetMinutes(45);
+	CHECK(database.GetEventInfo(0x0004, 0x0001, 2, time, &event));
+	CHECK(event.EventID == 2);
+	CHECK(database.GetNextEventInfo(0x0004, 0x0001, 2, time, &event));
+	CHECK(event.EventID == 3);
+	CHECK_FALSE(database.GetEventInfo(0x0004, 0x0001, 3, 1, &event));
+
+	// 互換用のロックは再帰的に取得でき、保持しているスレッドからは参照と更新ができる
+	{
+		LibISDB::MutexLock &compatLock = database.GetLock();
+		LibISDB::LockGuard lock(compatLock);
+		{
+			LibISDB::BlockLock lock2(database.GetLock());
+			CHECK(database.GetServiceCount() == 2);
+			CHECK(database.SetServiceEventList(LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 3), MakeEPGEventList(3, 10, startTime)));
+			CHECK(database.GetEventInfo(0x0004, 0x0001, 3, 1, &event));
+		}
+
+		// 他のスレッドはブロックされる
+		std::atomic<bool> done(false);
+		std::thread thread([&]() {
+			database.GetServiceCount();
+			done = true;
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		CHECK_FALSE(done);
+		lock.Unlock();
+		thread.join();
+		CHECK(done);
+	}
+
+	// あるサービスを列挙している間も、同じサービスの参照と他のサービスの更新ができる
+	{
+		std::atomic<bool> entered(false), release(false), timedOut(false);
+		std::thread reader([&]() {
+			database.EnumEventsSortedByTime(
+				0x0004, 0x0001, 1,
+				[&](const LibISDB::EventInfo &) -> bool {
+					entered = true;
+					const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+					while (!release) {
+						if (std::chrono::steady_clock::now() >= deadline) {
+							timedOut = true;
+							break;
+						}
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+					return false;
+				});
+		});
+		while (!entered)
+			std::this_thread::yield();
+
+		CHECK(database.GetEventInfo(0x0004, 0x0001, 1, 1, &event));
+		CHECK(database.SetServiceEventList(LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 2), MakeEPGEventList(2, 24, startTime)));
+		CHECK(database.GetEventListSortedByTime(0x0004, 0x0001, 2, &list));
+		CHECK(list.size() == 24);
+		CHECK(database.ResetServiceUpdated(0x0004, 0x0001, 2));
+		release = true;
+		reader.join();
+		CHECK_FALSE(timedOut);
+	}
+
+	// マージ
+	LibISDB::EPGDatabase database2;
+	REQUIRE(database2.SetServiceEventList(LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 1), MakeEPGEventList(1, 4, startTime)));
+	CHECK(database2.Merge(&database));
+	CHECK(database2.GetServiceCount() == 3);
+	CHECK(database2.GetEventListSortedByTime(0x0004, 0x0001, 1, &list));
+	CHECK(list.size() == 48);
+	CHECK(database2.GetEventListSortedByTime(0x0004, 0x0001, 3, &list));
+	CHECK(list.size() == 10);
+}
+
+TEST_CASE("EPGDatabaseSnapshot", "[epg]")
+{
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	LibISDB::EPGDatabase database;
+	const LibISDB::EPGDatabase::ServiceInfo service(0x0004, 0x0001, 1);
+	REQUIRE(database.SetServiceEventList(service, MakeEPGEventList(1, 48, startTime)));
+
+	CHECK_FALSE(database.GetEventListSnapshot(0x0004, 0x0001, 2));
+
+	LibISDB::EPGDatabase::EventListSnapshotPtr snapshot = database.GetEventListSnapshot(0x0004, 0x0001, 1);
+	REQUIRE(snapshot);
+	CHECK(snapshot->GetServiceInfo() == service);
+	REQUIRE(snapshot->GetEventCount() == 48);
+
+	LibISDB::EPGDatabase::EventList list;
+	REQUIRE(database.GetEventListSortedByTime(0x0004, 0x0001, 1, &list));
+	bool match = true;
+	size_t i = 0;
+	for (const LibISDB::EventInfo &event : *snapshot) {
+		if ((event.EventID != list[i].EventID) || (event.StartTime != list[i].StartTime))
+			match = false;
+		i++;
+	}
+	CHECK(match);
+
+	const LibISDB::EventInfo *pEvent = snapshot->GetEventByID(10);
+	REQUIRE(pEvent != nullptr);
+	CHECK(pEvent->EventID == 10);
+	CHECK(snapshot->GetEventByID(100) == nullptr);
+	LibISDB::DateTime time = startTime;
+	time.OffsetMinutes(75);
+	pEvent = snapshot->GetEventByTime(time);
+	REQUIRE(pEvent != nullptr);
+	CHECK(pEvent->EventID == 3);
+	time = startTime;
+	time.OffsetSeconds(-1);
+	CHECK(snapshot->GetEventByTime(time) == nullptr);
+	time.OffsetDays(2);
+	CHECK(snapshot->GetEventByTime(time) == nullptr);
+
+	// 更新されるまでは同じスナップショットが返される
+	CHECK(database.GetEventListSnapshot(0x0004, 0x0001, 1) == snapshot);
+	CHECK(database.ResetServiceUpdated(0x0004, 0x0001, 1));
+	CHECK(database.GetEventListSnapshot(0x0004, 0x0001, 1) == snapshot);
+
+	// 更新後も取得済みのスナップショットは変わらない
+	REQUIRE(database.SetServiceEventList(service, MakeEPGEventList(1, 12, startTime)));
+	LibISDB::EPGDatabase::EventListSnapshotPtr snapshot2 = database.GetEventListSnapshot(0x0004, 0x0001, 1);
+	REQUIRE(snapshot2);
+	CHECK(snapshot2 != snapshot);
+	CHECK(snapshot2->GetEventCount() == 12);
+	CHECK(snapshot->GetEventCount() == 48);
+	CHECK(snapshot->GetEventByID(48) != nullptr);
+
+	database.Clear();
+	CHECK_FALSE(database.GetEventListSnapshot(0x0004, 0x0001, 1));
+	CHECK(snapshot2->GetEventCount() == 12);
+}
+
+TEST_CASE("EPGDatabaseTimeIndex", "[epg]")
+{
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	const LibISDB::EPGDatabase::ServiceInfo service(0x0004, 0x0001, 1);
+	LibISDB::EPGDatabase::EventList list, sorted;
+
+	// 順不同のリストも開始時刻順に並べられる
+	list = MakeEPGEventList(1, 48, startTime);
+	std::reverse(list.begin(), list.end());
+	LibISDB::EPGDatabase database;
+	REQUIRE(database.SetServiceEventList(service, std::move(list)));
+	REQUIRE(database.GetEventListSortedByTime(0x0004, 0x0001, 1, &sorted));
+	REQUIRE(sorted.size() == 48);
+	bool ordered = true;
+	for (size_t i = 0; i < sorted.size(); i++) {
+		if (sorted[i].EventID != i + 1)
+			ordered = false;
+	}
+	CHECK(ordered);
+
+	// 時間が被っている番組は削除される
+	list = MakeEPGEventList(1, 1, startTime);
+	list[0].EventID = 100;
+	list[0].StartTime.OffsetMinutes(45);
+	list[0].Duration = 90 * 60;
+	LibISDB::EPGDatabase source;
+	REQUIRE(source.SetServiceEventList(service, std::move(list)));
+	REQUIRE(database.Merge(&source));
+
+	REQUIRE(database.GetEventListSortedByTime(0x0004, 0x0001, 1, &sorted));
+	REQUIRE(sorted.size() == 45);
+	CHECK(sorted[0].EventID == 1);
+	CHECK(sorted[1].EventID == 100);
+	CHECK(sorted[2].EventID == 6);
+	CHECK(sorted[44].EventID == 48);
+
+	LibISDB::EventInfo event;
+	CHECK_FALSE(database.GetEventInfo(0x0004, 0x0001, 1, 3, &event));
+	LibISDB::DateTime time = startTime;
+	time.OffsetMinutes(130);
+	REQUIRE(database.GetEventInfo(0x0004, 0x0001, 1, time, &event));
+	CHECK(event.EventID == 100);
+	REQUIRE(database.GetNextEventInfo(0x0004, 0x0001, 1, time, &event));
+	CHECK(event.EventID == 6);
+
+	int count = 0;
+	LibISDB::DateTime latest = startTime;
+	latest.OffsetHours(3);
+	CHECK(database.EnumEventsSortedByTime(
+		0x0004, 0x0001, 1, &time, &latest,
+		[&](const LibISDB::EventInfo &) -> bool { count++; return true; }));
+	CHECK(count == 2);
+}
+
+TEST_CASE("EPGDatabaseReentrantCallback", "[epg]")
+{
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	LibISDB::EPGDatabase database;
+	const LibISDB::EPGDatabase::ServiceInfo service(0x0004, 0x0001, 1);
+	REQUIRE(database.SetServiceEventList(service, MakeEPGEventList(1, 48, startTime)));
+
+	// コールバックの中から読み込みと書き込みを行ってもデッドロックしない
+	int count = 0;
+	CHECK(database.EnumEventsSortedByTime(
+		0x0004, 0x0001, 1,
+		[&](const LibISDB::EventInfo &event) -> bool {
+			LibISDB::EventInfo info;
+			CHECK(database.GetEventInfo(0x0004, 0x0001, 1, event.EventID, &info) == ((count == 0) || (event.EventID <= 24)));
+			int nestedCount = 0;
+			CHECK(database.EnumEventsUnsorted(
+				0x0004, 0x0001, 1,
+				[&](const LibISDB::EventInfo &) -> bool { nestedCount++; return false; }));
+			CHECK(nestedCount == 1);
+			if (count == 0)
+				CHECK(database.SetServiceEventList(service, MakeEPGEventList(1, 24, startTime)));
+			count++;
+			return true;
+		}));
+	// 列挙されるのは呼び出し時点の番組
+	CHECK(count == 48);
+
+	count = 0;
+	LibISDB::DateTime latest = startTime;
+	latest.OffsetHours(2);
+	CHECK(database.EnumEventsSortedByTime(
+		0x0004, 0x0001, 1, &startTime, &latest,
+		[&](const LibISDB::EventInfo &) -> bool {
+			LibISDB::EPGDatabase::EventList list;
+			CHECK(database.GetEventList(0x0004, 0x0001, 1, &list));
+			CHECK(list.size() == 24);
+			CHECK(database.SetServiceEventList(
+				LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 2), MakeEPGEventList(2, 4, startTime)));
+			count++;
+			return true;
+		}));
+	CHECK(count == 4);
+	CHECK(database.GetServiceCount() == 2);
+}
+
+TEST_CASE("EPGDatabaseUpdateSection", "[epg]")
+{
+	LibISDB::DateTime totTime;
+	totTime.Year = 2026;
+	totTime.Month = 10;
+	totTime.Day = 16;
+	totTime.Hour = 12;
+	totTime.Minute = 0;
+	totTime.Second = 0;
+	totTime.Millisecond = 0;
+	totTime.SetDayOfWeek();
+
+	LibISDB::EPGDatabase database;
+	database.SetNoPastEvents(false);
+
+	LibISDB::TOTTable totTable;
+	std::vector<uint8_t> data = MakeTOTPacket(totTime);
+	StorePackets(totTable, data);
+	REQUIRE(database.UpdateTOT(&totTable));
+
+	LibISDB::EITPfScheduleTable scheduleTable;
+	auto updateSection = [&](uint8_t sectionNumber, uint8_t version, const LibISDB::EPGDatabase::EventList &events) {
+		std::vector<uint8_t> packet = MakeEITSchedulePacket(1, sectionNumber, version, events);
+		StorePackets(scheduleTable, packet);
+		const LibISDB::EITTable *pEITTable = scheduleTable.GetLastUpdatedEITTable();
+		REQUIRE(pEITTable != nullptr);
+		REQUIRE(pEITTable->GetEventCount() == static_cast<int>(events.size()));
+		return database.UpdateSection(&scheduleTable, pEITTable);
+	};
+
+	// 開始時刻順でない番組が含まれていても索引は開始時刻順になる
+	LibISDB::DateTime startTime = totTime;
+	startTime.OffsetHours(1);
+	LibISDB::EPGDatabase::EventList events = MakeEPGEventList(1, 5, startTime);
+	LibISDB::EventInfo &early = *events.emplace(events.begin() + 3);
+	early.EventID = 10;
+	early.StartTime = totTime;
+	early.Duration = 30 * 60;
+	REQUIRE(updateSection(0, 0, events));
+	CHECK(GetSortedEventIDs(database, 1) == std::vector<uint16_t>({10, 1, 2, 3, 4, 5}));
+
+	// 同じ番組名は文字列プールで共有される
+	{
+		LibISDB::EPGDatabase::EventList list;
+		REQUIRE(database.GetEventList(0x0004, 0x0001, 1, &list));
+		std::vector<const LibISDB::PooledString *> names;
+		for (const LibISDB::EventInfo &e : list) {
+			if (!e.EventName.empty())
+				names.push_back(&e.EventName);
+		}
+		REQUIRE(names.size() == 5);
+		bool shared = true;
+		for (const LibISDB::PooledString *pName : names) {
+			if (!pName->IsShared(*names[0]))
+				shared = false;
+		}
+		CHECK(shared);
+	}
+
+	// 時間が被っている番組は削除される
+	events = MakeEPGEventList(1, 2, startTime);
+	events[0].EventID = 20;
+	events[0].StartTime.OffsetMinutes(15);
+	events[0].Duration = 60 * 60;
+	events[1].EventID = 21;
+	events[1].StartTime.OffsetHours(3);
+	REQUIRE(updateSection(8, 0, events));
+	CHECK(GetSortedEventIDs(database, 1) == std::vector<uint16_t>({10, 20, 4, 5, 21}));
+}
+
+
+TEST_CASE("EPGDatabaseMemoryUsage", "[epg]")
+{
+	const LibISDB::String text(40, LIBISDB_CHAR('a'));
+	const size_t textSize = LibISDB::PooledString(text).GetAllocatedSize();
+	const size_t nameSize = LibISDB::PooledString(LIBISDB_STR("Event")).GetAllocatedSize();
+	CHECK(textSize > sizeof(LibISDB::String));
+	CHECK(nameSize == sizeof(LibISDB::String));
+
+	// 文字列は共有されるため EventInfo::GetAllocatedSize() には含まない
+	LibISDB::EventInfo event;
+	event.ExtendedText.reserve(4);
+	event.EventText = text;
+	CHECK(event.GetAllocatedSize() == 4 * sizeof(LibISDB::EventInfo::ExtendedTextInfo));
+
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	LibISDB::EPGDatabase database;
+	for (uint16_t serviceID = 1; serviceID <= 2; serviceID++) {
+		LibISDB::EPGDatabase::EventList list = MakeEPGEventList(serviceID, 48, startTime);
+		for (LibISDB::EventInfo &e : list) {
+			LibISDB::String reserved = text;
+			reserved.reserve(200);
+			e.EventText = std::move(reserved);
+		}
+		REQUIRE(database.SetServiceEventList(LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, serviceID), std::move(list)));
+	}
+
+	// 番組毎に設定した同じ内容の文字列は、データベースに追加された時点で共有される
+	LibISDB::EPGDatabase::MemoryUsage usage;
+	CHECK_FALSE(database.GetServiceMemoryUsage(0x0004, 0x0001, 3, &usage));
+	REQUIRE(database.GetServiceMemoryUsage(0x0004, 0x0001, 1, &usage));
+	CHECK(usage.ServiceCount == 1);
+	CHECK(usage.EventCount == 48);
+	CHECK(usage.StringCount == 2);
+	CHECK(usage.StringBytes == textSize + nameSize);
+	CHECK(usage.SharedStringBytes == 47 * (textSize + nameSize));
+	CHECK(usage.EventBytes >= 48 * sizeof(LibISDB::EventInfo));
+	CHECK(usage.IndexBytes >= 48 * sizeof(LibISDB::EPGDatabase::TimeEventInfo));
+	CHECK(usage.SnapshotBytes == 0);
+
+	// スナップショットの文字列も共有される
+	const LibISDB::EPGDatabase::EventListSnapshotPtr snapshot = database.GetEventListSnapshot(0x0004, 0x0001, 1);
+	REQUIRE(snapshot);
+	REQUIRE(database.GetServiceMemoryUsage(0x0004, 0x0001, 1, &usage));
+	CHECK(usage.SnapshotBytes >= 48 * sizeof(LibISDB::EventInfo));
+	CHECK(usage.SnapshotBytes < 48 * (sizeof(LibISDB::EventInfo) + textSize));
+	CHECK(usage.StringBytes == textSize + nameSize);
+
+	REQUIRE(database.GetMemoryUsage(&usage));
+	CHECK(usage.ServiceCount == 2);
+	CHECK(usage.EventCount == 96);
+	CHECK(usage.StringCount == 2);
+	CHECK(usage.StringBytes == textSize + nameSize);
+	CHECK(usage.SharedStringBytes == 95 * (textSize + nameSize));
+	CHECK(usage.GetTotalBytes() > usage.StringBytes);
+
+	LibISDB::EPGDatabase::EventList list;
+	REQUIRE(database.GetEventList(0x0004, 0x0001, 2, &list));
+	REQUIRE(!list.empty());
+	CHECK(list[0].EventText == text);
+	CHECK(list[0].EventText.IsShared(snapshot->GetEventList()[0].EventText));
+
+	// 参照されなくなった文字列は数えない
+	{
+		LibISDB::EPGDatabase::EventList newList = MakeEPGEventList(1, 48, startTime);
+		REQUIRE(database.SetServiceEventList(LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 1), std::move(newList)));
+	}
+	REQUIRE(database.GetServiceMemoryUsage(0x0004, 0x0001, 1, &usage));
+	CHECK(usage.StringCount == 1);
+	CHECK(usage.StringBytes == nameSize);
+	CHECK(usage.SharedStringBytes == 47 * nameSize);
+	CHECK(usage.SnapshotBytes == 0);
+}
+
+TEST_CASE("StringPool", "[base][string]")
+{
+	const LibISDB::String text(40, LIBISDB_CHAR('a'));
+	LibISDB::StringPool pool;
+
+	LibISDB::PooledString str1 = pool.Intern(text);
+	const LibISDB::PooledString str2 = pool.Intern(LibISDB::StringView(text));
+	CHECK(str1 == text);
+	CHECK(text == str1);
+	CHECK(str1.length() == text.length());
+	CHECK(str1.IsShared(str2));
+	CHECK(pool.GetStringCount() == 1);
+
+	// プール外で作成された文字列はオブジェクトがそのまま登録される
+	LibISDB::PooledString other(LibISDB::String(10, LIBISDB_CHAR('b')));
+	LibISDB::PooledString copy = other;
+	CHECK(copy.IsShared(other));
+	CHECK(other != str1);
+	CHECK(pool.Intern(other).IsShared(other));
+	CHECK(pool.Intern(LibISDB::String(10, LIBISDB_CHAR('b'))).IsShared(other));
+	CHECK(pool.GetStringCount() == 2);
+
+	// 内容が同じであれば共有していなくても等しい
+	const LibISDB::PooledString unpooled(text);
+	CHECK_FALSE(unpooled.IsShared(str1));
+	CHECK(unpooled == str1);
+
+	// 空文字列はプールされない
+	CHECK(pool.Intern(LibISDB::String()).empty());
+	CHECK(LibISDB::PooledString(LIBISDB_STR("")).empty());
+	CHECK(LibISDB::PooledString().Get().empty());
+	CHECK(LibISDB::PooledString() == LIBISDB_STR(""));
+	CHECK(LibISDB::PooledString().GetAllocatedSize() == 0);
+	CHECK(pool.GetStringCount() == 2);
+
+	// どこからも参照されていない文字列が破棄される
+	other.clear();
+	copy.clear();
+	pool.Purge();
+	CHECK(pool.GetStringCount() == 1);
+
+	// Clear() しても取得済みの文字列はそのまま利用できる
+	pool.Clear();
+	CHECK(pool.GetStringCount() == 0);
+	CHECK(str1 == text);
+	CHECK_FALSE(pool.Intern(text).IsShared(str1));
+
+	// 登録数が増えると参照されていない文字列はまとめて破棄される
+	LibISDB::StringPool autoPool;
+	const LibISDB::PooledString kept = autoPool.Intern(text);
+	for (size_t i = 1; i <= 3000; i++)
+		autoPool.Intern(LibISDB::String(i, LIBISDB_CHAR('x')));
+	CHECK(autoPool.GetStringCount() <= 1024);
+	CHECK(autoPool.Intern(text).IsShared(kept));
+}
+
+TEST_CASE("EPGDatabaseTimeRangeBenchmark", "[.benchmark][epg]")
+{
+	constexpr int serviceCount = 300;
+	constexpr int eventCount = 8 * 48;
+	constexpr int repeat = 20;
+
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	LibISDB::EPGDatabase database;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < serviceCount; i++) {
+		database.SetServiceEventList(
+			LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, static_cast<uint16_t>(i + 1)),
+			MakeEPGEventList(static_cast<uint16_t>(i + 1), eventCount, startTime));
+	}
+	ReportThroughput("EPGDatabase set list", double(serviceCount) * eventCount, "events", std::chrono::steady_clock::now() - start);
+
+	// 既存のサービスへのマージでは1番組ずつ挿入される
+	LibISDB::EPGDatabase merged;
+	for (int i = 0; i < serviceCount; i++) {
+		merged.SetServiceEventList(
+			LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, static_cast<uint16_t>(i + 1)),
+			LibISDB::EPGDatabase::EventList());
+	}
+	start = std::chrono::steady_clock::now();
+	REQUIRE(merged.Merge(&database));
+	ReportThroughput("EPGDatabase merge", double(serviceCount) * eventCount, "events", std::chrono::steady_clock::now() - start);
+
+	// 3時間の範囲を全サービスについて列挙する
+	unsigned long long found = 0;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < repeat; r++) {
+		for (int hour = 0; hour < 8 * 24; hour += 3) {
+			LibISDB::DateTime earliest = startTime, latest = startTime;
+			earliest.OffsetHours(hour);
+			latest.OffsetHours(hour + 3);
+			for (int i = 0; i < serviceCount; i++) {
+				merged.EnumEventsSortedByTime(
+					0x0004, 0x0001, static_cast<uint16_t>(i + 1), &earliest, &latest,
+					[&](const LibISDB::EventInfo &) -> bool { found++; return true; });
+			}
+		}
+	}
+	const auto time = std::chrono::steady_clock::now() - start;
+	ReportThroughput("EPGDatabase time range", double(repeat) * (8 * 24 / 3) * serviceCount, "queries", time);
+	CHECK(found == static_cast<unsigned long long>(repeat) * serviceCount * eventCount);
+}
+
+
+#ifndef LIBISDB_WINDOWS
+
+#include "../LibISDB/EPG/EPGDataFile.hpp"
+
+namespace
+{
+
+	unsigned long long GetTestFileSize(const LibISDB::String &fileName)
+	{
+		LibISDB::FileStream file;
+		if (!file.Open(fileName, LibISDB::FileStream::OpenFlag::Read))
+			return 0;
+		return file.GetSize();
+	}
+
+	size_t CountEPGEvents(const LibISDB::EPGDatabase &database, uint16_t serviceID)
+	{
+		size_t count = 0;
+		database.EnumEventsUnsorted(
+			0x0004, 0x0001, serviceID,
+			[&](const LibISDB::EventInfo &Event) -> bool {
+				if (Event.EventName == LIBISDB_STR("Event"))
+					count++;
+				return true;
+			});
+		return count;
+	}
+
+}
+
+TEST_CASE("EPGDataFile", "[epg][file]")
+{
+	const LibISDB::String fileName = LIBISDB_STR("libisdbtest_epg.tmp");
+	constexpr LibISDB::EPGDataFile::OpenFlag incrementalFlags =
+		LibISDB::EPGDataFile::OpenFlag::Read |
+		LibISDB::EPGDataFile::OpenFlag::Write |
+		LibISDB::EPGDataFile::OpenFlag::Incremental;
+
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	LibISDB::EPGDatabase database;
+	for (uint16_t serviceID = 1; serviceID <= 3; serviceID++) {
+		REQUIRE(database.SetServiceEventList(
+			LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, serviceID),
+			MakeEPGEventList(serviceID, 48, startTime)));
+	}
+
+	// 従来の形式
+	{
+		LibISDB::EPGDataFile file;
+		REQUIRE(file.Open(&database, fileName, LibISDB::EPGDataFile::OpenFlag::Write));
+		REQUIRE(file.Save());
+		CHECK(file.GetFileVersion() == 0);
+
+		LibISDB::EPGDatabase loaded;
+		REQUIRE(file.Open(&loaded, fileName, LibISDB::EPGDataFile::OpenFlag::Read));
+		REQUIRE(file.Load());
+		CHECK(file.GetUpdateCount() == 1);
+		for (uint16_t serviceID = 1; serviceID <= 3; serviceID++)
+			CHECK(CountEPGEvents(loaded, serviceID) == 48);
+	}
+
+	// 索引付きの形式に変換される
+	{
+		LibISDB::EPGDataFile file;
+		REQUIRE(file.Open(&database, fileName, incrementalFlags));
+		REQUIRE(file.Save());
+		CHECK(file.GetFileVersion() == 1);
+	}
+	const unsigned long long size1 = GetTestFileSize(fileName);
+	REQUIRE(size1 > 0);
+
+	LibISDB::EPGDatabase loaded;
+	LibISDB::EPGDataFile file;
+	REQUIRE(file.Open(&loaded, fileName, incrementalFlags));
+	REQUIRE(file.LoadIndex());
+	CHECK(file.GetFileVersion() == 1);
+
+	LibISDB::EPGDatabase::ServiceList serviceList;
+	REQUIRE(file.GetServiceList(&serviceList));
+	CHECK(serviceList.size() == 3);
+	CHECK(CountEPGEvents(loaded, 2) == 0);
+	REQUIRE(file.LoadService(0x0004, 0x0001, 2));
+	CHECK(CountEPGEvents(loaded, 2) == 48);
+	CHECK_FALSE(file.LoadService(0x0004, 0x0001, 9));
+
+	// 変更が無ければ何も書き出さない
+	REQUIRE(file.Save());
+	CHECK(GetTestFileSize(fileName) == size1);
+
+	// 変更されたサービスのみ追記される
+	REQUIRE(loaded.SetServiceEventList(
+		LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, 2), MakeEPGEventList(2, 24, startTime)));
+	REQUIRE(file.Save());
+	const unsigned long long size2 = GetTestFileSize(fileName);
+	CHECK(size2 > size1);
+	CHECK(size2 - size1 < size1 / 2);
+	file.Close();
+
+	// 読み込まれていなかったサービスも保持される
+	{
+		LibISDB::EPGDatabase reloaded;
+		REQUIRE(file.Open(&reloaded, fileName, incrementalFlags));
+		REQUIRE(file.Load());
+		CHECK(file.GetUpdateCount() == 3);
+		CHECK(CountEPGEvents(reloaded, 1) == 48);
+		CHECK(CountEPGEvents(reloaded, 2) == 24);
+		CHECK(CountEPGEvents(reloaded, 3) == 48);
+		file.Close();
+	}
+
+	// 索引が壊れている場合はファイル全体を走査する
+	{
+		LibISDB::FileStream stream;
+		REQUIRE(stream.Open(fileName, LibISDB::FileStream::OpenFlag::Write));
+		REQUIRE(stream.SetPos(size2 - 8, LibISDB::Stream::SetPosType::Begin));
+		REQUIRE(stream.Write("XXXXXXXX", 8) == 8);
+		stream.Close();
+
+		LibISDB::EPGDatabase reloaded;
+		REQUIRE(file.Open(&reloaded, fileName, incrementalFlags));
+		REQUIRE(file.Load());
+		CHECK(CountEPGEvents(reloaded, 1) == 48);
+		CHECK(CountEPGEvents(reloaded, 2) == 24);
+		CHECK(CountEPGEvents(reloaded, 3) == 48);
+
+		// 書き直して無効なセグメントを取り除く
+		REQUIRE(file.Compact());
+		CHECK(GetTestFileSize(fileName) < size2);
+		file.Close();
+
+		LibISDB::EPGDatabase compacted;
+		REQUIRE(file.Open(&compacted, fileName, LibISDB::EPGDataFile::OpenFlag::Read));
+		REQUIRE(file.Load());
+		CHECK(file.GetFileVersion() == 1);
+		CHECK(CountEPGEvents(compacted, 1) == 48);
+		CHECK(CountEPGEvents(compacted, 2) == 24);
+		CHECK(CountEPGEvents(compacted, 3) == 48);
+		file.Close();
+	}
+
+	// ファイルにのみあるサービスのセグメントが壊れている場合は、そのサービスを破棄する
+	{
+		LibISDB::FileStream stream;
+		REQUIRE(stream.Open(fileName, LibISDB::FileStream::OpenFlag::Write));
+		REQUIRE(stream.SetPos(100, LibISDB::Stream::SetPosType::Begin));
+		REQUIRE(stream.Write("XXXXXXXX", 8) == 8);
+		stream.Close();
+
+		LibISDB::EPGDatabase empty;
+		REQUIRE(file.Open(&empty, fileName, incrementalFlags));
+		REQUIRE(file.LoadIndex());
+		REQUIRE(file.Compact());
+		CHECK(GetTestFileSize(fileName + LIBISDB_STR(".tmp")) == 0);
+		file.Close();
+
+		LibISDB::EPGDatabase compacted;
+		REQUIRE(file.Open(&compacted, fileName, LibISDB::EPGDataFile::OpenFlag::Read));
+		REQUIRE(file.Load());
+		CHECK(CountEPGEvents(compacted, 1) == 0);
+		CHECK(CountEPGEvents(compacted, 2) == 24);
+		CHECK(CountEPGEvents(compacted, 3) == 48);
+		file.Close();
+	}
+
+	std::remove(fileName.c_str());
+}
+
+TEST_CASE("EPGDataFileBenchmark", "[.benchmark][epg][file]")
+{
+	const LibISDB::String fileName = LIBISDB_STR("libisdbtest_epg_bench.tmp");
+	constexpr int serviceCount = 300;
+	constexpr int eventCount = 8 * 48;
+	constexpr int updateCount = 10;
+	constexpr LibISDB::EPGDataFile::OpenFlag incrementalFlags =
+		LibISDB::EPGDataFile::OpenFlag::Read |
+		LibISDB::EPGDataFile::OpenFlag::Write |
+		LibISDB::EPGDataFile::OpenFlag::Incremental;
+
+	LibISDB::DateTime startTime;
+	startTime.NowLocal();
+	startTime.TruncateToHours();
+
+	LibISDB::EPGDatabase database;
+	for (int i = 0; i < serviceCount; i++) {
+		database.SetServiceEventList(
+			LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, static_cast<uint16_t>(i + 1)),
+			MakeEPGEventList(static_cast<uint16_t>(i + 1), eventCount, startTime));
+	}
+
+	const double totalEvents = double(serviceCount) * eventCount;
+	LibISDB::EPGDataFile file;
+
+	REQUIRE(file.Open(&database, fileName, LibISDB::EPGDataFile::OpenFlag::Read | LibISDB::EPGDataFile::OpenFlag::Write));
+	auto start = std::chrono::steady_clock::now();
+	REQUIRE(file.Save());
+	ReportThroughput("EPGDataFile save (full)", totalEvents, "events", std::chrono::steady_clock::now() - start);
+	{
+		LibISDB::EPGDatabase loaded;
+		REQUIRE(file.Open(&loaded, fileName, LibISDB::EPGDataFile::OpenFlag::Read));
+		start = std::chrono::steady_clock::now();
+		REQUIRE(file.Load());
+		ReportThroughput("EPGDataFile load (version 0)", totalEvents, "events", std::chrono::steady_clock::now() - start);
+	}
+
+	REQUIRE(file.Open(&database, fileName, incrementalFlags));
+	start = std::chrono::steady_clock::now();
+	REQUIRE(file.Save());
+	ReportThroughput("EPGDataFile save (compact)", totalEvents, "events", std::chrono::steady_clock::now() - start);
+
+	// 一部のサービスのみを更新して保存する
+	for (int i = 0; i < updateCount; i++) {
+		database.SetServiceEventList(
+			LibISDB::EPGDatabase::ServiceInfo(0x0004, 0x0001, static_cast<uint16_t>(i + 1)),
+			MakeEPGEventList(static_cast<uint16_t>(i + 1), eventCount, startTime));
+	}
+	start = std::chrono::steady_clock::now();
+	REQUIRE(file.Save());
+	ReportThroughput("EPGDataFile save (incremental)", double(updateCount) * eventCount, "events", std::chrono::steady_clock::now() - start);
+
+	{
+		LibISDB::EPGDatabase loaded;
+		REQUIRE(file.Open(&loaded, fileName, incrementalFlags));
+		start = std::chrono::steady_clock::now();
+		REQUIRE(file.Load());
+		ReportThroughput("EPGDataFile load (version 1)", totalEvents, "events", std::chrono::steady_clock::now() - start);
+
+		start = std::chrono::steady_clock::now();
+		REQUIRE(file.LoadIndex());
+		REQUIRE(file.LoadService(0x0004, 0x0001, serviceCount / 2));
+		ReportThroughput("EPGDataFile load one service", double(eventCount), "events", std::chrono::steady_clock::now() - start);
+	}
+
+	file.Close();
+	std::remove(fileName.c_str());
+}
+
+#endif
+
+
 
 
 #ifdef LIBISDB_TEST_WMAIN